@@ -0,0 +1,180 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/bandwidth_manager.hpp"
+#include "libtorrent/aux_/bandwidth_limit.hpp"
+#include "libtorrent/aux_/bandwidth_socket.hpp"
+#include "libtorrent/time.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+// runs the scenarios of test_bandwidth_limiter.cpp with a lot more peers, and
+// measures the cost of bandwidth_manager::update_quotas() per tick, along with
+// how close the peers got to their expected rates. Each result is printed as
+// one JSON object per line.
+
+using namespace lt;
+
+namespace {
+
+using std::chrono::steady_clock;
+
+int const tick_interval = 500; // milliseconds, the default tick_interval
+
+struct peer : aux::bandwidth_socket, std::enable_shared_from_this<peer>
+{
+	peer(aux::bandwidth_manager& bwm, aux::bandwidth_channel& torrent
+		, aux::bandwidth_channel& global, int const request_size)
+		: m_bwm(bwm), m_torrent(torrent), m_global(global)
+		, m_request_size(request_size)
+	{}
+
+	bool is_disconnecting() const override { return false; }
+
+	void assign_bandwidth(int, int const amount) override
+	{
+		received += amount;
+		request();
+	}
+
+	void request()
+	{
+		aux::bandwidth_channel* channels[] = { &channel, &m_torrent, &m_global };
+		int const ret = m_bwm.request_bandwidth(shared_from_this()
+			, m_request_size, 1, channels, 3);
+		received += ret;
+	}
+
+	aux::bandwidth_channel channel;
+	std::int64_t received = 0;
+
+private:
+	aux::bandwidth_manager& m_bwm;
+	aux::bandwidth_channel& m_torrent;
+	aux::bandwidth_channel& m_global;
+	int m_request_size;
+};
+
+struct scenario
+{
+	char const* name;
+	int num_peers;
+	int num_torrents;
+	// the limits, in bytes per second. 0 means unlimited
+	int global_limit;
+	int torrent_limit;
+	int peer_limit;
+};
+
+void run(scenario const& s, int const seconds)
+{
+	aux::bandwidth_manager manager(0);
+	aux::bandwidth_channel global;
+	global.throttle(s.global_limit);
+	std::vector<aux::bandwidth_channel> torrents(std::size_t(s.num_torrents));
+	for (auto& t : torrents) t.throttle(s.torrent_limit);
+
+	std::vector<std::shared_ptr<peer>> peers;
+	for (int i = 0; i < s.num_peers; ++i)
+	{
+		peers.push_back(std::make_shared<peer>(manager
+			, torrents[std::size_t(i % s.num_torrents)], global, 16 * 1024));
+		peers.back()->channel.throttle(s.peer_limit);
+	}
+	for (auto& p : peers) p->request();
+
+	int const num_ticks = seconds * 1000 / tick_interval;
+	auto const start = steady_clock::now();
+	for (int i = 0; i < num_ticks; ++i)
+		manager.update_quotas(milliseconds(tick_interval));
+	std::int64_t const ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		steady_clock::now() - start).count();
+
+	// hand out the bandwidth assigned to requests that haven't completed yet
+	manager.close();
+
+	// the rate every peer is expected to get
+	double expected = s.peer_limit > 0 ? s.peer_limit : 1e18;
+	if (s.torrent_limit > 0)
+		expected = std::min(expected, double(s.torrent_limit) * s.num_torrents / s.num_peers);
+	if (s.global_limit > 0)
+		expected = std::min(expected, double(s.global_limit) / s.num_peers);
+
+	std::int64_t total = 0;
+	double min_rate = 1e18;
+	double max_rate = 0;
+	for (auto const& p : peers)
+	{
+		total += p->received;
+		double const rate = double(p->received) / seconds;
+		min_rate = std::min(min_rate, rate);
+		max_rate = std::max(max_rate, rate);
+	}
+
+	std::printf("{\"benchmark\": \"%s\", \"peers\": %d, \"ticks\": %d"
+		", \"total_ns\": %lld, \"ns_per_tick\": %.1f, \"rate\": %.1f"
+		", \"expected_rate\": %.1f, \"min_peer_rate\": %.1f, \"max_peer_rate\": %.1f"
+		", \"expected_peer_rate\": %.1f}\n"
+		, s.name, s.num_peers, num_ticks, static_cast<long long>(ns)
+		, double(ns) / num_ticks, double(total) / seconds
+		, expected * s.num_peers, min_rate, max_rate, expected);
+	std::fflush(stdout);
+}
+
+}
+
+int main(int argc, char const* argv[])
+{
+	int const seconds = argc > 1 ? std::atoi(argv[1]) : 60;
+	if (seconds <= 0)
+	{
+		std::fprintf(stderr, "usage: bandwidth_bench [seconds]\n");
+		return 1;
+	}
+
+	for (int const num_peers : {1000, 10000, 100000})
+	{
+		// like test_equal_connections(), every peer is limited by the global
+		// rate limit
+		run({"equal_connections", num_peers, 1, 10000000, 0, 0}, seconds);
+		// like test_torrents(), two torrents with their own limit
+		run({"torrents", num_peers, 2, 0, 2000000, 0}, seconds);
+		// like test_connections_variable_rate(), every peer has its own limit
+		run({"peer_limits", num_peers, 1, 0, 0, 1000}, seconds);
+	}
+}
@@ -0,0 +1,128 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/performance_counters.hpp"
+
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+// measures the cost of incrementing stats counters from many threads at
+// once, the way disk and hasher threads do. The sharded lt::counters is
+// compared against a single array of atomics shared by all threads, which is
+// how counters used to be laid out.
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+// the counters each simulated disk job increments
+int const job_counters[] = {
+	lt::counters::num_blocks_written,
+	lt::counters::num_write_ops,
+	lt::counters::disk_write_time,
+	lt::counters::disk_job_time,
+};
+
+struct shared_counters
+{
+	std::array<std::atomic<std::int64_t>, lt::counters::num_counters> values{};
+
+	void inc_stats_counter(int const c, std::int64_t const v)
+	{ values[std::size_t(c)].fetch_add(v, std::memory_order_relaxed); }
+};
+
+template <typename Counters>
+double run(Counters& c, int const num_threads, int const iterations)
+{
+	std::atomic<bool> start{false};
+	std::vector<std::thread> threads;
+	for (int t = 0; t < num_threads; ++t)
+	{
+		threads.emplace_back([&] {
+			while (!start.load()) std::this_thread::yield();
+			for (int i = 0; i < iterations; ++i)
+				for (int const idx : job_counters)
+					c.inc_stats_counter(idx, 1);
+		});
+	}
+
+	auto const begin = clock_type::now();
+	start = true;
+	for (auto& t : threads) t.join();
+	auto const end = clock_type::now();
+
+	auto const total_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+	std::int64_t const num_increments = std::int64_t(iterations) * num_threads
+		* std::int64_t(sizeof(job_counters) / sizeof(job_counters[0]));
+	// wall-clock time per increment, times the number of threads, is the
+	// cost of a single increment as seen by each thread
+	return double(total_ns) * num_threads / double(num_increments);
+}
+
+}
+
+int main(int argc, char const* argv[])
+{
+	int const num_threads = argc > 1 ? std::atoi(argv[1]) : 8;
+	int const iterations = argc > 2 ? std::atoi(argv[2]) : 1000000;
+	if (num_threads <= 0 || iterations <= 0)
+	{
+		std::fprintf(stderr, "usage: counters_bench [threads [iterations]]\n");
+		return 1;
+	}
+
+	lt::counters sharded;
+	double const sharded_ns = run(sharded, num_threads, iterations);
+
+	shared_counters shared;
+	double const shared_ns = run(shared, num_threads, iterations);
+
+	std::printf("threads: %d iterations: %d\n", num_threads, iterations);
+	std::printf("sharded counters: %.2f ns/increment\n", sharded_ns);
+	std::printf("shared atomics:   %.2f ns/increment\n", shared_ns);
+
+	// sanity check, no increments may be lost
+	std::int64_t const expected = std::int64_t(num_threads) * iterations;
+	if (sharded[lt::counters::num_blocks_written] != expected)
+	{
+		std::fprintf(stderr, "counter mismatch: %lld (expected %lld)\n"
+			, static_cast<long long>(sharded[lt::counters::num_blocks_written])
+			, static_cast<long long>(expected));
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,220 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/bencode.hpp"
+#include "libtorrent/bdecode.hpp"
+#include "libtorrent/entry.hpp"
+#include "libtorrent/performance_counters.hpp"
+#include "libtorrent/aux_/session_impl.hpp" // for listen_socket_t
+#include "libtorrent/aux_/session_settings.hpp"
+#include "libtorrent/aux_/listen_socket_handle.hpp"
+#include "libtorrent/kademlia/node.hpp"
+#include "libtorrent/kademlia/msg.hpp"
+#include "libtorrent/kademlia/rpc_manager.hpp"
+#include "libtorrent/kademlia/routing_table.hpp"
+#include "libtorrent/kademlia/traversal_algorithm.hpp"
+#include "libtorrent/kademlia/dht_observer.hpp"
+#include "libtorrent/kademlia/dht_storage.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifndef TORRENT_DISABLE_DHT
+
+// measures the cost of sending DHT requests through the rpc_manager and
+// matching the responses to them, with a number of requests outstanding
+// that never get a response, the way a node under load has. Each result is
+// printed as one JSON object per line.
+
+using namespace lt;
+using namespace lt::dht;
+
+namespace {
+
+using std::chrono::steady_clock;
+
+struct null_socket final : socket_manager
+{
+	bool has_quota() override { return true; }
+	bool send_packet(aux::listen_socket_handle const&, entry& msg
+		, udp::endpoint const&) override
+	{
+		last_tid = msg["t"].string();
+		return true;
+	}
+	std::string last_tid;
+};
+
+struct null_dht_observer final : dht_observer
+{
+	void set_external_address(aux::listen_socket_handle const&, address const&
+		, address const&) override {}
+	int get_listen_port(aux::transport, aux::listen_socket_handle const&) override
+	{ return 6881; }
+	void get_peers(sha1_hash const&) override {}
+	void outgoing_get_peers(sha1_hash const&, sha1_hash const&
+		, udp::endpoint const&) override {}
+	void announce(sha1_hash const&, address const&, int) override {}
+#ifndef TORRENT_DISABLE_LOGGING
+	bool should_log(module_t) const override { return false; }
+	void log(dht_logger::module_t, char const*, ...) override {}
+	void log_packet(message_direction_t, span<char const>
+		, udp::endpoint const&) override {}
+#endif
+	bool on_dht_request(string_view, msg const&, entry&) override { return false; }
+};
+
+node* no_foreign_node(node_id const&, std::string const&) { return nullptr; }
+
+struct result
+{
+	std::int64_t requests;
+	std::int64_t ticks;
+	std::int64_t ns;
+};
+
+result run(int const outstanding, int const num_requests)
+{
+	aux::session_settings sett;
+	null_socket sock;
+	null_dht_observer observer;
+	counters cnt;
+	auto ls = std::make_shared<aux::listen_socket_t>();
+	ls->local_endpoint = tcp::endpoint(make_address_v4("192.168.4.1"), 6881);
+
+	std::unique_ptr<dht_storage_interface> storage(dht_default_storage_constructor(sett));
+	storage->update_node_ids({node_id(nullptr)});
+	routing_table table(node_id(), udp::v4(), 8, sett, &observer);
+	rpc_manager rpc(node_id(), sett, table, ls, &sock, &observer);
+	node dht_node(ls, &sock, sett, node_id(nullptr), &observer, cnt
+		, no_foreign_node, *storage);
+	auto algo = std::make_shared<traversal_algorithm>(dht_node, node_id());
+
+	std::mt19937 rng(0x1337);
+	auto rand_ep = [&rng]
+	{
+		return udp::endpoint(address_v4((rng() & 0x00ffffff) | 0x0a000000)
+			, std::uint16_t(rng() | 1));
+	};
+
+	entry req;
+	req["q"] = "ping";
+
+	// these requests never get a response
+	for (int i = 0; i < outstanding; ++i)
+	{
+		auto o = rpc.allocate_observer<null_observer>(algo, rand_ep(), node_id());
+#if TORRENT_USE_ASSERTS
+		o->m_in_constructor = false;
+#endif
+		entry e = req;
+		rpc.invoke(e, o->target_ep(), o);
+	}
+
+	// the response is the same for all requests, except for the
+	// transaction ID
+	entry resp;
+	resp["y"] = "r";
+	resp["t"] = "..";
+	resp["r"]["id"] = std::string(20, 'a');
+	std::vector<char> buf;
+	bencode(std::back_inserter(buf), resp);
+	std::string const tid_key = "1:t2:";
+	auto const tid_pos = std::search(buf.begin(), buf.end()
+		, tid_key.begin(), tid_key.end()) - buf.begin() + int(tid_key.size());
+
+	result ret{0, 0, 0};
+	auto const start = steady_clock::now();
+	for (int i = 0; i < num_requests; ++i)
+	{
+		udp::endpoint const ep = rand_ep();
+		auto o = rpc.allocate_observer<null_observer>(algo, ep, node_id());
+#if TORRENT_USE_ASSERTS
+		o->m_in_constructor = false;
+#endif
+		entry e = req;
+		rpc.invoke(e, ep, o);
+		o.reset();
+
+		buf[std::size_t(tid_pos)] = sock.last_tid[0];
+		buf[std::size_t(tid_pos) + 1] = sock.last_tid[1];
+		error_code ec;
+		bdecode_node const decoded = bdecode(buf, ec);
+		node_id nid;
+		rpc.incoming(msg(decoded, ep), &nid);
+		++ret.requests;
+
+		// the DHT ticks the rpc_manager at least every 200 ms
+		if ((i % 100) == 0)
+		{
+			rpc.tick();
+			++ret.ticks;
+		}
+	}
+	ret.ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		steady_clock::now() - start).count();
+	return ret;
+}
+
+}
+
+int main(int argc, char const* argv[])
+{
+	int const num_requests = argc > 1 ? std::atoi(argv[1]) : 200000;
+	if (num_requests <= 0)
+	{
+		std::fprintf(stderr, "usage: dht_bench [requests]\n");
+		return 1;
+	}
+
+	for (int const outstanding : {0, 1000, 10000})
+	{
+		result const r = run(outstanding, num_requests);
+		std::printf("{\"benchmark\": \"rpc_round_trip\", \"outstanding\": %d"
+			", \"requests\": %lld, \"ticks\": %lld, \"total_ns\": %lld"
+			", \"ns_per_request\": %.1f}\n"
+			, outstanding, static_cast<long long>(r.requests)
+			, static_cast<long long>(r.ticks), static_cast<long long>(r.ns)
+			, double(r.ns) / double(r.requests));
+		std::fflush(stdout);
+	}
+}
+#else
+int main() {}
+#endif
@@ -0,0 +1,241 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/ip_filter.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <random>
+#include <set>
+#include <vector>
+
+// compares loading a large IPv4 blocklist into, and looking up addresses in,
+// the ip_filter against the std::set based filter it replaced. Each result is
+// printed as one JSON object per line.
+
+using namespace lt;
+
+namespace {
+
+using std::chrono::steady_clock;
+
+// the previous implementation of filter_impl, with the addresses as
+// integers, which only makes it faster than it was
+struct set_filter
+{
+	struct range
+	{
+		range(std::uint32_t s, std::uint32_t a = 0) : start(s), access(a) {} // NOLINT
+		bool operator<(range const& r) const { return start < r.start; }
+		std::uint32_t start;
+		std::uint32_t access;
+	};
+
+	set_filter() { m_access_list.insert(range(0, 0)); }
+
+	void add_rule(std::uint32_t const first, std::uint32_t const last
+		, std::uint32_t const flags)
+	{
+		auto i = m_access_list.upper_bound(first);
+		auto j = m_access_list.upper_bound(last);
+
+		if (i != m_access_list.begin()) --i;
+
+		std::uint32_t first_access = i->access;
+		std::uint32_t const last_access = std::prev(j)->access;
+
+		if (i->start != first && first_access != flags)
+		{
+			i = m_access_list.insert(i, range(first, flags));
+		}
+		else if (i != m_access_list.begin() && std::prev(i)->access == flags)
+		{
+			--i;
+			first_access = i->access;
+		}
+
+		if (i != j) m_access_list.erase(std::next(i), j);
+		if (i->start == first)
+		{
+			const_cast<std::uint32_t&>(i->access) = flags;
+		}
+		else if (first_access != flags)
+		{
+			m_access_list.insert(i, range(first, flags));
+		}
+
+		if ((j != m_access_list.end() && j->start - 1 != last)
+			|| (j == m_access_list.end() && last != 0xffffffff))
+		{
+			if (last_access != flags)
+				j = m_access_list.insert(j, range(last + 1, last_access));
+		}
+
+		if (j != m_access_list.end() && j->access == flags) m_access_list.erase(j);
+	}
+
+	std::uint32_t access(std::uint32_t const addr) const
+	{
+		auto i = m_access_list.upper_bound(addr);
+		if (i != m_access_list.begin()) --i;
+		return i->access;
+	}
+
+	std::size_t size() const { return m_access_list.size(); }
+
+	std::set<range> m_access_list;
+};
+
+address_v4 to_addr(std::uint32_t const a) { return address_v4(a); }
+
+struct result
+{
+	char const* name;
+	std::int64_t ranges;
+	std::int64_t load_ns;
+	std::int64_t lookup_ns;
+	std::int64_t bytes;
+	std::uint32_t blocked;
+};
+
+void print(result const& r, int const num_rules, int const num_lookups)
+{
+	std::printf("{\"benchmark\": \"%s\", \"rules\": %d, \"ranges\": %lld"
+		", \"load_ms\": %.1f, \"lookups\": %d, \"ns_per_lookup\": %.1f"
+		", \"approx_bytes\": %lld, \"blocked\": %u}\n"
+		, r.name, num_rules, static_cast<long long>(r.ranges)
+		, double(r.load_ns) / 1000000., num_lookups
+		, double(r.lookup_ns) / num_lookups
+		, static_cast<long long>(r.bytes), r.blocked);
+	std::fflush(stdout);
+}
+
+std::int64_t since(steady_clock::time_point const start)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		steady_clock::now() - start).count();
+}
+
+// a blocklist is mostly non-overlapping ranges of a few hundred addresses,
+// sorted by address
+std::vector<ip_range<address_v4>> make_blocklist(int const num_rules)
+{
+	std::mt19937 rng(0x1337);
+	std::vector<std::uint32_t> starts(std::size_t(num_rules) * 2);
+	for (auto& s : starts) s = std::uint32_t(rng());
+	std::sort(starts.begin(), starts.end());
+	starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+
+	std::vector<ip_range<address_v4>> ret;
+	ret.reserve(std::size_t(num_rules));
+	std::uniform_int_distribution<std::uint32_t> len(0, 1024);
+	for (std::size_t i = 0; i + 1 < starts.size() && int(ret.size()) < num_rules; i += 2)
+	{
+		std::uint32_t const last = std::min(starts[i] + len(rng), starts[i + 1] - 1);
+		ret.push_back({to_addr(starts[i]), to_addr(last), ip_filter::blocked});
+	}
+	return ret;
+}
+
+std::vector<std::uint32_t> make_lookups(int const num_lookups)
+{
+	std::mt19937 rng(0xc0ffee);
+	std::vector<std::uint32_t> ret(static_cast<std::size_t>(num_lookups));
+	for (auto& a : ret) a = std::uint32_t(rng());
+	return ret;
+}
+
+result run_set(std::vector<ip_range<address_v4>> const& rules
+	, std::vector<std::uint32_t> const& lookups)
+{
+	result ret{"set", 0, 0, 0, 0, 0};
+	auto start = steady_clock::now();
+	set_filter f;
+	for (auto const& r : rules)
+		f.add_rule(r.first.to_uint(), r.last.to_uint(), r.flags);
+	ret.load_ns = since(start);
+
+	start = steady_clock::now();
+	for (auto const a : lookups) ret.blocked += f.access(a);
+	ret.lookup_ns = since(start);
+
+	ret.ranges = std::int64_t(f.size());
+	// a red-black tree node is three pointers and a color, plus the range,
+	// plus the allocator's overhead
+	ret.bytes = ret.ranges * std::int64_t(4 * sizeof(void*) + sizeof(set_filter::range) + 8);
+	return ret;
+}
+
+result run_ip_filter(std::vector<ip_range<address_v4>> const& rules
+	, std::vector<std::uint32_t> const& lookups)
+{
+	result ret{"ip_filter", 0, 0, 0, 0, 0};
+	auto start = steady_clock::now();
+	ip_filter f;
+	f.add_rules(rules);
+	// the rules are applied on the first lookup, count it as part of loading
+	ret.blocked += f.access(to_addr(0));
+	ret.load_ns = since(start);
+
+	start = steady_clock::now();
+	for (auto const a : lookups) ret.blocked += f.access(to_addr(a));
+	ret.lookup_ns = since(start);
+
+	ret.ranges = std::int64_t(std::get<0>(f.export_filter()).size());
+	// the start address and the flags for each range
+	ret.bytes = ret.ranges * std::int64_t(sizeof(std::uint32_t) * 2);
+	return ret;
+}
+
+}
+
+int main(int argc, char const* argv[])
+{
+	int const num_lookups = argc > 1 ? std::atoi(argv[1]) : 1000000;
+	if (num_lookups <= 0)
+	{
+		std::fprintf(stderr, "usage: ip_filter_bench [lookups]\n");
+		return 1;
+	}
+
+	auto const lookups = make_lookups(num_lookups);
+	for (int const num_rules : {10000, 100000, 1000000})
+	{
+		auto const rules = make_blocklist(num_rules);
+		print(run_set(rules, lookups), num_rules, num_lookups);
+		print(run_ip_filter(rules, lookups), num_rules, num_lookups);
+	}
+}
@@ -0,0 +1,296 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/piece_picker.hpp"
+#include "libtorrent/torrent_peer.hpp"
+#include "libtorrent/bitfield.hpp"
+#include "libtorrent/performance_counters.hpp"
+#include "libtorrent/units.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <random>
+#include <vector>
+
+// microbenchmarks of the hot paths in the piece picker, on a large torrent
+// with a large swarm. Each result is printed as one JSON object per line, to
+// make it simple to collect and compare results over time.
+
+using namespace lt;
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+int const blocks_per_piece = 16;
+
+// the number of blocks each peer asks for in a single call to
+// pick_pieces(), this is roughly the size of a request queue
+int const blocks_per_pick = 16;
+
+struct swarm
+{
+	swarm(int const num_pieces, int const num_peers)
+		: picker(blocks_per_piece, blocks_per_piece, num_pieces)
+	{
+		std::mt19937 rng(0x1337);
+		std::uniform_int_distribution<int> density(5, 95);
+		for (int i = 0; i < num_peers; ++i)
+		{
+			tcp::endpoint const ep(make_address_v4(address_v4::uint_type(0x0a000000 + i)), 6881);
+			peers.emplace_back(ep, true, peer_source_flags_t{});
+
+			// every peer has a different fraction of the pieces
+			typed_bitfield<piece_index_t> have(num_pieces, false);
+			std::bernoulli_distribution has_piece(density(rng) / 100.0);
+			for (auto const p : have.range())
+				if (has_piece(rng)) have.set_bit(p);
+			bitfields.push_back(std::move(have));
+		}
+	}
+
+	piece_picker picker;
+	std::deque<ipv4_peer> peers;
+	std::vector<typed_bitfield<piece_index_t>> bitfields;
+};
+
+struct result
+{
+	char const* name;
+	std::int64_t ops;
+	std::int64_t ns;
+};
+
+void print(result const& r, int const num_pieces, int const num_peers)
+{
+	std::printf("{\"benchmark\": \"%s\", \"pieces\": %d, \"peers\": %d"
+		", \"operations\": %lld, \"total_ns\": %lld, \"ns_per_op\": %.1f}\n"
+		, r.name, num_pieces, num_peers
+		, static_cast<long long>(r.ops), static_cast<long long>(r.ns)
+		, r.ops > 0 ? double(r.ns) / double(r.ops) : 0.0);
+	std::fflush(stdout);
+}
+
+template <typename Fun>
+std::int64_t time_ns(Fun&& f)
+{
+	auto const start = clock_type::now();
+	f();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		clock_type::now() - start).count();
+}
+
+// peers joining and leaving the swarm, announcing their bitfields
+void bench_refcount(swarm& s, int const iterations, std::vector<result>& ret)
+{
+	int const num_peers = int(s.peers.size());
+	result inc{"inc_refcount_bitfield", 0, 0};
+	result dec{"dec_refcount_bitfield", 0, 0};
+	for (int i = 0; i < iterations; ++i)
+	{
+		inc.ns += time_ns([&] {
+			for (int p = 0; p < num_peers; ++p)
+				s.picker.inc_refcount(s.bitfields[std::size_t(p)], &s.peers[std::size_t(p)]);
+		});
+		inc.ops += num_peers;
+
+		dec.ns += time_ns([&] {
+			for (int p = 0; p < num_peers; ++p)
+				s.picker.dec_refcount(s.bitfields[std::size_t(p)], &s.peers[std::size_t(p)]);
+		});
+		dec.ops += num_peers;
+	}
+	ret.push_back(inc);
+	ret.push_back(dec);
+}
+
+// every peer picking a request queue worth of blocks
+void bench_pick_pieces(swarm& s, int const iterations, std::vector<result>& ret)
+{
+	int const num_peers = int(s.peers.size());
+	std::vector<piece_block> picked;
+	counters pc;
+	result r{"pick_pieces", 0, 0};
+	for (int i = 0; i < iterations; ++i)
+	{
+		r.ns += time_ns([&] {
+			for (int p = 0; p < num_peers; ++p)
+			{
+				picked.clear();
+				s.picker.pick_pieces(s.bitfields[std::size_t(p)], picked
+					, blocks_per_pick, 0, &s.peers[std::size_t(p)]
+					, piece_picker::rarest_first, {}, num_peers, pc);
+			}
+		});
+		r.ops += num_peers;
+	}
+	ret.push_back(r);
+}
+
+// picking blocks from individual pieces, both open and partially downloaded
+// ones. This is the inner loop of pick_pieces()
+void bench_add_blocks(swarm& s, int const iterations, std::vector<result>& ret)
+{
+	int const num_peers = int(s.peers.size());
+	int const num_pieces = s.picker.num_pieces();
+	std::vector<piece_block> interesting;
+	std::vector<piece_block> backup1;
+	std::vector<piece_block> backup2;
+	std::vector<piece_index_t> const ignore;
+
+	// the pieces each peer will look at, the next 64 pieces it has, starting
+	// at a random offset
+	std::mt19937 rng(0x1338);
+	std::uniform_int_distribution<int> start(0, num_pieces - 1);
+	auto candidates = std::vector<std::vector<piece_index_t>>(std::size_t(num_peers));
+	for (int p = 0; p < num_peers; ++p)
+	{
+		auto const& have = s.bitfields[std::size_t(p)];
+		int const first = start(rng);
+		for (int k = 0; k < num_pieces && candidates[std::size_t(p)].size() < 64; ++k)
+		{
+			piece_index_t const piece((first + k) % num_pieces);
+			if (have[piece]) candidates[std::size_t(p)].push_back(piece);
+		}
+	}
+
+	result r{"add_blocks", 0, 0};
+	for (int i = 0; i < iterations; ++i)
+	{
+		r.ns += time_ns([&] {
+			for (int p = 0; p < num_peers; ++p)
+			{
+				for (piece_index_t const piece : candidates[std::size_t(p)])
+				{
+					interesting.clear();
+					backup1.clear();
+					backup2.clear();
+					s.picker.add_blocks(piece, s.bitfields[std::size_t(p)]
+						, interesting, backup1, backup2, blocks_per_pick, 0
+						, &s.peers[std::size_t(p)], ignore, {});
+				}
+				r.ops += std::int64_t(candidates[std::size_t(p)].size());
+			}
+		});
+	}
+	ret.push_back(r);
+}
+
+// moving pieces through the download queues: requesting all of their blocks
+// (downloading, then full), receiving them (finished) and failing the hash
+// check (removed). This happens next to the partial pieces already in the
+// queues. The pieces are visited in random order, like rarest-first picks
+// them
+void bench_download_queue(swarm& s, int const iterations, std::vector<result>& ret)
+{
+	auto* peer = &s.peers[0];
+	std::vector<piece_index_t> pieces;
+	for (auto const p : s.bitfields[0].range())
+	{
+		if (pieces.size() >= 5000) break;
+		if (!s.bitfields[0][p]) continue;
+		if (s.picker.is_requested(piece_block(p, 0))
+			|| s.picker.is_downloaded(piece_block(p, 0))) continue;
+		pieces.push_back(p);
+	}
+	std::shuffle(pieces.begin(), pieces.end(), std::mt19937(0x1337));
+
+	result r{"download_queue", 0, 0};
+	for (int i = 0; i < iterations; ++i)
+	{
+		r.ns += time_ns([&] {
+			for (piece_index_t const p : pieces)
+				for (int b = 0; b < blocks_per_piece; ++b)
+					s.picker.mark_as_downloading(piece_block(p, b), peer);
+			for (piece_index_t const p : pieces)
+				for (int b = 0; b < blocks_per_piece; ++b)
+					s.picker.mark_as_finished(piece_block(p, b), peer);
+			for (piece_index_t const p : pieces)
+				s.picker.restore_piece(p);
+		});
+		r.ops += std::int64_t(pieces.size());
+	}
+	ret.push_back(r);
+}
+
+// have some of the peers start downloading pieces, to populate the download
+// queues the way they would be in a busy swarm
+void start_downloads(swarm& s)
+{
+	int const num_peers = int(s.peers.size());
+	std::vector<piece_block> picked;
+	counters pc;
+	for (int p = 0; p < num_peers; p += 2)
+	{
+		picked.clear();
+		auto* peer = &s.peers[std::size_t(p)];
+		s.picker.pick_pieces(s.bitfields[std::size_t(p)], picked
+			, blocks_per_pick, 0, peer, piece_picker::rarest_first, {}
+			, num_peers, pc);
+		// only request half the blocks, to leave partial pieces behind
+		for (std::size_t b = 0; b < picked.size(); b += 2)
+			s.picker.mark_as_downloading(picked[b], peer);
+	}
+}
+
+}
+
+int main(int argc, char const* argv[])
+{
+	int const num_pieces = argc > 1 ? std::atoi(argv[1]) : 100000;
+	int const num_peers = argc > 2 ? std::atoi(argv[2]) : 2000;
+	int const iterations = argc > 3 ? std::atoi(argv[3]) : 3;
+	if (num_pieces <= 0 || num_peers <= 0 || iterations <= 0)
+	{
+		std::fprintf(stderr, "usage: piece_picker_bench [pieces [peers [iterations]]]\n");
+		return 1;
+	}
+
+	swarm s(num_pieces, num_peers);
+	std::vector<result> results;
+
+	bench_refcount(s, iterations, results);
+
+	for (int p = 0; p < num_peers; ++p)
+		s.picker.inc_refcount(s.bitfields[std::size_t(p)], &s.peers[std::size_t(p)]);
+	start_downloads(s);
+
+	bench_pick_pieces(s, iterations, results);
+	bench_add_blocks(s, iterations, results);
+	bench_download_queue(s, iterations, results);
+
+	for (auto const& r : results) print(r, num_pieces, num_peers);
+	return 0;
+}
@@ -0,0 +1,198 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/timer_wheel.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+// compares the cost of ticking peers once per second by visiting every one of
+// them (like torrent::second_tick() used to) against only visiting the ones
+// that are due in a timer_wheel. Most peers in a large swarm are idle, and only
+// need to be checked for keep-alives and timeouts. Each result is printed as
+// one JSON object per line.
+
+using namespace lt;
+
+namespace {
+
+using std::chrono::steady_clock;
+
+// the timeouts mirror the defaults of the peer_connection checks, in ticks
+// (seconds)
+int const keepalive_interval = 60;
+int const inactivity_timeout = 120;
+int const max_tick_delay = 10;
+
+// a stand-in for a peer_connection. The padding makes every peer span a few
+// cache lines, like the real thing (which is a lot bigger still)
+struct peer : aux::timer_wheel_entry
+{
+	std::int64_t last_sent = 0;
+	std::int64_t last_receive = 0;
+	std::int64_t transferred = 0;
+	bool active = false;
+	std::array<char, 512> padding{};
+};
+
+// the part of second_tick() that every peer goes through. Returns the number
+// of seconds until the peer needs to be ticked again
+int tick_peer(peer& p, std::int64_t const now)
+{
+	if (p.active)
+	{
+		p.transferred += 16 * 1024;
+		p.last_sent = now;
+		p.last_receive = now;
+		return 1;
+	}
+
+	// send keep-alives
+	if (now - p.last_sent >= keepalive_interval) p.last_sent = now;
+	// the peer sends its keep-alives too
+	if (now - p.last_receive >= keepalive_interval) p.last_receive = now;
+	// this is never true in this simulation, but it needs to be checked
+	if (now - p.last_receive > inactivity_timeout) p.padding[0] = 1;
+
+	std::int64_t next = now + max_tick_delay;
+	next = std::min(next, p.last_sent + keepalive_interval);
+	next = std::min(next, p.last_receive + keepalive_interval);
+	return int(std::max(std::int64_t(1), next - now));
+}
+
+struct result
+{
+	char const* name;
+	std::int64_t visits;
+	std::int64_t ns;
+};
+
+void print(result const& r, int const num_peers, int const num_active
+	, int const num_ticks)
+{
+	std::printf("{\"benchmark\": \"%s\", \"peers\": %d, \"active_peers\": %d"
+		", \"ticks\": %d, \"peer_visits\": %lld, \"total_ns\": %lld"
+		", \"ns_per_tick\": %.1f}\n"
+		, r.name, num_peers, num_active, num_ticks
+		, static_cast<long long>(r.visits), static_cast<long long>(r.ns)
+		, double(r.ns) / num_ticks);
+	std::fflush(stdout);
+}
+
+std::vector<std::unique_ptr<peer>> make_peers(int const num_peers
+	, int const num_active)
+{
+	std::mt19937 rng(0x1337);
+	std::uniform_int_distribution<std::int64_t> last(-keepalive_interval + 1, 0);
+	std::vector<std::unique_ptr<peer>> peers;
+	peers.reserve(std::size_t(num_peers));
+	for (int i = 0; i < num_peers; ++i)
+	{
+		peers.emplace_back(new peer);
+		// spread out the keep-alives, the way peers that connected at
+		// different times would be
+		peers.back()->last_sent = last(rng);
+		peers.back()->last_receive = last(rng);
+	}
+	// the peers are allocated in order, shuffle them to not have the active
+	// ones next to each other in memory
+	std::shuffle(peers.begin(), peers.end(), rng);
+	for (int i = 0; i < num_active; ++i) peers[std::size_t(i)]->active = true;
+	return peers;
+}
+
+result run_scan(int const num_peers, int const num_active, int const num_ticks)
+{
+	auto peers = make_peers(num_peers, num_active);
+	result ret{"scan", 0, 0};
+	auto const start = steady_clock::now();
+	for (std::int64_t now = 1; now <= num_ticks; ++now)
+	{
+		for (auto& p : peers)
+		{
+			tick_peer(*p, now);
+			++ret.visits;
+		}
+	}
+	ret.ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		steady_clock::now() - start).count();
+	return ret;
+}
+
+result run_wheel(int const num_peers, int const num_active, int const num_ticks)
+{
+	auto peers = make_peers(num_peers, num_active);
+	aux::timer_wheel wheel;
+	for (auto& p : peers) wheel.schedule(*p, 1);
+
+	result ret{"timer_wheel", 0, 0};
+	auto const start = steady_clock::now();
+	for (std::int64_t now = 1; now <= num_ticks; ++now)
+	{
+		wheel.advance(now, [&](aux::timer_wheel_entry& e)
+		{
+			auto& p = static_cast<peer&>(e);
+			wheel.schedule(p, now + tick_peer(p, now));
+			++ret.visits;
+		});
+	}
+	ret.ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		steady_clock::now() - start).count();
+	return ret;
+}
+
+}
+
+int main(int argc, char const* argv[])
+{
+	int const num_ticks = argc > 1 ? std::atoi(argv[1]) : 600;
+	int const active_permille = argc > 2 ? std::atoi(argv[2]) : 20;
+	if (num_ticks <= 0 || active_permille < 0 || active_permille > 1000)
+	{
+		std::fprintf(stderr, "usage: timer_wheel_bench [ticks [active-peers-per-mille]]\n");
+		return 1;
+	}
+
+	for (int const num_peers : {10000, 100000})
+	{
+		int const num_active = int(std::int64_t(num_peers) * active_permille / 1000);
+		print(run_scan(num_peers, num_active, num_ticks), num_peers, num_active, num_ticks);
+		print(run_wheel(num_peers, num_active, num_ticks), num_peers, num_active, num_ticks);
+	}
+}
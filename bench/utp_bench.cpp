@@ -0,0 +1,240 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/utp_socket_manager.hpp"
+#include "libtorrent/aux_/utp_stream.hpp"
+#include "libtorrent/aux_/session_settings.hpp"
+#include "libtorrent/aux_/socket_type.hpp"
+#include "libtorrent/performance_counters.hpp"
+#include "libtorrent/io_context.hpp"
+#include "libtorrent/settings_pack.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+// replays uTP packets through utp_socket_manager::incoming_packet() with a
+// large number of open connections, to measure the cost of routing a packet
+// to its socket. Each result is printed as one JSON object per line, to make
+// it simple to collect and compare results over time.
+
+using namespace lt;
+
+namespace {
+
+using std::chrono::steady_clock;
+
+struct udp_iface final : aux::utp_socket_interface
+{
+	udp::endpoint get_local_endpoint() override
+	{ return udp::endpoint(make_address_v4("10.255.255.1"), 6881); }
+};
+
+struct connection
+{
+	udp::endpoint ep;
+	// the connection ID the remote end (i.e. us) sends packets with
+	std::uint16_t id;
+	// the sequence number of the SYN-ACK the socket sent us
+	std::uint16_t seq_nr;
+};
+
+struct result
+{
+	char const* name;
+	std::int64_t ops;
+	std::int64_t ns;
+};
+
+void print(result const& r, int const num_sockets)
+{
+	std::printf("{\"benchmark\": \"%s\", \"sockets\": %d"
+		", \"operations\": %lld, \"total_ns\": %lld, \"ns_per_op\": %.1f}\n"
+		, r.name, num_sockets
+		, static_cast<long long>(r.ops), static_cast<long long>(r.ns)
+		, r.ops > 0 ? double(r.ns) / double(r.ops) : 0.0);
+	std::fflush(stdout);
+}
+
+std::array<char, sizeof(aux::utp_header)> make_packet(int const type
+	, std::uint16_t const id, std::uint16_t const seq_nr, std::uint16_t const ack_nr)
+{
+	std::array<char, sizeof(aux::utp_header)> ret{};
+	auto* h = reinterpret_cast<aux::utp_header*>(ret.data());
+	h->type_ver = std::uint8_t((type << 4) | 1);
+	h->extension = 0;
+	h->connection_id = id;
+	h->timestamp_microseconds = 0;
+	h->timestamp_difference_microseconds = 0;
+	h->wnd_size = 1024 * 1024;
+	h->seq_nr = seq_nr;
+	h->ack_nr = ack_nr;
+	return ret;
+}
+
+// the number of packets received in a single wakeup of the UDP socket, after
+// which the socket is considered drained
+int const packets_per_drain = 32;
+
+}
+
+int main(int argc, char const* argv[])
+{
+	int const num_sockets = argc > 1 ? std::atoi(argv[1]) : 50000;
+	int const num_packets = argc > 2 ? std::atoi(argv[2]) : 2000000;
+	if (num_sockets <= 0 || num_sockets > 0xffffff || num_packets <= 0)
+	{
+		std::fprintf(stderr, "usage: utp_bench [sockets [packets]]\n");
+		return 1;
+	}
+
+	io_context ios;
+	aux::session_settings sett;
+	sett.set_int(settings_pack::connections_limit, num_sockets);
+	counters cnt;
+
+	auto const iface = std::make_shared<udp_iface>();
+
+	// the sockets accepted by the manager. These must be destructed before the
+	// manager, since they hold pointers into it
+	std::vector<std::unique_ptr<aux::utp_stream>> sockets;
+
+	// the connection whose SYN is currently being processed. The SYN-ACK
+	// sent in response to it tells us its sequence number
+	connection* current = nullptr;
+	std::int64_t packets_sent = 0;
+
+	aux::utp_socket_manager sm(
+		[&](std::weak_ptr<aux::utp_socket_interface>, udp::endpoint const&
+			, span<char const> p, error_code&, udp_send_flags_t)
+		{
+			++packets_sent;
+			if (current == nullptr || p.size() < int(sizeof(aux::utp_header))) return;
+			auto const* h = reinterpret_cast<aux::utp_header const*>(p.data());
+			current->seq_nr = h->seq_nr;
+		}
+		// the socket is taken by rvalue reference, to not instantiate the
+		// destructors of every socket_type alternative in this binary
+		, [&](aux::socket_type&& s)
+		{ sockets.push_back(std::make_unique<aux::utp_stream>(std::move(boost::get<aux::utp_stream>(s)))); }
+		, ios, sett, cnt, nullptr);
+
+	std::mt19937 rng(0x1339);
+	std::vector<connection> conns(static_cast<std::size_t>(num_sockets));
+	for (int i = 0; i < num_sockets; ++i)
+	{
+		// spread the connections over a few thousand addresses, with many
+		// ports each, the way a busy swarm looks
+		auto const addr = address_v4::uint_type(0x0a000000 + (i % 4093));
+		conns[std::size_t(i)].ep = udp::endpoint(make_address_v4(addr)
+			, std::uint16_t(1024 + i / 4093));
+		conns[std::size_t(i)].id = std::uint16_t(rng());
+	}
+
+	std::vector<result> results;
+
+	// establish all connections by sending a SYN for each
+	result syn{"incoming_syn", 0, 0};
+	{
+		auto const start = steady_clock::now();
+		for (auto& c : conns)
+		{
+			current = &c;
+			auto const pkt = make_packet(aux::ST_SYN, c.id, std::uint16_t(rng()), 0);
+			sm.incoming_packet(iface, c.ep, pkt);
+			sm.socket_drained();
+		}
+		current = nullptr;
+		syn.ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			steady_clock::now() - start).count();
+		syn.ops = num_sockets;
+	}
+	results.push_back(syn);
+
+	if (sm.num_sockets() != num_sockets || int(sockets.size()) != num_sockets)
+	{
+		std::fprintf(stderr, "failed to establish connections (%d sockets, %d accepted)\n"
+			, sm.num_sockets(), int(sockets.size()));
+		return 1;
+	}
+
+	// the packets are generated up-front, to only time the lookup and the
+	// processing of the packets. Every socket receives duplicate ACKs of its
+	// SYN-ACK, in random order, to defeat the last-socket cache. The packet
+	// with the connection ID of the SYN (i.e. one less than the receive ID)
+	// is for a connection that doesn't exist
+	struct replay_packet
+	{
+		std::array<char, sizeof(aux::utp_header)> buf;
+		udp::endpoint ep;
+	};
+	std::vector<replay_packet> packets(static_cast<std::size_t>(num_packets));
+	std::uniform_int_distribution<std::size_t> pick(0, conns.size() - 1);
+	std::bernoulli_distribution miss(0.05);
+	for (auto& p : packets)
+	{
+		auto const& c = conns[pick(rng)];
+		bool const unknown = miss(rng);
+		p.buf = make_packet(aux::ST_STATE
+			, unknown ? c.id : std::uint16_t(c.id + 1), 0, c.seq_nr);
+		p.ep = c.ep;
+	}
+
+	result replay{"incoming_packet", 0, 0};
+	{
+		auto const start = steady_clock::now();
+		int n = 0;
+		for (auto const& p : packets)
+		{
+			sm.incoming_packet(iface, p.ep, p.buf);
+			if (++n == packets_per_drain)
+			{
+				sm.socket_drained();
+				n = 0;
+			}
+		}
+		sm.socket_drained();
+		replay.ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			steady_clock::now() - start).count();
+		replay.ops = num_packets;
+	}
+	results.push_back(replay);
+
+	for (auto const& r : results) print(r, num_sockets);
+
+	sockets.clear();
+	return 0;
+}
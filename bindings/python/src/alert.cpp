@@ -165,6 +165,11 @@ list dht_sample_infohashes_nodes(dht_sample_infohashes_alert const& alert)
     return result;
 }
 
+bytes get_journal_record(save_resume_data_alert const& self)
+{
+    return bytes(self.journal_record.data(), self.journal_record.size());
+}
+
 #if TORRENT_ABI_VERSION == 1
 entry const& get_resume_data_entry(save_resume_data_alert const& self)
 {
@@ -773,6 +778,7 @@ void bind_alert()
     class_<save_resume_data_alert, bases<torrent_alert>, noncopyable>(
         "save_resume_data_alert", no_init)
         .def_readonly("params", &save_resume_data_alert::params)
+        .add_property("journal_record", &get_journal_record)
 #if TORRENT_ABI_VERSION == 1
         .add_property("resume_data", make_function(get_resume_data_entry, by_value()))
 #endif
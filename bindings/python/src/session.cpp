@@ -747,6 +747,16 @@ namespace
         return read_resume_data(b.arr, dict_to_limits(cfg));
     }
 
+    add_torrent_params read_resume_data_journal_wrapper0(bytes const& b)
+    {
+        return read_resume_data_journal(b.arr);
+    }
+
+    add_torrent_params read_resume_data_journal_wrapper1(bytes const& b, dict cfg)
+    {
+        return read_resume_data_journal(b.arr, dict_to_limits(cfg));
+    }
+
 	 int find_metric_idx_wrap(char const* name)
 	 {
 		 return lt::find_metric_idx(name);
@@ -1218,6 +1228,8 @@ void bind_session()
     def("default_settings", default_settings_wrapper);
     def("read_resume_data", read_resume_data_wrapper0);
     def("read_resume_data", read_resume_data_wrapper1);
+    def("read_resume_data_journal", read_resume_data_journal_wrapper0);
+    def("read_resume_data_journal", read_resume_data_journal_wrapper1);
     def("write_resume_data", write_resume_data);
     def("write_resume_data_buf", write_resume_data_buf_);
 
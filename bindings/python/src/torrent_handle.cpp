@@ -589,6 +589,7 @@ void bind_torrent_handle()
     s.attr("flush_disk_cache") = torrent_handle::flush_disk_cache;
     s.attr("save_info_dict") = torrent_handle::save_info_dict;
     s.attr("only_if_modified") = torrent_handle::only_if_modified;
+    s.attr("journal") = torrent_handle::journal;
     s.attr("alert_when_available") = torrent_handle::alert_when_available;
     s.attr("query_distributed_copies") = torrent_handle::query_distributed_copies;
     s.attr("query_accurate_download_counters") = torrent_handle::query_accurate_download_counters;
@@ -637,6 +638,7 @@ void bind_torrent_handle()
     s.attr("flush_disk_cache") = torrent_handle::flush_disk_cache;
     s.attr("save_info_dict") = torrent_handle::save_info_dict;
     s.attr("only_if_modified") = torrent_handle::only_if_modified;
+    s.attr("journal") = torrent_handle::journal;
     }
 
     {
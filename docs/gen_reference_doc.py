@@ -119,6 +119,7 @@ category_mapping = {
     'mmap_disk_io.hpp': 'Storage',
     'disabled_disk_io.hpp': 'Storage',
     'posix_disk_io.hpp': 'Storage',
+    'io_uring_disk_io.hpp': 'Storage',
     'extensions.hpp': 'Plugins',
     'ut_metadata.hpp': 'Plugins',
     'ut_pex.hpp': 'Plugins',
@@ -36,6 +36,11 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <cinttypes> // for PRId64 et.al.
 #include <fstream>
 #include <iostream>
+#include <chrono>
+
+#ifndef _WIN32
+#include <sys/resource.h> // for getrusage
+#endif
 
 #include "libtorrent/entry.hpp"
 #include "libtorrent/bencode.hpp"
@@ -57,10 +62,31 @@ namespace {
     --max-pieces <count>     set the upper limit on the number of pieces to
                              load in the torrent.
     --max-size <size in MiB> reject files larger than this size limit
+    --timing                 print the time it took to load the torrent and
+                             the peak memory usage of the process
+    --no-files               don't print the file list
 )";
 	std::exit(1);
 }
 
+// returns the peak resident set size of this process, in kiB, or -1 if it's
+// not known on this platform
+long peak_rss_kib()
+{
+#ifndef _WIN32
+	rusage ru{};
+	if (getrusage(RUSAGE_SELF, &ru) != 0) return -1;
+#ifdef __APPLE__
+	// macOS reports ru_maxrss in bytes, everyone else in kiB
+	return long(ru.ru_maxrss / 1024);
+#else
+	return long(ru.ru_maxrss);
+#endif
+#else
+	return -1;
+#endif
+}
+
 }
 
 int main(int argc, char const* argv[]) try
@@ -72,6 +98,8 @@ int main(int argc, char const* argv[]) try
 
 	lt::load_torrent_limits cfg;
 	bool show_pad = false;
+	bool show_timing = false;
+	bool show_files = true;
 
 	if (args.empty()) print_usage();
 
@@ -107,6 +135,16 @@ int main(int argc, char const* argv[]) try
 			show_pad = true;
 			args = args.subspan(1);
 		}
+		else if (args[0] == "--timing"_sv)
+		{
+			show_timing = true;
+			args = args.subspan(1);
+		}
+		else if (args[0] == "--no-files"_sv)
+		{
+			show_files = false;
+			args = args.subspan(1);
+		}
 		else
 		{
 			std::cerr << "unknown option: " << args[0] << "\n";
@@ -114,7 +152,17 @@ int main(int argc, char const* argv[]) try
 		}
 	}
 
+	auto const start = std::chrono::steady_clock::now();
 	lt::torrent_info const t(filename, cfg);
+	auto const load_time = std::chrono::steady_clock::now() - start;
+
+	if (show_timing)
+	{
+		std::printf("load time: %" PRId64 " ms\n"
+			"peak memory: %ld kiB\n"
+			, std::int64_t(std::chrono::duration_cast<std::chrono::milliseconds>(load_time).count())
+			, peak_rss_kib());
+	}
 
 	// print info about torrent
 	if (!t.nodes().empty())
@@ -143,7 +191,6 @@ int main(int argc, char const* argv[]) try
 		"magnet link: %s\n"
 		"name: %s\n"
 		"number of files: %d\n"
-		"files:\n"
 		, t.num_pieces()
 		, t.piece_length()
 		, ih.str().c_str()
@@ -153,29 +200,33 @@ int main(int argc, char const* argv[]) try
 		, t.name().c_str()
 		, t.num_files());
 	lt::file_storage const& st = t.files();
-	for (auto const i : st.file_range())
+	if (show_files)
 	{
-		auto const first = st.map_file(i, 0, 0).piece;
-		auto const last = st.map_file(i, std::max(std::int64_t(st.file_size(i)) - 1, std::int64_t(0)), 0).piece;
-		auto const flags = st.file_flags(i);
-		if ((flags & lt::file_storage::flag_pad_file) && !show_pad) continue;
-		std::stringstream file_root;
-		if (!st.root(i).is_all_zeros())
-			file_root << st.root(i);
-		std::printf(" %8" PRIx64 " %11" PRId64 " %c%c%c%c [ %5d, %5d ] %7u %s %s %s%s\n"
-			, st.file_offset(i)
-			, st.file_size(i)
-			, ((flags & lt::file_storage::flag_pad_file)?'p':'-')
-			, ((flags & lt::file_storage::flag_executable)?'x':'-')
-			, ((flags & lt::file_storage::flag_hidden)?'h':'-')
-			, ((flags & lt::file_storage::flag_symlink)?'l':'-')
-			, static_cast<int>(first)
-			, static_cast<int>(last)
-			, std::uint32_t(st.mtime(i))
-			, file_root.str().c_str()
-			, st.file_path(i).c_str()
-			, (flags & lt::file_storage::flag_symlink) ? "-> " : ""
-			, (flags & lt::file_storage::flag_symlink) ? st.symlink(i).c_str() : "");
+		std::printf("files:\n");
+		for (auto const i : st.file_range())
+		{
+			auto const first = st.map_file(i, 0, 0).piece;
+			auto const last = st.map_file(i, std::max(std::int64_t(st.file_size(i)) - 1, std::int64_t(0)), 0).piece;
+			auto const flags = st.file_flags(i);
+			if ((flags & lt::file_storage::flag_pad_file) && !show_pad) continue;
+			std::stringstream file_root;
+			if (!st.root(i).is_all_zeros())
+				file_root << st.root(i);
+			std::printf(" %8" PRIx64 " %11" PRId64 " %c%c%c%c [ %5d, %5d ] %7u %s %s %s%s\n"
+				, st.file_offset(i)
+				, st.file_size(i)
+				, ((flags & lt::file_storage::flag_pad_file)?'p':'-')
+				, ((flags & lt::file_storage::flag_executable)?'x':'-')
+				, ((flags & lt::file_storage::flag_hidden)?'h':'-')
+				, ((flags & lt::file_storage::flag_symlink)?'l':'-')
+				, static_cast<int>(first)
+				, static_cast<int>(last)
+				, std::uint32_t(st.mtime(i))
+				, file_root.str().c_str()
+				, st.file_path(i).c_str()
+				, (flags & lt::file_storage::flag_symlink) ? "-> " : ""
+				, (flags & lt::file_storage::flag_symlink) ? st.symlink(i).c_str() : "");
+		}
 	}
 	std::printf("web seeds:\n");
 	for (auto const& ws : t.web_seeds())
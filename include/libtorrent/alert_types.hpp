@@ -1166,6 +1166,10 @@ TORRENT_VERSION_NAMESPACE_3
 		TORRENT_UNEXPORT save_resume_data_alert(aux::stack_allocator& alloc
 			, add_torrent_params&& params
 			, torrent_handle const& h);
+		TORRENT_UNEXPORT save_resume_data_alert(aux::stack_allocator& alloc
+			, add_torrent_params&& params
+			, std::vector<char>&& record
+			, torrent_handle const& h);
 		TORRENT_UNEXPORT save_resume_data_alert(aux::stack_allocator& alloc
 			, add_torrent_params const& params
 			, torrent_handle const& h) = delete;
@@ -1180,6 +1184,13 @@ TORRENT_VERSION_NAMESPACE_3
 		// save the state to disk, you may pass it on to write_resume_data().
 		add_torrent_params params;
 
+		// if resume data was saved with torrent_handle::journal, and a full
+		// record had been saved for this torrent before, this is a journal
+		// record with the changes since the last record, to be appended to
+		// it. ``params`` then only holds the resume data the journal record
+		// was built from, which is not complete. Otherwise this is empty.
+		std::vector<char> journal_record;
+
 #if TORRENT_ABI_VERSION == 1
 		// points to the resume data.
 		TORRENT_DEPRECATED std::shared_ptr<entry> resume_data;
@@ -45,9 +45,15 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <functional>
 #include <utility> // for std::forward
 #include <mutex>
-#include <condition_variable>
 #include <atomic>
 #include <bitset>
+#include <array>
+#include <thread>
+#include <cstdint>
+
+#ifndef TORRENT_LINUX
+#include <condition_variable>
+#endif
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
 #include "libtorrent/extensions.hpp"
@@ -71,30 +77,34 @@ namespace aux {
 		template <class T, typename... Args>
 		void emplace_alert(Args&&... args) try
 		{
-			std::unique_lock<std::recursive_mutex> lock(m_mutex);
-
-			heterogeneous_queue<alert>& queue = m_alerts[m_generation];
+			producer_guard p(*this);
+			int const gen = p.generation;
 
 			// don't add more than this number of alerts, unless it's a
 			// high priority alert, in which case we try harder to deliver it
 			// for high priority alerts, double the upper limit
-			if (queue.size() / (1 + static_cast<int>(T::priority)) >= m_queue_size_limit)
+			if (m_num_queued[gen].load(std::memory_order_relaxed) / (1 + static_cast<int>(T::priority))
+				>= m_queue_size_limit.load(std::memory_order_relaxed))
 			{
-				// record that we dropped an alert of this type
-				m_dropped.set(T::alert_type);
+				// record that we dropped an alert of this type. The first time
+				// it happens in this generation, let the client know
+				if (record_dropped(gen, T::alert_type, T::static_category)
+					&& T::alert_type != alerts_dropped_alert::alert_type)
+				{
+					post_dropped_alert(gen);
+				}
 				return;
 			}
 
-			T& alert = queue.emplace_back<T>(
-				m_allocations[m_generation], std::forward<Args>(args)...);
+			T& alert = p.prod.alerts[gen].emplace_back<T>(
+				p.prod.allocations[gen], std::forward<Args>(args)...);
 
-			maybe_notify(&alert);
+			maybe_notify(p.prod, gen, &alert);
 		}
 		catch (std::bad_alloc const&)
 		{
 			// record that we dropped an alert of this type
-			std::unique_lock<std::recursive_mutex> lock(m_mutex);
-			m_dropped.set(T::alert_type);
+			record_dropped(m_generation.load(), T::alert_type, T::static_category);
 		}
 
 		bool pending() const;
@@ -123,27 +133,112 @@ namespace aux {
 
 		void set_notify_function(std::function<void()> const& fun);
 
+		// the number of alerts dropped because the queue was full, for each
+		// alert category bit. An alert belonging to more than one category is
+		// counted once for each of them.
+		std::array<std::int64_t, 32> dropped_alerts_per_category() const;
+
 #ifndef TORRENT_DISABLE_EXTENSIONS
 		void add_extension(std::shared_ptr<plugin> ext);
 #endif
 
 	private:
 
-		void maybe_notify(alert* a);
+		// every thread posting alerts has its own queues, so posting an alert
+		// never waits for another thread (in particular, not for the client
+		// calling get_all()). The queues are merged by get_all().
+		struct producer
+		{
+			// the thread posting to this producer
+			std::atomic<std::thread::id> owner{std::thread::id()};
+
+			// the generation this thread is currently posting to, or -1 if
+			// it's not in emplace_alert(). get_all() waits for the producers
+			// to leave the generation it's about to return to the client
+			std::atomic<int> active{-1};
+
+			// the number of nested calls to emplace_alert(), from extensions
+			// or the notify function posting alerts
+			int depth = 0;
+
+			// the double buffered alert queues and allocators of this thread,
+			// indexed by generation. See m_generation
+			aux::array<heterogeneous_queue<alert>, 2> alerts;
+			aux::array<stack_allocator, 2> allocations;
+
+			// the first alert in each queue. It can be read by other threads
+			// for wait_for_alert()
+			std::atomic<alert*> head[2] = {{nullptr}, {nullptr}};
+		};
+
+		// this is the maximum number of threads that can post alerts without
+		// any synchronization. Any additional threads share one producer,
+		// protected by m_shared_mutex
+		static constexpr int max_producers = 16;
+
+		// enters the current generation of the calling thread's producer for
+		// the scope of an emplace_alert() call
+		struct TORRENT_EXTRA_EXPORT producer_guard
+		{
+			explicit producer_guard(alert_manager& m);
+			~producer_guard();
+			producer_guard(producer_guard const&) = delete;
+			producer_guard& operator=(producer_guard const&) = delete;
+
+			std::unique_lock<std::recursive_mutex> lock;
+			producer& prod;
+			int generation;
+		};
+
+		producer& get_producer(std::unique_lock<std::recursive_mutex>& l);
+		void maybe_notify(producer& p, int gen, alert* a);
+		// returns true if this is the first alert of this type to be dropped
+		// from generation ``gen``
+		bool record_dropped(int gen, int type, alert_category_t category) noexcept;
+		void post_dropped_alert(int gen);
+		alert* peek() const;
+		void wait(std::uint32_t seq, time_duration max_wait);
+		void wake();
 
-		// this mutex protects everything. Since it's held while executing user
-		// callbacks (the notify function and extension on_alert()) it must be
-		// recursive to support recursively post new alerts.
-		mutable std::recursive_mutex m_mutex;
-		std::condition_variable_any m_condition;
 		std::atomic<alert_category_t> m_alert_mask;
-		int m_queue_size_limit;
+		std::atomic<int> m_queue_size_limit;
+
+		// used to tell threads apart from the ones posting to other
+		// alert_manager objects, when caching which producer a thread uses
+		std::uint64_t const m_instance;
+
+		aux::array<producer, max_producers> m_producers;
+		producer m_shared_producer;
+		std::recursive_mutex m_shared_mutex;
 
-		// a bitfield where each bit represents an alert type. Every time we drop
-		// an alert (because the queue is full or of some other error) we set the
-		// corresponding bit in this mask, to communicate to the client that it
-		// may have missed an update.
-		std::bitset<abi_alert_count> m_dropped;
+		// the number of slots in m_producers that have been claimed by a
+		// thread
+		std::atomic<int> m_num_producers{0};
+
+		// this is either 0 or 1, it indicates which queues in the producers
+		// the alerts are posted to right now. This is flipped when the client
+		// calls get_all(), at which point all of the alert objects passed to
+		// the client will be owned by libtorrent again, and reset.
+		std::atomic<int> m_generation{0};
+
+		// the total number of alerts posted to each generation, across all
+		// producers
+		aux::array<std::atomic<int>, 2> m_num_queued;
+
+		// serializes calls to get_all()
+		std::mutex m_get_all_mutex;
+
+		// a bitfield per generation where each bit represents an alert type.
+		// Every time we drop an alert (because the queue is full or of some
+		// other error) we set the corresponding bit in this mask, to
+		// communicate to the client that it may have missed an update. The
+		// thread dropping an alert of a new type posts an alerts_dropped_alert
+		// with the types dropped so far.
+		using dropped_mask = std::array<std::atomic<std::uint64_t>, (abi_alert_count + 63) / 64>;
+		aux::array<dropped_mask, 2> m_dropped;
+
+		// the number of dropped alerts per category bit
+		aux::array<std::atomic<std::int64_t>, 32> m_dropped_categories;
 
 		// this function (if set) is called whenever the number of alerts in
 		// the alert queue goes from 0 to 1. The client is expected to wake up
@@ -152,26 +247,25 @@ namespace aux {
 		// notification function will be called again the next time an alert is
 		// posted to the queue
 		std::function<void()> m_notify;
-
-		// this is either 0 or 1, it indicates which m_alerts and m_allocations
-		// the alert_manager is allowed to use right now. This is swapped when
-		// the client calls get_all(), at which point all of the alert objects
-		// passed to the client will be owned by libtorrent again, and reset.
-		int m_generation = 0;
-
-		// this is where all alerts are queued up. There are two heterogeneous
-		// queues to double buffer the thread access. The std::mutex in the alert
-		// manager gives exclusive access to m_alerts[m_generation] and
-		// m_allocations[m_generation] whereas the other copy is exclusively
-		// used by the client thread.
-		aux::array<heterogeneous_queue<alert>, 2> m_alerts;
-
-		// this is a stack where alerts can allocate variable length content,
-		// such as strings, to go with the alerts.
-		aux::array<stack_allocator, 2> m_allocations;
+		std::recursive_mutex m_notify_mutex;
+
+		// incremented every time the alert queue goes from 0 to 1 alerts.
+		// wait_for_alert() blocks until it changes, on linux by using it as a
+		// futex
+		std::atomic<std::uint32_t> m_wakeup{0};
+		std::atomic<int> m_waiters{0};
+#ifndef TORRENT_LINUX
+		std::mutex m_wait_mutex;
+		std::condition_variable m_wait_cond;
+#endif
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
 		std::list<std::shared_ptr<plugin>> m_ses_extensions;
+
+		// alerts are posted from any thread, but the calls to the plugins'
+		// on_alert() are serialized by this mutex. It's recursive since
+		// on_alert() may post alerts itself
+		std::recursive_mutex m_extensions_mutex;
 #endif
 	};
 }
@@ -77,7 +77,7 @@ namespace libtorrent { namespace aux {
 	constexpr std::size_t openssl_write_cost = 0;
 #endif
 
-	constexpr std::size_t read_handler_max_size = tracking + debug_read_iter + openssl_read_cost + 102 + 8 * sizeof(void*);
+	constexpr std::size_t read_handler_max_size = tracking + debug_read_iter + openssl_read_cost + 118 + 8 * sizeof(void*);
 	constexpr std::size_t write_handler_max_size = tracking + debug_write_iter + openssl_write_cost + 102 + 8 * sizeof(void*);
 	constexpr std::size_t udp_handler_max_size = tracking + debug_tick + 128 + 8 * sizeof(void*);
 	constexpr std::size_t utp_handler_max_size = tracking + debug_tick + 152 + 8 * sizeof(void*);
@@ -123,7 +123,7 @@ namespace libtorrent { namespace aux {
 	constexpr std::size_t fuzzer_read_cost = 0;
 #endif
 	constexpr std::size_t write_handler_max_size = tracking + debug_write_iter + openssl_write_cost + fuzzer_write_cost + 152;
-	constexpr std::size_t read_handler_max_size = tracking + debug_read_iter + openssl_read_cost + fuzzer_read_cost + 152;
+	constexpr std::size_t read_handler_max_size = tracking + debug_read_iter + openssl_read_cost + fuzzer_read_cost + 168;
 	constexpr std::size_t udp_handler_max_size = tracking + 144;
 	constexpr std::size_t utp_handler_max_size = tracking + 168;
 	constexpr std::size_t abort_handler_max_size = tracking + 72;
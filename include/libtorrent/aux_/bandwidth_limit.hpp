@@ -60,7 +60,10 @@ struct TORRENT_EXTRA_EXPORT bandwidth_channel
 	}
 
 	int quota_left() const;
-	void update_quota(int dt_milliseconds);
+
+	// adds the quota for the given amount of time, according to the
+	// limit. Fractions of a byte are carried over to the next update
+	void update_quota(std::int64_t dt_microseconds);
 
 	// this is used when connections disconnect with
 	// some quota left. It's returned to its bandwidth
@@ -81,15 +84,25 @@ struct TORRENT_EXTRA_EXPORT bandwidth_channel
 		return false;
 	}
 
-	// used as temporary storage while distributing
-	// bandwidth
-	int tmp;
+	// the sum of the priorities of the requests queued in the
+	// bandwidth_manager that are limited by this channel. Maintained by the
+	// bandwidth_manager as requests are queued and dispatched
+	std::int64_t queued_priority;
+
+	// the bandwidth_manager's time (in microseconds) when update_quota()
+	// was last called for this channel. Quota is only added to the channel
+	// while it has requests queued
+	std::int64_t last_update;
 
 	// this is the number of bytes to distribute this round
 	int distribute_quota;
 
 private:
 
+	// the fraction of a byte (in millionths) left over from the last call
+	// to update_quota()
+	std::int64_t m_quota_fraction;
+
 	// this is the amount of bandwidth we have
 	// been assigned without using yet.
 	std::int64_t m_quota_left;
@@ -35,7 +35,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #define TORRENT_BANDWIDTH_MANAGER_HPP_INCLUDED
 
 #include <memory>
-#include <vector>
+#include <deque>
 
 #include "libtorrent/aux_/invariant_check.hpp"
 #include "libtorrent/assert.hpp"
@@ -50,6 +50,9 @@ namespace aux {
 struct TORRENT_EXTRA_EXPORT bandwidth_manager
 {
 	explicit bandwidth_manager(int channel);
+	~bandwidth_manager();
+	bandwidth_manager(bandwidth_manager const&) = delete;
+	bandwidth_manager& operator=(bandwidth_manager const&) = delete;
 
 	void close();
 
@@ -72,15 +75,31 @@ struct TORRENT_EXTRA_EXPORT bandwidth_manager
 	void check_invariant() const;
 #endif
 
+	// hands out the quota accrued over ``dt`` to the queued requests. Every
+	// queued request is visited once per call, so no peer waits more than
+	// one tick for its share
 	void update_quotas(time_duration const& dt);
 
 private:
 
-	// these are the consumers that want bandwidth
-	std::vector<bw_request> m_queue;
+	// adds and removes the request's priority to the bandwidth channels
+	// it's limited by
+	void add_channels(bw_request const& r);
+	void remove_channels(bw_request const& r);
+
+	// these are the consumers that want bandwidth, in round-robin order.
+	// A tick visits requests from the front, and puts the ones that still
+	// need more bandwidth at the back
+	std::deque<bw_request> m_queue;
 	// the number of bytes all the requests in queue are for
 	std::int64_t m_queued_bytes;
 
+	// the time, in microseconds, that quota has been handed out up to. This
+	// is the sum of all the dt passed to update_quotas(). Bandwidth channels
+	// are updated lazily, when a request limited by them is visited, for
+	// the time since their last update
+	std::int64_t m_time = 0;
+
 	// this is the channel within the consumers
 	// that bandwidth is assigned to (upload or download)
 	int m_channel;
@@ -63,7 +63,8 @@ struct TORRENT_EXTRA_EXPORT bw_request
 	int ttl;
 
 	// loops over the bandwidth channels and assigns bandwidth
-	// from the most limiting one
+	// from the most limiting one. The request gets its share of each
+	// channel's quota, in proportion to its priority
 	int assign_bandwidth();
 
 	static constexpr int max_bandwidth_channels = 10;
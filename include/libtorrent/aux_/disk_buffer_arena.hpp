@@ -0,0 +1,168 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_DISK_BUFFER_ARENA_HPP_INCLUDED
+#define TORRENT_DISK_BUFFER_ARENA_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/aux_/export.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace libtorrent {
+namespace aux {
+
+	// the memory backing disk buffers. Blocks are carved out of large slabs.
+	// Once there are more slabs than the retention limit, slabs whose blocks
+	// are all back in the central free list are returned to the system.
+	// Every thread allocating or freeing blocks (up to max_thread_caches of
+	// them) gets its own cache of free blocks, which it can use without any
+	// synchronization. Only when a cache runs empty, or full, does it move a
+	// batch of blocks from or to the central free list, under a mutex. When
+	// a thread exits, its caches are returned to the arenas they belong to.
+	struct TORRENT_EXTRA_EXPORT disk_buffer_arena
+	{
+		// the size of a slab is the size of a huge page on x86 and ARM
+		static constexpr int slab_size = 2 * 1024 * 1024;
+		static constexpr int blocks_per_slab = slab_size / 0x4000;
+
+		static constexpr int max_thread_caches = 16;
+		static constexpr int cache_capacity = 64;
+		static constexpr int cache_batch = cache_capacity / 2;
+
+		disk_buffer_arena();
+		~disk_buffer_arena();
+		disk_buffer_arena(disk_buffer_arena const&) = delete;
+		disk_buffer_arena& operator=(disk_buffer_arena const&) = delete;
+
+		// returns a block of default_block_size bytes, or nullptr if a new
+		// slab was needed but couldn't be allocated
+		char* allocate();
+		void free(char* buf);
+
+		// when enabled, new slabs are allocated as explicit huge pages, if
+		// possible, and otherwise are advised to be backed by transparent huge
+		// pages
+		void set_hugepages(bool enable);
+
+		// the number of slabs to keep around once they are free. Slabs beyond
+		// this are returned to the system as soon as all of their blocks are
+		// freed. 0 means no limit
+		void set_max_retained_slabs(int n);
+
+		struct stats
+		{
+			// number of slabs, and how many of them are explicit huge pages
+			int slabs = 0;
+			int hugepage_slabs = 0;
+
+			// free blocks in the central list and in the thread caches
+			int free_blocks = 0;
+			int cached_blocks = 0;
+
+			// the number of blocks served from a thread cache, and the number
+			// of times a thread cache was refilled from, or flushed to, the
+			// central free list
+			std::int64_t cache_hits = 0;
+			std::int64_t central_transfers = 0;
+		};
+
+		stats get_stats() const;
+
+		// called when a thread exits, to return its cache to the central free
+		// list and make it available to other threads
+		void release_cache(void* cache);
+
+	private:
+
+		struct alignas(64) thread_cache
+		{
+			std::atomic<std::thread::id> owner{};
+
+			// only the owner thread modifies these, the atomics are for
+			// get_stats()
+			std::atomic<int> size{0};
+			std::atomic<std::int64_t> hits{0};
+			std::array<char*, cache_capacity> blocks{};
+		};
+
+		struct slab
+		{
+			char* memory;
+			bool huge;
+
+			// the number of blocks of this slab in the central free list
+			int free;
+		};
+
+		thread_cache* local_cache();
+
+		// move blocks between a thread cache and the central list. Both
+		// return the new size of the cache
+		int refill(thread_cache& c);
+		int flush(thread_cache& c);
+
+		// m_mutex must be held for these
+		bool add_slab();
+		slab& slab_of(char const* block);
+		void push_free(char* block);
+		char* pop_free();
+		void release_free_slabs();
+
+		mutable std::mutex m_mutex;
+		std::vector<char*> m_free;
+
+		// sorted by address
+		std::vector<slab> m_slabs;
+		std::int64_t m_central_transfers = 0;
+		int m_max_retained_slabs = 0;
+
+		// the number of slabs whose blocks are all in m_free
+		int m_free_slabs = 0;
+
+		std::array<thread_cache, max_thread_caches> m_caches;
+
+		// identifies this arena in the thread local cache lookup, since
+		// another arena may be constructed at the same address
+		std::uint64_t const m_instance;
+
+		std::atomic<bool> m_hugepages{false};
+	};
+}
+}
+
+#endif
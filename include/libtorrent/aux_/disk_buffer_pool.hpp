@@ -42,12 +42,14 @@ POSSIBILITY OF SUCH DAMAGE.
 #endif
 #include <vector>
 #include <mutex>
+#include <atomic>
 #include <functional>
 #include <memory>
 
 #include "libtorrent/io_context.hpp"
 #include "libtorrent/span.hpp"
 #include "libtorrent/aux_/storage_utils.hpp" // for iovec_t
+#include "libtorrent/aux_/disk_buffer_arena.hpp"
 
 namespace libtorrent {
 
@@ -69,29 +71,30 @@ namespace aux {
 		void free_buffer(char* buf);
 		void free_multiple_buffers(span<char*> bufvec);
 
-		int in_use() const
-		{
-			std::unique_lock<std::mutex> l(m_pool_mutex);
-			return m_in_use;
-		}
+		int in_use() const { return m_in_use.load(std::memory_order_relaxed); }
+
+		disk_buffer_arena::stats arena_stats() const { return m_arena.get_stats(); }
 
 		void set_settings(settings_interface const& sett);
 
 	private:
 
-		void free_buffer_impl(char* buf, std::unique_lock<std::mutex>& l);
-		char* allocate_buffer_impl(std::unique_lock<std::mutex>& l, char const* category);
+		void free_buffer_impl(char* buf);
+		char* allocate_buffer_impl(char const* category);
+
+		// the memory the buffers are allocated from
+		disk_buffer_arena m_arena;
 
 		// number of disk buffers currently allocated
-		int m_in_use;
+		std::atomic<int> m_in_use;
 
 		// cache size limit
-		int m_max_use;
+		std::atomic<int> m_max_use;
 
 		// if we have exceeded the limit, we won't start
 		// allowing allocations again until we drop below
 		// this low watermark
-		int m_low_watermark;
+		std::atomic<int> m_low_watermark;
 
 		// if we exceed the max number of buffers, we start
 		// adding up callbacks to this queue. Once the number
@@ -99,23 +102,25 @@ namespace aux {
 		// we start calling these functions back
 		std::vector<std::weak_ptr<disk_observer>> m_observers;
 
-		// set to true to throttle more allocations
-		bool m_exceeded_max_size;
+		// set to true to throttle more allocations. It's only cleared, and
+		// m_observers only modified, with m_pool_mutex held
+		std::atomic<bool> m_exceeded_max_size;
 
 		// this is the main thread io_context. Callbacks are
 		// posted on this in order to have them execute in
 		// the main thread.
 		io_context& m_ios;
 
-		void check_buffer_level(std::unique_lock<std::mutex>& l);
+		void check_buffer_level();
 		void remove_buffer_in_use(char* buf);
 
-		mutable std::mutex m_pool_mutex;
+		std::mutex m_pool_mutex;
 
 		// this is specifically exempt from release_asserts
 		// since it's a quite costly check. Only for debug
 		// builds.
 #if TORRENT_USE_INVARIANT_CHECKS
+		std::mutex m_in_use_mutex;
 		std::set<char*> m_buffers_in_use;
 #endif
 #if TORRENT_USE_ASSERTS
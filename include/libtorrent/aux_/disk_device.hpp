@@ -0,0 +1,67 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_DISK_DEVICE_HPP_INCLUDED
+#define TORRENT_DISK_DEVICE_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/aux_/export.hpp"
+
+#include <cstdint>
+#include <string>
+
+namespace libtorrent {
+namespace aux {
+
+	// identifies the storage device a path lives on
+	struct disk_device
+	{
+		// the st_dev of the path. Paths with the same ID are on the same
+		// device (or at least the same file system)
+		std::uint64_t id = 0;
+
+		// true if the device is known to be a spinning disk. This is only
+		// detected on Linux, everything else is assumed to be solid state
+		bool rotational = false;
+
+		// false if the path (nor any of its parents) could be queried
+		bool valid = false;
+	};
+
+	// returns the device ``path`` is on. If ``path`` doesn't exist (yet), the
+	// device of its closest existing parent directory is returned, since
+	// that's where it will be created
+	TORRENT_EXTRA_EXPORT disk_device device_for_path(std::string path);
+}
+}
+
+#endif
@@ -44,6 +44,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/units.hpp"
 #include "libtorrent/session_types.hpp"
 #include "libtorrent/flags.hpp"
+#include "libtorrent/time.hpp"
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 #include <boost/variant/variant.hpp>
@@ -211,6 +212,10 @@ namespace aux {
 
 		move_flags_t move_flags = move_flags_t::always_replace_files;
 
+		// the time this job was put on a per-device job queue, to measure how
+		// long it waited for the device
+		time_point queued = min_time();
+
 #if TORRENT_USE_ASSERTS
 		bool in_use = false;
 
@@ -0,0 +1,136 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TORRENT_DISK_JOB_QUEUE_HPP_INCLUDED
+#define TORRENT_DISK_JOB_QUEUE_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/aux_/export.hpp"
+#include "libtorrent/tailqueue.hpp"
+#include "libtorrent/storage_defs.hpp" // for storage_index_t
+
+#include <cstdint>
+#include <map>
+#include <utility>
+
+namespace libtorrent {
+namespace aux {
+
+	struct disk_io_job;
+
+	// a queue of disk jobs waiting for a disk thread. Jobs are issued in the
+	// order they were queued, unless the queue is in elevator mode (for
+	// spinning disks). Then they are issued in ascending order of the
+	// position in the torrent they access, starting at the position of the
+	// last job issued and wrapping around to the lowest one at the end
+	// (C-SCAN). Jobs at the same position are issued in the order they were
+	// queued. Files are assumed to be laid out on disk in the same order as
+	// they are in the torrent.
+	struct TORRENT_EXTRA_EXPORT disk_job_queue
+	{
+		disk_job_queue() = default;
+		disk_job_queue(disk_job_queue const&) = delete;
+		disk_job_queue& operator=(disk_job_queue const&) = delete;
+
+		// may only be changed while the queue is empty
+		void set_elevator(bool e);
+		bool elevator() const { return m_elevator; }
+
+		// the limit of jobs taken off of this queue that haven't completed
+		// yet. 0 means no limit
+		void set_max_in_flight(int n) { m_max_in_flight = n; }
+
+		void push_back(disk_io_job* j);
+		void append(tailqueue<disk_io_job>& jobs);
+
+		// removes and returns the next job to issue. This does not count it
+		// as in flight, see job_started()
+		disk_io_job* pop_front();
+
+		// returns the job pop_front() would return next, without removing it
+		disk_io_job* front() const;
+
+		// the caller is responsible for calling job_started() when it starts
+		// executing a job taken off of this queue, and job_finished() when
+		// it completes
+		void job_started() { ++m_in_flight; }
+		void job_finished() { TORRENT_ASSERT(m_in_flight > 0); --m_in_flight; }
+		int num_in_flight() const { return m_in_flight; }
+
+		// true if there's a job a thread may start on
+		bool ready() const
+		{
+			return !empty() && (m_max_in_flight == 0 || m_in_flight < m_max_in_flight);
+		}
+
+		int size() const { return m_elevator ? int(m_sorted.size()) : m_jobs.size(); }
+		bool empty() const { return m_elevator ? m_sorted.empty() : m_jobs.empty(); }
+
+		// calls f for every queued job, in no particular order
+		template <typename Fun>
+		void for_each(Fun f)
+		{
+			for (auto i = m_jobs.iterate(); i.get(); i.next())
+				f(i.get());
+			for (auto const& e : m_sorted)
+				f(e.second);
+		}
+
+	private:
+
+		using position_t = std::pair<storage_index_t, std::int64_t>;
+
+		// the position in the torrent a job accesses
+		static position_t job_position(disk_io_job const* j);
+
+		// the job to issue next in elevator mode
+		std::multimap<position_t, disk_io_job*>::const_iterator next_sorted() const;
+
+		// jobs in the order they were queued. Used when not in elevator mode
+		tailqueue<disk_io_job> m_jobs;
+
+		// jobs ordered by the position they access. Used in elevator mode.
+		// Insertion keeps jobs with the same position in the order they were
+		// queued
+		std::multimap<position_t, disk_io_job*> m_sorted;
+
+		// the position of the last job issued in elevator mode
+		position_t m_head{};
+
+		int m_in_flight = 0;
+		int m_max_in_flight = 0;
+
+		bool m_elevator = false;
+	};
+}
+}
+
+#endif
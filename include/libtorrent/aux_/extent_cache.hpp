@@ -0,0 +1,132 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_EXTENT_CACHE_HPP_INCLUDED
+#define TORRENT_EXTENT_CACHE_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/aux_/export.hpp"
+#include "libtorrent/aux_/vector.hpp"
+#include "libtorrent/units.hpp"
+#include "libtorrent/download_priority.hpp"
+#include "libtorrent/sha1_hash.hpp"
+#include "libtorrent/span.hpp"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace libtorrent {
+
+	class file_storage;
+
+namespace aux {
+
+	// the ranges of a file that hold data, as opposed to being holes in a
+	// sparse file. Each range is [start, end), in ascending order
+	using data_extents = std::vector<std::pair<std::int64_t, std::int64_t>>;
+
+	// asks the file system which parts of the file hold data, using
+	// lseek(SEEK_DATA/SEEK_HOLE). Returns false if the file can't be opened or
+	// the file system can't tell. ``size`` is set to the size of the file.
+	// File systems without support for sparse files report the whole file
+	// as data. Always returns false on systems without SEEK_DATA, such as
+	// windows
+	TORRENT_EXTRA_EXPORT bool query_data_extents(std::string const& path
+		, std::int64_t& size, data_extents& ext);
+
+	// the hashes of ``len`` zero bytes. These are cached, since these are
+	// what the pieces in holes of sparse files hash to
+	TORRENT_EXTRA_EXPORT sha1_hash zero_hash(int len);
+	TORRENT_EXTRA_EXPORT sha256_hash zero_hash2(int len);
+
+	// sets the v2 block hashes of a piece of ``piece_size2`` zero bytes
+	TORRENT_EXTRA_EXPORT void zero_block_hashes(span<sha256_hash> hashes, int piece_size2);
+
+	// caches the data extents of the files of a torrent while it's being
+	// checked, to find pieces that were never written, and don't need to be
+	// read. Like the stat_cache, it's cleared before checking and when the
+	// files are released, to not use stale results
+	struct TORRENT_EXTRA_EXPORT extent_cache
+	{
+		// returns true if all of the piece is in holes of sparse files, or in
+		// pad files. Reading it would yield only zeros. Pieces overlapping
+		// files that don't exist, are shorter than expected or whose priority
+		// is 0 (they may be in the part file) are not considered holes, but
+		// have to be read to get the same errors as reading them would
+		bool piece_in_holes(file_storage const& fs, std::string const& save_path
+			, aux::vector<download_priority_t, file_index_t> const& prio
+			, piece_index_t piece);
+
+		// like piece_in_holes(), but never asks the file system. If the
+		// extents of any of the files the piece overlaps haven't been queried
+		// yet, it returns false
+		bool piece_in_known_holes(file_storage const& fs
+			, aux::vector<download_priority_t, file_index_t> const& prio
+			, piece_index_t piece);
+
+		void clear();
+
+	private:
+
+		struct file_entry
+		{
+			// set once the file system has been asked about this file
+			bool queried = false;
+
+			// false if the extents of the file could not be queried
+			bool valid = false;
+			std::int64_t size = 0;
+			data_extents extents;
+		};
+
+		// if save_path is nullptr, files whose extents haven't been queried
+		// yet are not considered holes
+		bool piece_in_holes_impl(file_storage const& fs, std::string const* save_path
+			, aux::vector<download_priority_t, file_index_t> const& prio
+			, piece_index_t piece);
+
+		// returns true if [offset, offset + len) of the file doesn't overlap
+		// any data. m_mutex must be held
+		bool range_in_holes(file_entry const& e, std::int64_t offset, std::int64_t len) const;
+
+		std::mutex m_mutex;
+
+		// one entry per file, allocated once the first piece is checked
+		aux::vector<file_entry, file_index_t> m_files;
+	};
+}
+}
+
+#endif
@@ -0,0 +1,153 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_IO_URING_HPP_INCLUDED
+#define TORRENT_IO_URING_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+
+#if TORRENT_HAVE_IO_URING
+
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/span.hpp"
+
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+#include <linux/io_uring.h>
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+
+#include <cstdint>
+
+namespace libtorrent {
+namespace aux {
+
+	// a minimal wrapper around a Linux io_uring instance, talking to the
+	// kernel via the raw system calls (i.e. without depending on liburing).
+	// The submission queue may only be used by a single thread at a time,
+	// and the completion queue may only be used by a single thread at a time.
+	// One thread may submit while another one is waiting for completions.
+	struct TORRENT_EXTRA_EXPORT io_uring_ring
+	{
+		// ``entries`` is the requested size of the submission queue. The
+		// completion queue is typically twice that size. If the kernel does not
+		// support io_uring, ``ec`` is set and the object is not usable.
+		io_uring_ring(std::uint32_t entries, error_code& ec);
+		~io_uring_ring();
+
+		io_uring_ring(io_uring_ring const&) = delete;
+		io_uring_ring& operator=(io_uring_ring const&) = delete;
+
+		explicit operator bool() const { return m_fd >= 0; }
+
+		std::uint32_t sq_entries() const { return m_sq_entries; }
+		std::uint32_t cq_entries() const { return m_cq_entries; }
+
+		// the number of submission queue entries that can be prepared before
+		// submit() has to be called
+		std::uint32_t sq_space_left() const;
+
+		// returns a zeroed submission queue entry, or nullptr if the submission
+		// queue is full. The entry is handed to the kernel on the next call to
+		// submit().
+		io_uring_sqe* get_sqe();
+
+		// hands all prepared submission queue entries to the kernel. Returns
+		// the number of entries consumed, or -1 and sets ``ec``.
+		int submit(error_code& ec);
+
+		// blocks until at least one completion is available. Returns false if
+		// the wait was interrupted by an error other than EINTR.
+		bool wait_cqe(error_code& ec);
+
+		// calls ``f`` for every available completion queue entry and then
+		// marks them as consumed. Returns the number of entries handled.
+		template <typename Fun>
+		int reap(Fun f)
+		{
+			std::uint32_t head = *m_cq_head;
+			std::uint32_t const tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+			int ret = 0;
+			for (; head != tail; ++head, ++ret)
+				f(m_cqes[head & *m_cq_mask]);
+			__atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+			return ret;
+		}
+
+		// registers a (possibly sparse, using -1) table of file descriptors.
+		// Submission queue entries flagged with IOSQE_FIXED_FILE refer to
+		// slots in this table instead of plain file descriptors.
+		bool register_files(span<int const> fds, error_code& ec);
+
+		// removes the registered file table, for a table of a different size
+		// to be registered. No submitted operation may refer to it.
+		bool unregister_files(error_code& ec);
+
+		// replaces the file descriptor in the specified slot of the
+		// registered file table. -1 clears the slot.
+		bool update_file(int slot, int fd, error_code& ec);
+
+	private:
+
+		void unmap_rings();
+
+		int m_fd = -1;
+
+		std::uint32_t m_sq_entries = 0;
+		std::uint32_t m_cq_entries = 0;
+
+		// the memory mappings of the rings and the submission entries
+		void* m_sq_ring = nullptr;
+		std::size_t m_sq_ring_size = 0;
+		void* m_cq_ring = nullptr;
+		std::size_t m_cq_ring_size = 0;
+		io_uring_sqe* m_sqes = nullptr;
+		std::size_t m_sqes_size = 0;
+
+		// pointers into the shared ring memory
+		std::uint32_t* m_sq_head = nullptr;
+		std::uint32_t* m_sq_tail = nullptr;
+		std::uint32_t const* m_sq_mask = nullptr;
+		std::uint32_t* m_sq_array = nullptr;
+		std::uint32_t* m_cq_head = nullptr;
+		std::uint32_t const* m_cq_tail = nullptr;
+		std::uint32_t const* m_cq_mask = nullptr;
+		io_uring_cqe const* m_cqes = nullptr;
+
+		// our local copy of the submission queue tail. Entries between
+		// *m_sq_tail and m_sqe_tail have been prepared but not yet submitted
+		std::uint32_t m_sqe_tail = 0;
+	};
+}
+}
+
+#endif // TORRENT_HAVE_IO_URING
+
+#endif
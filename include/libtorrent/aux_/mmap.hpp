@@ -171,6 +171,10 @@ namespace aux {
 			return m_mapping->memory();
 		}
 
+		// the mapping backing this view. Holding on to it keeps range()
+		// valid, even after the file has been closed by the file_view_pool
+		std::shared_ptr<void const> mapping() const { return m_mapping; }
+
 	private:
 		explicit file_view(std::shared_ptr<file_mapping> m) : m_mapping(std::move(m)) {}
 		std::shared_ptr<file_mapping> m_mapping;
@@ -0,0 +1,182 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_POSIX_FILE_POOL_HPP
+#define TORRENT_POSIX_FILE_POOL_HPP
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/units.hpp"
+#include "libtorrent/storage_defs.hpp"
+#include "libtorrent/aux_/storage_utils.hpp" // for iovec_t
+#include "libtorrent/aux_/open_mode.hpp"
+#include "libtorrent/aux_/time.hpp"
+#include "libtorrent/aux_/file_pointer.hpp"
+
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <string>
+
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+
+#define BOOST_BIND_NO_PLACEHOLDERS
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/sequenced_index.hpp>
+#include <boost/multi_index/member.hpp>
+
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+
+namespace libtorrent {
+
+class file_storage;
+struct open_file_state;
+
+namespace aux {
+
+	namespace mi = boost::multi_index;
+
+	// an open file, as held by the posix_file_pool. On POSIX systems this
+	// wraps a file descriptor, accessed with positional reads and writes
+	// (pread() and pwritev()), so the same descriptor can be shared by any
+	// number of outstanding requests. On windows it wraps a FILE* and seeks
+	// before every access.
+	struct TORRENT_EXTRA_EXPORT posix_file
+	{
+#ifdef TORRENT_WINDOWS
+		explicit posix_file(FILE* f) : m_file(f) {}
+#else
+		explicit posix_file(int fd) : m_fd(fd) {}
+		~posix_file();
+#endif
+		posix_file(posix_file const&) = delete;
+		posix_file& operator=(posix_file const&) = delete;
+
+		// returns the number of bytes read. A short read means we hit the end
+		// of the file. Returns -1 on error and sets ``ec``.
+		int readv(std::int64_t offset, span<iovec_t const> bufs, error_code& ec);
+
+		// returns the number of bytes written, or -1 on error (and sets
+		// ``ec``)
+		int writev(std::int64_t offset, span<iovec_t const> bufs, error_code& ec);
+
+#ifdef TORRENT_WINDOWS
+		FILE* file() const { return m_file.file(); }
+	private:
+		file_pointer m_file;
+#else
+		int fd() const { return m_fd; }
+	private:
+		int m_fd;
+#endif
+	};
+
+	// this is an LRU cache of open files used by posix_storage. The number of
+	// files it keeps open is bounded by the ``file_pool_size`` setting. It's
+	// shared by all posix_storage objects belonging to the same disk I/O
+	// subsystem.
+	struct TORRENT_EXTRA_EXPORT posix_file_pool
+	{
+		// ``size`` specifies the number of allowed files handles
+		// to hold open at any given time.
+		explicit posix_file_pool(int size = 40);
+		~posix_file_pool();
+
+		posix_file_pool(posix_file_pool const&) = delete;
+		posix_file_pool& operator=(posix_file_pool const&) = delete;
+
+		// return an open file handle to file at ``file_index`` in the
+		// file_storage ``fs`` opened at save path ``p``. If the file is not
+		// already open, it's opened with mode ``m``. A file opened for writing
+		// is created if it doesn't exist, along with any missing directories.
+		// On failure, ``ec`` is set and the operation that failed is stored in
+		// ``op``.
+		std::shared_ptr<posix_file> open_file(storage_index_t st, std::string const& p
+			, file_index_t file_index, file_storage const& fs, open_mode_t m
+			, error_code& ec, operation_t& op);
+
+		// release all files belonging to the specified storage (``st``). The
+		// overload that takes ``file_index`` releases only the file with that
+		// index in storage ``st``. Files that are currently being accessed are
+		// closed once the last reference goes away.
+		void release();
+		void release(storage_index_t st);
+		void release(storage_index_t st, file_index_t file_index);
+
+		// update the allowed number of open file handles to ``size``.
+		void resize(int size);
+
+		// returns the current limit of number of allowed open file handles held
+		// by the posix_file_pool.
+		int size_limit() const { return m_size; }
+
+		std::vector<open_file_state> get_status(storage_index_t st) const;
+
+	private:
+
+		std::shared_ptr<posix_file> remove_oldest(std::unique_lock<std::mutex>&);
+
+		int m_size;
+
+		using file_id = std::pair<storage_index_t, file_index_t>;
+
+		struct file_entry
+		{
+			file_entry(file_id k, std::shared_ptr<posix_file> f, open_mode_t const m)
+				: key(k), file(std::move(f)), mode(m) {}
+
+			file_id key;
+			std::shared_ptr<posix_file> file;
+			time_point last_use{aux::time_now()};
+			open_mode_t mode{};
+		};
+
+		using files_container = mi::multi_index_container<
+			file_entry,
+			mi::indexed_by<
+			// look up files by (torrent, file) key
+			mi::ordered_unique<mi::member<file_entry, file_id, &file_entry::key>>,
+			// look up files by least recently used
+			mi::sequenced<>
+			>
+		>;
+
+		// maps storage index, file index pairs to the lru entry for the file
+		files_container m_files;
+		mutable std::mutex m_mutex;
+	};
+
+}
+}
+
+#endif
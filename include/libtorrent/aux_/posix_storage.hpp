@@ -41,8 +41,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/aux_/storage_utils.hpp" // for iovec_t
 #include "libtorrent/hex.hpp" // to_hex
 #include "libtorrent/aux_/open_mode.hpp" // for aux::open_mode_t
-#include "libtorrent/aux_/file_pointer.hpp"
+#include "libtorrent/aux_/posix_file_pool.hpp"
 #include "libtorrent/aux_/posix_part_file.hpp"
+#include "libtorrent/aux_/extent_cache.hpp"
 #include <memory>
 #include <string>
 
@@ -53,7 +54,7 @@ namespace aux {
 
 	struct TORRENT_EXTRA_EXPORT posix_storage
 	{
-		explicit posix_storage(storage_params const& p);
+		posix_storage(storage_params const& p, posix_file_pool& pool);
 		file_storage const& files() const;
 		file_storage const& orig_files() const { return m_files; }
 		~posix_storage();
@@ -86,9 +87,24 @@ namespace aux {
 
 		void initialize(settings_interface const&, storage_error& ec);
 
+		void set_storage_index(storage_index_t st) { m_storage_index = st; }
+		storage_index_t storage_index() const { return m_storage_index; }
+
+		std::vector<open_file_state> get_status() const;
+
+		std::string const& save_path() const { return m_save_path; }
+
+		// returns true if reads and writes to this file are redirected to the
+		// part file, because the file has priority 0
+		bool uses_partfile(file_index_t index) const;
+
+		// returns true if the piece is entirely in holes of sparse files, and
+		// was never written. Used when checking the files
+		bool piece_in_holes(piece_index_t piece);
+
 	private:
 
-		file_pointer open_file(file_index_t idx, open_mode_t mode, std::int64_t offset
+		std::shared_ptr<posix_file> open_file(file_index_t idx, open_mode_t mode
 			, storage_error& ec);
 
 		void need_partfile();
@@ -99,6 +115,7 @@ namespace aux {
 		std::unique_ptr<file_storage> m_mapped_files;
 		std::string m_save_path;
 		stat_cache m_stat_cache;
+		extent_cache m_extent_cache;
 
 		aux::vector<download_priority_t, file_index_t> m_file_priority;
 
@@ -115,6 +132,11 @@ namespace aux {
 
 		std::string m_part_file_name;
 		std::unique_ptr<posix_part_file> m_part_file;
+
+		// the file pool is shared by all storages belonging to the same disk
+		// I/O subsystem. Files in it are keyed by our storage index
+		posix_file_pool& m_pool;
+		storage_index_t m_storage_index{0};
 	};
 }
 }
@@ -0,0 +1,93 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TORRENT_RESUME_JOURNAL_HPP_INCLUDED
+#define TORRENT_RESUME_JOURNAL_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/aux_/export.hpp"
+#include "libtorrent/units.hpp"
+#include "libtorrent/socket.hpp" // for tcp::endpoint
+#include "libtorrent/fwd.hpp"
+
+#include <vector>
+
+namespace libtorrent {
+namespace aux {
+
+	// the changes to a torrent's resume data since the last record that was
+	// saved for it. The torrent marks fields as changed as they change, and
+	// journal records (see torrent_handle::journal) only hold the fields
+	// marked here, plus the small ones that are always saved.
+	struct TORRENT_EXTRA_EXPORT resume_journal
+	{
+		// resets the journal once a record with the state in ``atp`` has been
+		// saved. ``num_have`` is the number of pieces we have as of that
+		// record
+		void saved(add_torrent_params const& atp, int num_have);
+
+		// the pieces we have gained since the last record, in the order we
+		// got them
+		std::vector<piece_index_t> have;
+
+		// the number of pieces we had as of the last record. If the number of
+		// pieces we have now is not this plus the size of ``have``, we have
+		// lost some, and the have-bitfield is saved in full
+		int num_have = 0;
+
+		// the peers and banned peers saved in the last record, sorted. Peers
+		// come and go in the peer list all the time, so rather than tracking
+		// every change, the peers picked for a record are compared against
+		// these
+		std::vector<tcp::endpoint> peers;
+		std::vector<tcp::endpoint> banned_peers;
+
+		// set once a full record with the torrent's metadata has been saved,
+		// which journal records can be appended to
+		bool active = false;
+
+		// these fields have changed in ways not tracked above, and are saved
+		// in full
+		bool pieces = false;
+		bool file_priorities = false;
+		bool piece_priorities = false;
+	};
+
+	// returns a journal record for the resume data in ``atp``. The
+	// have-bitfield and the file- and piece priorities are only saved if
+	// ``journal`` marks them as changed, and only the pieces we have gained
+	// and the peers that were added or removed otherwise.
+	TORRENT_EXTRA_EXPORT std::vector<char> write_resume_journal(
+		add_torrent_params const& atp, resume_journal const& journal);
+}
+}
+
+#endif
@@ -87,6 +87,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/extensions.hpp"
 #include "libtorrent/aux_/portmap.hpp"
 #include "libtorrent/aux_/lsd.hpp"
+#include "libtorrent/aux_/timer_wheel.hpp"
 #include "libtorrent/io_context.hpp"
 #include "libtorrent/flags.hpp"
 #include "libtorrent/span.hpp"
@@ -417,6 +418,7 @@ namespace aux {
 			{ return m_peer_allocator; }
 
 			io_context& get_context() override { return m_io_context; }
+			timer_wheel& peer_timers() override { return m_peer_timers; }
 			resolver_interface& get_resolver() override { return m_host_resolver; }
 
 			aux::vector<torrent*>& torrent_list(torrent_list_index_t i) override
@@ -971,6 +973,10 @@ namespace aux {
 			// ordered by their queue position
 			aux::vector<torrent*, queue_position_t> m_download_queue;
 
+			// peer connections that have timeouts or other periodic work due
+			// are ticked from here, rather than ticking every peer every second
+			timer_wheel m_peer_timers;
+
 			// peer connections are put here when disconnected to avoid
 			// race conditions with the disk thread. It's important that
 			// peer connections are destructed from the network thread,
@@ -1221,6 +1227,10 @@ namespace aux {
 
 			void on_udp_writeable(std::weak_ptr<session_udp_socket> s, error_code const& ec);
 
+			// sends the packets queued up on the socket while processing
+			// incoming packets
+			void flush_udp_batch(std::shared_ptr<session_udp_socket> const& s);
+
 			void on_udp_packet(std::weak_ptr<session_udp_socket> s
 				, std::weak_ptr<listen_socket_t> ls
 				, transport ssl, error_code const& ec);
@@ -78,6 +78,7 @@ namespace aux {
 	struct bandwidth_manager;
 	struct resolver_interface;
 	struct alert_manager;
+	struct timer_wheel;
 }
 
 	// hidden
@@ -155,6 +156,10 @@ namespace aux {
 
 		virtual torrent_peer_allocator_interface& get_peer_allocator() = 0;
 		virtual io_context& get_context() = 0;
+
+		// peer connections schedule themselves here, to have second_tick()
+		// called when they have work due. One tick is one second
+		virtual aux::timer_wheel& peer_timers() = 0;
 		virtual aux::resolver_interface& get_resolver() = 0;
 
 		virtual bool has_connection(peer_connection* p) const = 0;
@@ -0,0 +1,125 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_SHA_MULTI_HPP_INCLUDED
+#define TORRENT_SHA_MULTI_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/sha1_hash.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/span.hpp"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace libtorrent {
+namespace aux {
+
+	// the implementations of sha1_multi() and sha256_multi(). By default, the
+	// fastest one supported by the CPU is used. Picking one explicitly is
+	// meant for tests. If the CPU doesn't support the one asked for, the
+	// portable implementation is used.
+	enum class sha_multi_impl : std::uint8_t
+	{
+		automatic,
+
+		// hasher and hasher256
+		portable,
+
+		// the SHA extensions, one buffer at a time
+		sha_ni,
+
+		// 8 buffers at a time, in the lanes of AVX2 registers
+		avx2,
+	};
+
+	// these hash a number of independent buffers. The digest of ``bufs[i]``
+	// is stored in ``out[i]``. Where the CPU supports it (see cpuid.hpp), the
+	// buffers are hashed using the SHA extensions, or several at a time, in
+	// lockstep, in the lanes of AVX2 registers. Buffers of the same size
+	// should be adjacent, since only buffers with the same number of (SHA)
+	// blocks can share a batch. ``out`` must not overlap any of the buffers.
+	TORRENT_EXTRA_EXPORT void sha1_multi(span<span<char const> const> bufs
+		, span<sha1_hash> out, sha_multi_impl impl = sha_multi_impl::automatic);
+	TORRENT_EXTRA_EXPORT void sha256_multi(span<span<char const> const> bufs
+		, span<sha256_hash> out, sha_multi_impl impl = sha_multi_impl::automatic);
+
+	// computes the SHA-1 of a number of streams at the same time. Each call
+	// to update() appends one buffer to every stream, and the streams are
+	// hashed together, the same way sha1_multi() hashes its buffers. This is
+	// used to hash several v1 pieces a block at a time, without holding
+	// whole pieces in memory.
+	struct TORRENT_EXTRA_EXPORT sha1_multi_context
+	{
+		explicit sha1_multi_context(int num_streams
+			, sha_multi_impl impl = sha_multi_impl::automatic);
+
+		// appends ``bufs[i]`` to stream ``i``. There must be one buffer per
+		// stream, but they may be empty. Streams are hashed in lockstep as
+		// long as their buffers are the same size, which makes a multiple of
+		// 64 bytes the most efficient
+		void update(span<span<char const> const> bufs);
+
+		// stores the digest of stream ``i`` in ``out[i]``. The context can't
+		// be updated after this
+		void final(span<sha1_hash> out);
+
+	private:
+
+		struct stream
+		{
+			std::array<std::uint32_t, 5> state;
+
+			// the bytes of the SHA-1 block that isn't complete yet
+			std::array<char, 64> pending;
+			int pending_len = 0;
+
+			// the total number of bytes in the stream
+			std::uint64_t length = 0;
+		};
+
+		sha_multi_impl m_impl;
+		std::vector<stream> m_streams;
+
+		// the streams, when using the portable implementation
+		std::vector<hasher> m_hashers;
+	};
+
+	// returns true if sha1_multi() and sha256_multi() are faster than hashing
+	// the buffers one at a time with hasher and hasher256, i.e. if it's worth
+	// gathering buffers to hash them together.
+	TORRENT_EXTRA_EXPORT bool sha_multi_accelerated();
+}
+}
+
+#endif
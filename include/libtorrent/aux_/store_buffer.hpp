@@ -35,6 +35,9 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <unordered_map>
 #include <mutex>
+#include <array>
+#include <atomic>
+#include <cstdint>
 
 #include "libtorrent/storage_defs.hpp"
 
@@ -88,14 +91,21 @@ struct hash<libtorrent::aux::torrent_location>
 namespace libtorrent {
 namespace aux {
 
+// the store buffer holds blocks that have been handed to the disk subsystem
+// for writing, but not yet written. Until they are, reads and hashes of those
+// blocks must be served from these buffers.
+// It is accessed from the network thread as well as all disk threads, so the
+// map is partitioned into shards, each protected by its own mutex. All blocks
+// of the same piece belong to the same shard.
 struct store_buffer
 {
 	template <typename Fun>
 	bool get(torrent_location const loc, Fun f) const
 	{
-		std::unique_lock<std::mutex> l(m_mutex);
-		auto const it = m_store_buffer.find(loc);
-		if (it != m_store_buffer.end())
+		shard const& s = m_shards[shard_index(loc)];
+		auto const l = lock(s);
+		auto const it = s.blocks.find(loc);
+		if (it != s.blocks.end())
 		{
 			f(it->second);
 			return true;
@@ -106,11 +116,21 @@ struct store_buffer
 	template <typename Fun>
 	int get2(torrent_location const loc1, torrent_location const loc2, Fun f) const
 	{
-		std::unique_lock<std::mutex> l(m_mutex);
-		auto const it1 = m_store_buffer.find(loc1);
-		auto const it2 = m_store_buffer.find(loc2);
-		char const* buf1 = (it1 == m_store_buffer.end()) ? nullptr : it1->second;
-		char const* buf2 = (it2 == m_store_buffer.end()) ? nullptr : it2->second;
+		std::size_t const idx1 = shard_index(loc1);
+		std::size_t const idx2 = shard_index(loc2);
+		shard const& s1 = m_shards[idx1];
+		shard const& s2 = m_shards[idx2];
+
+		// if the locations belong to different shards, always lock them in
+		// the same order, to avoid deadlocks
+		std::unique_lock<std::mutex> l1 = lock(idx1 <= idx2 ? s1 : s2);
+		std::unique_lock<std::mutex> l2;
+		if (idx1 != idx2) l2 = lock(idx1 <= idx2 ? s2 : s1);
+
+		auto const it1 = s1.blocks.find(loc1);
+		auto const it2 = s2.blocks.find(loc2);
+		char const* buf1 = (it1 == s1.blocks.end()) ? nullptr : it1->second;
+		char const* buf2 = (it2 == s2.blocks.end()) ? nullptr : it2->second;
 
 		if (buf1 == nullptr && buf2 == nullptr)
 			return 0;
@@ -120,22 +140,56 @@ struct store_buffer
 
 	void insert(torrent_location const loc, char const* buf)
 	{
-		std::lock_guard<std::mutex> l(m_mutex);
-		m_store_buffer.insert({loc, buf});
+		shard& s = m_shards[shard_index(loc)];
+		auto const l = lock(s);
+		s.blocks.insert({loc, buf});
 	}
 
 	void erase(torrent_location const loc)
 	{
-		std::lock_guard<std::mutex> l(m_mutex);
-		auto it = m_store_buffer.find(loc);
-		TORRENT_ASSERT(it != m_store_buffer.end());
-		m_store_buffer.erase(it);
+		shard& s = m_shards[shard_index(loc)];
+		auto const l = lock(s);
+		auto it = s.blocks.find(loc);
+		TORRENT_ASSERT(it != s.blocks.end());
+		s.blocks.erase(it);
 	}
 
+	// the number of times a thread had to wait for another thread to release
+	// the lock of a shard
+	std::int64_t lock_contention() const
+	{ return m_contention.load(std::memory_order_relaxed); }
+
 private:
 
-	mutable std::mutex m_mutex;
-	std::unordered_map<torrent_location, char const*> m_store_buffer;
+	struct shard
+	{
+		mutable std::mutex mutex;
+		std::unordered_map<torrent_location, char const*> blocks;
+	};
+
+	static constexpr std::size_t num_shards = 32;
+
+	static std::size_t shard_index(torrent_location const& loc)
+	{
+		std::size_t ret = 0;
+		boost::hash_combine(ret, std::hash<storage_index_t>{}(loc.torrent));
+		boost::hash_combine(ret, std::hash<piece_index_t>{}(loc.piece));
+		return ret % num_shards;
+	}
+
+	std::unique_lock<std::mutex> lock(shard const& s) const
+	{
+		std::unique_lock<std::mutex> l(s.mutex, std::try_to_lock);
+		if (!l.owns_lock())
+		{
+			m_contention.fetch_add(1, std::memory_order_relaxed);
+			l.lock();
+		}
+		return l;
+	}
+
+	std::array<shard, num_shards> m_shards;
+	mutable std::atomic<std::int64_t> m_contention{0};
 };
 
 }
@@ -0,0 +1,145 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_TIMER_WHEEL_HPP_INCLUDED
+#define TORRENT_TIMER_WHEEL_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/aux_/export.hpp"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace libtorrent {
+namespace aux {
+
+	struct timer_wheel;
+
+	// an object that can be scheduled in a timer_wheel. Scheduled objects
+	// derive from this, and the wheel refers to them by pointer. An entry
+	// that's destructed while scheduled removes itself from the wheel.
+	struct TORRENT_EXTRA_EXPORT timer_wheel_entry
+	{
+		timer_wheel_entry() = default;
+		timer_wheel_entry(timer_wheel_entry const&) = delete;
+		timer_wheel_entry& operator=(timer_wheel_entry const&) = delete;
+		~timer_wheel_entry();
+
+		bool scheduled() const { return m_wheel != nullptr; }
+
+		// the tick this entry is due at. Only meaningful while it's scheduled,
+		// and in the callback it's fired from
+		std::int64_t due() const { return m_due; }
+
+	private:
+		friend struct timer_wheel;
+
+		timer_wheel* m_wheel = nullptr;
+		std::int64_t m_due = 0;
+
+		// the slot this entry is in, and its index in the slot
+		std::int32_t m_slot = 0;
+		std::int32_t m_pos = 0;
+	};
+
+	// a hierarchical timer wheel. Time is counted in ticks, and moved forward
+	// by advance(). There are 4 levels of 64 slots each. The first level has
+	// one slot per tick, and every slot of the following levels spans all
+	// slots of the level below it. Entries are moved down a level each time
+	// the level below has gone through all its slots, so advancing the wheel
+	// only touches entries that are due or about to be. Scheduling and
+	// cancelling are constant time.
+	//
+	// The slots are arrays of pointers rather than linked lists, so that the
+	// entries due at a tick can be fetched from memory in parallel, instead of
+	// one after the other.
+	struct TORRENT_EXTRA_EXPORT timer_wheel
+	{
+		explicit timer_wheel(std::int64_t now = 0);
+		~timer_wheel();
+		timer_wheel(timer_wheel const&) = delete;
+		timer_wheel& operator=(timer_wheel const&) = delete;
+
+		// schedules ``e`` to fire at tick ``due``. If it's already scheduled,
+		// it's moved. An entry that's due at the current tick, or earlier,
+		// fires at the next tick.
+		void schedule(timer_wheel_entry& e, std::int64_t due);
+		void cancel(timer_wheel_entry& e);
+
+		// moves the wheel forward to tick ``now``, calling ``f(e)`` for every
+		// entry that's due, one tick at a time. The entry is no longer
+		// scheduled when ``f`` is called, and ``f`` may schedule or cancel
+		// any entry, including the one it's called for. The order entries
+		// due at the same tick are fired in is unspecified.
+		template <typename Fun>
+		void advance(std::int64_t const now, Fun&& f)
+		{
+			while (m_now < now)
+			{
+				step(now);
+				while (timer_wheel_entry* e = pop_expired())
+					f(*e);
+			}
+		}
+
+		std::int64_t now() const { return m_now; }
+		int size() const { return m_size; }
+		bool empty() const { return m_size == 0; }
+
+	private:
+
+		static constexpr int slot_bits = 6;
+		static constexpr int num_slots = 1 << slot_bits;
+		static constexpr int num_levels = 4;
+
+		void step(std::int64_t now);
+		timer_wheel_entry* pop_expired();
+		void insert(timer_wheel_entry& e);
+		void unlink(timer_wheel_entry& e);
+
+		// all slots, level by level. The level 0 slot of the current tick
+		// holds the entries that are due, and are handed out by advance()
+		std::array<std::vector<timer_wheel_entry*>, num_slots * num_levels> m_slots;
+
+		// the entries of a slot that's being moved down a level. This is only
+		// a member to keep its allocation around
+		std::vector<timer_wheel_entry*> m_cascade;
+
+		// the current tick
+		std::int64_t m_now;
+		int m_size = 0;
+	};
+}
+}
+
+#endif
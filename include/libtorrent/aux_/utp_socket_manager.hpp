@@ -36,8 +36,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #ifndef TORRENT_UTP_SOCKET_MANAGER_HPP_INCLUDED
 #define TORRENT_UTP_SOCKET_MANAGER_HPP_INCLUDED
 
-#include <map>
 #include <functional>
+#include <memory>
+#include <vector>
 
 #include "libtorrent/aux_/socket_type.hpp"
 #include "libtorrent/session_status.hpp"
@@ -45,6 +46,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/aux_/session_settings.hpp"
 #include "libtorrent/span.hpp"
 #include "libtorrent/aux_/packet_pool.hpp"
+#include "libtorrent/aux_/utp_socket_table.hpp"
 
 namespace libtorrent {
 
@@ -63,7 +65,7 @@ namespace aux {
 		virtual ~utp_socket_interface() = default;
 	};
 
-	struct utp_socket_manager
+	struct TORRENT_EXTRA_EXPORT utp_socket_manager
 	{
 		using send_fun_t = std::function<void(std::weak_ptr<utp_socket_interface>
 			, udp::endpoint const&
@@ -101,10 +103,12 @@ namespace aux {
 
 		void remove_udp_socket(std::weak_ptr<utp_socket_interface> sock);
 
-		// internal, used by utp_stream
-		void remove_socket(std::uint16_t id);
-
 		utp_socket_impl* new_utp_socket(utp_stream* str);
+
+		// internal, used by utp_socket_impl once the remote endpoint of an
+		// outgoing connection is known. Incoming packets are only routed to
+		// sockets that have been bound
+		void bind_socket(utp_socket_impl* s);
 		int gain_factor() const { return m_sett.get_int(settings_pack::utp_gain_factor); }
 		int target_delay() const { return m_sett.get_int(settings_pack::utp_target_delay) * 1000; }
 		int syn_resends() const { return m_sett.get_int(settings_pack::utp_syn_resends); }
@@ -148,9 +152,13 @@ namespace aux {
 		send_fun_t m_send_fun;
 		incoming_utp_callback_t m_cb;
 
-		// replace with a hash-map
-		using socket_map_t = std::multimap<std::uint16_t, std::unique_ptr<utp_socket_impl>>;
-		socket_map_t m_utp_sockets;
+		// all uTP sockets, in no particular order
+		std::vector<std::unique_ptr<utp_socket_impl>> m_utp_sockets;
+
+		// the sockets whose remote endpoint is known, indexed by (remote
+		// endpoint, receive connection ID). This is what incoming packets are
+		// looked up in
+		utp_socket_table m_socket_index;
 
 		using socket_vector_t = std::vector<utp_socket_impl*>;
 
@@ -0,0 +1,99 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_UTP_SOCKET_TABLE_HPP_INCLUDED
+#define TORRENT_UTP_SOCKET_TABLE_HPP_INCLUDED
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/aux_/export.hpp"
+#include "libtorrent/socket.hpp" // for udp::endpoint
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace libtorrent {
+namespace aux {
+
+	struct utp_socket_impl;
+
+	// maps (remote endpoint, receive connection ID) to the uTP socket incoming
+	// packets should be delivered to. This is a flat open-addressing hash
+	// table with linear probing. The full key is stored in the slots, so a
+	// lookup only touches the (contiguous) slot array, and never the sockets
+	// themselves. The table does not own the sockets.
+	struct TORRENT_EXTRA_EXPORT utp_socket_table
+	{
+		// returns the socket for this key, or nullptr if there is none
+		utp_socket_impl* find(udp::endpoint const& ep, std::uint16_t id) const;
+
+		// returns false if there already is a socket with this key. In that
+		// case, the existing socket is left in place
+		bool insert(udp::endpoint const& ep, std::uint16_t id, utp_socket_impl* s);
+
+		// removes the entry for this key, but only if it maps to s. Returns
+		// true if the entry was removed
+		bool erase(udp::endpoint const& ep, std::uint16_t id, utp_socket_impl const* s);
+
+		int size() const { return m_size; }
+		bool empty() const { return m_size == 0; }
+		void clear();
+
+	private:
+
+		struct slot
+		{
+			// IPv4 addresses are stored in the first 4 bytes
+			std::array<std::uint8_t, 16> addr;
+			std::uint16_t port;
+			std::uint16_t id;
+			bool v4;
+			// nullptr means the slot is empty
+			utp_socket_impl* socket = nullptr;
+		};
+
+		static slot make_key(udp::endpoint const& ep, std::uint16_t id);
+		static bool same_key(slot const& lhs, slot const& rhs);
+		static std::uint64_t hash(slot const& k);
+		std::size_t home_slot(slot const& k) const;
+		std::size_t find_slot(slot const& k) const;
+		void grow();
+
+		// the number of slots is always 0 or a power of two, and it's kept at
+		// most half full, to keep the probe sequences short
+		std::vector<slot> m_slots;
+		int m_size = 0;
+	};
+}
+}
+
+#endif
@@ -0,0 +1,168 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_WRITE_HASHER_HPP_INCLUDED
+#define TORRENT_WRITE_HASHER_HPP_INCLUDED
+
+#include <unordered_map>
+#include <mutex>
+#include <array>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/sha1_hash.hpp"
+#include "libtorrent/bitfield.hpp"
+#include "libtorrent/disk_buffer_holder.hpp"
+#include "libtorrent/units.hpp"
+#include "libtorrent/aux_/store_buffer.hpp" // for torrent_location
+#include "libtorrent/aux_/vector.hpp"
+
+namespace libtorrent {
+namespace aux {
+
+// keeps the hash state of pieces while their blocks are being written, to be
+// able to hash a piece without reading it back from disk once it's complete.
+// This is used by mmap_disk_io when the hash_on_write setting is enabled.
+//
+// The SHA-1 hash of a v1 piece has to be computed over the blocks in order.
+// Blocks that are written out of order are held in a small staging area until
+// the blocks before them have been written. When the staging area is full,
+// they are dropped, and read back when the piece is hashed, just like the
+// blocks that haven't been written yet by then. The SHA-256 hashes of v2
+// blocks are independent of each other, and computed as they are written.
+//
+// Like the store_buffer, the pieces are partitioned into shards, each
+// protected by its own mutex.
+struct TORRENT_EXTRA_EXPORT write_hasher
+{
+	// the hashes of a piece, computed from the blocks written to it so far
+	struct piece_state
+	{
+		// the SHA-1 hash of the first v1_blocks blocks of the piece
+		hasher h;
+		int v1_blocks = 0;
+
+		// the SHA-256 hashes of the v2 blocks of the piece. Only the ones
+		// whose bit is set in v2_hashed have been written
+		aux::vector<sha256_hash> v2_hashes;
+		typed_bitfield<int> v2_hashed;
+
+		// blocks that have been written, but not yet fed into h, because
+		// blocks before them haven't been written yet
+		struct staged_block
+		{
+			int block;
+			int len;
+			disk_buffer_holder buffer;
+		};
+		std::vector<staged_block> staged;
+
+		// set if a block was written more than once. The hashes may not
+		// match what's on disk anymore, and can't be used
+		bool invalid = false;
+
+		// set once the piece has been hashed. The entry is kept around until
+		// the writes that were outstanding at that point have completed, so
+		// that they don't start a new one. outstanding_writes may go negative
+		// until writes_counted is set, by hashed()
+		bool hashed = false;
+		bool writes_counted = false;
+		int outstanding_writes = 0;
+
+		// the value of the shard's clock when a block of this piece was last
+		// written. When a shard is full, the least recently written piece is
+		// evicted
+		std::uint64_t last_use = 0;
+
+		bool has_v2_hash(int const block) const
+		{ return block < v2_hashed.size() && v2_hashed.get_bit(block); }
+	};
+
+	// the maximum number of pieces to keep hash state for
+	static constexpr int max_pieces = 1024;
+
+	// the maximum number of out of order blocks to keep in the staging area,
+	// across all pieces
+	static constexpr int max_staged_blocks = 128;
+
+	// called once the block at ``loc`` has been written to disk. ``buffer``
+	// holds the block. ``v1_len`` is the number of bytes of the block that
+	// belong to the v1 piece, or 0 if no v1 hash is needed, ``v2_len`` is
+	// the size of the v2 block, or 0 if no v2 hash is needed for it. If the
+	// block is staged, the buffer is moved into the staging area.
+	void block_written(torrent_location loc, disk_buffer_holder& buffer
+		, int v1_len, int v2_len, int blocks_in_piece2);
+
+	// moves the hash state of the piece into ``st``, to be completed by the
+	// caller. Returns false if there is no (valid) state for the piece. Either
+	// way, the caller must call hashed() when done, with the number of blocks
+	// of the piece that were still waiting to be written.
+	bool take(storage_index_t storage, piece_index_t piece, piece_state& st);
+	void hashed(storage_index_t storage, piece_index_t piece, int outstanding_writes);
+
+	// discards the hash state of a piece, or of all pieces of a storage
+	void clear_piece(storage_index_t storage, piece_index_t piece);
+	void clear_storage(storage_index_t storage);
+	void clear();
+
+	// the number of blocks currently in the staging area
+	int num_staged() const { return m_num_staged.load(std::memory_order_relaxed); }
+
+private:
+
+	struct shard
+	{
+		std::mutex mutex;
+		// the offset of the key is always 0
+		std::unordered_map<torrent_location, piece_state> pieces;
+		std::uint64_t clock = 0;
+	};
+
+	static constexpr std::size_t num_shards = 32;
+
+	static std::size_t shard_index(storage_index_t storage, piece_index_t piece);
+
+	void evict_piece(shard& s);
+	void feed_staged(piece_state& st);
+	void release_staged(piece_state& st);
+
+	std::array<shard, num_shards> m_shards;
+	std::atomic<int> m_num_staged{0};
+};
+
+}
+}
+
+#endif
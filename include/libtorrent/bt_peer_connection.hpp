@@ -191,6 +191,7 @@ namespace libtorrent {
 
 		void get_specific_peer_info(peer_info& p) const override;
 		bool in_handshake() const override;
+		bool can_send_references() const override;
 		bool packet_finished() const { return m_recv_buffer.packet_finished(); }
 
 		bool supports_holepunch() const { return m_holepunch_id != 0; }
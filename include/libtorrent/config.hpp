@@ -134,6 +134,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 // non-Apple BSD
 #define TORRENT_USE_GETRANDOM 1
+#define TORRENT_USE_PREADV 1
 
 #endif // __APPLE__
 
@@ -166,6 +167,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #define TORRENT_USE_IFCONF 1
 #define TORRENT_HAS_SALEN 0
 #define TORRENT_USE_FDATASYNC 1
+#define TORRENT_USE_PREADV 1
 
 #if defined __GLIBC__ && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ > 24))
 #define TORRENT_USE_GETRANDOM 1
@@ -197,6 +199,22 @@ POSSIBILITY OF SUCH DAMAGE.
 #define TORRENT_HAS_FALLOCATE 0
 #endif
 
+// the io_uring disk I/O back-end talks to the kernel directly, it only
+// requires the kernel headers
+#ifndef TORRENT_HAVE_IO_URING
+#if defined __has_include
+#if __has_include(<linux/io_uring.h>)
+#define TORRENT_HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+// recvmmsg() and sendmmsg() are used to receive and send UDP packets in
+// batches
+#ifndef TORRENT_USE_MMSG
+#define TORRENT_USE_MMSG 1
+#endif
+
 #endif // ANDROID
 
 #if defined __GLIBC__ && ( defined __x86_64__ || defined __i386 \
@@ -452,6 +470,14 @@ POSSIBILITY OF SUCH DAMAGE.
 #define TORRENT_HAVE_MAP_VIEW_OF_FILE 0
 #endif
 
+#ifndef TORRENT_HAVE_IO_URING
+#define TORRENT_HAVE_IO_URING 0
+#endif
+
+#ifndef TORRENT_USE_MMSG
+#define TORRENT_USE_MMSG 0
+#endif
+
 #ifndef TORRENT_USE_MADVISE
 #define TORRENT_USE_MADVISE 0
 #endif
@@ -464,6 +490,10 @@ POSSIBILITY OF SUCH DAMAGE.
 #define TORRENT_USE_FDATASYNC 0
 #endif
 
+#ifndef TORRENT_USE_PREADV
+#define TORRENT_USE_PREADV 0
+#endif
+
 #ifndef TORRENT_USE_UNC_PATHS
 #define TORRENT_USE_UNC_PATHS 0
 #endif
@@ -201,6 +201,26 @@ namespace file_open_mode {
 			, std::function<void(storage_error const&)> handler
 			, disk_job_flags_t flags = {}) = 0;
 
+		// allocate a buffer for a block of payload that is about to be
+		// received from a peer. The peer reads the payload from its socket
+		// directly into this buffer, and then hands it over to
+		// async_write_buffer(), saving a copy. ``exceeded`` is set to true if
+		// the disk cache is full, in which case the disk_observer is notified
+		// once it drops below the low watermark again, just like when
+		// async_write() returns true. Returning an empty holder (which the
+		// default implementation does) makes peers fall back to receiving
+		// into their own buffer and calling async_write().
+		virtual disk_buffer_holder allocate_receive_buffer(bool& exceeded
+			, std::shared_ptr<disk_observer> o, char const* category);
+
+		// like async_write(), but takes ownership of a buffer returned by
+		// allocate_receive_buffer(). The default implementation forwards the
+		// buffer to async_write().
+		virtual bool async_write_buffer(storage_index_t storage, peer_request const& r
+			, disk_buffer_holder buffer, std::shared_ptr<disk_observer> o
+			, std::function<void(storage_error const&)> handler
+			, disk_job_flags_t flags = {});
+
 		// Compute hash(es) for the specified piece. Unless the v1_hash flag is
 		// set (in ``flags``), the SHA-1 hash of the whole piece does not need
 		// to be computed.
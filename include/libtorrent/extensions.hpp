@@ -495,7 +495,9 @@ TORRENT_VERSION_NAMESPACE_3_END
 		virtual void on_piece_pass(piece_index_t) {}
 		virtual void on_piece_failed(piece_index_t) {}
 
-		// called approximately once every second
+		// called approximately once every second, while the peer is
+		// transferring data. Peers that are idle are ticked less often, but at
+		// least every 10 seconds
 		virtual void tick() {}
 
 		// called each time a request message is to be sent. If true
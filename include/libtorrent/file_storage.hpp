@@ -42,6 +42,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <unordered_map>
 #include <ctime>
 #include <cstdint>
+#include <memory>
 
 #include "libtorrent/assert.hpp"
 #include "libtorrent/peer_request.hpp"
@@ -174,10 +175,6 @@ namespace aux {
 		// that's why it's private, to keep people away from it
 		char const* name = nullptr;
 	public:
-		// the SHA-256 root of the merkle tree for this file
-		// this is a pointer into the .torrent file
-		char const* root = nullptr;
-
 		// the index into file_storage::m_paths. To get
 		// the full path to this file, concatenate the path
 		// from that array with the 'name' field in
@@ -622,6 +619,10 @@ namespace aux {
 
 		aux::path_index_t get_or_add_path(string_view path);
 
+		// sets the name of the file entry to a copy of n, stored in
+		// m_name_blocks
+		void set_entry_name(aux::file_entry& e, string_view n);
+
 		// the number of bytes in a regular piece
 		// (i.e. not the potentially truncated last piece)
 		int m_piece_length = 0;
@@ -650,6 +651,13 @@ namespace aux {
 		// stays valid throughout the lifetime of this file_storage object.
 		aux::vector<char const*, file_index_t> m_file_hashes;
 
+		// the SHA-256 roots of the merkle trees of each file, for v2 torrents.
+		// Just like m_file_hashes, these are pointers into the .torrent file,
+		// and this array is empty if no file has a root. They are kept out of
+		// aux::file_entry to keep that struct small for v1 torrents with many
+		// files.
+		aux::vector<char const*, file_index_t> m_file_roots;
+
 		// for files that are symlinks, the symlink
 		// path_index in the aux::file_entry indexes
 		// this vector of strings
@@ -668,6 +676,21 @@ namespace aux {
 		// entry appended, to form full file paths
 		aux::vector<std::string, aux::path_index_t> m_paths;
 
+		// open addressing hash table of indices into m_paths, used to look up
+		// (and intern) directory names in constant time when adding files.
+		// Empty slots are aux::file_entry::no_path. The size is a power of two
+		// and it's kept at most half full
+		aux::vector<aux::path_index_t> m_path_table;
+
+		// storage for file names that don't point into the .torrent file, like
+		// the names of pad files and of files added by path, to avoid one heap
+		// allocation per file. Names are immutable once written, and the
+		// blocks are shared with copies of this file_storage (whose file
+		// entries point into them). Names are only appended to the last block,
+		// and only if no copy refers to it
+		std::vector<std::shared_ptr<char>> m_name_blocks;
+		int m_name_block_left = 0;
+
 		// name of torrent. For multi-file torrents
 		// this is always the root directory
 		std::string m_name;
@@ -0,0 +1,65 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_IO_URING_DISK_IO_HPP
+#define TORRENT_IO_URING_DISK_IO_HPP
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/io_context.hpp"
+
+#include <memory>
+
+namespace libtorrent {
+
+	struct counters;
+	struct disk_interface;
+	struct settings_interface;
+
+	// constructs a disk I/O back-end based on Linux' io_uring interface. Read,
+	// write and hash jobs are batched into the submission queue whenever
+	// submit_jobs() is called, files are kept open and registered with the
+	// kernel (up to settings_pack::file_pool_size of them) and completions are
+	// delivered back to the network thread in batches. Operations other than
+	// reading, writing and hashing are performed the same way as the
+	// posix_disk_io back-end.
+	// If the system does not support io_uring (or the kernel refuses to set
+	// up a ring) this falls back to returning a posix_disk_io back-end.
+	TORRENT_EXPORT std::unique_ptr<disk_interface> io_uring_disk_io_constructor(
+		io_context& ios, settings_interface const&, counters& cnt);
+
+	// returns true if the system supports io_uring, i.e. whether
+	// io_uring_disk_io_constructor() constructs an io_uring back-end rather
+	// than falling back to posix_disk_io
+	TORRENT_EXPORT bool io_uring_available();
+}
+
+#endif
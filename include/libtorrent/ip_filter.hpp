@@ -37,11 +37,12 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "libtorrent/config.hpp"
 
-#include <set>
 #include <vector>
 #include <cstdint>
 #include <tuple>
 #include <limits>
+#include <mutex>
+#include <atomic>
 
 #include "libtorrent/address.hpp"
 
@@ -89,6 +90,28 @@ namespace aux {
 	inline std::uint16_t max_addr<std::uint16_t>()
 	{ return (std::numeric_limits<std::uint16_t>::max)(); }
 
+	// IPv6 addresses don't fit in a built-in integer. This is a 128 bit
+	// integer key that compares like the address it was made from
+	struct filter_key6
+	{
+		std::uint64_t hi;
+		std::uint64_t lo;
+		friend bool operator==(filter_key6 const& lhs, filter_key6 const& rhs)
+		{ return lhs.hi == rhs.hi && lhs.lo == rhs.lo; }
+		friend bool operator!=(filter_key6 const& lhs, filter_key6 const& rhs)
+		{ return !(lhs == rhs); }
+		friend bool operator<(filter_key6 const& lhs, filter_key6 const& rhs)
+		{ return lhs.hi < rhs.hi || (lhs.hi == rhs.hi && lhs.lo < rhs.lo); }
+		friend bool operator<=(filter_key6 const& lhs, filter_key6 const& rhs)
+		{ return !(rhs < lhs); }
+	};
+
+	// the integer type addresses are stored as in the filter
+	template <typename Addr> struct filter_key;
+	template <> struct filter_key<address_v4::bytes_type> { using type = std::uint32_t; };
+	template <> struct filter_key<address_v6::bytes_type> { using type = filter_key6; };
+	template <> struct filter_key<std::uint16_t> { using type = std::uint16_t; };
+
 	// this is the generic implementation of
 	// a filter for a specific address type.
 	// it works with IPv4 and IPv6
@@ -98,28 +121,55 @@ namespace aux {
 	public:
 
 		filter_impl();
+		filter_impl(filter_impl const&);
+		filter_impl(filter_impl&&);
+		filter_impl& operator=(filter_impl const&);
+		filter_impl& operator=(filter_impl&&);
+		~filter_impl();
+
 		bool empty() const;
 		void add_rule(Addr first, Addr last, std::uint32_t flags);
+		// make room for ``n`` more rules, without reallocating
+		void reserve(std::size_t n);
 		std::uint32_t access(Addr const& addr) const;
 		template <typename ExternalAddressType>
 		std::vector<ip_range<ExternalAddressType>> export_filter() const;
 
 	private:
 
-		struct range
+		using key_type = typename filter_key<Addr>::type;
+
+		struct rule
 		{
-			range(Addr addr, std::uint32_t a = 0) : start(addr), access(a) {} // NOLINT
-			bool operator<(range const& r) const { return start < r.start; }
-			bool operator<(Addr const& a) const { return start < a; }
-			Addr start;
-			// the end of the range is implicit
-			// and given by the next entry in the set
-			std::uint32_t access;
-			friend bool operator==(range const& lhs, range const& rhs)
-			{ return lhs.start == rhs.start && lhs.access == rhs.access; }
+			key_type first;
+			key_type last;
+			std::uint32_t flags;
 		};
 
-		std::set<range> m_access_list;
+		// applies the rules added since the last time the filter was
+		// frozen. This is done on the first lookup after adding rules, to
+		// make loading a blocklist one rule at a time O(n log n), rather
+		// than O(n^2)
+		void freeze() const;
+		void freeze_impl() const;
+
+		// the rules added since the filter was last frozen, in the order
+		// they were added
+		mutable std::vector<rule> m_pending;
+
+		// the start of each range and the flags for it. The end of a range
+		// is implicit, and given by the start of the next one. The ranges
+		// are stored in Eytzinger (breadth-first) order, with a dummy
+		// element at index 0. The children of the range at index k are at
+		// 2k and 2k + 1, so a lookup is a walk down an implicit binary
+		// tree, with no pointers, where the top levels share cache lines.
+		mutable std::vector<key_type> m_start;
+		mutable std::vector<std::uint32_t> m_access;
+
+		// set when m_pending is not empty. The mutex is only taken to
+		// freeze the filter
+		mutable std::atomic<bool> m_dirty{false};
+		mutable std::mutex m_mutex;
 	};
 
 	extern template class filter_impl<address_v4::bytes_type>;
@@ -171,8 +221,20 @@ struct TORRENT_EXPORT ip_filter
 	//
 	// This means that in a case of overlapping ranges, the last one applied takes
 	// precedence.
+	//
+	// Adding a rule is O(1). The rules added are applied to the filter on
+	// the next call to access() or export_filter(), which is O(n + m ``log`` m),
+	// where n is the number of ranges in the filter and m the number of
+	// rules added since the last lookup. Adding a large number of rules and
+	// then looking up addresses is efficient, interleaving add_rule() and
+	// access() on a large filter is not.
 	void add_rule(address const& first, address const& last, std::uint32_t flags);
 
+	// Adds all rules in ``rules``, as if add_rule() was called for each one,
+	// in order. Use this to load a blocklist.
+	void add_rules(std::vector<ip_range<address_v4>> const& rules);
+	void add_rules(std::vector<ip_range<address_v6>> const& rules);
+
 	// Returns the access permissions for the given address (``addr``). The permission
 	// can currently be 0 or ``ip_filter::blocked``. The complexity of this operation
 	// is O(``log`` n), where n is the minimum number of non-overlapping ranges to describe
@@ -73,11 +73,14 @@ namespace dht {
 	// the peers, mutable and immutable items and it's designed to
 	// provide a fast and fully compliant behavior of the BEPs.
 	//
-	// libtorrent comes with one built-in storage implementation:
+	// libtorrent comes with two built-in storage implementations:
 	// ``dht_default_storage`` (private non-accessible class). Its
 	// constructor function is called dht_default_storage_constructor().
 	// You should know that if this storage becomes full of DHT items,
 	// the current implementation could degrade in performance.
+	// ``dht_compact_storage`` (private non-accessible class) is meant for
+	// nodes storing a large number of torrents and items. Its constructor
+	// function is called dht_compact_storage_constructor().
 	struct TORRENT_EXPORT dht_storage_interface
 	{
 #if TORRENT_ABI_VERSION == 1
@@ -239,6 +242,16 @@ namespace dht {
 	TORRENT_EXPORT std::unique_ptr<dht_storage_interface> dht_default_storage_constructor(
 		settings_interface const& settings);
 
+	// constructor for a DHT storage that behaves like the default one, but
+	// uses less memory and CPU when storing a large number of torrents and
+	// items. Peers are stored as 10 (IPv4) or 22 (IPv6) byte records, their
+	// compact endpoint followed by the time they announced, and torrents and
+	// items in hash tables. Evicting an item and expiring peers and
+	// items don't require visiting all of them. Set it in
+	// session_params::dht_storage_constructor to use it.
+	TORRENT_EXPORT std::unique_ptr<dht_storage_interface> dht_compact_storage_constructor(
+		settings_interface const& settings);
+
 } // namespace dht
 } // namespace libtorrent
 
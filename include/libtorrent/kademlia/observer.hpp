@@ -39,6 +39,10 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <cstdint>
 #include <memory>
 
+#include <libtorrent/aux_/disable_warnings_push.hpp>
+#include <boost/smart_ptr/intrusive_ptr.hpp>
+#include <libtorrent/aux_/disable_warnings_pop.hpp>
+
 #include <libtorrent/time.hpp>
 #include <libtorrent/address.hpp>
 #include <libtorrent/flags.hpp>
@@ -52,11 +56,17 @@ struct dht_observer;
 struct observer;
 struct msg;
 struct traversal_algorithm;
+class rpc_manager;
+
+// defined in rpc_manager.cpp, where the observer is returned to the pool
+TORRENT_EXTRA_EXPORT void intrusive_ptr_release(observer const* o);
 
 using observer_flags_t = libtorrent::flags::bitfield_flag<std::uint8_t, struct observer_flags_tag>;
 
+// observers are allocated from a pool owned by the rpc_manager, and
+// reference counted intrusively. They are only ever used from the DHT's
+// thread, so the reference count is not atomic
 struct TORRENT_EXTRA_EXPORT observer
-	: std::enable_shared_from_this<observer>
 {
 	observer(std::shared_ptr<traversal_algorithm> a
 		, udp::endpoint const& ep, node_id const& id)
@@ -120,8 +130,16 @@ protected:
 
 private:
 
-	std::shared_ptr<observer> self()
-	{ return shared_from_this(); }
+	boost::intrusive_ptr<observer> self() { return this; }
+
+	friend void intrusive_ptr_add_ref(observer const* o)
+	{
+		TORRENT_ASSERT(o->m_refs < 0xffffffff);
+		++o->m_refs;
+	}
+
+	friend void intrusive_ptr_release(observer const* o);
+	friend class rpc_manager;
 
 	time_point m_sent;
 
@@ -137,6 +155,12 @@ private:
 
 	std::uint16_t m_port = 0;
 
+	mutable std::uint32_t m_refs = 0;
+
+	// the rpc_manager whose pool this observer was allocated from. Set by
+	// rpc_manager::allocate_observer()
+	rpc_manager* m_rpc = nullptr;
+
 public:
 	observer_flags_t flags{};
 
@@ -148,7 +172,7 @@ public:
 #endif
 };
 
-using observer_ptr = std::shared_ptr<observer>;
+using observer_ptr = boost::intrusive_ptr<observer>;
 
 }
 }
@@ -36,7 +36,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #ifndef RPC_MANAGER_HPP
 #define RPC_MANAGER_HPP
 
-#include <unordered_map>
+#include <deque>
+#include <vector>
 #include <cstdint>
 
 #include <libtorrent/socket.hpp>
@@ -102,18 +103,14 @@ public:
 #endif
 
 	template <typename T, typename... Args>
-	std::shared_ptr<T> allocate_observer(Args&&... args)
+	boost::intrusive_ptr<T> allocate_observer(Args&&... args)
 	{
 		void* ptr = allocate_observer();
-		if (ptr == nullptr) return std::shared_ptr<T>();
-
-		auto deleter = [this](observer* o)
-		{
-			TORRENT_ASSERT(o->m_in_use);
-			o->~observer();
-			free_observer(o);
-		};
-		return std::shared_ptr<T>(new (ptr) T(std::forward<Args>(args)...), deleter);
+		if (ptr == nullptr) return boost::intrusive_ptr<T>();
+
+		T* o = new (ptr) T(std::forward<Args>(args)...);
+		o->m_rpc = this;
+		return boost::intrusive_ptr<T>(o);
 	}
 
 	int num_allocated_observers() const { return m_allocated_observers; }
@@ -122,12 +119,49 @@ public:
 
 private:
 
+	friend void intrusive_ptr_release(observer const*);
+
 	void* allocate_observer();
 	void free_observer(void* ptr);
 
+	// an outstanding request
+	struct transaction
+	{
+		observer_ptr o;
+		// identifies this request among all requests sent, since
+		// transaction IDs are reused
+		std::uint32_t seq = 0;
+		std::uint16_t tid = 0;
+	};
+
+	// returns the index of the transaction with the ID ``tid`` in
+	// m_transactions, or -1
+	int find_transaction(std::uint16_t tid) const;
+	void add_transaction(std::uint16_t tid, observer_ptr o);
+	observer_ptr remove_transaction(int idx);
+
 	mutable lt::aux::pool m_pool_allocator;
 
-	std::unordered_multimap<std::uint16_t, observer_ptr> m_transactions;
+	// the outstanding requests, keyed by transaction ID. Transaction IDs
+	// are unique among outstanding requests, so this is a flat, open
+	// addressing table, with linear probing from the slot given by the
+	// (random) transaction ID. Empty slots have a null observer. The size
+	// is always a power of two
+	std::vector<transaction> m_transactions;
+	int m_num_transactions = 0;
+
+	// the transaction ID and sequence number of the outstanding requests,
+	// in the order they were sent. Since every request has the same timeout,
+	// the ones that have timed out are always at the front. Requests that
+	// have completed are removed lazily, when they are found not to be in
+	// m_transactions anymore
+	std::deque<std::pair<std::uint16_t, std::uint32_t>> m_timeout_queue;
+
+	// the number of requests at the front of m_timeout_queue that have
+	// passed their short timeout
+	std::size_t m_short_timeouts = 0;
+
+	std::uint32_t m_next_seq = 0;
 
 	aux::listen_socket_handle m_sock;
 	socket_manager* m_sock_man;
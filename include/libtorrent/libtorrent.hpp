@@ -54,6 +54,7 @@
 #include "libtorrent/info_hash.hpp"
 #include "libtorrent/io.hpp"
 #include "libtorrent/io_context.hpp"
+#include "libtorrent/io_uring_disk_io.hpp"
 #include "libtorrent/ip_filter.hpp"
 #include "libtorrent/ip_voter.hpp"
 #include "libtorrent/kademlia/announce_flags.hpp"
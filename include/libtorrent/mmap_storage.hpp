@@ -41,12 +41,14 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <mutex>
 #include <atomic>
 #include <memory>
+#include <cstdint>
 
 #include "libtorrent/fwd.hpp"
 #include "libtorrent/aux_/disk_job_fence.hpp"
 #include "libtorrent/storage_defs.hpp"
 #include "libtorrent/part_file.hpp"
 #include "libtorrent/stat_cache.hpp"
+#include "libtorrent/aux_/extent_cache.hpp"
 #include "libtorrent/bitfield.hpp"
 #include "libtorrent/span.hpp"
 #include "libtorrent/aux_/vector.hpp"
@@ -104,6 +106,14 @@ namespace aux {
 			, storage_error&);
 		bool tick();
 
+		// returns true if the piece is entirely in holes of sparse files, and
+		// was never written. Used when checking the files
+		bool piece_in_holes(piece_index_t piece);
+
+		// like piece_in_holes(), but only considers files whose extents were
+		// already queried, without asking the file system
+		bool piece_in_known_holes(piece_index_t piece);
+
 		int readv(settings_interface const&, span<iovec_t const> bufs
 			, piece_index_t piece, int offset, aux::open_mode_t flags, storage_error&);
 		int writev(settings_interface const&, span<iovec_t const> bufs
@@ -114,6 +124,20 @@ namespace aux {
 		int hashv2(settings_interface const&, hasher256& ph, std::ptrdiff_t len
 			, piece_index_t piece, int offset, aux::open_mode_t flags, storage_error&);
 
+		// copies the v2 block at ``offset`` into ``buf``. Like hashv2(), this
+		// reads from a single file, and returns a short read (or 0) if the
+		// file is smaller than expected
+		int read2(settings_interface const&, span<char> buf
+			, piece_index_t piece, int offset, aux::open_mode_t flags, storage_error&);
+
+		// if the ``len`` bytes at ``offset`` into ``piece`` are backed by the
+		// mapping of a single file, returns a holder pointing into it, that
+		// keeps the mapping alive. Otherwise, e.g. if the range spans files or
+		// is stored in the part file, returns an empty holder and the range
+		// has to be copied with readv().
+		disk_buffer_holder read_view(settings_interface const&
+			, piece_index_t piece, int offset, int len, aux::open_mode_t flags);
+
 		// if the files in this storage are mapped, returns the mapped
 		// file_storage, otherwise returns the original file_storage object.
 		file_storage const& files() const { return m_mapped_files ? *m_mapped_files : m_files; }
@@ -137,8 +161,23 @@ namespace aux {
 		storage_index_t storage_index() const { return m_storage_index; }
 		void set_storage_index(storage_index_t st) { m_storage_index = st; }
 
+		// this is modified by move_storage(), and must only be accessed by
+		// jobs holding a fence on the storage
+		std::string const& save_path() const { return m_save_path; }
+
+		// the kinds of hashes the hash jobs for this storage ask for. When
+		// hashing pieces as they're written, only these are computed. Until
+		// the first piece is hashed, both v1 and v2 hashes are assumed to be
+		// wanted
+		void set_hashes_wanted(bool const v1, bool const v2)
+		{ m_hashes_wanted.store(std::uint8_t((v1 ? 1 : 0) | (v2 ? 2 : 0)), std::memory_order_relaxed); }
+		bool v1_hash_wanted() const { return (m_hashes_wanted.load(std::memory_order_relaxed) & 1) != 0; }
+		bool v2_hash_wanted() const { return (m_hashes_wanted.load(std::memory_order_relaxed) & 2) != 0; }
+
 	private:
 
+		std::atomic<std::uint8_t> m_hashes_wanted{3};
+
 		bool m_need_tick = false;
 		file_storage const& m_files;
 
@@ -162,6 +201,10 @@ namespace aux {
 		// each entry represents the size and timestamp of the file
 		mutable stat_cache m_stat_cache;
 
+		// the data extents of the files, to skip reading pieces in holes
+		// when checking. Cleared along with m_stat_cache
+		aux::extent_cache m_extent_cache;
+
 		// helper function to open a file in the file pool with the right mode
 		boost::optional<aux::file_view> open_file(settings_interface const&, file_index_t
 			, aux::open_mode_t, storage_error&) const;
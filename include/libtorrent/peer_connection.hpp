@@ -71,6 +71,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/piece_picker.hpp" // for picker_options_t
 #include "libtorrent/units.hpp"
 #include "libtorrent/aux_/socket_type.hpp"
+#include "libtorrent/aux_/timer_wheel.hpp"
 
 #include <ctime>
 #include <algorithm>
@@ -280,6 +281,7 @@ namespace aux {
 
 	struct TORRENT_EXTRA_EXPORT peer_connection
 		: peer_connection_hot_members
+		, aux::timer_wheel_entry
 		, aux::bandwidth_socket
 		, peer_class_set
 		, disk_observer
@@ -484,7 +486,18 @@ namespace aux {
 		void sent_syn(bool ipv6);
 		void received_synack(bool ipv6);
 
-		// is called once every second by the main loop
+		// is called by the session's timer wheel when this peer is due. It
+		// calls second_tick() (or, for connections not yet attached to a
+		// torrent, checks the handshake timeout) and schedules the next tick
+		void timer_tick(int tick_interval_ms);
+
+		// makes sure the peer is ticked at the next second. This is called on
+		// any activity on the connection
+		void wake_tick();
+
+		// is called once every second by the main loop, for as long as the
+		// peer is active. Idle peers are ticked less often, but always in time
+		// for their timeouts
 		void second_tick(int tick_interval_ms);
 
 		aux::socket_type const& get_socket() const { return m_socket; }
@@ -584,8 +597,24 @@ namespace aux {
 		void incoming_bitfield(typed_bitfield<piece_index_t> const& bits);
 		void incoming_request(peer_request const& r);
 		void incoming_piece(peer_request const& p, char const* data);
+		void incoming_piece(peer_request const& p, disk_buffer_holder data);
 		void incoming_piece_fragment(int bytes);
 		void start_receive_piece(peer_request const& r);
+
+		// called once the header of a piece message has been received (and
+		// start_receive_piece() has been called), to have the rest of its
+		// payload read from the socket straight into a disk buffer.
+		// ``received`` is the part of the payload that has already been
+		// received into the receive buffer. If this returns true, the peer
+		// connection takes over receiving the payload, accounts for it and
+		// calls incoming_piece() once it's complete. The subclass must then
+		// consider the message finished. Returns false if the disk subsystem
+		// doesn't support it or the request is not a regular block.
+		bool start_disk_receive(peer_request const& r, span<char const> received);
+
+		// if a piece payload is being received into a disk buffer, returns
+		// its progress. Otherwise returns an invalid piece_block_progress
+		piece_block_progress disk_receive_progress() const;
 		void incoming_cancel(peer_request const& r);
 
 		bool can_disconnect(error_code const& ec) const;
@@ -658,6 +687,13 @@ namespace aux {
 		// value invalid (the default constructor).
 		virtual piece_block_progress downloading_piece_progress() const;
 
+		// returns true if blocks sent to this peer can be references into the
+		// disk cache or file mappings. That's the case when the payload is
+		// passed to the kernel as-is. Otherwise (uTP, SSL, encryption) it's
+		// copied or transformed in the network thread, where touching a
+		// mapped file isn't safe.
+		virtual bool can_send_references() const;
+
 		void send_buffer(span<char const> buf);
 		void setup_send();
 
@@ -785,7 +821,9 @@ namespace aux {
 		void on_receive_data(error_code const& error
 			, std::size_t bytes_transferred);
 
-		void account_received_bytes(int bytes_transferred);
+		void account_received_bytes(int bytes_transferred, int disk_bytes);
+		void incoming_piece_impl(peer_request const& p, char const* data
+			, disk_buffer_holder buffer);
 
 		void do_update_interest();
 		void fill_send_buffer();
@@ -805,6 +843,9 @@ namespace aux {
 		int request_timeout() const;
 		void check_graceful_pause();
 
+		// the number of seconds until this peer needs to be ticked again
+		int next_tick_delay() const;
+
 		int wanted_transfer(int channel);
 		int request_bandwidth(int channel, int bytes = 0);
 
@@ -1072,6 +1113,19 @@ namespace aux {
 		// thread that hasn't yet been completely written.
 		int m_outstanding_writing_bytes = 0;
 
+		// while the payload of a piece message is received straight into a
+		// disk buffer (see start_disk_receive()), this is the buffer, the
+		// request it belongs to and the number of bytes received into it so
+		// far
+		disk_buffer_holder m_disk_recv_buffer;
+		peer_request m_disk_recv_request{};
+		int m_disk_recv_pos = 0;
+
+		// set if the disk cache was full when m_disk_recv_buffer was
+		// allocated. The download channel is blocked on the disk once the
+		// block has been handed over, unless on_disk() was called in between
+		bool m_disk_recv_exceeded = false;
+
 		// max transfer rates seen on this peer
 		int m_download_rate_peak = 0;
 		int m_upload_rate_peak = 0;
@@ -202,11 +202,17 @@ namespace libtorrent {
 			num_write_ops,
 			num_read_ops,
 			num_read_back,
+			num_hole_pieces_skipped,
+			store_buffer_contention,
+			disk_arena_cache_hits,
+			disk_arena_central_transfers,
 
 			disk_read_time,
 			disk_write_time,
 			disk_hash_time,
 			disk_job_time,
+			disk_device_queue_time,
+			disk_device_jobs,
 
 			waste_piece_timed_out,
 			waste_piece_cancelled,
@@ -401,7 +407,14 @@ namespace libtorrent {
 			request_latency,
 
 			disk_blocks_in_use,
+			disk_arena_slabs,
+			disk_arena_hugepage_slabs,
+			disk_arena_free_blocks,
+			disk_arena_cached_blocks,
 			queued_disk_jobs,
+			disk_device_queues,
+			disk_device_max_queue_depth,
+			disk_device_max_queue_latency,
 			num_running_disk_jobs,
 			num_read_jobs,
 			num_write_jobs,
@@ -473,21 +486,46 @@ namespace libtorrent {
 		counters(counters const&) TORRENT_COUNTER_NOEXCEPT;
 		counters& operator=(counters const&) & TORRENT_COUNTER_NOEXCEPT;
 
-		// returns the new value
+		// returns the new value. Stats counters (as opposed to gauges) are
+		// kept per thread, for those the returned value is only the calling
+		// thread's share of the total.
 		std::int64_t inc_stats_counter(int c, std::int64_t value = 1) TORRENT_COUNTER_NOEXCEPT;
 		std::int64_t operator[](int i) const TORRENT_COUNTER_NOEXCEPT;
 
+		// only valid for gauges
 		void set_value(int c, std::int64_t value) TORRENT_COUNTER_NOEXCEPT;
 		void blend_stats_counter(int c, std::int64_t value, int ratio) TORRENT_COUNTER_NOEXCEPT;
 
 	private:
 
 		// TODO: some space could be saved here by making gauges 32 bits
-		// TODO: restore these to regular integers. Instead have one copy
-		// of the counters per thread and collect them at convenient
-		// synchronization points
 #ifdef ATOMIC_LLONG_LOCK_FREE
-		aux::array<std::atomic<std::int64_t>, num_counters> m_stats_counter;
+		// stats counters are incremented from the network thread as well as
+		// the disk and hasher threads. To avoid those threads bouncing the same
+		// cache lines between them, stats counters are sharded. Each thread
+		// is assigned a shard and increments its own copy of the counters. The
+		// shards are summed up when the counters are read, which only happens
+		// when posting session stats.
+		static constexpr int num_shards = 16;
+
+		// the number of slots of each shard, this is rounded up to a whole
+		// number of cache lines and padded by one more, to make sure two
+		// shards never share a cache line
+		static constexpr int shard_stride = (num_stats_counters + 7) / 8 * 8 + 8;
+
+		// returns the index of the shard used by the calling thread
+		static int thread_shard() noexcept;
+
+		std::atomic<std::int64_t>& stats_counter(int shard, int c) noexcept
+		{ return m_stats_shards[shard * shard_stride + c]; }
+		std::atomic<std::int64_t> const& stats_counter(int shard, int c) const noexcept
+		{ return m_stats_shards[shard * shard_stride + c]; }
+
+		aux::array<std::atomic<std::int64_t>, num_shards * shard_stride> m_stats_shards;
+
+		// gauges may be decremented and set, they are indexed by the counter
+		// index minus num_stats_counters
+		aux::array<std::atomic<std::int64_t>, num_gauges_counters> m_gauges;
 #else
 		// if the atomic type isn't lock-free, use a single lock instead, for
 		// the whole array
@@ -495,6 +533,27 @@ namespace libtorrent {
 		aux::array<std::int64_t, num_counters> m_stats_counter;
 #endif
 	};
+
+namespace aux {
+
+	// reports a cumulative count that's maintained outside of the counters
+	// object, like the store buffer's lock contention, as a stats counter.
+	// Each call to report() increments the counter by how much the count has
+	// grown since the last call
+	struct reported_count
+	{
+		void report(counters& c, int const idx, std::int64_t const total)
+		{
+			std::int64_t prev = m_reported.load(std::memory_order_relaxed);
+			while (total > prev && !m_reported.compare_exchange_weak(prev, total
+				, std::memory_order_relaxed)) {}
+			if (total > prev) c.inc_stats_counter(idx, total - prev);
+		}
+
+	private:
+		std::atomic<std::int64_t> m_reported{0};
+	};
+}
 }
 
 #endif
@@ -776,6 +776,15 @@ namespace libtorrent {
 		std::vector<downloading_piece>::iterator update_piece_state(
 			std::vector<downloading_piece>::iterator dp);
 
+		// adds and removes downloading_piece objects to and from the
+		// m_downloads lists, keeping m_download_slot up to date. Adding puts it
+		// at the end, removing moves the last one into its place, so both are
+		// O(1). The lists are not kept in any particular order
+		std::vector<downloading_piece>::iterator add_to_download_queue(
+			download_queue_t queue, downloading_piece const& dp);
+		void remove_from_download_queue(download_queue_t queue
+			, std::vector<downloading_piece>::iterator i);
+
 	private:
 
 #if TORRENT_USE_ASSERTS || TORRENT_USE_INVARIANT_CHECKS
@@ -844,8 +853,10 @@ namespace libtorrent {
 
 		// each piece that's currently being downloaded has an entry in this list
 		// with block allocations. i.e. it says which parts of the piece that is
-		// being downloaded. This list is ordered by piece index to make lookups
-		// efficient there are as many buckets as there are piece states. See
+		// being downloaded. The lists are not ordered. Entries are appended,
+		// removed by swapping in the last one, and found through
+		// m_download_slot, so they can't be binary searched. There are as many
+		// buckets as there are piece states. See
 		// piece_pos::state_t. The only download state that does not have a
 		// corresponding downloading_piece vector is piece_open and
 		// piece_downloading_reverse (the latter uses the same as
@@ -854,6 +865,12 @@ namespace libtorrent {
 			, static_cast<std::uint8_t>(piece_pos::num_download_categories)
 			, download_queue_t> m_downloads;
 
+		// for every piece that's being downloaded, this is the position of its
+		// downloading_piece in the m_downloads list it belongs to. This makes
+		// find_dl_piece() O(1), and lets the lists be unordered. The entries of
+		// pieces that aren't being downloaded are -1.
+		aux::vector<int, piece_index_t> m_download_slot;
+
 		// this holds the information of the blocks in partially downloaded
 		// pieces. the downloading_piece::info index point into this vector for
 		// its storage
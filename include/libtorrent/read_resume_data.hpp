@@ -66,6 +66,18 @@ namespace libtorrent {
 		, int piece_limit = 0x200000);
 	TORRENT_EXPORT add_torrent_params read_resume_data(span<char const> buffer
 		, load_torrent_limits const& cfg = {});
+
+	// parses a resume data journal, i.e. a full record from
+	// write_resume_data_buf() followed by the journal records from
+	// save_resume_data_alert::journal_record. The records are applied to the
+	// add_torrent_params in order, and a full record replaces everything
+	// before it. The records are parsed in place, so ``buffer`` may be a
+	// memory mapped journal file. If the last record is truncated, e.g.
+	// because the client exited while appending it, it is ignored.
+	TORRENT_EXPORT add_torrent_params read_resume_data_journal(span<char const> buffer
+		, error_code& ec, load_torrent_limits const& cfg = {});
+	TORRENT_EXPORT add_torrent_params read_resume_data_journal(span<char const> buffer
+		, load_torrent_limits const& cfg = {});
 }
 
 #endif
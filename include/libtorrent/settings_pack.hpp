@@ -988,6 +988,23 @@ namespace aux {
 			// previously deleted information from the disk.
 			enable_set_file_valid_data,
 
+			// when enabled, the mmap disk I/O back-end computes the piece
+			// hashes incrementally, as blocks are written to disk, rather than
+			// reading the piece back once it's complete. Blocks that arrive out
+			// of order are held in memory, in a small staging area, until
+			// the blocks before them have been written. This trades some CPU
+			// time and memory in the disk threads for fewer disk reads. It has
+			// no effect on the other disk I/O back-ends.
+			hash_on_write,
+
+			// when enabled, the 2 MiB slabs disk buffers are allocated from
+			// are backed by explicit huge pages (``MAP_HUGETLB``), if the
+			// system has any reserved. Otherwise the kernel is advised to use
+			// transparent huge pages for them. This reduces TLB misses when
+			// moving a lot of data through the disk buffers. It only affects
+			// slabs allocated after the setting is changed.
+			disk_buffer_hugepages,
+
 			max_bool_setting_internal
 		};
 
@@ -1990,6 +2007,33 @@ namespace aux {
 			// torrent_info::parse_info_section(), if those are used.
 			max_piece_count,
 
+			// ``max_udp_announces_per_second`` paces announces to UDP trackers,
+			// to avoid sending a burst of them when many torrents start at the
+			// same time. Announces above the rate are queued, and counted by
+			// the ``tracker.num_queued_tracker_announces`` counter. Up to one
+			// second worth of announces may be sent back-to-back. Scrapes and
+			// ``stopped`` events are not limited. 0 means unlimited.
+			max_udp_announces_per_second,
+
+			// ``disk_device_threads`` is the number of disk threads to run for
+			// each storage device. When non-zero, reads, writes and (unless
+			// there are dedicated ``hashing_threads``) hash jobs are queued per
+			// device, as identified by the device a torrent's save path is on,
+			// rather than on a queue shared by all torrents. This keeps a slow
+			// disk from holding up torrents saved on faster ones. Jobs affecting
+			// a whole torrent, like checking and moving it, still run on the
+			// ``aio_threads``. Jobs for spinning disks are issued in the order
+			// of their offset, elevator style. 0 (the default) disables
+			// per-device queues.
+			disk_device_threads,
+
+			// ``disk_device_max_in_flight`` is the maximum number of jobs
+			// executing against one device at a time, when per-device queues are
+			// enabled. A low limit leaves more jobs in the queue to be ordered by
+			// offset, for spinning disks. 0 means there's no limit other than
+			// ``disk_device_threads``.
+			disk_device_max_in_flight,
+
 			max_int_setting_internal
 		};
 
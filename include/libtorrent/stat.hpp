@@ -87,6 +87,10 @@ namespace libtorrent {
 
 		std::int32_t counter() const { return m_counter; }
 
+		// true if nothing has been transferred since the last second_tick()
+		// and the rate has decayed to 0
+		bool idle() const { return m_counter == 0 && m_5_sec_average == 0; }
+
 		void clear()
 		{
 			m_counter = 0;
@@ -171,6 +175,14 @@ namespace libtorrent {
 				m_stat[i].second_tick(tick_interval_ms);
 		}
 
+		// true if second_tick() would not change anything
+		bool is_idle() const
+		{
+			for (int i = 0; i < num_channels; ++i)
+				if (!m_stat[i].idle()) return false;
+			return true;
+		}
+
 		int low_pass_upload_rate() const
 		{
 			return m_stat[upload_payload].low_pass_rate()
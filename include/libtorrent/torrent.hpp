@@ -89,6 +89,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/aux_/deferred_handler.hpp"
 #include "libtorrent/aux_/allocating_handler.hpp"
 #include "libtorrent/aux_/announce_entry.hpp"
+#include "libtorrent/aux_/resume_journal.hpp"
 #include "libtorrent/extensions.hpp" // for add_peer_flags_t
 #include "libtorrent/ssl.hpp"
 
@@ -1093,6 +1094,10 @@ namespace libtorrent {
 		int time_since_complete() const { return int(::time(nullptr) - m_last_seen_complete); }
 		time_t last_seen_complete() const { return m_last_seen_complete; }
 
+		// called when a peer tells us when it last saw a seed
+		void swarm_seen_complete(std::time_t const t)
+		{ m_swarm_last_seen_complete = std::max(m_swarm_last_seen_complete, t); }
+
 		template <typename Fun, typename... Args>
 		void wrap(Fun f, Args&&... a);
 
@@ -1356,6 +1361,10 @@ namespace libtorrent {
 		// this object is used to track download progress of individual files
 		aux::file_progress m_file_progress;
 
+		// what changed since the last resume data record was saved, for
+		// journal records (torrent_handle::journal)
+		aux::resume_journal m_journal;
+
 		// a queue of the most recent low-availability pieces we accessed on disk.
 		// These are good candidates for suggesting other peers to request from
 		// us.
@@ -1431,7 +1440,7 @@ namespace libtorrent {
 		std::time_t m_last_seen_complete = 0;
 
 		// this is the time last any of our peers saw a seed
-		// in this swarm
+		// in this swarm, among the peers currently connected
 		std::time_t m_swarm_last_seen_complete = 0;
 
 		// keep a copy if the info-hash here, so it can be accessed from multiple
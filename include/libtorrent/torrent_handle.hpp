@@ -645,6 +645,17 @@ namespace aux {
 		// resume_data_not_modified.
 		static constexpr resume_data_flags_t only_if_modified = 2_bit;
 
+		// if a full record of resume data has been saved for this torrent
+		// since it was added, only save what changed since the last record.
+		// The save_resume_data_alert then holds a journal record, in
+		// save_resume_data_alert::journal_record, rather than the full resume
+		// data. Append it to the file the full record was saved to, and load
+		// that file with read_resume_data_journal(). The have-bitfield, the
+		// piece- and file priorities and the peer list are only saved as far
+		// as they changed. Saving resume data without this flag gives a full
+		// record, which compacts the journal when it replaces the file.
+		static constexpr resume_data_flags_t journal = 3_bit;
+
 		// ``save_resume_data()`` asks libtorrent to generate fast-resume data for
 		// this torrent.
 		//
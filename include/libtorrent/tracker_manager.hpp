@@ -48,6 +48,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <functional>
 #include <memory>
 #include <unordered_map>
+#include <map>
 #include <deque>
 
 #include "libtorrent/flags.hpp"
@@ -325,7 +326,8 @@ enum class event_t : std::uint8_t
 			, span<char const>
 			, error_code&, udp_send_flags_t)>;
 
-		tracker_manager(send_fun_t send_fun
+		tracker_manager(io_context& ios
+			, send_fun_t send_fun
 			, send_fun_hostname_t send_fun_hostname
 			, counters& stats_counters
 			, aux::resolver_interface& resolver
@@ -387,8 +389,29 @@ enum class event_t : std::uint8_t
 			, udp::endpoint const& ep, span<char const> p
 			, error_code& ec, udp_send_flags_t flags = {});
 
+		// called by a UDP tracker connection that needs a connection ID from
+		// ``tracker``. Returns true if the connection should send the connect
+		// message. If another connection is already waiting for a connection
+		// ID from the same tracker, ``c`` is parked and restarted once that
+		// one completes, by end_udp_connect().
+		bool begin_udp_connect(address const& tracker
+			, std::shared_ptr<udp_tracker_connection> c);
+		void end_udp_connect(address const& tracker);
+
+		// adds the scrape request ``c`` to the batch of info-hashes to send to
+		// its tracker, from its listen socket. A batch is sent once it's full,
+		// or after a short delay
+		void queue_udp_scrape(std::shared_ptr<udp_tracker_connection> c);
+
 	private:
 
+		void start_udp_request(std::shared_ptr<udp_tracker_connection> c);
+		bool udp_announce_slot(time_point now);
+		void on_udp_announce_timer(error_code const& ec);
+		void on_udp_scrape_timer(error_code const& ec);
+		void send_udp_scrapes(std::vector<std::shared_ptr<udp_tracker_connection>> batch);
+		void update_queued_announces();
+
 		// maps transactionid to the udp_tracker_connection
 		// These must use shared_ptr to avoid a dangling reference
 		// if a connection is erased while a timeout event is in the queue
@@ -397,6 +420,30 @@ enum class event_t : std::uint8_t
 		std::vector<std::shared_ptr<http_tracker_connection>> m_http_conns;
 		std::deque<std::shared_ptr<http_tracker_connection>> m_queued;
 
+		// UDP tracker connections waiting for another connection to the same
+		// tracker to receive a connection ID. The existence of an entry means
+		// a connect message is in flight
+		std::map<address, std::vector<std::weak_ptr<udp_tracker_connection>>> m_udp_connecting;
+
+		// UDP scrape requests waiting to be sent, batched by the listen socket
+		// and tracker endpoint they're sent from and to
+		std::map<std::pair<aux::listen_socket_handle, udp::endpoint>
+			, std::vector<std::shared_ptr<udp_tracker_connection>>> m_udp_scrapes;
+		deadline_timer m_udp_scrape_timer;
+		bool m_udp_scrape_timer_active = false;
+
+		// UDP announces held back by the max_udp_announces_per_second limit.
+		// They are also in m_udp_conns, so aborting them works the same way as
+		// for running ones
+		std::deque<std::shared_ptr<udp_tracker_connection>> m_queued_udp;
+		deadline_timer m_udp_announce_timer;
+		bool m_udp_announce_timer_active = false;
+
+		// the point in time the next UDP announce is due, to pace them
+		// according to max_udp_announces_per_second. Announces may run up to
+		// one second ahead of this, which allows short bursts
+		time_point m_next_udp_announce = min_time();
+
 		send_fun_t m_send_fun;
 		send_fun_hostname_t m_send_fun_hostname;
 		aux::resolver_interface& m_host_resolver;
@@ -46,6 +46,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <array>
 #include <memory>
+#include <vector>
 
 namespace libtorrent {
 
@@ -90,8 +91,31 @@ namespace aux { struct alert_manager; }
 			error_code error;
 		};
 
+		// the max number of packets returned by a single call to read()
+		static constexpr int read_batch_size = 32;
+
+		// receives as many packets as are available on the socket, up to the
+		// size of ``pkts`` (and at most read_batch_size). Returns the number
+		// of packets stored in ``pkts``. The data they point to is valid until
+		// the next call to read(). Where available, recvmmsg() is used to
+		// receive all packets with a single system call.
 		int read(span<packet> pkts, error_code& ec);
 
+		// while a send batch is open, packets passed to send() are not sent
+		// right away, but queued up and sent with as few system calls as possible
+		// when the batch is closed by flush_batch(), using sendmmsg() and UDP
+		// generic segmentation offload where available. Packets that are
+		// proxied, or too large to be queued, are still sent immediately.
+		// Since the packets are only sent when the batch is flushed, errors
+		// sending them are reported by flush_batch(). If the socket's send
+		// buffer is full, flush_batch() fails with would_block, and the
+		// packets that weren't sent are kept. They go out first the next time
+		// anything is sent or flushed. Until then, send() outside of a batch
+		// fails with would_block too, as does queuing a packet when the queue
+		// is full. On platforms without sendmmsg(), these are no-ops.
+		void begin_batch();
+		void flush_batch(error_code& ec);
+
 		// this is only valid when using a socks5 proxy
 		void send_hostname(char const* hostname, int port, span<char const> p
 			, error_code& ec, udp_send_flags_t flags = {});
@@ -155,7 +179,40 @@ namespace aux { struct alert_manager; }
 		io_context& m_ioc;
 
 		using receive_buffer = std::array<char, 1500>;
-		std::unique_ptr<receive_buffer> m_buf;
+		std::unique_ptr<std::array<receive_buffer, read_batch_size>> m_buf;
+
+#if TORRENT_USE_MMSG
+		int receive_batch(span<packet> pkts, int first_buf, error_code& ec);
+
+		// the max number of packets held in the send queue. If it fills up,
+		// it's flushed
+		static constexpr int send_batch_size = 64;
+
+		struct queued_packet
+		{
+			udp::endpoint to;
+			int size;
+			bool dont_fragment;
+		};
+
+		// returns the number of packets handed to the kernel (or dropped
+		// because of an error specific to them). Sending stops early if the
+		// socket's send buffer is full
+		int send_queued(span<queued_packet const> pkts, int first_buf
+			, error_code& ec);
+
+		// packets queued up to be sent when the current batch is flushed.
+		// Packet i is stored in buffer i of m_send_buf
+		std::vector<queued_packet> m_send_queue;
+		std::unique_ptr<std::array<receive_buffer, send_batch_size>> m_send_buf;
+
+		// true between begin_batch() and flush_batch()
+		bool m_batching = false;
+
+		// this is set if the kernel doesn't support UDP generic segmentation
+		// offload (or it failed for this socket)
+		bool m_disable_gso = false;
+#endif
 		aux::listen_socket_handle m_listen_socket;
 
 		std::uint16_t m_bind_port;
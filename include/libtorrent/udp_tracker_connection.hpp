@@ -86,6 +86,8 @@ namespace libtorrent {
 		void name_lookup(error_code const& error
 			, std::vector<address> const& addresses, int port);
 		void start_announce();
+		void resume_connect();
+		void end_connect();
 
 		bool on_receive(udp::endpoint const& ep, span<char const> buf);
 		bool on_receive_hostname(char const* hostname, span<char const> buf);
@@ -103,6 +105,8 @@ namespace libtorrent {
 		void send_udp_connect();
 		void send_udp_announce();
 		void send_udp_scrape();
+		void send_udp_scrape_batch(std::vector<std::shared_ptr<udp_tracker_connection>> batch);
+		void scrape_response(int complete, int downloaded, int incomplete);
 
 		void on_timeout(error_code const& ec) override;
 
@@ -125,7 +129,20 @@ namespace libtorrent {
 
 		action_t m_state;
 
+		// when this connection sends a scrape request on behalf of other
+		// connections to the same tracker too, these are the others, in the
+		// order their info-hashes were added to the request
+		std::vector<std::shared_ptr<udp_tracker_connection>> m_scrape_batch;
+
 		bool m_abort;
+
+		// true while this connection has a connect message in flight, that
+		// other connections to the same tracker may be waiting for
+		bool m_connecting;
+
+		// true while this connection is waiting for another connection's
+		// connect message, to then use its connection ID
+		bool m_waiting_for_connect;
 	};
 
 }
@@ -72,10 +72,10 @@ namespace
 		return sett;
 	}
 
-	std::unique_ptr<dht_storage_interface> create_default_dht_storage(
-		settings_interface const& sett)
+	std::unique_ptr<dht_storage_interface> create_dht_storage(
+		settings_interface const& sett, dht_storage_constructor_type const& make_storage)
 	{
-		std::unique_ptr<dht_storage_interface> s(dht_default_storage_constructor(sett));
+		std::unique_ptr<dht_storage_interface> s(make_storage(sett));
 		TEST_CHECK(s.get() != nullptr);
 
 		s->update_node_ids({to_hash("0000000000000000000000000000000000000200")});
@@ -111,10 +111,10 @@ void test_expiration(high_resolution_clock::duration const& expiry_time
 	sim.run();
 }
 
-TORRENT_TEST(dht_storage_counters)
+void test_dht_storage_counters(dht_storage_constructor_type const& make_storage)
 {
 	auto sett = test_settings();
-	std::unique_ptr<dht_storage_interface> s(create_default_dht_storage(sett));
+	std::unique_ptr<dht_storage_interface> s(create_dht_storage(sett, make_storage));
 
 	TEST_CHECK(s.get() != nullptr);
 
@@ -165,13 +165,85 @@ TORRENT_TEST(dht_storage_counters)
 	test_expiration(hours(1), s, c); // test expiration of everything after 3 hours
 }
 
+TORRENT_TEST(dht_storage_counters)
+{
+	test_dht_storage_counters(dht_default_storage_constructor);
+}
+
+TORRENT_TEST(dht_compact_storage_counters)
+{
+	test_dht_storage_counters(dht_compact_storage_constructor);
+}
+
+// the compact storage doesn't check every torrent for timed out peers on every
+// tick. Each tick visits a slice of them, so that all of them are visited every
+// 15 minutes
+TORRENT_TEST(dht_compact_storage_incremental_peer_expiry)
+{
+	int const num_torrents = 100;
+	auto sett = test_settings();
+	sett.set_int(settings_pack::dht_max_torrents, num_torrents);
+	std::unique_ptr<dht_storage_interface> s(create_dht_storage(sett
+		, dht_compact_storage_constructor));
+
+	for (int i = 0; i < num_torrents; ++i)
+	{
+		sha1_hash h = to_hash("5fbfbff10c5d6a4ec8a88e4c6ab4c28b95eee400");
+		h[19] = std::uint8_t(i);
+		s->announce_peer(h, ep("124.31.75.21", 1), "torrent_name", false);
+	}
+	TEST_EQUAL(s->counters().torrents, num_torrents);
+
+	default_config cfg;
+	simulation sim(cfg);
+	sim::asio::io_context ios(sim, addr("10.0.0.1"));
+
+	// tick once a minute. Peers time out after 45 minutes
+	sim::asio::high_resolution_timer timer(ios);
+	int minute = 0;
+	int first_expired = 0;
+	std::function<void(boost::system::error_code const&)> on_tick
+		= [&](boost::system::error_code const&)
+	{
+		++minute;
+		s->tick();
+		int const torrents = s->counters().torrents;
+		TEST_EQUAL(s->counters().peers, torrents);
+
+		if (minute < 45) TEST_EQUAL(torrents, num_torrents);
+
+		// once the peers have timed out, the torrents are removed a few at
+		// a time
+		if (torrents < num_torrents && first_expired == 0)
+		{
+			first_expired = minute;
+			TEST_CHECK(torrents > 0);
+		}
+
+		if (minute == 45 + 15)
+		{
+			TEST_EQUAL(torrents, 0);
+			return;
+		}
+		timer.expires_after(minutes(1));
+		timer.async_wait(on_tick);
+	};
+	timer.expires_after(minutes(1));
+	timer.async_wait(on_tick);
+
+	sim.run();
+
+	TEST_EQUAL(minute, 45 + 15);
+	TEST_CHECK(first_expired >= 45);
+}
+
 TORRENT_TEST(dht_storage_infohashes_sample)
 {
 	auto sett = test_settings();
 	sett.set_int(settings_pack::dht_max_torrents, 5);
 	sett.set_int(settings_pack::dht_sample_infohashes_interval, 30);
 	sett.set_int(settings_pack::dht_max_infohashes_sample_count, 2);
-	std::unique_ptr<dht_storage_interface> s(create_default_dht_storage(sett));
+	std::unique_ptr<dht_storage_interface> s(create_dht_storage(sett, dht_default_storage_constructor));
 
 	TEST_CHECK(s.get() != nullptr);
 
@@ -928,6 +928,23 @@ namespace libtorrent {
 #endif
 	}
 
+
+	save_resume_data_alert::save_resume_data_alert(aux::stack_allocator& alloc
+		, add_torrent_params&& p
+		, std::vector<char>&& record
+		, torrent_handle const& h)
+		: torrent_alert(alloc, h)
+		, params(std::move(p))
+		, journal_record(std::move(record))
+#if TORRENT_ABI_VERSION == 1
+		, resume_data(std::make_shared<entry>())
+#endif
+	{
+#if TORRENT_ABI_VERSION < 3
+		params.info_hash = params.info_hashes.get_best();
+#endif
+	}
+
 	std::string save_resume_data_alert::message() const
 	{
 #ifdef TORRENT_DISABLE_ALERT_MSG
@@ -37,54 +37,249 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/aux_/alert_manager.hpp"
 #include "libtorrent/alert_types.hpp"
 
+#include <algorithm> // for inplace_merge
+
 #ifndef TORRENT_DISABLE_EXTENSIONS
 #include "libtorrent/extensions.hpp"
 #include <memory> // for shared_ptr
 #endif
 
+#ifdef TORRENT_LINUX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <climits> // for INT_MAX
+#include <ctime>
+#endif
+
 namespace libtorrent {
 namespace aux {
 
+namespace {
+
+	std::atomic<std::uint64_t> g_instance{0};
+
+	// the producer the current thread used last, and which alert_manager it
+	// belongs to. Almost all alerts are posted by the network thread of a
+	// single session, so this saves looking it up
+	struct producer_cache
+	{
+		std::uint64_t instance = 0;
+		void* prod = nullptr;
+	};
+	thread_local producer_cache t_producer;
+}
+
 	alert_manager::alert_manager(int const queue_limit, alert_category_t const alert_mask)
 		: m_alert_mask(alert_mask)
 		, m_queue_size_limit(queue_limit)
-	{}
+		, m_instance(++g_instance)
+	{
+		for (auto& n : m_num_queued) n.store(0, std::memory_order_relaxed);
+		for (auto& m : m_dropped)
+			for (auto& d : m) d.store(0, std::memory_order_relaxed);
+		for (auto& d : m_dropped_categories) d.store(0, std::memory_order_relaxed);
+	}
 
 	alert_manager::~alert_manager() = default;
 
-	alert* alert_manager::wait_for_alert(time_duration max_wait)
+	alert_manager::producer& alert_manager::get_producer(
+		std::unique_lock<std::recursive_mutex>& l)
+	{
+		if (t_producer.instance == m_instance)
+		{
+			auto* p = static_cast<producer*>(t_producer.prod);
+			if (p == &m_shared_producer) l = std::unique_lock<std::recursive_mutex>(m_shared_mutex);
+			return *p;
+		}
+
+		std::thread::id const self = std::this_thread::get_id();
+		producer* ret = nullptr;
+
+		// this thread may have posted alerts before, but to a different
+		// alert_manager in between
+		int const num = std::min(m_num_producers.load(), max_producers);
+		for (int i = 0; i < num; ++i)
+		{
+			if (m_producers[i].owner.load() != self) continue;
+			ret = &m_producers[i];
+			break;
+		}
+
+		if (ret == nullptr)
+		{
+			int const idx = m_num_producers.fetch_add(1);
+			if (idx < max_producers)
+			{
+				ret = &m_producers[idx];
+				ret->owner.store(self);
+			}
+			else
+			{
+				ret = &m_shared_producer;
+			}
+		}
+
+		t_producer.instance = m_instance;
+		t_producer.prod = ret;
+		if (ret == &m_shared_producer) l = std::unique_lock<std::recursive_mutex>(m_shared_mutex);
+		return *ret;
+	}
+
+	alert_manager::producer_guard::producer_guard(alert_manager& m)
+		: prod(m.get_producer(lock))
+	{
+		// alerts posted recursively, from within on_alert() or the notify
+		// function, go in the same generation as the outer one
+		if (prod.depth++ > 0)
+		{
+			generation = prod.active.load(std::memory_order_relaxed);
+			return;
+		}
+
+		// announce which generation we're about to post to, and make sure
+		// get_all() didn't flip it in the meantime. If it did, it may not
+		// have seen us and we have to use the new one
+		int gen = m.m_generation.load();
+		for (;;)
+		{
+			prod.active.store(gen);
+			int const g = m.m_generation.load();
+			if (g == gen) break;
+			gen = g;
+		}
+		generation = gen;
+	}
+
+	alert_manager::producer_guard::~producer_guard()
+	{
+		if (--prod.depth == 0)
+			prod.active.store(-1, std::memory_order_release);
+	}
+
+	bool alert_manager::record_dropped(int const gen, int const type
+		, alert_category_t const category) noexcept
+	{
+		std::uint64_t const mask = std::uint64_t(1) << (type % 64);
+		std::uint64_t const prev = m_dropped[gen][std::size_t(type / 64)].fetch_or(mask
+			, std::memory_order_relaxed);
+		auto const bits = static_cast<std::uint32_t>(category);
+		for (int i = 0; i < 32; ++i)
+		{
+			if (bits & (1u << i))
+				m_dropped_categories[i].fetch_add(1, std::memory_order_relaxed);
+		}
+		return (prev & mask) == 0;
+	}
+
+	void alert_manager::post_dropped_alert(int const gen)
+	{
+		std::bitset<abi_alert_count> dropped;
+		for (std::size_t i = 0; i < m_dropped[gen].size(); ++i)
+		{
+			std::uint64_t const bits = m_dropped[gen][i].load(std::memory_order_relaxed);
+			for (std::size_t k = 0; k < 64 && i * 64 + k < abi_alert_count; ++k)
+				if (bits & (std::uint64_t(1) << k)) dropped.set(i * 64 + k);
+		}
+		emplace_alert<alerts_dropped_alert>(dropped);
+	}
+
+	std::array<std::int64_t, 32> alert_manager::dropped_alerts_per_category() const
+	{
+		std::array<std::int64_t, 32> ret;
+		for (int i = 0; i < 32; ++i)
+			ret[std::size_t(i)] = m_dropped_categories[i].load(std::memory_order_relaxed);
+		return ret;
+	}
+
+	alert* alert_manager::peek() const
+	{
+		int const gen = m_generation.load();
+		if (m_num_queued[gen].load() == 0) return nullptr;
+		int const num = std::min(m_num_producers.load(), max_producers);
+		for (int i = 0; i < num; ++i)
+		{
+			alert* a = m_producers[i].head[gen].load(std::memory_order_acquire);
+			if (a) return a;
+		}
+		return m_shared_producer.head[gen].load(std::memory_order_acquire);
+	}
+
+#ifdef TORRENT_LINUX
+	void alert_manager::wait(std::uint32_t const seq, time_duration const max_wait)
+	{
+		std::int64_t const ns = std::max(std::int64_t(0), total_microseconds(max_wait) * 1000);
+		timespec ts;
+		ts.tv_sec = time_t(ns / 1000000000);
+		ts.tv_nsec = long(ns % 1000000000);
+		// this call can be interrupted prematurely by other signals, and it
+		// returns immediately if m_wakeup has changed since we read seq
+		static_assert(sizeof(m_wakeup) == sizeof(std::uint32_t), "m_wakeup is used as a futex");
+		::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&m_wakeup)
+			, FUTEX_WAIT_PRIVATE, seq, &ts, nullptr, 0);
+	}
+
+	void alert_manager::wake()
+	{
+		::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&m_wakeup)
+			, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+	}
+#else
+	void alert_manager::wait(std::uint32_t const seq, time_duration const max_wait)
+	{
+		std::unique_lock<std::mutex> l(m_wait_mutex);
+		m_wait_cond.wait_for(l, max_wait, [&] { return m_wakeup.load() != seq; });
+	}
+
+	void alert_manager::wake()
 	{
-		std::unique_lock<std::recursive_mutex> lock(m_mutex);
+		{
+			// make sure a waiting thread is either not yet checking m_wakeup, or
+			// is already waiting on the condition variable
+			std::lock_guard<std::mutex> l(m_wait_mutex);
+		}
+		m_wait_cond.notify_all();
+	}
+#endif
 
-		if (!m_alerts[m_generation].empty())
-			return m_alerts[m_generation].front();
+	alert* alert_manager::wait_for_alert(time_duration max_wait)
+	{
+		std::uint32_t const seq = m_wakeup.load();
+		if (alert* a = peek()) return a;
 
-		// this call can be interrupted prematurely by other signals
-		m_condition.wait_for(lock, max_wait);
-		if (!m_alerts[m_generation].empty())
-			return m_alerts[m_generation].front();
+		++m_waiters;
+		wait(seq, max_wait);
+		--m_waiters;
 
-		return nullptr;
+		return peek();
 	}
 
-	void alert_manager::maybe_notify(alert* a)
+	void alert_manager::maybe_notify(producer& p, int const gen, alert* a)
 	{
-		if (m_alerts[m_generation].size() == 1)
+		p.head[gen].store(p.alerts[gen].front(), std::memory_order_release);
+
+		if (m_num_queued[gen].fetch_add(1) == 0)
 		{
 			// we just posted to an empty queue. If anyone is waiting for
 			// alerts, we need to notify them. Also (potentially) call the
 			// user supplied m_notify callback to let the client wake up its
 			// message loop to poll for alerts.
-			if (m_notify) m_notify();
+			{
+				std::lock_guard<std::recursive_mutex> l(m_notify_mutex);
+				if (m_notify) m_notify();
+			}
 
-			// TODO: 2 keep a count of the number of threads waiting. Only if it's
-			// > 0 notify them
-			m_condition.notify_all();
+			++m_wakeup;
+			if (m_waiters.load() > 0) wake();
 		}
 
 #ifndef TORRENT_DISABLE_EXTENSIONS
-		for (auto& e : m_ses_extensions)
-			e->on_alert(a);
+		if (!m_ses_extensions.empty())
+		{
+			std::lock_guard<std::recursive_mutex> l(m_extensions_mutex);
+			for (auto& e : m_ses_extensions)
+				e->on_alert(a);
+		}
 #else
 		TORRENT_UNUSED(a);
 #endif
@@ -92,9 +287,9 @@ namespace aux {
 
 	void alert_manager::set_notify_function(std::function<void()> const& fun)
 	{
-		std::unique_lock<std::recursive_mutex> lock(m_mutex);
+		std::lock_guard<std::recursive_mutex> l(m_notify_mutex);
 		m_notify = fun;
-		if (!m_alerts[m_generation].empty())
+		if (m_num_queued[m_generation.load()].load() > 0)
 		{
 			if (m_notify) m_notify();
 		}
@@ -103,46 +298,87 @@ namespace aux {
 #ifndef TORRENT_DISABLE_EXTENSIONS
 	void alert_manager::add_extension(std::shared_ptr<plugin> ext)
 	{
+		std::lock_guard<std::recursive_mutex> l(m_extensions_mutex);
 		m_ses_extensions.push_back(ext);
 	}
 #endif
 
 	void alert_manager::get_all(std::vector<alert*>& alerts)
 	{
-		std::lock_guard<std::recursive_mutex> lock(m_mutex);
+		std::lock_guard<std::mutex> l(m_get_all_mutex);
+
+		alerts.clear();
 
-		if (m_alerts[m_generation].empty())
+		int const gen = m_generation.load();
+		if (m_num_queued[gen].load() == 0) return;
+
+		// nobody is posting to the next generation, the client is done with
+		// the alerts in there (it's calling get_all() again). Clear it before
+		// letting producers use it
+		int const next = gen ^ 1;
+		int const num = std::min(m_num_producers.load(), max_producers);
+		auto reset = [next](producer& p)
 		{
-			alerts.clear();
-			return;
+			p.head[next].store(nullptr, std::memory_order_relaxed);
+			p.alerts[next].clear();
+			p.allocations[next].reset();
+		};
+		for (int i = 0; i < num; ++i) reset(m_producers[i]);
+		{
+			std::lock_guard<std::recursive_mutex> sl(m_shared_mutex);
+			reset(m_shared_producer);
 		}
+		m_num_queued[next].store(0);
+		for (auto& d : m_dropped[next]) d.store(0, std::memory_order_relaxed);
 
-		if (m_dropped.any()) {
-			emplace_alert<alerts_dropped_alert>(m_dropped);
-			m_dropped.reset();
-		}
+		// swap buffers
+		m_generation.store(next);
 
-		m_alerts[m_generation].get_pointers(alerts);
+		// wait for the threads still posting to the generation we're about to
+		// return. Posting an alert doesn't block, except for the calls to the
+		// plugins' on_alert(), so this wait is as long as the slowest
+		// on_alert() call (if there are any plugins), and short otherwise.
+		// The calling thread itself may be one of them, if get_all() is called
+		// from the notify function. The shared producer is protected by its
+		// mutex instead.
+		std::thread::id const self = std::this_thread::get_id();
+		std::vector<alert*> tmp;
+		auto collect = [&](producer& p, bool const wait_for_producer)
+		{
+			if (wait_for_producer && p.owner.load() != self)
+			{
+				while (p.active.load() == gen) std::this_thread::yield();
+			}
+			if (p.alerts[gen].empty()) return;
+			p.alerts[gen].get_pointers(tmp);
+			auto const mid = alerts.size();
+			alerts.insert(alerts.end(), tmp.begin(), tmp.end());
 
-		// swap buffers
-		m_generation = (m_generation + 1) & 1;
-		// clear the one we will start writing to now
-		m_alerts[m_generation].clear();
-		m_allocations[m_generation].reset();
+			// the alerts from each thread are in the order they were posted.
+			// Merge them by time stamp
+			if (mid > 0)
+			{
+				std::inplace_merge(alerts.begin(), alerts.begin() + std::ptrdiff_t(mid)
+					, alerts.end(), [](alert const* lhs, alert const* rhs)
+					{ return lhs->timestamp() < rhs->timestamp(); });
+			}
+		};
+		for (int i = 0; i < std::min(m_num_producers.load(), max_producers); ++i)
+			collect(m_producers[i], true);
+		{
+			std::lock_guard<std::recursive_mutex> sl(m_shared_mutex);
+			collect(m_shared_producer, false);
+		}
 	}
 
 	bool alert_manager::pending() const
 	{
-		std::lock_guard<std::recursive_mutex> lock(m_mutex);
-		return !m_alerts[m_generation].empty();
+		return m_num_queued[m_generation.load()].load() > 0;
 	}
 
 	int alert_manager::set_alert_queue_size_limit(int queue_size_limit_)
 	{
-		std::lock_guard<std::recursive_mutex> lock(m_mutex);
-
-		std::swap(m_queue_size_limit, queue_size_limit_);
-		return queue_size_limit_;
+		return m_queue_size_limit.exchange(queue_size_limit_);
 	}
 }
 }
@@ -40,8 +40,10 @@ namespace libtorrent {
 namespace aux {
 
 	bandwidth_channel::bandwidth_channel()
-		: tmp(0)
+		: queued_priority(0)
+		, last_update(0)
 		, distribute_quota(0)
+		, m_quota_fraction(0)
 		, m_quota_left(0)
 		, m_limit(0)
 	{}
@@ -61,15 +63,19 @@ namespace aux {
 		return std::max(int(m_quota_left), 0);
 	}
 
-	void bandwidth_channel::update_quota(int const dt_milliseconds)
+	void bandwidth_channel::update_quota(std::int64_t const dt_microseconds)
 	{
 		TORRENT_ASSERT_VAL(m_limit >= 0, m_limit);
 		TORRENT_ASSERT_VAL(m_limit < inf, m_limit);
+		TORRENT_ASSERT(dt_microseconds >= 0);
 
 		if (m_limit == 0) return;
 
 		// "to_add" should never have int64 overflow: "m_limit" contains < "<int>::max"
-		std::int64_t const to_add = (std::int64_t(m_limit) * dt_milliseconds + 500) / 1000;
+		// and the bandwidth_manager never passes more than a few minutes
+		std::int64_t const micro_bytes = std::int64_t(m_limit) * dt_microseconds + m_quota_fraction;
+		std::int64_t const to_add = micro_bytes / 1000000;
+		m_quota_fraction = micro_bytes % 1000000;
 
 		if (to_add > inf - m_quota_left)
 		{
@@ -78,7 +84,12 @@ namespace aux {
 		else
 		{
 			m_quota_left += to_add;
-			if (m_quota_left / 3 > m_limit) m_quota_left = std::int64_t(m_limit) * 3;
+			// don't let more than 3 seconds worth of quota build up. Unless
+			// this update covers more than that, which happens when there
+			// are more requests queued than the bandwidth_manager visits in
+			// one tick
+			std::int64_t const max_quota = std::max(std::int64_t(m_limit) * 3, to_add);
+			if (m_quota_left > max_quota) m_quota_left = max_quota;
 			// "m_quota_left" will never have int64 overflow but may exceed "<int>::max"
 			m_quota_left = std::min(m_quota_left, std::int64_t(inf));
 		}
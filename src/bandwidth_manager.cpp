@@ -34,9 +34,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "libtorrent/aux_/bandwidth_manager.hpp"
 
-#if TORRENT_USE_ASSERTS
-#include <climits>
-#endif
+#include <vector>
 
 namespace libtorrent {
 namespace aux {
@@ -48,14 +46,23 @@ namespace aux {
 	{
 	}
 
+	bandwidth_manager::~bandwidth_manager()
+	{
+		// the bandwidth channels may outlive us, and be used by another
+		// bandwidth_manager
+		for (auto const& r : m_queue) remove_channels(r);
+	}
+
 	void bandwidth_manager::close()
 	{
 		m_abort = true;
 
-		std::vector<bw_request> queue;
+		std::deque<bw_request> queue;
 		queue.swap(m_queue);
 		m_queued_bytes = 0;
 
+		for (auto const& r : queue) remove_channels(r);
+
 		while (!queue.empty())
 		{
 			bw_request& bwr = queue.back();
@@ -85,6 +92,28 @@ namespace aux {
 		return m_queued_bytes;
 	}
 
+	void bandwidth_manager::add_channels(bw_request const& r)
+	{
+		for (int j = 0; j < bw_request::max_bandwidth_channels && r.channel[j]; ++j)
+		{
+			bandwidth_channel* bwc = r.channel[j];
+			// the channel doesn't accrue any quota while it has nothing
+			// queued
+			if (bwc->queued_priority == 0) bwc->last_update = m_time;
+			bwc->queued_priority += r.priority;
+		}
+	}
+
+	void bandwidth_manager::remove_channels(bw_request const& r)
+	{
+		for (int j = 0; j < bw_request::max_bandwidth_channels && r.channel[j]; ++j)
+		{
+			bandwidth_channel* bwc = r.channel[j];
+			TORRENT_ASSERT(bwc->queued_priority >= r.priority);
+			bwc->queued_priority -= r.priority;
+		}
+	}
+
 	// non prioritized means that, if there's a line for bandwidth,
 	// others will cut in front of the non-prioritized peers.
 	// this is used by web seeds
@@ -121,6 +150,7 @@ namespace aux {
 		if (k == 0) return blk;
 
 		m_queued_bytes += blk;
+		add_channels(bwr);
 		m_queue.push_back(std::move(bwr));
 		return 0;
 	}
@@ -132,6 +162,8 @@ namespace aux {
 		for (auto const& r : m_queue)
 		{
 			queued += r.request_size - r.assigned;
+			for (int j = 0; j < bw_request::max_bandwidth_channels && r.channel[j]; ++j)
+				TORRENT_ASSERT(r.channel[j]->queued_priority >= r.priority);
 		}
 		TORRENT_ASSERT(queued == m_queued_bytes);
 	}
@@ -140,80 +172,74 @@ namespace aux {
 	void bandwidth_manager::update_quotas(time_duration const& dt)
 	{
 		if (m_abort) return;
-		if (m_queue.empty()) return;
-
-		INVARIANT_CHECK;
 
-		std::int64_t dt_milliseconds = total_milliseconds(dt);
-		if (dt_milliseconds > 3000) dt_milliseconds = 3000;
+		std::int64_t dt_microseconds = total_microseconds(dt);
+		if (dt_microseconds > 3000000) dt_microseconds = 3000000;
+		if (dt_microseconds < 0) dt_microseconds = 0;
+		m_time += dt_microseconds;
 
-		// for each bandwidth channel, call update_quota(dt)
+		if (m_queue.empty()) return;
 
-		std::vector<bandwidth_channel*> channels;
+		INVARIANT_CHECK;
 
+		// every request is visited once per tick
 		std::vector<bw_request> queue;
 
-		for (auto i = m_queue.begin(); i != m_queue.end();)
+		for (int i = int(m_queue.size()); i > 0; --i)
 		{
-			if (i->peer->is_disconnecting())
+			bw_request r = std::move(m_queue.front());
+			m_queue.pop_front();
+
+			if (r.peer->is_disconnecting())
 			{
-				m_queued_bytes -= i->request_size - i->assigned;
+				m_queued_bytes -= r.request_size - r.assigned;
 
 				// return all assigned quota to all the
 				// bandwidth channels this peer belongs to
-				for (int j = 0; j < bw_request::max_bandwidth_channels && i->channel[j]; ++j)
+				for (int j = 0; j < bw_request::max_bandwidth_channels && r.channel[j]; ++j)
 				{
-					bandwidth_channel* bwc = i->channel[j];
-					bwc->return_quota(i->assigned);
+					bandwidth_channel* bwc = r.channel[j];
+					bwc->return_quota(r.assigned);
 				}
 
-				i->assigned = 0;
-				queue.push_back(std::move(*i));
-				i = m_queue.erase(i);
+				r.assigned = 0;
+				queue.push_back(std::move(r));
 				continue;
 			}
-			for (int j = 0; j < bw_request::max_bandwidth_channels && i->channel[j]; ++j)
-			{
-				bandwidth_channel* bwc = i->channel[j];
-				bwc->tmp = 0;
-			}
-			++i;
-		}
 
-		for (auto const& r : m_queue)
-		{
+			// add the quota accrued since the channel was last updated. The
+			// quota distributed this tick is what the channel has at this
+			// point, requests visited later in the same tick are assigned
+			// their share of the same amount
 			for (int j = 0; j < bw_request::max_bandwidth_channels && r.channel[j]; ++j)
 			{
 				bandwidth_channel* bwc = r.channel[j];
-				if (bwc->tmp == 0) channels.push_back(bwc);
-				TORRENT_ASSERT(INT_MAX - bwc->tmp > r.priority);
-				bwc->tmp += r.priority;
+				if (bwc->last_update == m_time) continue;
+				std::int64_t const elapsed = m_time - bwc->last_update;
+				bwc->update_quota(elapsed);
+				bwc->last_update = m_time;
 			}
-		}
-
-		for (auto const& ch : channels)
-		{
-			ch->update_quota(int(dt_milliseconds));
-		}
 
-		for (auto i = m_queue.begin(); i != m_queue.end();)
-		{
-			int a = i->assign_bandwidth();
-			if (i->assigned == i->request_size
-				|| (i->ttl <= 0 && i->assigned > 0))
+			int a = r.assign_bandwidth();
+			if (r.assigned == r.request_size
+				|| (r.ttl <= 0 && r.assigned > 0))
 			{
-				a += i->request_size - i->assigned;
-				TORRENT_ASSERT(i->assigned <= i->request_size);
-				queue.push_back(std::move(*i));
-				i = m_queue.erase(i);
+				a += r.request_size - r.assigned;
+				TORRENT_ASSERT(r.assigned <= r.request_size);
+				queue.push_back(std::move(r));
 			}
 			else
 			{
-				++i;
+				m_queue.push_back(std::move(r));
 			}
 			m_queued_bytes -= a;
 		}
 
+		// the requests that are done only leave their channels once every
+		// request has been visited. The share of a channel's quota is based
+		// on the requests queued on it when the tick started
+		for (auto const& r : queue) remove_channels(r);
+
 		while (!queue.empty())
 		{
 			bw_request& bwr = queue.back();
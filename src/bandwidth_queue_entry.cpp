@@ -59,15 +59,15 @@ namespace aux {
 		--ttl;
 		if (quota == 0) return quota;
 
-		for (int j = 0; j < 5 && channel[j]; ++j)
+		for (int j = 0; j < max_bandwidth_channels && channel[j]; ++j)
 		{
 			if (channel[j]->throttle() == 0) continue;
-			if (channel[j]->tmp == 0) continue;
-			quota = std::min(int(std::int64_t(channel[j]->distribute_quota)
-				* priority / channel[j]->tmp), quota);
+			TORRENT_ASSERT(channel[j]->queued_priority >= priority);
+			quota = int(std::min(std::int64_t(channel[j]->distribute_quota)
+				* priority / channel[j]->queued_priority, std::int64_t(quota)));
 		}
 		assigned += quota;
-		for (int j = 0; j < 5 && channel[j]; ++j)
+		for (int j = 0; j < max_bandwidth_channels && channel[j]; ++j)
 			channel[j]->use_quota(quota);
 		TORRENT_ASSERT(assigned <= request_size);
 		return quota;
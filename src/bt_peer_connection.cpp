@@ -510,6 +510,15 @@ namespace {
 		return !m_sent_handshake || m_state < state_t::read_packet_size;
 	}
 
+	bool bt_peer_connection::can_send_references() const
+	{
+#if !defined TORRENT_DISABLE_ENCRYPTION
+		// encrypted payload is copied by append_const_send_buffer() anyway
+		if (!m_enc_handler.is_send_plaintext()) return false;
+#endif
+		return peer_connection::can_send_references();
+	}
+
 #if !defined TORRENT_DISABLE_ENCRYPTION
 
 	void bt_peer_connection::write_pe1_2_dhkey()
@@ -797,6 +806,11 @@ namespace {
 		std::shared_ptr<torrent> t = associated_torrent().lock();
 		TORRENT_ASSERT(t);
 
+		// the payload may be received straight into a disk buffer
+		piece_block_progress const disk_progress = disk_receive_progress();
+		if (disk_progress.piece_index != piece_block_progress::invalid_index)
+			return disk_progress;
+
 		span<char const> recv_buffer = m_recv_buffer.get();
 		// are we currently receiving a 'piece' message?
 		if (m_state != state_t::read_packet
@@ -1117,7 +1131,24 @@ namespace {
 		}
 
 		incoming_piece_fragment(piece_bytes);
-		if (!m_recv_buffer.packet_finished()) return;
+		if (!m_recv_buffer.packet_finished())
+		{
+			// the first time the entire header has been received, try to
+			// receive the rest of the payload straight into a disk buffer.
+			// That's not possible when the stream is encrypted, since it's
+			// decrypted in the receive buffer. If it is possible, this message
+			// is done as far as we're concerned, the payload is passed
+			// directly to incoming_piece() once it has been received
+#if !defined TORRENT_DISABLE_ENCRYPTION
+			if (!m_enc_handler.is_recv_plaintext()) return;
+#endif
+			if (recv_pos - received < header_size
+				&& start_disk_receive(p, recv_buffer.subspan(header_size)))
+			{
+				m_recv_buffer.cut(0, recv_pos);
+			}
+			return;
+		}
 
 		incoming_piece(p, recv_buffer.data() + header_size);
 	}
@@ -2022,7 +2053,11 @@ namespace {
 		// but where do we put that info?
 
 		int const last_seen_complete = int(root.dict_find_int_value("complete_ago", -1));
-		if (last_seen_complete >= 0) set_last_seen_complete(last_seen_complete);
+		if (last_seen_complete >= 0)
+		{
+			set_last_seen_complete(last_seen_complete);
+			t->swarm_seen_complete(this->last_seen_complete());
+		}
 
 		auto const client_info = root.dict_find_string_value("v");
 		if (!client_info.empty())
@@ -41,13 +41,13 @@ POSSIBILITY OF SUCH DAMAGE.
 #if defined _MSC_VER && TORRENT_HAS_SSE
 #include <intrin.h>
 #include <nmmintrin.h>
+#include <immintrin.h> // for _xgetbv
 #endif
 
 #if TORRENT_HAS_SSE && defined __GNUC__
 #include <cpuid.h>
-#else
-#include <cstring> // for std::memset
 #endif
+#include <cstring> // for std::memset
 
 #if defined __GLIBC__ && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 16))
 #define TORRENT_HAS_AUXV 1
@@ -95,6 +95,48 @@ namespace {
 		std::memset(&info[0], 0, sizeof(std::uint32_t) * 4);
 #endif
 	}
+
+	// like cpuid(), but for leaves that have sub-leaves
+	void cpuid_count(std::uint32_t* info, int type, int sub) noexcept
+	{
+#if defined _MSC_VER
+		__cpuidex(reinterpret_cast<int*>(info), type, sub);
+#elif defined __GNUC__
+		if (__get_cpuid_max(0, nullptr) < std::uint32_t(type))
+		{
+			std::memset(&info[0], 0, sizeof(std::uint32_t) * 4);
+			return;
+		}
+		__cpuid_count(std::uint32_t(type), std::uint32_t(sub), info[0], info[1], info[2], info[3]);
+#else
+		TORRENT_UNUSED(type);
+		TORRENT_UNUSED(sub);
+		std::memset(&info[0], 0, sizeof(std::uint32_t) * 4);
+#endif
+	}
+
+	// returns true if the operating system saves the AVX (YMM) registers on
+	// context switches
+	bool os_supports_avx() noexcept
+	{
+		std::uint32_t cpui[4] = {0};
+		cpuid(cpui, 1);
+		// OSXSAVE and AVX
+		if ((cpui[2] & (1 << 27)) == 0 || (cpui[2] & (1 << 28)) == 0)
+			return false;
+#if defined _MSC_VER
+		std::uint64_t const xcr0 = _xgetbv(0);
+#elif defined __GNUC__
+		std::uint32_t eax = 0;
+		std::uint32_t edx = 0;
+		__asm__ ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		std::uint64_t const xcr0 = (std::uint64_t(edx) << 32) | eax;
+#else
+		std::uint64_t const xcr0 = 0;
+#endif
+		// the XMM and YMM state
+		return (xcr0 & 6) == 6;
+	}
 #endif
 
 	bool supports_sse42() noexcept
@@ -119,6 +161,33 @@ namespace {
 #endif
 	}
 
+	bool supports_sha_ni() noexcept
+	{
+#if TORRENT_HAS_SSE
+		std::uint32_t cpui[4] = {0};
+		cpuid(cpui, 1);
+		// the SHA extensions are used together with SSSE3 and SSE4.1
+		if ((cpui[2] & (1 << 9)) == 0 || (cpui[2] & (1 << 19)) == 0)
+			return false;
+		cpuid_count(cpui, 7, 0);
+		return (cpui[1] & (1 << 29)) != 0;
+#else
+		return false;
+#endif
+	}
+
+	bool supports_avx2() noexcept
+	{
+#if TORRENT_HAS_SSE
+		if (!os_supports_avx()) return false;
+		std::uint32_t cpui[4] = {0};
+		cpuid_count(cpui, 7, 0);
+		return (cpui[1] & (1 << 5)) != 0;
+#else
+		return false;
+#endif
+	}
+
 	bool supports_arm_neon() noexcept
 	{
 #if TORRENT_HAS_ARM_NEON && TORRENT_HAS_AUXV
@@ -159,4 +228,6 @@ namespace {
 	bool const mmx_support = supports_mmx();
 	bool const arm_neon_support = supports_arm_neon();
 	bool const arm_crc32c_support = supports_arm_crc32c();
+	bool const sha_ni_support = supports_sha_ni();
+	bool const avx2_support = supports_avx2();
 } }
@@ -0,0 +1,402 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/disk_buffer_arena.hpp"
+#include "libtorrent/disk_interface.hpp" // for default_block_size
+#include "libtorrent/assert.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+
+#if TORRENT_HAVE_MMAP
+#include <sys/mman.h>
+
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+auto const map_failed = MAP_FAILED;
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+#endif
+
+namespace libtorrent {
+namespace aux {
+
+	static_assert(disk_buffer_arena::blocks_per_slab * default_block_size
+		== disk_buffer_arena::slab_size, "slabs must hold a whole number of blocks");
+
+namespace {
+
+	std::atomic<std::uint64_t> g_instance{0};
+
+	// the arenas that are alive, so that a thread exiting can tell whether
+	// the arena it used last is still around to return its cache to
+	std::mutex g_arenas_mutex;
+	std::vector<std::pair<std::uint64_t, disk_buffer_arena*>> g_arenas;
+
+	// g_arenas_mutex must be held
+	disk_buffer_arena* find_arena(std::uint64_t const instance)
+	{
+		auto const i = std::find_if(g_arenas.begin(), g_arenas.end()
+			, [&](std::pair<std::uint64_t, disk_buffer_arena*> const& e)
+			{ return e.first == instance; });
+		return i == g_arenas.end() ? nullptr : i->second;
+	}
+
+	// the caches the current thread owns, and which arena each belongs to.
+	// Almost all disk buffers are allocated and freed from the network thread
+	// and the disk threads of a single session, so the one used last is
+	// checked first
+	struct cache_bindings
+	{
+		cache_bindings() = default;
+		cache_bindings(cache_bindings const&) = delete;
+		cache_bindings& operator=(cache_bindings const&) = delete;
+
+		~cache_bindings()
+		{
+			if (entries.empty()) return;
+			std::lock_guard<std::mutex> l(g_arenas_mutex);
+			for (auto const& e : entries)
+			{
+				if (e.cache == nullptr) continue;
+				disk_buffer_arena* const a = find_arena(e.instance);
+				if (a != nullptr) a->release_cache(e.cache);
+			}
+		}
+
+		struct entry
+		{
+			std::uint64_t instance;
+			// nullptr if the arena had no cache left for this thread
+			void* cache;
+		};
+		std::vector<entry> entries;
+		std::size_t last = 0;
+	};
+	thread_local cache_bindings t_caches;
+
+	char* map_slab(bool const hugepages, bool& huge)
+	{
+		huge = false;
+#if TORRENT_HAVE_MMAP
+#ifdef MAP_HUGETLB
+		if (hugepages)
+		{
+			void* const ret = ::mmap(nullptr, disk_buffer_arena::slab_size
+				, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (ret != map_failed)
+			{
+				huge = true;
+				return static_cast<char*>(ret);
+			}
+		}
+#endif
+		void* const ret = ::mmap(nullptr, disk_buffer_arena::slab_size
+			, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (ret == map_failed) return nullptr;
+#ifdef MADV_HUGEPAGE
+		// no explicit huge pages are reserved, fall back to transparent ones
+		if (hugepages) ::madvise(ret, disk_buffer_arena::slab_size, MADV_HUGEPAGE);
+#endif
+		return static_cast<char*>(ret);
+#else
+		TORRENT_UNUSED(hugepages);
+		return static_cast<char*>(std::malloc(disk_buffer_arena::slab_size));
+#endif
+	}
+
+	void unmap_slab(char* const memory)
+	{
+#if TORRENT_HAVE_MMAP
+		::munmap(memory, disk_buffer_arena::slab_size);
+#else
+		std::free(memory);
+#endif
+	}
+}
+
+	constexpr int disk_buffer_arena::slab_size;
+	constexpr int disk_buffer_arena::blocks_per_slab;
+	constexpr int disk_buffer_arena::max_thread_caches;
+	constexpr int disk_buffer_arena::cache_capacity;
+	constexpr int disk_buffer_arena::cache_batch;
+
+	disk_buffer_arena::disk_buffer_arena()
+		: m_instance(++g_instance)
+	{
+		std::lock_guard<std::mutex> l(g_arenas_mutex);
+		g_arenas.emplace_back(m_instance, this);
+	}
+
+	disk_buffer_arena::~disk_buffer_arena()
+	{
+		{
+			std::lock_guard<std::mutex> l(g_arenas_mutex);
+			g_arenas.erase(std::remove_if(g_arenas.begin(), g_arenas.end()
+				, [this](std::pair<std::uint64_t, disk_buffer_arena*> const& e)
+				{ return e.second == this; }), g_arenas.end());
+		}
+
+		for (auto const& s : m_slabs)
+			unmap_slab(s.memory);
+	}
+
+	disk_buffer_arena::thread_cache* disk_buffer_arena::local_cache()
+	{
+		auto& b = t_caches;
+		if (b.last < b.entries.size() && b.entries[b.last].instance == m_instance)
+			return static_cast<thread_cache*>(b.entries[b.last].cache);
+
+		for (std::size_t i = 0; i < b.entries.size(); ++i)
+		{
+			if (b.entries[i].instance != m_instance) continue;
+			b.last = i;
+			return static_cast<thread_cache*>(b.entries[i].cache);
+		}
+
+		// claim a free cache. Threads beyond max_thread_caches use the
+		// central free list directly
+		std::thread::id const self = std::this_thread::get_id();
+		thread_cache* ret = nullptr;
+		for (auto& c : m_caches)
+		{
+			std::thread::id expected;
+			if (!c.owner.compare_exchange_strong(expected, self)) continue;
+			ret = &c;
+			break;
+		}
+
+		// forget about the arenas that have been destructed since
+		{
+			std::lock_guard<std::mutex> l(g_arenas_mutex);
+			b.entries.erase(std::remove_if(b.entries.begin(), b.entries.end()
+				, [](cache_bindings::entry const& e) { return find_arena(e.instance) == nullptr; })
+				, b.entries.end());
+		}
+		b.entries.push_back({m_instance, ret});
+		b.last = b.entries.size() - 1;
+		return ret;
+	}
+
+	void disk_buffer_arena::release_cache(void* const cache)
+	{
+		auto& c = *static_cast<thread_cache*>(cache);
+		TORRENT_ASSERT(c.owner.load() == std::this_thread::get_id());
+
+		std::lock_guard<std::mutex> l(m_mutex);
+		int const size = c.size.load(std::memory_order_relaxed);
+		for (int i = 0; i < size; ++i)
+			push_free(c.blocks[std::size_t(i)]);
+		c.size.store(0, std::memory_order_relaxed);
+		c.owner.store(std::thread::id());
+		release_free_slabs();
+	}
+
+	char* disk_buffer_arena::allocate()
+	{
+		thread_cache* const c = local_cache();
+		if (c == nullptr)
+		{
+			std::lock_guard<std::mutex> l(m_mutex);
+			if (m_free.empty() && !add_slab()) return nullptr;
+			return pop_free();
+		}
+
+		int size = c->size.load(std::memory_order_relaxed);
+		if (size == 0)
+		{
+			size = refill(*c);
+			if (size == 0) return nullptr;
+		}
+		else
+		{
+			c->hits.store(c->hits.load(std::memory_order_relaxed) + 1
+				, std::memory_order_relaxed);
+		}
+
+		--size;
+		char* const ret = c->blocks[std::size_t(size)];
+		c->size.store(size, std::memory_order_relaxed);
+		return ret;
+	}
+
+	void disk_buffer_arena::free(char* const buf)
+	{
+		TORRENT_ASSERT(buf != nullptr);
+		thread_cache* const c = local_cache();
+		if (c == nullptr)
+		{
+			std::lock_guard<std::mutex> l(m_mutex);
+			push_free(buf);
+			release_free_slabs();
+			return;
+		}
+
+		int size = c->size.load(std::memory_order_relaxed);
+		if (size == cache_capacity) size = flush(*c);
+		c->blocks[std::size_t(size)] = buf;
+		c->size.store(size + 1, std::memory_order_relaxed);
+	}
+
+	int disk_buffer_arena::refill(thread_cache& c)
+	{
+		TORRENT_ASSERT(c.size.load(std::memory_order_relaxed) == 0);
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (int(m_free.size()) < cache_batch) add_slab();
+
+		int const n = std::min(int(m_free.size()), cache_batch);
+		for (int i = n - 1; i >= 0; --i)
+			c.blocks[std::size_t(i)] = pop_free();
+		++m_central_transfers;
+		return n;
+	}
+
+	int disk_buffer_arena::flush(thread_cache& c)
+	{
+		TORRENT_ASSERT(c.size.load(std::memory_order_relaxed) == cache_capacity);
+
+		// hand back the blocks at the bottom of the cache. The ones at the top
+		// were freed most recently and are the most likely to still be in the
+		// CPU cache
+		std::lock_guard<std::mutex> l(m_mutex);
+		for (int i = 0; i < cache_batch; ++i)
+			push_free(c.blocks[std::size_t(i)]);
+		std::copy(c.blocks.begin() + cache_batch, c.blocks.end(), c.blocks.begin());
+		++m_central_transfers;
+		release_free_slabs();
+		return cache_capacity - cache_batch;
+	}
+
+	bool disk_buffer_arena::add_slab()
+	{
+		bool huge = false;
+		char* const memory = map_slab(m_hugepages.load(), huge);
+		if (memory == nullptr) return false;
+
+		auto const i = std::upper_bound(m_slabs.begin(), m_slabs.end(), memory
+			, [](char const* m, slab const& s) { return m < s.memory; });
+		m_slabs.insert(i, {memory, huge, blocks_per_slab});
+		++m_free_slabs;
+		m_free.reserve(m_free.size() + blocks_per_slab);
+
+		// push the blocks in reverse, to hand them out in address order
+		for (int b = blocks_per_slab - 1; b >= 0; --b)
+			m_free.push_back(memory + b * default_block_size);
+		return true;
+	}
+
+	disk_buffer_arena::slab& disk_buffer_arena::slab_of(char const* const block)
+	{
+		auto const i = std::upper_bound(m_slabs.begin(), m_slabs.end(), block
+			, [](char const* b, slab const& s) { return b < s.memory; });
+		TORRENT_ASSERT(i != m_slabs.begin());
+		TORRENT_ASSERT(block < std::prev(i)->memory + slab_size);
+		return *std::prev(i);
+	}
+
+	void disk_buffer_arena::push_free(char* const block)
+	{
+		m_free.push_back(block);
+		slab& s = slab_of(block);
+		TORRENT_ASSERT(s.free < blocks_per_slab);
+		if (++s.free == blocks_per_slab) ++m_free_slabs;
+	}
+
+	char* disk_buffer_arena::pop_free()
+	{
+		TORRENT_ASSERT(!m_free.empty());
+		char* const ret = m_free.back();
+		m_free.pop_back();
+		slab& s = slab_of(ret);
+		TORRENT_ASSERT(s.free > 0);
+		if (s.free-- == blocks_per_slab) --m_free_slabs;
+		return ret;
+	}
+
+	void disk_buffer_arena::release_free_slabs()
+	{
+		int const excess = int(m_slabs.size()) - m_max_retained_slabs;
+		if (m_max_retained_slabs == 0 || excess <= 0 || m_free_slabs == 0) return;
+
+		// mark the slabs to release, by setting their free count to -1
+		int const release = std::min(excess, m_free_slabs);
+		int marked = 0;
+		for (auto& s : m_slabs)
+		{
+			if (marked == release) break;
+			if (s.free != blocks_per_slab) continue;
+			s.free = -1;
+			++marked;
+		}
+
+		m_free.erase(std::remove_if(m_free.begin(), m_free.end()
+			, [this](char const* b) { return slab_of(b).free < 0; }), m_free.end());
+
+		for (auto const& s : m_slabs)
+			if (s.free < 0) unmap_slab(s.memory);
+		m_slabs.erase(std::remove_if(m_slabs.begin(), m_slabs.end()
+			, [](slab const& s) { return s.free < 0; }), m_slabs.end());
+		m_free_slabs -= release;
+	}
+
+	void disk_buffer_arena::set_hugepages(bool const enable)
+	{
+		m_hugepages.store(enable);
+	}
+
+	void disk_buffer_arena::set_max_retained_slabs(int const n)
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_max_retained_slabs = n;
+		release_free_slabs();
+	}
+
+	disk_buffer_arena::stats disk_buffer_arena::get_stats() const
+	{
+		stats ret;
+		{
+			std::lock_guard<std::mutex> l(m_mutex);
+			ret.slabs = int(m_slabs.size());
+			ret.hugepage_slabs = int(std::count_if(m_slabs.begin(), m_slabs.end()
+				, [](slab const& s) { return s.huge; }));
+			ret.free_blocks = int(m_free.size());
+			ret.central_transfers = m_central_transfers;
+		}
+
+		for (auto const& c : m_caches)
+		{
+			ret.cached_blocks += c.size.load(std::memory_order_relaxed);
+			ret.cache_hits += c.hits.load(std::memory_order_relaxed);
+		}
+		return ret;
+	}
+}
+}
@@ -72,7 +72,7 @@ namespace aux {
 	disk_buffer_pool::disk_buffer_pool(io_context& ios)
 		: m_in_use(0)
 		, m_max_use(64)
-		, m_low_watermark(std::max(m_max_use - 32, 0))
+		, m_low_watermark(32)
 		, m_exceeded_max_size(false)
 		, m_ios(ios)
 	{}
@@ -89,12 +89,17 @@ namespace aux {
 	// and if we're in fact below the low watermark. If so, we need to
 	// post the notification messages to the peers that are waiting for
 	// more buffers to received data into
-	void disk_buffer_pool::check_buffer_level(std::unique_lock<std::mutex>& l)
+	void disk_buffer_pool::check_buffer_level()
 	{
-		TORRENT_ASSERT(l.owns_lock());
-		if (!m_exceeded_max_size || m_in_use > m_low_watermark) return;
+		if (!m_exceeded_max_size.load() || m_in_use.load() > m_low_watermark.load()) return;
 
-		m_exceeded_max_size = false;
+		// check again with the mutex held. allocate_buffer() only adds
+		// observers while the flag is set, with the mutex held, so none of
+		// them can be left behind once we clear it
+		std::unique_lock<std::mutex> l(m_pool_mutex);
+		if (!m_exceeded_max_size.load() || m_in_use.load() > m_low_watermark.load()) return;
+
+		m_exceeded_max_size.store(false);
 
 		std::vector<std::weak_ptr<disk_observer>> cbs;
 		m_observers.swap(cbs);
@@ -104,8 +109,7 @@ namespace aux {
 
 	char* disk_buffer_pool::allocate_buffer(char const* category)
 	{
-		std::unique_lock<std::mutex> l(m_pool_mutex);
-		return allocate_buffer_impl(l, category);
+		return allocate_buffer_impl(category);
 	}
 
 	// we allow allocating more blocks even after we exceed the max size,
@@ -118,51 +122,53 @@ namespace aux {
 	char* disk_buffer_pool::allocate_buffer(bool& exceeded
 		, std::shared_ptr<disk_observer> o, char const* category)
 	{
-		std::unique_lock<std::mutex> l(m_pool_mutex);
-		char* ret = allocate_buffer_impl(l, category);
-		if (m_exceeded_max_size)
+		char* ret = allocate_buffer_impl(category);
+		if (m_exceeded_max_size.load())
 		{
-			exceeded = true;
-			if (o) m_observers.push_back(o);
+			std::lock_guard<std::mutex> l(m_pool_mutex);
+			if (m_exceeded_max_size.load())
+			{
+				exceeded = true;
+				if (o) m_observers.push_back(o);
+			}
 		}
 		return ret;
 	}
 
-	char* disk_buffer_pool::allocate_buffer_impl(std::unique_lock<std::mutex>& l
-		, char const*)
+	char* disk_buffer_pool::allocate_buffer_impl(char const*)
 	{
 		TORRENT_ASSERT(m_settings_set);
 		TORRENT_ASSERT(m_magic == 0x1337);
-		TORRENT_ASSERT(l.owns_lock());
-		TORRENT_UNUSED(l);
 
-		char* ret = static_cast<char*>(std::malloc(default_block_size));
+		char* ret = m_arena.allocate();
 
 		if (ret == nullptr)
 		{
-			m_exceeded_max_size = true;
+			m_exceeded_max_size.store(true);
 			return nullptr;
 		}
 
-		++m_in_use;
+		int const in_use = m_in_use.fetch_add(1) + 1;
 
 #if TORRENT_USE_INVARIANT_CHECKS
 		try
 		{
+			std::lock_guard<std::mutex> l(m_in_use_mutex);
 			TORRENT_ASSERT(m_buffers_in_use.count(ret) == 0);
 			m_buffers_in_use.insert(ret);
 		}
 		catch (...)
 		{
-			free_buffer_impl(ret, l);
+			free_buffer_impl(ret);
 			return nullptr;
 		}
 #endif
 
-		if (m_in_use >= m_low_watermark + (m_max_use - m_low_watermark)
-			/ 2 && !m_exceeded_max_size)
+		int const low_watermark = m_low_watermark.load(std::memory_order_relaxed);
+		if (in_use >= low_watermark + (m_max_use.load(std::memory_order_relaxed)
+			- low_watermark) / 2 && !m_exceeded_max_size.load())
 		{
-			m_exceeded_max_size = true;
+			m_exceeded_max_size.store(true);
 		}
 
 		return ret;
@@ -173,22 +179,20 @@ namespace aux {
 		// sort the pointers in order to maximize cache hits
 		std::sort(bufvec.begin(), bufvec.end());
 
-		std::unique_lock<std::mutex> l(m_pool_mutex);
 		for (char* buf : bufvec)
 		{
 			remove_buffer_in_use(buf);
-			free_buffer_impl(buf, l);
+			free_buffer_impl(buf);
 		}
 
-		check_buffer_level(l);
+		check_buffer_level();
 	}
 
 	void disk_buffer_pool::free_buffer(char* buf)
 	{
-		std::unique_lock<std::mutex> l(m_pool_mutex);
 		remove_buffer_in_use(buf);
-		free_buffer_impl(buf, l);
-		check_buffer_level(l);
+		free_buffer_impl(buf);
+		check_buffer_level();
 	}
 
 	void disk_buffer_pool::set_settings(settings_interface const& sett)
@@ -196,13 +200,20 @@ namespace aux {
 		std::unique_lock<std::mutex> l(m_pool_mutex);
 
 		int const pool_size = std::max(1, sett.get_int(settings_pack::max_queued_disk_bytes) / default_block_size);
-		m_max_use = pool_size;
-		m_low_watermark = m_max_use / 2;
-		if (m_in_use >= m_max_use && !m_exceeded_max_size)
+		m_max_use.store(pool_size);
+		m_low_watermark.store(pool_size / 2);
+		if (m_in_use.load() >= pool_size && !m_exceeded_max_size.load())
 		{
-			m_exceeded_max_size = true;
+			m_exceeded_max_size.store(true);
 		}
 
+		m_arena.set_hugepages(sett.get_bool(settings_pack::disk_buffer_hugepages));
+
+		// keep enough slabs around for the pool to fill up, plus one, to not
+		// return a slab to the system only to map a new one right after
+		int const slab_blocks = disk_buffer_arena::blocks_per_slab;
+		m_arena.set_max_retained_slabs((pool_size + slab_blocks - 1) / slab_blocks + 1);
+
 #if TORRENT_USE_ASSERTS
 		m_settings_set = true;
 #endif
@@ -212,23 +223,22 @@ namespace aux {
 	{
 		TORRENT_UNUSED(buf);
 #if TORRENT_USE_INVARIANT_CHECKS
+		std::lock_guard<std::mutex> l(m_in_use_mutex);
 		std::set<char*>::iterator i = m_buffers_in_use.find(buf);
 		TORRENT_ASSERT(i != m_buffers_in_use.end());
 		m_buffers_in_use.erase(i);
 #endif
 	}
 
-	void disk_buffer_pool::free_buffer_impl(char* buf, std::unique_lock<std::mutex>& l)
+	void disk_buffer_pool::free_buffer_impl(char* buf)
 	{
 		TORRENT_ASSERT(buf);
 		TORRENT_ASSERT(m_magic == 0x1337);
 		TORRENT_ASSERT(m_settings_set);
-		TORRENT_ASSERT(l.owns_lock());
-		TORRENT_UNUSED(l);
 
-		std::free(buf);
+		m_arena.free(buf);
 
-		--m_in_use;
+		m_in_use.fetch_sub(1);
 	}
 
 }
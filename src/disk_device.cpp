@@ -0,0 +1,117 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/disk_device.hpp"
+#include "libtorrent/aux_/path.hpp"
+
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+
+#include <sys/stat.h>
+
+#ifdef TORRENT_LINUX
+#include <sys/sysmacros.h> // for major, minor
+#include <cstdio>
+#endif
+
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+
+namespace libtorrent {
+namespace aux {
+
+namespace {
+
+	bool device_id(std::string const& path, std::uint64_t& id)
+	{
+		native_path_string const f = convert_to_native_path_string(path);
+#ifdef TORRENT_WINDOWS
+		struct ::_stat64 st;
+		if (::_wstat64(f.c_str(), &st) != 0) return false;
+#else
+		struct ::stat st;
+		if (::stat(f.c_str(), &st) != 0) return false;
+#endif
+		id = std::uint64_t(st.st_dev);
+		return true;
+	}
+
+#ifdef TORRENT_LINUX
+	bool read_rotational(char const* path)
+	{
+		FILE* f = std::fopen(path, "r");
+		if (f == nullptr) return false;
+		int const c = std::fgetc(f);
+		std::fclose(f);
+		return c == '1';
+	}
+
+	bool is_rotational(std::uint64_t const id)
+	{
+		auto const dev = static_cast<dev_t>(id);
+		char path[100];
+		// partitions don't have a queue directory of their own, it's in the
+		// parent (whole disk) directory. File systems not backed by a block
+		// device (tmpfs, network file systems) have neither
+		std::snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/queue/rotational"
+			, major(dev), minor(dev));
+		if (read_rotational(path)) return true;
+		std::snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/../queue/rotational"
+			, major(dev), minor(dev));
+		return read_rotational(path);
+	}
+#endif
+
+} // anonymous namespace
+
+	disk_device device_for_path(std::string path)
+	{
+		disk_device ret;
+		path = complete(path);
+		for (;;)
+		{
+			if (device_id(path, ret.id))
+			{
+				ret.valid = true;
+				break;
+			}
+			if (!has_parent_path(path)) return ret;
+			std::string parent = parent_path(path);
+			if (parent.empty() || parent == path) return ret;
+			path = std::move(parent);
+		}
+
+#ifdef TORRENT_LINUX
+		ret.rotational = is_rotational(ret.id);
+#endif
+		return ret;
+	}
+}
+}
@@ -40,4 +40,20 @@ constexpr disk_job_flags_t disk_interface::sequential_access;
 constexpr disk_job_flags_t disk_interface::volatile_read;
 constexpr disk_job_flags_t disk_interface::v1_hash;
 
+disk_buffer_holder disk_interface::allocate_receive_buffer(bool&
+	, std::shared_ptr<disk_observer>, char const*)
+{
+	return {};
+}
+
+bool disk_interface::async_write_buffer(storage_index_t const storage
+	, peer_request const& r, disk_buffer_holder buffer
+	, std::shared_ptr<disk_observer> o
+	, std::function<void(storage_error const&)> handler
+	, disk_job_flags_t const flags)
+{
+	return async_write(storage, r, buffer.data(), std::move(o)
+		, std::move(handler), flags);
+}
+
 }
@@ -0,0 +1,110 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "libtorrent/config.hpp"
+
+#if TORRENT_HAVE_MMAP || TORRENT_HAVE_MAP_VIEW_OF_FILE
+
+#include "libtorrent/aux_/disk_job_queue.hpp"
+#include "libtorrent/aux_/disk_io_job.hpp"
+#include "libtorrent/mmap_storage.hpp"
+
+namespace libtorrent {
+namespace aux {
+
+	void disk_job_queue::set_elevator(bool const e)
+	{
+		TORRENT_ASSERT(empty());
+		m_elevator = e;
+	}
+
+	disk_job_queue::position_t disk_job_queue::job_position(disk_io_job const* j)
+	{
+		if (!j->storage) return {};
+		std::int64_t offset = std::int64_t(static_cast<int>(j->piece))
+			* j->storage->files().piece_length();
+		if (j->action != job_action_t::hash)
+			offset += j->d.io.offset;
+		return {j->storage->storage_index(), offset};
+	}
+
+	void disk_job_queue::push_back(disk_io_job* j)
+	{
+		if (m_elevator)
+			m_sorted.emplace(job_position(j), j);
+		else
+			m_jobs.push_back(j);
+	}
+
+	void disk_job_queue::append(tailqueue<disk_io_job>& jobs)
+	{
+		if (!m_elevator)
+		{
+			m_jobs.append(jobs);
+			return;
+		}
+
+		while (!jobs.empty())
+			push_back(jobs.pop_front());
+	}
+
+	disk_io_job* disk_job_queue::pop_front()
+	{
+		TORRENT_ASSERT(!empty());
+		if (!m_elevator) return m_jobs.pop_front();
+
+		auto const i = next_sorted();
+		m_head = i->first;
+		disk_io_job* j = i->second;
+		m_sorted.erase(i);
+		return j;
+	}
+
+	disk_io_job* disk_job_queue::front() const
+	{
+		TORRENT_ASSERT(!empty());
+		if (!m_elevator) return m_jobs.first();
+		return next_sorted()->second;
+	}
+
+	std::multimap<disk_job_queue::position_t, disk_io_job*>::const_iterator
+	disk_job_queue::next_sorted() const
+	{
+		// the job closest after the last one, or the first one if there are
+		// none after it
+		auto i = m_sorted.lower_bound(m_head);
+		if (i == m_sorted.end()) i = m_sorted.begin();
+		return i;
+	}
+}
+}
+
+#endif // HAVE_MMAP || HAVE_MAP_VIEW_OF_FILE
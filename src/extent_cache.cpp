@@ -0,0 +1,215 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/extent_cache.hpp"
+#include "libtorrent/aux_/path.hpp"
+#include "libtorrent/file_storage.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/disk_interface.hpp" // for default_block_size
+
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+
+#include <algorithm>
+#include <map>
+
+#ifndef TORRENT_WINDOWS
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+
+namespace libtorrent {
+namespace aux {
+
+	bool query_data_extents(std::string const& path
+		, std::int64_t& size, data_extents& ext)
+	{
+		ext.clear();
+#if !defined TORRENT_WINDOWS && defined SEEK_DATA && defined SEEK_HOLE
+		native_path_string const f = convert_to_native_path_string(path);
+		int const fd = ::open(f.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) return false;
+
+		bool ret = true;
+		off_t const end = ::lseek(fd, 0, SEEK_END);
+		if (end < 0) ret = false;
+		off_t pos = 0;
+		while (ret && pos < end)
+		{
+			off_t const data = ::lseek(fd, pos, SEEK_DATA);
+			if (data < 0)
+			{
+				// ENXIO means there's no more data past pos. Anything else
+				// means the file system doesn't support the query
+				if (errno != ENXIO) ret = false;
+				break;
+			}
+			off_t hole = ::lseek(fd, data, SEEK_HOLE);
+			if (hole < 0)
+			{
+				ret = false;
+				break;
+			}
+			if (hole > end) hole = end;
+			ext.emplace_back(std::int64_t(data), std::int64_t(hole));
+			pos = hole;
+		}
+		::close(fd);
+		size = std::int64_t(end);
+		return ret;
+#else
+		// without SEEK_DATA (e.g. on windows) the extents are unknown, and
+		// every piece is read when checking
+		TORRENT_UNUSED(path);
+		TORRENT_UNUSED(size);
+		return false;
+#endif
+	}
+
+namespace {
+
+	template <typename Hash, typename Hasher>
+	Hash zero_hash_impl(int const len)
+	{
+		// there are only ever a handful of different lengths, the piece size
+		// and the size of the last piece of the torrents being checked
+		static std::mutex cache_mutex;
+		static std::map<int, Hash> cache;
+
+		std::unique_lock<std::mutex> l(cache_mutex);
+		auto const i = cache.find(len);
+		if (i != cache.end()) return i->second;
+		l.unlock();
+
+		std::vector<char> const zeros(std::size_t(std::min(len, default_block_size)), '\0');
+		Hasher h;
+		for (int left = len; left > 0; left -= default_block_size)
+			h.update({zeros.data(), std::min(left, default_block_size)});
+		Hash const ret = h.final();
+
+		l.lock();
+		if (cache.size() > 64) cache.clear();
+		cache.emplace(len, ret);
+		return ret;
+	}
+}
+
+	sha1_hash zero_hash(int const len)
+	{ return zero_hash_impl<sha1_hash, hasher>(len); }
+
+	sha256_hash zero_hash2(int const len)
+	{ return zero_hash_impl<sha256_hash, hasher256>(len); }
+
+	void zero_block_hashes(span<sha256_hash> const hashes, int const piece_size2)
+	{
+		int const blocks = (piece_size2 + default_block_size - 1) / default_block_size;
+		TORRENT_ASSERT(int(hashes.size()) >= blocks);
+		for (int i = 0; i < blocks; ++i)
+		{
+			hashes[i] = zero_hash2(
+				std::min(default_block_size, piece_size2 - i * default_block_size));
+		}
+	}
+
+	bool extent_cache::piece_in_holes(file_storage const& fs, std::string const& save_path
+		, aux::vector<download_priority_t, file_index_t> const& prio
+		, piece_index_t const piece)
+	{
+		return piece_in_holes_impl(fs, &save_path, prio, piece);
+	}
+
+	bool extent_cache::piece_in_known_holes(file_storage const& fs
+		, aux::vector<download_priority_t, file_index_t> const& prio
+		, piece_index_t const piece)
+	{
+		return piece_in_holes_impl(fs, nullptr, prio, piece);
+	}
+
+	bool extent_cache::piece_in_holes_impl(file_storage const& fs, std::string const* save_path
+		, aux::vector<download_priority_t, file_index_t> const& prio
+		, piece_index_t const piece)
+	{
+		std::vector<file_slice> const slices = fs.map_block(piece, 0, fs.piece_size(piece));
+
+		for (auto const& s : slices)
+		{
+			if (fs.pad_file_at(s.file_index)) continue;
+			if (s.file_index < prio.end_index() && prio[s.file_index] == dont_download)
+				return false;
+
+			std::unique_lock<std::mutex> l(m_mutex);
+			if (m_files.empty()) m_files.resize(fs.num_files());
+			if (!m_files[s.file_index].queried)
+			{
+				if (save_path == nullptr) return false;
+
+				// don't hold the mutex while asking the file system. Pieces of
+				// the same file are checked by one thread at a time, or the
+				// result is the same anyway
+				l.unlock();
+				file_entry tmp;
+				tmp.valid = query_data_extents(fs.file_path(s.file_index, *save_path)
+					, tmp.size, tmp.extents);
+				tmp.queried = true;
+				l.lock();
+				// the cache may have been cleared in the meantime
+				if (m_files.empty()) m_files.resize(fs.num_files());
+				m_files[s.file_index] = std::move(tmp);
+			}
+			if (!range_in_holes(m_files[s.file_index], s.offset, s.size)) return false;
+		}
+		return true;
+	}
+
+	bool extent_cache::range_in_holes(file_entry const& e
+		, std::int64_t const offset, std::int64_t const len) const
+	{
+		if (!e.valid) return false;
+		// reading past the end of the file fails, rather than returning zeros
+		if (offset + len > e.size) return false;
+
+		// the first extent ending after offset
+		auto const i = std::partition_point(e.extents.begin(), e.extents.end()
+			, [=](std::pair<std::int64_t, std::int64_t> const& ext) { return ext.second <= offset; });
+		return i == e.extents.end() || i->first >= offset + len;
+	}
+
+	void extent_cache::clear()
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		aux::vector<file_entry, file_index_t>().swap(m_files);
+	}
+}
+}
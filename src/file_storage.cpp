@@ -48,6 +48,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/aux_/disable_warnings_pop.hpp"
 
 #include <cstdio>
+#include <cstring>
 #include <cinttypes>
 #include <algorithm>
 #include <functional>
@@ -120,6 +121,39 @@ namespace {
 		return lhs.offset < rhs.offset;
 	}
 
+	// FNV-1a
+	std::uint32_t path_hash(string_view const path)
+	{
+		std::uint32_t ret = 2166136261u;
+		for (char const c : path)
+		{
+			ret ^= std::uint8_t(c);
+			ret *= 16777619u;
+		}
+		return ret;
+	}
+
+	// the size of the n:th block of file names. Blocks grow up to 64 kiB, so
+	// file_storage objects with just a few files stay small
+	int name_block_size(std::size_t const n)
+	{
+		return 256 << std::min(n, std::size_t(8));
+	}
+
+	int find_path_slot(aux::vector<aux::path_index_t> const& table
+		, aux::vector<std::string, aux::path_index_t> const& paths
+		, string_view const path)
+	{
+		int const mask = table.end_index() - 1;
+		int slot = int(path_hash(path)) & mask;
+		while (table[slot] != aux::file_entry::no_path
+			&& paths[table[slot]] != path)
+		{
+			slot = (slot + 1) & mask;
+		}
+		return slot;
+	}
+
 }
 
 	int file_storage::piece_size2(piece_index_t const index) const
@@ -158,7 +192,7 @@ namespace {
 		if (is_complete(path))
 		{
 			TORRENT_ASSERT(set_name);
-			e.set_name(path);
+			set_entry_name(e, path);
 			e.path_index = aux::file_entry::path_is_absolute;
 			return;
 		}
@@ -173,7 +207,7 @@ namespace {
 
 		if (branch_path.empty())
 		{
-			if (set_name) e.set_name(leaf);
+			if (set_name) set_entry_name(e, leaf);
 			e.path_index = aux::file_entry::no_path;
 			return;
 		}
@@ -198,28 +232,60 @@ namespace {
 		}
 
 		e.path_index = get_or_add_path(branch_path);
-		if (set_name) e.set_name(leaf);
+		if (set_name) set_entry_name(e, leaf);
 	}
 
 	aux::path_index_t file_storage::get_or_add_path(string_view const path)
 	{
+		// make sure there's room for one more path before looking this one up,
+		// so the slot we find can be used to insert it
+		if ((m_paths.size() + 1) * 2 > m_path_table.size())
+		{
+			m_path_table.assign(std::max(std::size_t(16), m_path_table.size() * 2)
+				, aux::file_entry::no_path);
+			for (auto const i : m_paths.range())
+				m_path_table[find_path_slot(m_path_table, m_paths, m_paths[i])] = i;
+		}
+
 		// do we already have this path in the path list?
-		auto const p = std::find(m_paths.rbegin(), m_paths.rend(), path);
+		int const slot = find_path_slot(m_path_table, m_paths, path);
+		if (m_path_table[slot] != aux::file_entry::no_path)
+			return m_path_table[slot];
+
+		// no, we don't. add it
+		auto const ret = m_paths.end_index();
+		TORRENT_ASSERT(path.size() == 0 || path[0] != '/');
+		m_paths.emplace_back(path.data(), path.size());
+		m_path_table[slot] = ret;
+		return ret;
+	}
 
-		if (p == m_paths.rend())
+	void file_storage::set_entry_name(aux::file_entry& e, string_view const n)
+	{
+		// long names don't necessarily fit in a block, they are rare enough to
+		// be allocated separately
+		if (n.empty() || n.size() >= 256)
 		{
-			// no, we don't. add it
-			auto const ret = m_paths.end_index();
-			TORRENT_ASSERT(path.size() == 0 || path[0] != '/');
-			m_paths.emplace_back(path.data(), path.size());
-			return ret;
+			e.set_name(n);
+			return;
 		}
-		else
+
+		int const len = int(n.size());
+		if (m_name_blocks.empty()
+			|| m_name_block_left < len
+			|| m_name_blocks.back().use_count() > 1)
 		{
-			// yes we do. use it
-			return aux::path_index_t{aux::numeric_cast<std::uint32_t>(
-				p.base() - m_paths.begin() - 1)};
+			int const size = name_block_size(m_name_blocks.size());
+			m_name_blocks.emplace_back(new char[std::size_t(size)]
+				, std::default_delete<char[]>());
+			m_name_block_left = size;
 		}
+
+		char* const dst = m_name_blocks.back().get()
+			+ name_block_size(m_name_blocks.size() - 1) - m_name_block_left;
+		std::memcpy(dst, n.data(), n.size());
+		m_name_block_left -= len;
+		e.set_name({dst, n.size()}, true);
 	}
 
 #if TORRENT_ABI_VERSION == 1
@@ -261,7 +327,6 @@ namespace aux {
 		, hidden_attribute(fe.hidden_attribute)
 		, executable_attribute(fe.executable_attribute)
 		, symlink_attribute(fe.symlink_attribute)
-		, root(fe.root)
 		, path_index(fe.path_index)
 	{
 		bool const borrow = fe.name_len != name_is_owned;
@@ -280,7 +345,6 @@ namespace aux {
 		executable_attribute = fe.executable_attribute;
 		symlink_attribute = fe.symlink_attribute;
 		no_root_dir = fe.no_root_dir;
-		root = fe.root;
 
 		// if the name is not owned, don't allocate memory, we can point into the
 		// same metadata buffer
@@ -301,7 +365,6 @@ namespace aux {
 		, executable_attribute(fe.executable_attribute)
 		, symlink_attribute(fe.symlink_attribute)
 		, name(fe.name)
-		, root(fe.root)
 		, path_index(fe.path_index)
 	{
 		fe.name_len = 0;
@@ -321,7 +384,6 @@ namespace aux {
 		symlink_attribute = fe.symlink_attribute;
 		no_root_dir = fe.no_root_dir;
 		name = fe.name;
-		root = fe.root;
 		name_len = fe.name_len;
 
 		fe.name_len = 0;
@@ -732,7 +794,7 @@ namespace aux {
 			char name[30];
 			std::snprintf(name, sizeof(name), "%" PRIu64
 				, pad.size);
-			pad.set_name(name);
+			set_entry_name(pad, name);
 			pad.pad_file = true;
 			m_total_size += pad_size;
 		}
@@ -757,8 +819,12 @@ namespace aux {
 		e.hidden_attribute = bool(file_flags & file_storage::flag_hidden);
 		e.executable_attribute = bool(file_flags & file_storage::flag_executable);
 		e.symlink_attribute = bool(file_flags & file_storage::flag_symlink);
-		e.root = root_hash;
 
+		if (root_hash)
+		{
+			if (m_file_roots.size() < m_files.size()) m_file_roots.resize(m_files.size());
+			m_file_roots[last_file()] = root_hash;
+		}
 		if (filehash)
 		{
 			if (m_file_hashes.size() < m_files.size()) m_file_hashes.resize(m_files.size());
@@ -793,14 +859,16 @@ namespace aux {
 	sha256_hash file_storage::root(file_index_t const index) const
 	{
 		TORRENT_ASSERT_PRECOND(index >= file_index_t{} && index < end_file());
-		if (m_files[index].root == nullptr) return sha256_hash();
-		return sha256_hash(m_files[index].root);
+		if (index >= m_file_roots.end_index() || m_file_roots[index] == nullptr)
+			return sha256_hash();
+		return sha256_hash(m_file_roots[index]);
 	}
 
 	char const* file_storage::root_ptr(file_index_t const index) const
 	{
 		TORRENT_ASSERT_PRECOND(index >= file_index_t{} && index < end_file());
-		return m_files[index].root;
+		if (index >= m_file_roots.end_index()) return nullptr;
+		return m_file_roots[index];
 	}
 
 	std::string file_storage::symlink(file_index_t const index) const
@@ -1163,9 +1231,13 @@ namespace {
 		using std::swap;
 		swap(ti.m_files, m_files);
 		swap(ti.m_file_hashes, m_file_hashes);
+		swap(ti.m_file_roots, m_file_roots);
 		swap(ti.m_symlinks, m_symlinks);
 		swap(ti.m_mtime, m_mtime);
 		swap(ti.m_paths, m_paths);
+		swap(ti.m_path_table, m_path_table);
+		swap(ti.m_name_blocks, m_name_blocks);
+		swap(ti.m_name_block_left, m_name_block_left);
 		swap(ti.m_name, m_name);
 		swap(ti.m_total_size, m_total_size);
 		swap(ti.m_num_pieces, m_num_pieces);
@@ -1212,12 +1284,15 @@ namespace {
 
 		aux::vector<aux::file_entry, file_index_t> new_files;
 		aux::vector<char const*, file_index_t> new_file_hashes;
+		aux::vector<char const*, file_index_t> new_file_roots;
 		aux::vector<std::time_t, file_index_t> new_mtime;
 
 		// reserve enough space for the worst case after padding
 		new_files.reserve(new_order.size() * 2 - 1);
 		if (!m_file_hashes.empty())
 			new_file_hashes.reserve(new_order.size() * 2 - 1);
+		if (!m_file_roots.empty())
+			new_file_roots.reserve(new_order.size() * 2 - 1);
 		if (!m_mtime.empty())
 			new_mtime.reserve(new_order.size() * 2 - 1);
 
@@ -1238,11 +1313,13 @@ namespace {
 				pad.path_index = get_or_add_path(".pad");
 				char name[30];
 				std::snprintf(name, sizeof(name), "%" PRIu64, pad.size);
-				pad.set_name(name);
+				set_entry_name(pad, name);
 				pad.pad_file = true;
 
 				if (!m_file_hashes.empty())
 					new_file_hashes.push_back(nullptr);
+				if (!m_file_roots.empty())
+					new_file_roots.push_back(nullptr);
 				if (!m_mtime.empty())
 					new_mtime.push_back(0);
 			}
@@ -1255,6 +1332,11 @@ namespace {
 			else if (!m_file_hashes.empty())
 				new_file_hashes.push_back(nullptr);
 
+			if (i < m_file_roots.end_index())
+				new_file_roots.push_back(m_file_roots[i]);
+			else if (!m_file_roots.empty())
+				new_file_roots.push_back(nullptr);
+
 			if (i < m_mtime.end_index())
 				new_mtime.push_back(m_mtime[i]);
 			else if (!m_mtime.empty())
@@ -1268,6 +1350,7 @@ namespace {
 
 		m_files = std::move(new_files);
 		m_file_hashes = std::move(new_file_hashes);
+		m_file_roots = std::move(new_file_roots);
 		m_mtime = std::move(new_mtime);
 
 		m_total_size = off;
@@ -0,0 +1,260 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/config.hpp"
+
+#if TORRENT_HAVE_IO_URING
+
+#include "libtorrent/aux_/io_uring.hpp"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+namespace libtorrent {
+namespace aux {
+
+namespace {
+
+	int sys_io_uring_setup(std::uint32_t const entries, io_uring_params* p)
+	{
+		return int(::syscall(__NR_io_uring_setup, entries, p));
+	}
+
+	int sys_io_uring_enter(int const fd, std::uint32_t const to_submit
+		, std::uint32_t const min_complete, std::uint32_t const flags)
+	{
+		return int(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete
+			, flags, nullptr, 0));
+	}
+
+	int sys_io_uring_register(int const fd, unsigned const opcode
+		, void const* arg, unsigned const nr_args)
+	{
+		return int(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+	}
+
+	template <typename T>
+	T* ring_ptr(void* base, std::uint32_t const offset)
+	{
+		return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+	}
+}
+
+	io_uring_ring::io_uring_ring(std::uint32_t const entries, error_code& ec)
+	{
+		io_uring_params p;
+		std::memset(&p, 0, sizeof(p));
+		m_fd = sys_io_uring_setup(entries, &p);
+		if (m_fd < 0)
+		{
+			ec.assign(errno, system_category());
+			m_fd = -1;
+			return;
+		}
+
+		m_sq_entries = p.sq_entries;
+		m_cq_entries = p.cq_entries;
+
+		m_sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(std::uint32_t);
+		m_cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+
+		// newer kernels let us map both rings with a single mmap() call
+		bool const single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (single_mmap)
+			m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+
+		m_sq_ring = ::mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE
+			, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+		if (m_sq_ring == MAP_FAILED)
+		{
+			ec.assign(errno, system_category());
+			m_sq_ring = nullptr;
+			unmap_rings();
+			return;
+		}
+
+		if (single_mmap)
+		{
+			m_cq_ring = m_sq_ring;
+		}
+		else
+		{
+			m_cq_ring = ::mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE
+				, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+			if (m_cq_ring == MAP_FAILED)
+			{
+				ec.assign(errno, system_category());
+				m_cq_ring = nullptr;
+				unmap_rings();
+				return;
+			}
+		}
+
+		m_sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+		void* sqes = ::mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE
+			, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+		if (sqes == MAP_FAILED)
+		{
+			ec.assign(errno, system_category());
+			unmap_rings();
+			return;
+		}
+		m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+		m_sq_head = ring_ptr<std::uint32_t>(m_sq_ring, p.sq_off.head);
+		m_sq_tail = ring_ptr<std::uint32_t>(m_sq_ring, p.sq_off.tail);
+		m_sq_mask = ring_ptr<std::uint32_t const>(m_sq_ring, p.sq_off.ring_mask);
+		m_sq_array = ring_ptr<std::uint32_t>(m_sq_ring, p.sq_off.array);
+		m_cq_head = ring_ptr<std::uint32_t>(m_cq_ring, p.cq_off.head);
+		m_cq_tail = ring_ptr<std::uint32_t const>(m_cq_ring, p.cq_off.tail);
+		m_cq_mask = ring_ptr<std::uint32_t const>(m_cq_ring, p.cq_off.ring_mask);
+		m_cqes = ring_ptr<io_uring_cqe const>(m_cq_ring, p.cq_off.cqes);
+
+		m_sqe_tail = *m_sq_tail;
+	}
+
+	io_uring_ring::~io_uring_ring()
+	{
+		unmap_rings();
+	}
+
+	void io_uring_ring::unmap_rings()
+	{
+		if (m_sqes != nullptr) ::munmap(m_sqes, m_sqes_size);
+		if (m_cq_ring != nullptr && m_cq_ring != m_sq_ring) ::munmap(m_cq_ring, m_cq_ring_size);
+		if (m_sq_ring != nullptr) ::munmap(m_sq_ring, m_sq_ring_size);
+		m_sqes = nullptr;
+		m_cq_ring = nullptr;
+		m_sq_ring = nullptr;
+		if (m_fd >= 0) ::close(m_fd);
+		m_fd = -1;
+	}
+
+	std::uint32_t io_uring_ring::sq_space_left() const
+	{
+		std::uint32_t const head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+		return m_sq_entries - (m_sqe_tail - head);
+	}
+
+	io_uring_sqe* io_uring_ring::get_sqe()
+	{
+		if (sq_space_left() == 0) return nullptr;
+		std::uint32_t const idx = m_sqe_tail & *m_sq_mask;
+		io_uring_sqe* sqe = &m_sqes[idx];
+		std::memset(sqe, 0, sizeof(*sqe));
+		m_sq_array[idx] = idx;
+		++m_sqe_tail;
+		return sqe;
+	}
+
+	int io_uring_ring::submit(error_code& ec)
+	{
+		// publish the new entries to the kernel before entering
+		__atomic_store_n(m_sq_tail, m_sqe_tail, __ATOMIC_RELEASE);
+
+		// this includes entries left over from a previous call that the kernel
+		// did not consume
+		std::uint32_t const to_submit = m_sqe_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+		if (to_submit == 0) return 0;
+
+		int ret;
+		do
+		{
+			ret = sys_io_uring_enter(m_fd, to_submit, 0, 0);
+		} while (ret < 0 && errno == EINTR);
+
+		if (ret < 0)
+		{
+			ec.assign(errno, system_category());
+			return -1;
+		}
+		return ret;
+	}
+
+	bool io_uring_ring::wait_cqe(error_code& ec)
+	{
+		for (;;)
+		{
+			if (*m_cq_head != __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE))
+				return true;
+
+			int const ret = sys_io_uring_enter(m_fd, 0, 1, IORING_ENTER_GETEVENTS);
+			if (ret < 0 && errno != EINTR)
+			{
+				ec.assign(errno, system_category());
+				return false;
+			}
+		}
+	}
+
+	bool io_uring_ring::register_files(span<int const> const fds, error_code& ec)
+	{
+		if (sys_io_uring_register(m_fd, IORING_REGISTER_FILES, fds.data()
+			, unsigned(fds.size())) < 0)
+		{
+			ec.assign(errno, system_category());
+			return false;
+		}
+		return true;
+	}
+
+	bool io_uring_ring::unregister_files(error_code& ec)
+	{
+		if (sys_io_uring_register(m_fd, IORING_UNREGISTER_FILES, nullptr, 0) < 0)
+		{
+			ec.assign(errno, system_category());
+			return false;
+		}
+		return true;
+	}
+
+	bool io_uring_ring::update_file(int const slot, int fd, error_code& ec)
+	{
+		io_uring_files_update up;
+		std::memset(&up, 0, sizeof(up));
+		up.offset = std::uint32_t(slot);
+		up.fds = std::uint64_t(reinterpret_cast<std::uintptr_t>(&fd));
+		if (sys_io_uring_register(m_fd, IORING_REGISTER_FILES_UPDATE, &up, 1) < 0)
+		{
+			ec.assign(errno, system_category());
+			return false;
+		}
+		return true;
+	}
+}
+}
+
+#endif // TORRENT_HAVE_IO_URING
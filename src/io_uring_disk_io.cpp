@@ -0,0 +1,1378 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/io_uring_disk_io.hpp"
+#include "libtorrent/posix_disk_io.hpp"
+
+#if TORRENT_HAVE_IO_URING
+
+#include "libtorrent/disk_interface.hpp"
+#include "libtorrent/aux_/disk_buffer_pool.hpp"
+#include "libtorrent/aux_/io_uring.hpp"
+#include "libtorrent/aux_/store_buffer.hpp"
+#include "libtorrent/performance_counters.hpp"
+#include "libtorrent/aux_/session_settings.hpp"
+#include "libtorrent/aux_/path.hpp"
+#include "libtorrent/aux_/numeric_cast.hpp"
+#include "libtorrent/aux_/posix_storage.hpp"
+#include "libtorrent/aux_/posix_file_pool.hpp"
+#include "libtorrent/aux_/throw.hpp"
+#include "libtorrent/aux_/time.hpp"
+#include "libtorrent/file_storage.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/add_torrent_params.hpp"
+
+#include <vector>
+#include <map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace libtorrent {
+
+namespace {
+
+	storage_index_t pop(std::vector<storage_index_t>& q)
+	{
+		TORRENT_ASSERT(!q.empty());
+		storage_index_t const ret = q.back();
+		q.pop_back();
+		return ret;
+	}
+
+	using aux::posix_storage;
+
+	// the number of submission queue entries in the ring. The completion
+	// queue is twice this size
+	std::uint32_t const ring_entries = 256;
+
+	// user_data of the no-op entry used to wake up the completion thread
+	// when shutting down
+	std::uint64_t const wakeup_token = 0;
+
+	enum class uring_action : std::uint8_t { read, write, hash, hash2 };
+
+	struct uring_job;
+	struct uring_storage;
+
+	// a single readv() or writev() against one file, issued as one submission
+	// queue entry. A job is split into one slice per file it touches
+	struct uring_slice
+	{
+		uring_job* job;
+		file_index_t file;
+
+		// index into the open file table
+		int slot;
+		std::int64_t file_offset;
+
+		// the range of iovecs (in uring_job::iovecs) this slice reads into or
+		// writes from
+		int iov_begin;
+		int iov_count;
+
+		// number of bytes this slice is expected to transfer
+		int size;
+
+		// the number of bytes transferred, or a negative errno
+		int result;
+	};
+
+	struct uring_job
+	{
+		uring_action action;
+		storage_index_t storage;
+
+		// the completion thread refers to the storage through this pointer
+		// rather than the index, since m_torrents may be reallocated by the
+		// network thread
+		uring_storage* st = nullptr;
+		piece_index_t piece;
+		int offset = 0;
+		disk_job_flags_t flags;
+
+		// the buffer for read, write and hash2 jobs
+		disk_buffer_holder buffer;
+
+		// the part of the buffer transferred to or from disk, and its offset
+		// into the piece. Parts of a read may be satisfied by the store buffer
+		char* disk_buf = nullptr;
+		int disk_offset = 0;
+
+		// hash jobs read the whole piece, one disk buffer per block
+		std::vector<disk_buffer_holder> blocks;
+		int piece_size = 0;
+		int piece_size2 = 0;
+		span<sha256_hash> block_hashes;
+
+		std::function<void(disk_buffer_holder, storage_error const&)> read_handler;
+		std::function<void(storage_error const&)> write_handler;
+		std::function<void(piece_index_t, sha1_hash const&, storage_error const&)> hash_handler;
+		std::function<void(piece_index_t, sha256_hash const&, storage_error const&)> hash2_handler;
+
+		std::vector<uring_slice> slices;
+		std::vector<::iovec> iovecs;
+
+		// the number of slices that have not completed yet. Only touched by the
+		// completion thread once the job has been submitted
+		int outstanding = 0;
+
+		// set when the job touches files that live in the part file, or needs
+		// more submission queue entries than the ring has. Such jobs are
+		// performed synchronously by posix_storage
+		bool synchronous = false;
+
+		// the number of bytes the job transfers
+		int bytes = 0;
+
+		storage_error error;
+		sha1_hash piece_hash;
+		sha256_hash block_hash;
+		time_point start_time;
+
+		void call_handler()
+		{
+			switch (action)
+			{
+				case uring_action::read:
+					read_handler(std::move(buffer), error);
+					break;
+				case uring_action::write:
+					write_handler(error);
+					break;
+				case uring_action::hash:
+					hash_handler(piece, piece_hash, error);
+					break;
+				case uring_action::hash2:
+					hash2_handler(piece, block_hash, error);
+					break;
+			}
+		}
+	};
+
+	// an entry in the table of open files. The index of the entry is also
+	// its slot in the file table registered with the ring
+	struct uring_file
+	{
+		storage_index_t storage{};
+		file_index_t file{};
+		int fd = -1;
+		bool writable = false;
+
+		// the number of submitted slices referring to this file. A file may
+		// only be closed once this drops to zero
+		std::atomic<int> refs{0};
+		time_point last_use;
+	};
+
+	struct uring_storage
+	{
+		uring_storage(storage_params const& p, aux::posix_file_pool& pool)
+			: storage(p, pool) {}
+		posix_storage storage;
+
+		// the number of submitted jobs that have not completed yet
+		std::atomic<int> in_flight{0};
+	};
+
+} // anonymous namespace
+
+	struct TORRENT_EXTRA_EXPORT io_uring_disk_io final
+		: disk_interface
+		, buffer_allocator_interface
+	{
+		io_uring_disk_io(io_context& ios, settings_interface const& sett, counters& cnt
+			, std::unique_ptr<aux::io_uring_ring> ring)
+			: m_settings(sett)
+			, m_buffer_pool(ios)
+			, m_stats_counters(cnt)
+			, m_ios(ios)
+			, m_ring(std::move(ring))
+		{
+			// this allocates the open file table
+			settings_updated();
+
+			m_thread = std::thread([this, work = make_work_guard(m_ios)]
+			{
+				completion_thread();
+				TORRENT_UNUSED(work);
+			});
+		}
+
+		~io_uring_disk_io() override
+		{
+			if (!m_abort) abort(true);
+			if (m_thread.joinable()) m_thread.join();
+			close_files([](uring_file const&) { return true; });
+		}
+
+		void settings_updated() override
+		{
+			m_buffer_pool.set_settings(m_settings);
+			m_wanted_num_files = std::max(1, m_settings.get_int(settings_pack::file_pool_size));
+			resize_files();
+		}
+
+		storage_holder new_torrent(storage_params const& params
+			, std::shared_ptr<void> const&) override
+		{
+			// make sure we can remove this torrent without causing a memory
+			// allocation, by causing the allocation now instead
+			m_free_slots.reserve(m_torrents.size() + 1);
+			storage_index_t const idx = m_free_slots.empty()
+				? m_torrents.end_index()
+				: pop(m_free_slots);
+			auto storage = std::make_unique<uring_storage>(params, m_file_pool);
+			storage->storage.set_storage_index(idx);
+			if (idx == m_torrents.end_index()) m_torrents.emplace_back(std::move(storage));
+			else m_torrents[idx] = std::move(storage);
+			return storage_holder(idx, *this);
+		}
+
+		void remove_torrent(storage_index_t const idx) override
+		{
+			if (!m_torrents[idx]) return;
+			drain(idx);
+			close_files([idx](uring_file const& f) { return f.storage == idx; });
+			m_torrents[idx].reset();
+			m_free_slots.push_back(idx);
+		}
+
+		void abort(bool const wait) override
+		{
+			if (m_abort) return;
+
+			// make sure everything that has been queued is submitted and
+			// completed before the completion thread is told to exit
+			while (!m_queued_jobs.empty())
+			{
+				flush_jobs();
+				if (m_queued_jobs.empty()) break;
+				std::unique_lock<std::mutex> l(m_drain_mutex);
+				m_drain_cond.wait_for(l, milliseconds(10));
+			}
+
+			m_abort = true;
+			io_uring_sqe* sqe = m_ring->get_sqe();
+			while (sqe == nullptr)
+			{
+				std::unique_lock<std::mutex> l(m_drain_mutex);
+				m_drain_cond.wait_for(l, milliseconds(10));
+				sqe = m_ring->get_sqe();
+			}
+			sqe->opcode = IORING_OP_NOP;
+			sqe->user_data = wakeup_token;
+			++m_sqes_in_flight;
+			error_code ec;
+			m_ring->submit(ec);
+
+			if (wait && m_thread.joinable()) m_thread.join();
+		}
+
+		void async_read(storage_index_t const storage, peer_request const& r
+			, std::function<void(disk_buffer_holder block, storage_error const& se)> handler
+			, disk_job_flags_t const flags) override
+		{
+			TORRENT_ASSERT(r.length <= default_block_size);
+			TORRENT_ASSERT(r.length > 0);
+
+			disk_buffer_holder buffer(*this, m_buffer_pool.allocate_buffer("send buffer"), r.length);
+			if (!buffer)
+			{
+				storage_error error;
+				error.ec = errors::no_memory;
+				error.operation = operation_t::alloc_cache_piece;
+				handler(disk_buffer_holder{}, error);
+				return;
+			}
+
+			int const block_offset = r.start - (r.start % default_block_size);
+			// this is the offset into the block that we're reading from
+			int const read_offset = r.start - block_offset;
+
+			// the range of the request that still needs to be read from disk,
+			// after consulting the store buffer
+			int disk_offset = r.start;
+			int disk_length = r.length;
+
+			if (read_offset + r.length > default_block_size)
+			{
+				// This is an unaligned request spanning two blocks. One or both
+				// of the two blocks may be in the store buffer
+				aux::torrent_location const loc1{storage, r.piece, block_offset};
+				aux::torrent_location const loc2{storage, r.piece, block_offset + default_block_size};
+				int const len1 = default_block_size - read_offset;
+
+				int const ret = m_store_buffer.get2(loc1, loc2, [&](char const* buf1, char const* buf2)
+				{
+					if (buf1)
+						std::memcpy(buffer.data(), buf1 + read_offset, std::size_t(len1));
+					if (buf2)
+						std::memcpy(buffer.data() + len1, buf2, std::size_t(r.length - len1));
+					return (buf1 ? 2 : 0) | (buf2 ? 1 : 0);
+				});
+
+				if (ret == 3)
+				{
+					handler(std::move(buffer), storage_error{});
+					return;
+				}
+				if (ret == 2)
+				{
+					// the first block was found, read the second half
+					disk_offset = block_offset + default_block_size;
+					disk_length = r.length - len1;
+				}
+				else if (ret == 1)
+				{
+					disk_length = len1;
+				}
+			}
+			else if (m_store_buffer.get({storage, r.piece, block_offset}, [&](char const* buf)
+				{ std::memcpy(buffer.data(), buf + read_offset, std::size_t(r.length)); }))
+			{
+				handler(std::move(buffer), storage_error{});
+				return;
+			}
+
+			auto j = std::make_unique<uring_job>();
+			j->action = uring_action::read;
+			j->storage = storage;
+			j->piece = r.piece;
+			j->offset = r.start;
+			j->flags = flags;
+			j->bytes = disk_length;
+			j->read_handler = std::move(handler);
+			j->disk_buf = buffer.data() + (disk_offset - r.start);
+			j->disk_offset = disk_offset;
+			j->buffer = std::move(buffer);
+			add_slices(*j, iovec_t{j->disk_buf, disk_length}, disk_offset);
+			queue_job(std::move(j));
+		}
+
+		bool async_write(storage_index_t const storage, peer_request const& r
+			, char const* buf, std::shared_ptr<disk_observer> o
+			, std::function<void(storage_error const&)> handler
+			, disk_job_flags_t const flags) override
+		{
+			TORRENT_ASSERT(r.start % default_block_size == 0);
+			TORRENT_ASSERT(r.length <= default_block_size);
+
+			bool exceeded = false;
+			disk_buffer_holder buffer = allocate_receive_buffer(exceeded, o, "receive buffer");
+			if (!buffer) aux::throw_ex<std::bad_alloc>();
+			std::memcpy(buffer.data(), buf, aux::numeric_cast<std::size_t>(r.length));
+
+			async_write_buffer(storage, r, std::move(buffer), std::move(o)
+				, std::move(handler), flags);
+			return exceeded;
+		}
+
+		disk_buffer_holder allocate_receive_buffer(bool& exceeded
+			, std::shared_ptr<disk_observer> o, char const* const category) override
+		{
+			return disk_buffer_holder(*this, m_buffer_pool.allocate_buffer(
+				exceeded, std::move(o), category), default_block_size);
+		}
+
+		bool async_write_buffer(storage_index_t const storage, peer_request const& r
+			, disk_buffer_holder buffer, std::shared_ptr<disk_observer>
+			, std::function<void(storage_error const&)> handler
+			, disk_job_flags_t const flags) override
+		{
+			TORRENT_ASSERT(buffer);
+			TORRENT_ASSERT(r.start % default_block_size == 0);
+			TORRENT_ASSERT(r.length <= default_block_size);
+
+			auto j = std::make_unique<uring_job>();
+			j->action = uring_action::write;
+			j->storage = storage;
+			j->piece = r.piece;
+			j->offset = r.start;
+			j->flags = flags;
+			j->bytes = r.length;
+			j->write_handler = std::move(handler);
+			j->disk_buf = buffer.data();
+			j->disk_offset = r.start;
+			j->buffer = std::move(buffer);
+
+			// until the write completes, reads of this block are served from
+			// the buffer
+			m_store_buffer.insert({storage, r.piece, r.start}, j->buffer.data());
+
+			add_slices(*j, iovec_t{j->disk_buf, r.length}, r.start);
+			queue_job(std::move(j));
+			return false;
+		}
+
+		void async_hash(storage_index_t const storage, piece_index_t const piece
+			, span<sha256_hash> const block_hashes, disk_job_flags_t const flags
+			, std::function<void(piece_index_t, sha1_hash const&, storage_error const&)> handler) override
+		{
+			bool const v1 = bool(flags & disk_interface::v1_hash);
+			bool const v2 = !block_hashes.empty();
+
+			posix_storage const& st = m_torrents[storage]->storage;
+
+			auto j = std::make_unique<uring_job>();
+			j->action = uring_action::hash;
+			j->storage = storage;
+			j->piece = piece;
+			j->flags = flags;
+			j->block_hashes = block_hashes;
+			j->hash_handler = std::move(handler);
+			j->piece_size = v1 ? st.files().piece_size(piece) : 0;
+			j->piece_size2 = v2 ? st.orig_files().piece_size2(piece) : 0;
+
+			int const read_size = std::max(j->piece_size, j->piece_size2);
+			int const num_blocks = (read_size + default_block_size - 1) / default_block_size;
+			TORRENT_ASSERT(!v2 || int(block_hashes.size()) >= st.orig_files().blocks_in_piece2(piece));
+
+			j->blocks.reserve(std::size_t(num_blocks));
+			for (int i = 0; i < num_blocks; ++i)
+			{
+				j->blocks.emplace_back(*this, m_buffer_pool.allocate_buffer("hash buffer"), default_block_size);
+				if (!j->blocks.back())
+				{
+					storage_error error;
+					error.ec = errors::no_memory;
+					error.operation = operation_t::alloc_cache_piece;
+					post(m_ios, [piece, error, h = std::move(j->hash_handler)]{ h(piece, sha1_hash{}, error); });
+					return;
+				}
+			}
+
+			// blocks that are still waiting to be written are copied from the
+			// store buffer. Runs of blocks that aren't are read from disk, with
+			// as few system calls as possible
+			std::vector<iovec_t> run;
+			int run_offset = 0;
+			for (int i = 0; i < num_blocks; ++i)
+			{
+				int const offset = i * default_block_size;
+				int const len = std::min(default_block_size, read_size - offset);
+				bool const buffered = m_store_buffer.get({storage, piece, offset}
+					, [&](char const* buf)
+					{ std::memcpy(j->blocks[std::size_t(i)].data(), buf, std::size_t(len)); });
+				if (!buffered)
+				{
+					if (run.empty()) run_offset = offset;
+					run.push_back({j->blocks[std::size_t(i)].data(), len});
+					j->bytes += len;
+				}
+				if ((buffered || i == num_blocks - 1) && !run.empty())
+				{
+					add_slices(*j, run, run_offset);
+					run.clear();
+				}
+			}
+			queue_job(std::move(j));
+		}
+
+		void async_hash2(storage_index_t const storage, piece_index_t const piece
+			, int const offset, disk_job_flags_t const flags
+			, std::function<void(piece_index_t, sha256_hash const&, storage_error const&)> handler) override
+		{
+			disk_buffer_holder buffer(*this, m_buffer_pool.allocate_buffer("hash buffer"), default_block_size);
+			if (!buffer)
+			{
+				storage_error error;
+				error.ec = errors::no_memory;
+				error.operation = operation_t::alloc_cache_piece;
+				post(m_ios, [=, h = std::move(handler)]{ h(piece, sha256_hash{}, error); });
+				return;
+			}
+
+			posix_storage const& st = m_torrents[storage]->storage;
+			int const piece_size = st.files().piece_size2(piece);
+			int const len = std::min(default_block_size, piece_size - offset);
+
+			if (m_store_buffer.get({storage, piece, offset}, [&](char const* buf)
+				{ std::memcpy(buffer.data(), buf, std::size_t(len)); }))
+			{
+				sha256_hash const hash = hasher256(buffer.data(), len).final();
+				post(m_ios, [=, h = std::move(handler)]{ h(piece, hash, storage_error{}); });
+				return;
+			}
+
+			auto j = std::make_unique<uring_job>();
+			j->action = uring_action::hash2;
+			j->storage = storage;
+			j->piece = piece;
+			j->offset = offset;
+			j->flags = flags;
+			j->bytes = len;
+			j->hash2_handler = std::move(handler);
+			j->disk_buf = buffer.data();
+			j->disk_offset = offset;
+			j->buffer = std::move(buffer);
+			add_slices(*j, iovec_t{j->disk_buf, len}, offset);
+			queue_job(std::move(j));
+		}
+
+		void async_move_storage(storage_index_t const storage, std::string p
+			, move_flags_t const flags
+			, std::function<void(status_t, std::string const&, storage_error const&)> handler) override
+		{
+			posix_storage& st = release_storage(storage);
+			storage_error ec;
+			status_t ret;
+			std::tie(ret, p) = st.move_storage(p, flags, ec);
+			post(m_ios, [=, h = std::move(handler)]{ h(ret, p, ec); });
+		}
+
+		void async_release_files(storage_index_t const storage, std::function<void()> handler) override
+		{
+			posix_storage& st = release_storage(storage);
+			st.release_files();
+			if (!handler) return;
+			post(m_ios, [=]{ handler(); });
+		}
+
+		void async_delete_files(storage_index_t const storage, remove_flags_t const options
+			, std::function<void(storage_error const&)> handler) override
+		{
+			storage_error error;
+			posix_storage& st = release_storage(storage);
+			st.delete_files(options, error);
+			post(m_ios, [=, h = std::move(handler)]{ h(error); });
+		}
+
+		void async_check_files(storage_index_t const storage
+			, add_torrent_params const* resume_data
+			, aux::vector<std::string, file_index_t> links
+			, std::function<void(status_t, storage_error const&)> handler) override
+		{
+			posix_storage& st = release_storage(storage);
+
+			add_torrent_params tmp;
+			add_torrent_params const* rd = resume_data ? resume_data : &tmp;
+
+			storage_error error;
+			status_t const ret = [&]
+			{
+				st.initialize(m_settings, error);
+				if (error) return status_t::fatal_disk_error;
+
+				bool const verify_success = st.verify_resume_data(*rd
+					, std::move(links), error);
+
+				if (m_settings.get_bool(settings_pack::no_recheck_incomplete_resume))
+					return status_t::no_error;
+
+				if (!aux::contains_resume_data(*rd))
+				{
+					// if we don't have any resume data, we still may need to trigger a
+					// full re-check, if there are *any* files.
+					storage_error ignore;
+					return (st.has_any_file(ignore))
+						? status_t::need_full_check
+						: status_t::no_error;
+				}
+
+				return verify_success
+					? status_t::no_error
+					: status_t::need_full_check;
+			}();
+
+			post(m_ios, [error, ret, h = std::move(handler)]{ h(ret, error); });
+		}
+
+		void async_rename_file(storage_index_t const storage
+			, file_index_t const idx
+			, std::string name
+			, std::function<void(std::string const&, file_index_t, storage_error const&)> handler) override
+		{
+			posix_storage& st = release_storage(storage);
+			storage_error error;
+			st.rename_file(idx, name, error);
+			post(m_ios, [idx, error, h = std::move(handler), n = std::move(name)] () mutable
+				{ h(std::move(n), idx, error); });
+		}
+
+		void async_stop_torrent(storage_index_t const storage, std::function<void()> handler) override
+		{
+			release_storage(storage);
+			if (!handler) return;
+			post(m_ios, std::move(handler));
+		}
+
+		void async_set_file_priority(storage_index_t const storage
+			, aux::vector<download_priority_t, file_index_t> prio
+			, std::function<void(storage_error const&
+				, aux::vector<download_priority_t, file_index_t>)> handler) override
+		{
+			// moving data in or out of the part file is done synchronously
+			drain(storage);
+			posix_storage& st = m_torrents[storage]->storage;
+			storage_error error;
+			st.set_file_priority(prio, error);
+			post(m_ios, [p = std::move(prio), h = std::move(handler), error] () mutable
+				{ h(error, std::move(p)); });
+		}
+
+		void async_clear_piece(storage_index_t, piece_index_t const index
+			, std::function<void(piece_index_t)> handler) override
+		{
+			post(m_ios, [=, h = std::move(handler)]{ h(index); });
+		}
+
+		// implements buffer_allocator_interface
+		void free_disk_buffer(char* b) override
+		{ m_buffer_pool.free_buffer(b); }
+
+		void update_stats_counters(counters& c) const override
+		{
+			c.set_value(counters::queued_disk_jobs, std::int64_t(m_queued_jobs.size()));
+			c.set_value(counters::disk_blocks_in_use, m_buffer_pool.in_use());
+			m_reported_contention.report(c, counters::store_buffer_contention
+				, m_store_buffer.lock_contention());
+
+			aux::disk_buffer_arena::stats const arena = m_buffer_pool.arena_stats();
+			m_reported_cache_hits.report(c, counters::disk_arena_cache_hits, arena.cache_hits);
+			m_reported_central_transfers.report(c, counters::disk_arena_central_transfers
+				, arena.central_transfers);
+			c.set_value(counters::disk_arena_slabs, arena.slabs);
+			c.set_value(counters::disk_arena_hugepage_slabs, arena.hugepage_slabs);
+			c.set_value(counters::disk_arena_free_blocks, arena.free_blocks);
+			c.set_value(counters::disk_arena_cached_blocks, arena.cached_blocks);
+		}
+
+		std::vector<open_file_state> get_status(storage_index_t const storage) const override
+		{
+			std::vector<open_file_state> ret;
+			for (int i = 0; i < m_num_files; ++i)
+			{
+				uring_file const& f = m_files[std::size_t(i)];
+				if (f.fd < 0 || f.storage != storage) continue;
+				ret.push_back({f.file, f.writable
+					? file_open_mode::read_write : file_open_mode::read_only
+					, f.last_use});
+			}
+			return ret;
+		}
+
+		void submit_jobs() override
+		{
+			flush_jobs();
+		}
+
+	private:
+
+		// splits the job's transfer of ``bufs`` at ``offset`` into the piece
+		// into one slice per file
+		void add_slices(uring_job& j, span<iovec_t const> bufs, int const offset)
+		{
+			posix_storage const& st = m_torrents[j.storage]->storage;
+			bool const write = j.action == uring_action::write;
+			storage_error ignore;
+			aux::readwritev(st.files(), bufs, j.piece, offset, ignore
+				, [&](file_index_t const file_index, std::int64_t const file_offset
+					, span<iovec_t const> vec, storage_error&)
+			{
+				int const size = bufs_size(vec);
+
+				// reading from a pad file yields zeroes, writing to it is a no-op
+				if (st.files().pad_file_at(file_index))
+					return write ? size : aux::read_zeroes(vec);
+
+				if (st.uses_partfile(file_index))
+					j.synchronous = true;
+
+				uring_slice s;
+				s.job = &j;
+				s.file = file_index;
+				s.slot = -1;
+				s.file_offset = file_offset;
+				s.iov_begin = int(j.iovecs.size());
+				s.iov_count = int(vec.size());
+				s.size = size;
+				s.result = 0;
+				for (auto const& b : vec)
+					j.iovecs.push_back({b.data(), std::size_t(b.size())});
+				j.slices.push_back(s);
+				return size;
+			});
+
+			// each slice needs a submission queue entry and (typically) a file
+			// slot of its own. Jobs that can never fit are not submitted to the
+			// ring
+			if (j.slices.size() > std::min(std::size_t(ring_entries), std::size_t(m_num_files)))
+				j.synchronous = true;
+		}
+
+		void queue_job(std::unique_ptr<uring_job> j)
+		{
+			j->st = m_torrents[j->storage].get();
+			j->start_time = clock_type::now();
+			m_queued_jobs.push_back(std::move(j));
+		}
+
+		// submits as many queued jobs as will fit in the ring, in order
+		void flush_jobs()
+		{
+			if (m_abort)
+			{
+				// the completion thread may be gone, fail the jobs
+				for (auto& job : m_queued_jobs)
+				{
+					job->error.ec = boost::asio::error::operation_aborted;
+					fail_job(std::move(job));
+				}
+				m_queued_jobs.clear();
+				return;
+			}
+
+			// while the file table is waiting to be resized, don't submit more
+			// jobs. Once the ones in flight complete, this is called again
+			resize_files();
+			if (m_wanted_num_files != m_num_files) return;
+
+			bool submitted = false;
+			while (!m_queued_jobs.empty())
+			{
+				uring_job* j = m_queued_jobs.front().get();
+
+				// the file table may have shrunk since the job was queued
+				if (int(j->slices.size()) > m_num_files)
+					j->synchronous = true;
+
+				if (j->synchronous)
+				{
+					// every job queued before this one has been submitted already.
+					// wait for those to complete before touching the files
+					// synchronously
+					if (submitted)
+					{
+						error_code ec;
+						m_ring->submit(ec);
+						submitted = false;
+					}
+					wait_for_storage(j->storage);
+					perform_synchronously(std::move(m_queued_jobs.front()));
+					m_queued_jobs.pop_front();
+					continue;
+				}
+
+				int const ret = submit_job(*j);
+				// we're out of space in the ring, or out of file slots. We'll
+				// try again once some jobs complete
+				if (ret == 0) break;
+
+				if (ret > 0)
+				{
+					submitted = true;
+					// the completion thread owns the job now
+					m_queued_jobs.front().release();
+				}
+				else
+				{
+					// the job failed before being submitted, typically because a
+					// file could not be opened
+					fail_job(std::move(m_queued_jobs.front()));
+				}
+				m_queued_jobs.pop_front();
+			}
+
+			if (submitted)
+			{
+				// if this fails, the entries are left in the ring and handed to
+				// the kernel with the next submission
+				error_code ignore;
+				m_ring->submit(ignore);
+			}
+		}
+
+		void fail_job(std::unique_ptr<uring_job> j)
+		{
+			TORRENT_ASSERT(j->error);
+			if (j->action == uring_action::write)
+				m_store_buffer.erase({j->storage, j->piece, j->offset});
+			post_handler(std::move(j));
+		}
+
+		void post_handler(std::unique_ptr<uring_job> j)
+		{
+			post(m_ios, [jp = j.release()] {
+				std::unique_ptr<uring_job> job(jp);
+				job->call_handler();
+			});
+		}
+
+		// returns 1 if the job was submitted, 0 if it needs to be retried
+		// later, and -1 if it failed (with the error set in the job)
+		int submit_job(uring_job& j)
+		{
+			int const num_slices = int(j.slices.size());
+
+			// all slices may have been served from pad files (or the store
+			// buffer). Complete it right away
+			if (num_slices == 0)
+			{
+				finish_job(&j);
+				post_handler(std::unique_ptr<uring_job>(&j));
+				return 1;
+			}
+
+			if (m_ring->sq_space_left() < std::uint32_t(num_slices)
+				|| m_sqes_in_flight + num_slices > int(m_ring->cq_entries()))
+				return 0;
+
+			bool const write = j.action == uring_action::write;
+			for (int i = 0; i < num_slices; ++i)
+			{
+				uring_slice& s = j.slices[std::size_t(i)];
+				s.slot = open_slot(j.storage, s.file, write, j.error);
+				if (s.slot < 0)
+				{
+					// release the files we've already grabbed for this job
+					for (int k = 0; k < i; ++k)
+						--m_files[std::size_t(j.slices[std::size_t(k)].slot)].refs;
+					return j.error ? -1 : 0;
+				}
+				++m_files[std::size_t(s.slot)].refs;
+			}
+
+			j.outstanding = num_slices;
+			m_sqes_in_flight += num_slices;
+			++j.st->in_flight;
+
+			for (auto& s : j.slices)
+			{
+				io_uring_sqe* sqe = m_ring->get_sqe();
+				TORRENT_ASSERT(sqe != nullptr);
+				sqe->opcode = std::uint8_t(write ? IORING_OP_WRITEV : IORING_OP_READV);
+				if (m_fixed_files)
+				{
+					sqe->flags = IOSQE_FIXED_FILE;
+					sqe->fd = s.slot;
+				}
+				else
+				{
+					sqe->fd = m_files[std::size_t(s.slot)].fd;
+				}
+				sqe->off = std::uint64_t(s.file_offset);
+				sqe->addr = std::uint64_t(reinterpret_cast<std::uintptr_t>(j.iovecs.data() + s.iov_begin));
+				sqe->len = std::uint32_t(s.iov_count);
+				sqe->user_data = std::uint64_t(reinterpret_cast<std::uintptr_t>(&s));
+			}
+			return 1;
+		}
+
+		// returns the slot in the open file table for the specified file,
+		// opening it if necessary. Returns -1 if no slot is available, or if
+		// opening the file failed, in which case ``ec`` is set.
+		int open_slot(storage_index_t const storage, file_index_t const file
+			, bool const write, storage_error& ec)
+		{
+			time_point const now = aux::time_now();
+			auto const it = m_file_slots.find({storage, file});
+			if (it != m_file_slots.end())
+			{
+				uring_file& f = m_files[std::size_t(it->second)];
+				if (!write || f.writable)
+				{
+					f.last_use = now;
+					return it->second;
+				}
+
+				// the file is open in read-only mode, but we need to write to it.
+				// we have to wait for the outstanding reads before re-opening it
+				if (f.refs > 0) return -1;
+				close_slot(it->second);
+			}
+
+			// find an empty slot or the least recently used file that is idle
+			int slot = -1;
+			for (int i = 0; i < m_num_files; ++i)
+			{
+				uring_file const& f = m_files[std::size_t(i)];
+				if (f.fd < 0) { slot = i; break; }
+				if (f.refs > 0) continue;
+				if (slot < 0 || f.last_use < m_files[std::size_t(slot)].last_use)
+					slot = i;
+			}
+			if (slot < 0) return -1;
+			if (m_files[std::size_t(slot)].fd >= 0) close_slot(slot);
+
+			int const fd = open_fd(storage, file, write, ec);
+			if (fd < 0) return -1;
+
+			if (m_fixed_files)
+			{
+				error_code e;
+				if (!m_ring->update_file(slot, fd, e))
+				{
+					::close(fd);
+					ec.ec = e;
+					ec.file(file);
+					ec.operation = operation_t::file_open;
+					return -1;
+				}
+			}
+
+			uring_file& f = m_files[std::size_t(slot)];
+			f.storage = storage;
+			f.file = file;
+			f.fd = fd;
+			f.writable = write;
+			f.last_use = now;
+			m_file_slots[{storage, file}] = slot;
+			return slot;
+		}
+
+		int open_fd(storage_index_t const storage, file_index_t const file
+			, bool const write, storage_error& ec)
+		{
+			posix_storage const& st = m_torrents[storage]->storage;
+			std::string const fn = st.files().file_path(file, st.save_path());
+
+			int const flags = O_CLOEXEC | (write ? O_RDWR | O_CREAT : O_RDONLY);
+			int fd = ::open(fn.c_str(), flags, 0666);
+			if (fd < 0 && write && errno == ENOENT)
+			{
+				// the directory the file is in doesn't exist. create it
+				// and try again
+				create_directories(parent_path(fn), ec.ec);
+				if (ec.ec)
+				{
+					ec.file(file);
+					ec.operation = operation_t::mkdir;
+					return -1;
+				}
+				fd = ::open(fn.c_str(), flags, 0666);
+			}
+
+			if (fd < 0)
+			{
+				ec.ec.assign(errno, generic_category());
+				ec.file(file);
+				ec.operation = operation_t::file_open;
+				return -1;
+			}
+			return fd;
+		}
+
+		void close_slot(int const slot)
+		{
+			uring_file& f = m_files[std::size_t(slot)];
+			TORRENT_ASSERT(f.refs == 0);
+			if (f.fd < 0) return;
+			if (m_fixed_files)
+			{
+				error_code ignore;
+				m_ring->update_file(slot, -1, ignore);
+			}
+			::close(f.fd);
+			m_file_slots.erase({f.storage, f.file});
+			f.fd = -1;
+			f.writable = false;
+		}
+
+		// if file_pool_size has changed, closes all files and reallocates the
+		// open file table. This has to wait until no submitted operation
+		// refers to a slot in the table, it's retried by flush_jobs()
+		void resize_files()
+		{
+			if (m_wanted_num_files == m_num_files) return;
+
+			// the completion thread is done with the table once it has
+			// reaped all entries
+			if (m_sqes_in_flight > 0) return;
+
+			close_files([](uring_file const&) { return true; });
+			if (m_fixed_files)
+			{
+				error_code ignore;
+				m_ring->unregister_files(ignore);
+			}
+
+			m_num_files = m_wanted_num_files;
+			m_files.reset(new uring_file[std::size_t(m_num_files)]);
+
+			// if the kernel supports it, keep the file table registered with
+			// the ring, to save it the work of looking up every file descriptor
+			// for every operation
+			std::vector<int> const empty_slots(std::size_t(m_num_files), -1);
+			error_code ignore;
+			m_fixed_files = m_ring->register_files(empty_slots, ignore);
+		}
+
+		template <typename Pred>
+		void close_files(Pred p)
+		{
+			for (int i = 0; i < m_num_files; ++i)
+			{
+				if (m_files[std::size_t(i)].fd >= 0 && p(m_files[std::size_t(i)]))
+					close_slot(i);
+			}
+		}
+
+		// blocks until all submitted jobs for this storage have completed
+		void wait_for_storage(storage_index_t const storage)
+		{
+			uring_storage const* st = m_torrents[storage].get();
+			std::unique_lock<std::mutex> l(m_drain_mutex);
+			m_drain_cond.wait(l, [st] { return st->in_flight == 0; });
+		}
+
+		// submits and waits for all jobs for this storage to complete
+		void drain(storage_index_t const storage)
+		{
+			for (;;)
+			{
+				flush_jobs();
+				bool const queued = std::any_of(m_queued_jobs.begin(), m_queued_jobs.end()
+					, [&](std::unique_ptr<uring_job> const& j) { return j->storage == storage; });
+				if (!queued) break;
+				std::unique_lock<std::mutex> l(m_drain_mutex);
+				m_drain_cond.wait_for(l, milliseconds(10));
+			}
+			wait_for_storage(storage);
+		}
+
+		// drains the storage and closes all its files, in preparation for
+		// operations that affect the files as a whole
+		posix_storage& release_storage(storage_index_t const storage)
+		{
+			drain(storage);
+			close_files([storage](uring_file const& f) { return f.storage == storage; });
+			m_file_pool.release(storage);
+			return m_torrents[storage]->storage;
+		}
+
+		void perform_synchronously(std::unique_ptr<uring_job> j)
+		{
+			posix_storage& st = m_torrents[j->storage]->storage;
+			// files that are about to be accessed via the posix_storage must
+			// not be held open by us in a different mode
+			close_files([&](uring_file const& f) { return f.storage == j->storage && f.refs == 0; });
+
+			switch (j->action)
+			{
+				case uring_action::read:
+				case uring_action::write:
+				case uring_action::hash2:
+				{
+					iovec_t const b = {j->disk_buf, j->bytes};
+					if (j->action == uring_action::write)
+					{
+						st.writev(m_settings, b, j->piece, j->disk_offset, j->error);
+						m_store_buffer.erase({j->storage, j->piece, j->offset});
+					}
+					else
+					{
+						st.readv(m_settings, b, j->piece, j->disk_offset, j->error);
+					}
+					if (j->action == uring_action::hash2 && !j->error)
+						j->block_hash = hasher256(j->buffer.data(), j->bytes).final();
+					break;
+				}
+				case uring_action::hash:
+				{
+					int const read_size = std::max(j->piece_size, j->piece_size2);
+					for (int i = 0; i < int(j->blocks.size()); ++i)
+					{
+						int const offset = i * default_block_size;
+						iovec_t b = {j->blocks[std::size_t(i)].data()
+							, std::min(default_block_size, read_size - offset)};
+						int const ret = st.readv(m_settings, b, j->piece, offset, j->error);
+						if (ret <= 0 || j->error) break;
+					}
+					if (!j->error) compute_hashes(*j);
+					break;
+				}
+			}
+
+			update_stats(*j);
+			post_handler(std::move(j));
+		}
+
+		// hash jobs have all their blocks in memory at this point
+		void compute_hashes(uring_job& j)
+		{
+			hasher ph;
+			bool const v1 = bool(j.flags & disk_interface::v1_hash);
+			int const blocks_in_piece2 = j.block_hashes.empty() ? 0
+				: (j.piece_size2 + default_block_size - 1) / default_block_size;
+			for (int i = 0; i < int(j.blocks.size()); ++i)
+			{
+				int const offset = i * default_block_size;
+				char const* buf = j.blocks[std::size_t(i)].data();
+				if (v1 && offset < j.piece_size)
+					ph.update({buf, std::min(default_block_size, j.piece_size - offset)});
+				if (i < blocks_in_piece2)
+				{
+					j.block_hashes[i] = hasher256(buf
+						, std::min(default_block_size, j.piece_size2 - offset)).final();
+				}
+			}
+			if (v1) j.piece_hash = ph.final();
+		}
+
+		void update_stats(uring_job const& j)
+		{
+			if (j.error) return;
+			std::int64_t const job_time = total_microseconds(clock_type::now() - j.start_time);
+			int const num_blocks = (j.bytes + default_block_size - 1) / default_block_size;
+			switch (j.action)
+			{
+				case uring_action::write:
+					m_stats_counters.inc_stats_counter(counters::num_blocks_written);
+					m_stats_counters.inc_stats_counter(counters::num_write_ops);
+					m_stats_counters.inc_stats_counter(counters::disk_write_time, job_time);
+					break;
+				case uring_action::read:
+					m_stats_counters.inc_stats_counter(counters::num_read_back);
+					m_stats_counters.inc_stats_counter(counters::num_blocks_read);
+					m_stats_counters.inc_stats_counter(counters::num_read_ops);
+					m_stats_counters.inc_stats_counter(counters::disk_read_time, job_time);
+					break;
+				case uring_action::hash:
+				case uring_action::hash2:
+					m_stats_counters.inc_stats_counter(counters::num_read_back);
+					m_stats_counters.inc_stats_counter(counters::num_blocks_read, num_blocks);
+					m_stats_counters.inc_stats_counter(counters::num_read_ops);
+					m_stats_counters.inc_stats_counter(counters::disk_hash_time, job_time);
+					break;
+			}
+			m_stats_counters.inc_stats_counter(counters::disk_job_time, job_time);
+		}
+
+		// called in the completion thread once all slices of a job have
+		// completed
+		void finish_job(uring_job* j)
+		{
+			bool const write = j->action == uring_action::write;
+			for (auto const& s : j->slices)
+			{
+				if (s.result == s.size) continue;
+				if (s.result < 0) j->error.ec.assign(-s.result, generic_category());
+				else j->error.ec.assign(errors::file_too_short, libtorrent_category());
+				j->error.file(s.file);
+				j->error.operation = write ? operation_t::file_write : operation_t::file_read;
+				break;
+			}
+
+			switch (j->action)
+			{
+				case uring_action::write:
+					m_store_buffer.erase({j->storage, j->piece, j->offset});
+					break;
+				case uring_action::hash:
+					if (!j->error) compute_hashes(*j);
+					break;
+				case uring_action::hash2:
+					if (!j->error) j->block_hash = hasher256(j->buffer.data(), j->bytes).final();
+					break;
+				case uring_action::read:
+					break;
+			}
+			update_stats(*j);
+		}
+
+		void completion_thread()
+		{
+			std::vector<std::unique_ptr<uring_job>> done;
+			for (;;)
+			{
+				error_code ec;
+				if (!m_ring->wait_cqe(ec)) break;
+
+				int completed = 0;
+				m_ring->reap([&](io_uring_cqe const& cqe)
+				{
+					++completed;
+					if (cqe.user_data == wakeup_token) return;
+					auto* s = reinterpret_cast<uring_slice*>(std::uintptr_t(cqe.user_data));
+					s->result = cqe.res;
+					--m_files[std::size_t(s->slot)].refs;
+					uring_job* j = s->job;
+					if (--j->outstanding > 0) return;
+					finish_job(j);
+					done.emplace_back(j);
+				});
+
+				// this is the last time the completion thread touches the storage
+				for (auto const& j : done) --j->st->in_flight;
+
+				if (!done.empty()) post_completions(done);
+
+				{
+					std::lock_guard<std::mutex> l(m_drain_mutex);
+					m_sqes_in_flight -= completed;
+				}
+				m_drain_cond.notify_all();
+
+				if (m_abort && m_sqes_in_flight == 0) break;
+			}
+		}
+
+		// hands completed jobs over to the network thread. Only one
+		// call_job_handlers() is kept in flight at a time, later completions are
+		// picked up by it
+		void post_completions(std::vector<std::unique_ptr<uring_job>>& done)
+		{
+			std::lock_guard<std::mutex> l(m_completed_mutex);
+			for (auto& j : done) m_completed_jobs.push_back(std::move(j));
+			done.clear();
+			if (m_completions_in_flight) return;
+			m_completions_in_flight = true;
+			post(m_ios, [this] { call_job_handlers(); });
+		}
+
+		void call_job_handlers()
+		{
+			m_stats_counters.inc_stats_counter(counters::on_disk_counter);
+			std::vector<std::unique_ptr<uring_job>> jobs;
+			{
+				std::lock_guard<std::mutex> l(m_completed_mutex);
+				m_completions_in_flight = false;
+				jobs.swap(m_completed_jobs);
+			}
+
+			for (auto& j : jobs) j->call_handler();
+			jobs.clear();
+
+			// completing jobs made room in the ring for more
+			if (!m_abort) flush_jobs();
+		}
+
+		// files opened by posix_storage, for jobs that are performed
+		// synchronously. Those are rare, so only a few files are kept open.
+		// This must outlive the storages in m_torrents
+		aux::posix_file_pool m_file_pool{4};
+
+		aux::vector<std::unique_ptr<uring_storage>, storage_index_t> m_torrents;
+
+		// slots that are unused in the m_torrents vector
+		std::vector<storage_index_t> m_free_slots;
+
+		settings_interface const& m_settings;
+
+		// disk cache
+		aux::disk_buffer_pool m_buffer_pool;
+
+		// the cumulative counts of the store buffer and the buffer arena
+		// that have been reported as stats counters so far
+		mutable aux::reported_count m_reported_contention;
+		mutable aux::reported_count m_reported_cache_hits;
+		mutable aux::reported_count m_reported_central_transfers;
+
+		counters& m_stats_counters;
+
+		// callbacks are posted on this
+		io_context& m_ios;
+
+		std::unique_ptr<aux::io_uring_ring> m_ring;
+
+		// every write job is inserted into this map while it's in flight,
+		// reads and hashes of those blocks are satisfied from it
+		aux::store_buffer m_store_buffer;
+
+		// jobs that have not been submitted to the ring yet. Only accessed by
+		// the network thread
+		std::deque<std::unique_ptr<uring_job>> m_queued_jobs;
+
+		// the table of open files. It's also registered with the ring (if
+		// m_fixed_files is true), using the same indices. When file_pool_size
+		// changes, m_wanted_num_files is updated and the table is reallocated
+		// once it's not in use
+		int m_num_files = 0;
+		int m_wanted_num_files = 0;
+		std::unique_ptr<uring_file[]> m_files;
+		std::map<std::pair<storage_index_t, file_index_t>, int> m_file_slots;
+		bool m_fixed_files = false;
+
+		// the number of submission queue entries whose completion has not been
+		// reaped yet. We make sure this never exceeds the size of the completion
+		// queue
+		std::atomic<int> m_sqes_in_flight{0};
+
+		// signalled by the completion thread every time it has reaped
+		// completions
+		std::mutex m_drain_mutex;
+		std::condition_variable m_drain_cond;
+
+		// jobs that have completed, waiting to have their handlers called on
+		// the network thread
+		std::mutex m_completed_mutex;
+		std::vector<std::unique_ptr<uring_job>> m_completed_jobs;
+		bool m_completions_in_flight = false;
+
+		std::atomic<bool> m_abort{false};
+
+		std::thread m_thread;
+	};
+
+	TORRENT_EXPORT std::unique_ptr<disk_interface> io_uring_disk_io_constructor(
+		io_context& ios, settings_interface const& sett, counters& cnt)
+	{
+		error_code ec;
+		auto ring = std::make_unique<aux::io_uring_ring>(ring_entries, ec);
+		if (ec || !*ring) return posix_disk_io_constructor(ios, sett, cnt);
+		return std::make_unique<io_uring_disk_io>(ios, sett, cnt, std::move(ring));
+	}
+
+	TORRENT_EXPORT bool io_uring_available()
+	{
+		static bool const available = []
+		{
+			error_code ec;
+			aux::io_uring_ring const ring(ring_entries, ec);
+			return !ec && bool(ring);
+		}();
+		return available;
+	}
+}
+
+#else
+
+namespace libtorrent {
+
+	TORRENT_EXPORT std::unique_ptr<disk_interface> io_uring_disk_io_constructor(
+		io_context& ios, settings_interface const& sett, counters& cnt)
+	{
+		return posix_disk_io_constructor(ios, sett, cnt);
+	}
+
+	TORRENT_EXPORT bool io_uring_available() { return false; }
+}
+
+#endif // TORRENT_HAVE_IO_URING
@@ -31,7 +31,8 @@ POSSIBILITY OF SUCH DAMAGE.
 
 */
 
-#include <iterator> // for next
+#include <algorithm>
+#include <queue>
 
 #include "libtorrent/ip_filter.hpp"
 #include "libtorrent/assert.hpp"
@@ -63,6 +64,20 @@ namespace libtorrent {
 			TORRENT_ASSERT_FAIL();
 	}
 
+	void ip_filter::add_rules(std::vector<ip_range<address_v4>> const& rules)
+	{
+		m_filter4.reserve(rules.size());
+		for (auto const& r : rules)
+			m_filter4.add_rule(r.first.to_bytes(), r.last.to_bytes(), r.flags);
+	}
+
+	void ip_filter::add_rules(std::vector<ip_range<address_v6>> const& rules)
+	{
+		m_filter6.reserve(rules.size());
+		for (auto const& r : rules)
+			m_filter6.add_rule(r.first.to_bytes(), r.last.to_bytes(), r.flags);
+	}
+
 	std::uint32_t ip_filter::access(address const& addr) const
 	{
 		if (addr.is_v4())
@@ -162,109 +177,331 @@ namespace aux {
 	template EXPORT_INST address_v4::bytes_type max_addr<address_v4::bytes_type>();
 	template EXPORT_INST address_v6::bytes_type max_addr<address_v6::bytes_type>();
 
+namespace {
+
+	std::uint32_t to_key(address_v4::bytes_type const& a)
+	{
+		return (std::uint32_t(a[0]) << 24) | (std::uint32_t(a[1]) << 16)
+			| (std::uint32_t(a[2]) << 8) | std::uint32_t(a[3]);
+	}
+
+	filter_key6 to_key(address_v6::bytes_type const& a)
+	{
+		filter_key6 ret{0, 0};
+		for (std::size_t i = 0; i < 8; ++i)
+		{
+			ret.hi = (ret.hi << 8) | a[i];
+			ret.lo = (ret.lo << 8) | a[i + 8];
+		}
+		return ret;
+	}
+
+	std::uint16_t to_key(std::uint16_t const a) { return a; }
+
 	template <typename Addr>
-	filter_impl<Addr>::filter_impl()
+	Addr from_key(typename filter_key<Addr>::type k);
+
+	template <>
+	address_v4::bytes_type from_key<address_v4::bytes_type>(std::uint32_t const k)
+	{
+		return {{std::uint8_t(k >> 24), std::uint8_t(k >> 16)
+			, std::uint8_t(k >> 8), std::uint8_t(k)}};
+	}
+
+	template <>
+	address_v6::bytes_type from_key<address_v6::bytes_type>(filter_key6 const k)
 	{
+		address_v6::bytes_type ret;
+		for (std::size_t i = 0; i < 8; ++i)
+		{
+			ret[i] = std::uint8_t(k.hi >> (56 - i * 8));
+			ret[i + 8] = std::uint8_t(k.lo >> (56 - i * 8));
+		}
+		return ret;
+	}
+
+	template <>
+	std::uint16_t from_key<std::uint16_t>(std::uint16_t const k) { return k; }
+
+	template <typename Key>
+	Key max_key() { return (std::numeric_limits<Key>::max)(); }
+
+	template <>
+	filter_key6 max_key<filter_key6>()
+	{
+		return {(std::numeric_limits<std::uint64_t>::max)()
+			, (std::numeric_limits<std::uint64_t>::max)()};
+	}
+
+	template <typename Key>
+	Key zero_key() { return Key(0); }
+
+	template <>
+	filter_key6 zero_key<filter_key6>() { return {0, 0}; }
+
+	// these must not be called with max_key() and zero_key() respectively
+	std::uint32_t next_key(std::uint32_t const k) { return k + 1; }
+	std::uint16_t next_key(std::uint16_t const k) { return std::uint16_t(k + 1); }
+	filter_key6 next_key(filter_key6 const k)
+	{ return k.lo == max_key<std::uint64_t>() ? filter_key6{k.hi + 1, 0} : filter_key6{k.hi, k.lo + 1}; }
+
+	std::uint32_t prev_key(std::uint32_t const k) { return k - 1; }
+	std::uint16_t prev_key(std::uint16_t const k) { return std::uint16_t(k - 1); }
+	filter_key6 prev_key(filter_key6 const k)
+	{ return k.lo == 0 ? filter_key6{k.hi - 1, max_key<std::uint64_t>()} : filter_key6{k.hi, k.lo - 1}; }
+
+	// a flat range, where the end is given by the start of the next one
+	template <typename Key>
+	struct flat_range
+	{
+		Key start;
+		std::uint32_t access;
+		// false if no rule covers this range
+		bool defined;
+	};
+
+	// the in-order traversal of the implicit tree rooted at k is the sorted
+	// order of the ranges
+	template <typename Key>
+	void from_eytzinger(std::vector<Key> const& start
+		, std::vector<std::uint32_t> const& access
+		, std::vector<flat_range<Key>>& out, std::size_t const k)
+	{
+		if (k >= start.size()) return;
+		from_eytzinger(start, access, out, 2 * k);
+		out.push_back({start[k], access[k], true});
+		from_eytzinger(start, access, out, 2 * k + 1);
+	}
+
+	template <typename Key>
+	void to_eytzinger(std::vector<flat_range<Key>> const& in, std::size_t& i
+		, std::vector<Key>& start, std::vector<std::uint32_t>& access
+		, std::size_t const k)
+	{
+		if (k >= start.size()) return;
+		to_eytzinger(in, i, start, access, 2 * k);
+		start[k] = in[i].start;
+		access[k] = in[i].access;
+		++i;
+		to_eytzinger(in, i, start, access, 2 * k + 1);
+	}
+} // anonymous namespace
+
+	template <typename Addr>
+	filter_impl<Addr>::filter_impl()
 		// make the entire ip-range non-blocked
-		m_access_list.insert(range(zero<Addr>(), 0));
+		: m_start{zero_key<key_type>(), zero_key<key_type>()}
+		, m_access{0, 0}
+	{}
+
+	template <typename Addr>
+	filter_impl<Addr>::filter_impl(filter_impl const& f)
+	{
+		std::lock_guard<std::mutex> l(f.m_mutex);
+		m_pending = f.m_pending;
+		m_start = f.m_start;
+		m_access = f.m_access;
+		m_dirty = f.m_dirty.load();
 	}
 
+	template <typename Addr>
+	filter_impl<Addr>::filter_impl(filter_impl&& f)
+		: filter_impl()
+	{
+		*this = std::move(f);
+	}
+
+	template <typename Addr>
+	filter_impl<Addr>& filter_impl<Addr>::operator=(filter_impl const& f)
+	{
+		if (&f == this) return *this;
+		filter_impl tmp(f);
+		return *this = std::move(tmp);
+	}
+
+	template <typename Addr>
+	filter_impl<Addr>& filter_impl<Addr>::operator=(filter_impl&& f)
+	{
+		if (&f == this) return *this;
+		std::lock(m_mutex, f.m_mutex);
+		std::lock_guard<std::mutex> l1(m_mutex, std::adopt_lock);
+		std::lock_guard<std::mutex> l2(f.m_mutex, std::adopt_lock);
+		m_pending.swap(f.m_pending);
+		m_start.swap(f.m_start);
+		m_access.swap(f.m_access);
+		bool const dirty = m_dirty.load();
+		m_dirty = f.m_dirty.load();
+		f.m_dirty = dirty;
+		return *this;
+	}
+
+	template <typename Addr>
+	filter_impl<Addr>::~filter_impl() = default;
+
 	template <typename Addr>
 	bool filter_impl<Addr>::empty() const
 	{
-		return m_access_list.empty()
-			|| (m_access_list.size() == 1 && *m_access_list.begin() == range(zero<Addr>(), 0));
+		freeze();
+		return m_start.size() == 2 && m_access[1] == 0;
 	}
 
 	template <typename Addr>
 	void filter_impl<Addr>::add_rule(Addr first, Addr last, std::uint32_t const flags)
 	{
-		TORRENT_ASSERT(!m_access_list.empty());
 		TORRENT_ASSERT(first < last || first == last);
+		m_pending.push_back({to_key(first), to_key(last), flags});
+		m_dirty = true;
+	}
 
-		auto i = m_access_list.upper_bound(first);
-		auto j = m_access_list.upper_bound(last);
-
-		if (i != m_access_list.begin()) --i;
-
-		TORRENT_ASSERT(j != m_access_list.begin());
-		TORRENT_ASSERT(j != i);
+	template <typename Addr>
+	void filter_impl<Addr>::reserve(std::size_t const n)
+	{
+		m_pending.reserve(m_pending.size() + n);
+	}
 
-		std::uint32_t first_access = i->access;
-		std::uint32_t last_access = std::prev(j)->access;
+	template <typename Addr>
+	void filter_impl<Addr>::freeze() const
+	{
+		if (!m_dirty.load(std::memory_order_acquire)) return;
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (!m_dirty.load(std::memory_order_relaxed)) return;
+		freeze_impl();
+		m_dirty.store(false, std::memory_order_release);
+	}
 
-		if (i->start != first && first_access != flags)
-		{
-			i = m_access_list.insert(i, range(first, flags));
-		}
-		else if (i != m_access_list.begin() && std::prev(i)->access == flags)
+	template <typename Addr>
+	void filter_impl<Addr>::freeze_impl() const
+	{
+		using range = flat_range<key_type>;
+		key_type const zero = zero_key<key_type>();
+
+		// turn the pending rules into flat ranges, where the last rule
+		// covering an address wins. Sweep over the start and end of all
+		// rules, keeping the rules covering the current address in a heap,
+		// with the most recent on top. Rules that have ended are removed
+		// lazily, once they reach the top
+		struct event
 		{
-			--i;
-			first_access = i->access;
-		}
-		TORRENT_ASSERT(!m_access_list.empty());
-		TORRENT_ASSERT(i != m_access_list.end());
-
-		if (i != j) m_access_list.erase(std::next(i), j);
-		if (i->start == first)
+			key_type at;
+			std::uint32_t rule;
+			bool start;
+		};
+		std::vector<event> events;
+		events.reserve(m_pending.size() * 2);
+		for (std::size_t i = 0; i < m_pending.size(); ++i)
 		{
-			// This is an optimization over erasing and inserting a new element
-			// here.
-			// this const-cast is OK because we know that the new
-			// start address will keep the set correctly ordered
-			const_cast<Addr&>(i->start) = first;
-			const_cast<std::uint32_t&>(i->access) = flags;
+			rule const& r = m_pending[i];
+			events.push_back({r.first, std::uint32_t(i), true});
+			// a rule that extends to the last address never ends
+			if (r.last != max_key<key_type>())
+				events.push_back({next_key(r.last), std::uint32_t(i), false});
 		}
-		else if (first_access != flags)
+		std::sort(events.begin(), events.end()
+			, [](event const& lhs, event const& rhs) { return lhs.at < rhs.at; });
+
+		std::vector<range> rules;
+		rules.push_back({zero, 0, false});
+		std::priority_queue<std::uint32_t> active;
+		std::vector<bool> ended(m_pending.size(), false);
+		for (auto i = events.begin(); i != events.end();)
 		{
-			m_access_list.insert(i, range(first, flags));
+			key_type const at = i->at;
+			for (; i != events.end() && i->at == at; ++i)
+			{
+				if (i->start) active.push(i->rule);
+				else ended[i->rule] = true;
+			}
+			while (!active.empty() && ended[active.top()]) active.pop();
+
+			range const r = active.empty() ? range{at, 0, false}
+				: range{at, m_pending[active.top()].flags, true};
+			if (rules.back().start == at) rules.back() = r;
+			else if (rules.back().defined != r.defined
+				|| rules.back().access != r.access)
+				rules.push_back(r);
 		}
 
-		if ((j != m_access_list.end()
-				&& minus_one(j->start) != last)
-			|| (j == m_access_list.end()
-				&& last != max_addr<Addr>()))
+		// merge them with the ranges we already have
+		std::vector<range> base;
+		base.reserve(m_start.size() - 1);
+		from_eytzinger(m_start, m_access, base, 1);
+		TORRENT_ASSERT(!base.empty() && base.front().start == zero);
+
+		std::vector<range> merged;
+		merged.reserve(base.size() + rules.size());
+		auto b = base.begin();
+		auto r = rules.begin();
+		std::uint32_t base_access = 0;
+		range rule_range = rules.front();
+		while (b != base.end() || r != rules.end())
 		{
-			TORRENT_ASSERT(j == m_access_list.end() || last < minus_one(j->start));
-			if (last_access != flags)
-				j = m_access_list.insert(j, range(plus_one(last), last_access));
+			key_type const at = r == rules.end() || (b != base.end() && b->start < r->start)
+				? b->start : r->start;
+			if (b != base.end() && b->start == at) base_access = (b++)->access;
+			if (r != rules.end() && r->start == at) rule_range = *r++;
+
+			std::uint32_t const a = rule_range.defined ? rule_range.access : base_access;
+			if (merged.empty() || merged.back().access != a)
+				merged.push_back({at, a, true});
 		}
 
-		if (j != m_access_list.end() && j->access == flags) m_access_list.erase(j);
-		TORRENT_ASSERT(!m_access_list.empty());
+		std::vector<rule>().swap(m_pending);
+
+		m_start.resize(merged.size() + 1);
+		m_access.resize(merged.size() + 1);
+		m_start[0] = zero;
+		m_access[0] = 0;
+		std::size_t i = 0;
+		to_eytzinger(merged, i, m_start, m_access, 1);
+		TORRENT_ASSERT(i == merged.size());
 	}
 
 	template <typename Addr>
 	std::uint32_t filter_impl<Addr>::access(Addr const& addr) const
 	{
-		TORRENT_ASSERT(!m_access_list.empty());
-		auto i = m_access_list.upper_bound(addr);
-		if (i != m_access_list.begin()) --i;
-		TORRENT_ASSERT(i != m_access_list.end());
-		TORRENT_ASSERT(i->start <= addr && (std::next(i) == m_access_list.end()
-			|| addr < std::next(i)->start));
-		return i->access;
+		freeze();
+		key_type const key = to_key(addr);
+		key_type const* start = m_start.data();
+		std::size_t const n = m_start.size();
+
+		// walk down the tree, remembering the last range that starts at or
+		// before the address. The first range starts at zero, so there always
+		// is one. There are no branches on the comparison, the compiler
+		// turns the selects into conditional moves
+		std::size_t found = 1;
+		std::size_t k = 1;
+		while (k < n)
+		{
+			bool const le = start[k] <= key;
+			found = le ? k : found;
+			k = 2 * k + le;
+		}
+		return m_access[found];
 	}
 
 	template <typename Addr>
 	template <typename ExternalAddressType>
 	std::vector<ip_range<ExternalAddressType>> filter_impl<Addr>::export_filter() const
 	{
+		freeze();
+		std::vector<flat_range<key_type>> ranges;
+		ranges.reserve(m_start.size() - 1);
+		from_eytzinger(m_start, m_access, ranges, 1);
+
 		std::vector<ip_range<ExternalAddressType>> ret;
-		ret.reserve(m_access_list.size());
+		ret.reserve(ranges.size());
 
-		for (auto i = m_access_list.begin()
-			, end(m_access_list.end()); i != end;)
+		for (auto i = ranges.begin(), end(ranges.end()); i != end;)
 		{
 			ip_range<ExternalAddressType> r;
-			r.first = ExternalAddressType(i->start);
+			r.first = ExternalAddressType(from_key<Addr>(i->start));
 			r.flags = i->access;
 
 			++i;
 			if (i == end)
 				r.last = ExternalAddressType(max_addr<Addr>());
 			else
-				r.last = ExternalAddressType(minus_one(i->start));
+				r.last = ExternalAddressType(from_key<Addr>(prev_key(i->start)));
 
 			ret.push_back(r);
 		}
@@ -0,0 +1,922 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/kademlia/dht_storage.hpp"
+#include "libtorrent/settings_pack.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <libtorrent/socket_io.hpp>
+#include <libtorrent/aux_/time.hpp>
+#include <libtorrent/config.hpp>
+#include <libtorrent/bloom_filter.hpp>
+#include <libtorrent/random.hpp>
+#include <libtorrent/aux_/vector.hpp>
+#include <libtorrent/aux_/ip_helpers.hpp> // for is_v4
+#include <libtorrent/bdecode.hpp>
+
+namespace libtorrent { namespace dht {
+namespace {
+
+	// peers that haven't announced for this long are removed
+	constexpr time_duration peer_timeout = minutes(45);
+
+	// every torrent is checked for timed out peers at least this often. The
+	// work is spread out over the calls to tick() in between
+	constexpr time_duration peer_sweep_interval = minutes(15);
+
+	constexpr int sample_infohashes_interval_max = 21600;
+	constexpr int infohashes_sample_count_max = 20;
+
+	// when the item table is full, this many of the least recently seen
+	// items are considered, and the least important of them is removed
+	constexpr int eviction_candidates = 8;
+
+	// times are stored as seconds since the storage was created
+	using timestamp = std::uint32_t;
+
+	// a peer, in the compact form it's sent in get_peers responses: the
+	// address followed by the port, in network byte order. This also makes
+	// the peers sort by address, then port. It's followed by the time of
+	// the last announce, with the top bit set for seeds.
+	template <std::size_t AddrSize>
+	struct packed_peer
+	{
+		static constexpr std::size_t endpoint_size = AddrSize + 2;
+
+		std::array<char, endpoint_size + 4> buf;
+
+		timestamp added() const { return load() & 0x7fffffff; }
+		bool seed() const { return (load() & 0x80000000) != 0; }
+
+		void set(timestamp const t, bool const s)
+		{
+			std::uint32_t const v = (t & 0x7fffffff) | (s ? 0x80000000 : 0);
+			std::memcpy(buf.data() + endpoint_size, &v, 4);
+		}
+
+	private:
+		std::uint32_t load() const
+		{
+			std::uint32_t ret;
+			std::memcpy(&ret, buf.data() + endpoint_size, 4);
+			return ret;
+		}
+	};
+
+	using peer4 = packed_peer<4>;
+	using peer6 = packed_peer<16>;
+
+	static_assert(sizeof(peer4) == 10, "IPv4 peers are expected to be packed");
+	static_assert(sizeof(peer6) == 22, "IPv6 peers are expected to be packed");
+
+	template <std::size_t AddrSize>
+	bool operator<(packed_peer<AddrSize> const& lhs, packed_peer<AddrSize> const& rhs)
+	{
+		return std::memcmp(lhs.buf.data(), rhs.buf.data()
+			, packed_peer<AddrSize>::endpoint_size) < 0;
+	}
+
+	address peer_address(peer4 const& p)
+	{
+		address_v4::bytes_type b;
+		std::memcpy(b.data(), p.buf.data(), b.size());
+		return address_v4(b);
+	}
+
+	address peer_address(peer6 const& p)
+	{
+		address_v6::bytes_type b;
+		std::memcpy(b.data(), p.buf.data(), b.size());
+		return address_v6(b);
+	}
+
+	std::array<char, 4> address_bytes(address_v4 const& a)
+	{
+		std::array<char, 4> ret;
+		auto const b = a.to_bytes();
+		std::memcpy(ret.data(), b.data(), b.size());
+		return ret;
+	}
+
+	std::array<char, 16> address_bytes(address_v6 const& a)
+	{
+		std::array<char, 16> ret;
+		auto const b = a.to_bytes();
+		std::memcpy(ret.data(), b.data(), b.size());
+		return ret;
+	}
+
+	struct torrent_entry
+	{
+		sha1_hash key;
+		std::string name;
+		std::vector<peer4> peers4;
+		std::vector<peer6> peers6;
+	};
+
+	struct immutable_item_entry
+	{
+		sha1_hash key;
+		// the actual value
+		std::unique_ptr<char[]> value;
+		// this counts the number of IPs we have seen
+		// announcing this item, this is used to determine
+		// popularity if we reach the limit of items to store
+		bloom_filter<128> ips;
+		// the last time we heard about this item
+		timestamp last_seen = 0;
+		// number of IPs in the bloom filter
+		int num_announcers = 0;
+		// size of malloced space pointed to by value
+		int size = 0;
+		// the neighbors in the list of items, ordered by last_seen. These
+		// are indices into the item table, -1 at the ends
+		std::int32_t prev = -1;
+		std::int32_t next = -1;
+	};
+
+	struct mutable_item_entry : immutable_item_entry
+	{
+		signature sig{};
+		sequence_number seq{};
+		public_key pk{};
+		std::string salt;
+	};
+
+	void set_value(immutable_item_entry& item, span<char const> buf)
+	{
+		int const size = int(buf.size());
+		if (item.size != size)
+		{
+			item.value.reset(new char[std::size_t(size)]);
+			item.size = size;
+		}
+		std::copy(buf.begin(), buf.end(), item.value.get());
+	}
+
+	// the entries are stored densely in a vector, and found by an open
+	// addressing hash table of indices into it, with linear probing. Removing
+	// an entry moves the last one into its place. The keys are hashed with a
+	// random seed, since they are chosen by other nodes
+	template <typename Entry>
+	class hashed_table
+	{
+	public:
+
+		hashed_table()
+			: m_seed(random(0xffffffff) | (std::uint64_t(random(0xffffffff)) << 32))
+		{}
+
+		int size() const { return int(m_entries.size()); }
+		bool empty() const { return m_entries.empty(); }
+
+		Entry& operator[](int const idx) { return m_entries[std::size_t(idx)]; }
+		Entry const& operator[](int const idx) const { return m_entries[std::size_t(idx)]; }
+
+		// returns the index of the entry with the key ``k``, or -1
+		int find(sha1_hash const& k) const
+		{
+			if (m_slots.empty()) return -1;
+			std::size_t const mask = m_slots.size() - 1;
+			for (std::size_t i = home(k);; i = (i + 1) & mask)
+			{
+				std::uint32_t const s = m_slots[i];
+				if (s == 0) return -1;
+				if (m_entries[s - 1].key == k) return int(s - 1);
+			}
+		}
+
+		// adds a new entry with the key ``k``, which must not already be
+		// in the table. Returns its index
+		int insert(sha1_hash const& k)
+		{
+			TORRENT_ASSERT(find(k) == -1);
+			if ((m_entries.size() + 1) * 2 > m_slots.size())
+				rehash(std::max(std::size_t(16), m_slots.size() * 2));
+
+			m_entries.emplace_back();
+			m_entries.back().key = k;
+			int const idx = int(m_entries.size()) - 1;
+			m_slots[free_slot(k)] = std::uint32_t(idx + 1);
+			return idx;
+		}
+
+		// removes the entry at ``idx`` by moving the last entry into its
+		// place. Returns the index the moved entry had, or -1 if ``idx`` was
+		// the last one
+		int erase(int const idx)
+		{
+			erase_slot(slot_of(idx));
+			int const last = int(m_entries.size()) - 1;
+			int moved = -1;
+			if (idx != last)
+			{
+				m_slots[slot_of(last)] = std::uint32_t(idx + 1);
+				m_entries[std::size_t(idx)] = std::move(m_entries.back());
+				moved = last;
+			}
+			m_entries.pop_back();
+
+			// give back memory when most entries have expired
+			if (m_slots.size() > 16 && m_entries.size() * 8 < m_slots.size())
+			{
+				rehash(m_slots.size() / 2);
+				m_entries.shrink_to_fit();
+			}
+			return moved;
+		}
+
+	private:
+
+		std::size_t home(sha1_hash const& k) const
+		{
+			std::uint64_t words[3] = {0, 0, 0};
+			std::memcpy(words, k.data(), k.size());
+			std::uint64_t h = m_seed;
+			for (auto const w : words)
+			{
+				h = (h ^ w) * 0x9e3779b97f4a7c15ULL;
+				h ^= h >> 32;
+			}
+			return std::size_t(h) & (m_slots.size() - 1);
+		}
+
+		std::size_t free_slot(sha1_hash const& k) const
+		{
+			std::size_t const mask = m_slots.size() - 1;
+			std::size_t i = home(k);
+			while (m_slots[i] != 0) i = (i + 1) & mask;
+			return i;
+		}
+
+		std::size_t slot_of(int const idx) const
+		{
+			std::size_t const mask = m_slots.size() - 1;
+			std::size_t i = home(m_entries[std::size_t(idx)].key);
+			while (m_slots[i] != std::uint32_t(idx + 1)) i = (i + 1) & mask;
+			return i;
+		}
+
+		// clear the slot and shift back the entries after it that would
+		// otherwise not be found, instead of leaving a tombstone
+		void erase_slot(std::size_t i)
+		{
+			std::size_t const mask = m_slots.size() - 1;
+			m_slots[i] = 0;
+			for (std::size_t j = (i + 1) & mask; m_slots[j] != 0; j = (j + 1) & mask)
+			{
+				std::size_t const h = home(m_entries[m_slots[j] - 1].key);
+				// the entry can stay if its home slot is cyclically in (i, j]
+				bool const stays = i < j ? (h > i && h <= j) : (h > i || h <= j);
+				if (stays) continue;
+				m_slots[i] = m_slots[j];
+				m_slots[j] = 0;
+				i = j;
+			}
+		}
+
+		void rehash(std::size_t const num_slots)
+		{
+			m_slots.assign(num_slots, 0);
+			for (std::size_t i = 0; i < m_entries.size(); ++i)
+				m_slots[free_slot(m_entries[i].key)] = std::uint32_t(i + 1);
+		}
+
+		std::vector<Entry> m_entries;
+		// the index + 1 of the entry in each slot, 0 for empty slots. The
+		// size is always a power of two
+		std::vector<std::uint32_t> m_slots;
+		std::uint64_t m_seed;
+	};
+
+	// a table of items, that also keeps them in a list ordered by when they
+	// were last seen. This makes it cheap to find the items to expire, and
+	// the candidates for eviction
+	template <typename Item>
+	class item_table
+	{
+	public:
+
+		int size() const { return m_table.size(); }
+		Item& operator[](int const idx) { return m_table[idx]; }
+		Item const& operator[](int const idx) const { return m_table[idx]; }
+		int find(sha1_hash const& k) const { return m_table.find(k); }
+
+		int insert(sha1_hash const& k)
+		{
+			int const idx = m_table.insert(k);
+			link(idx);
+			return idx;
+		}
+
+		void touch(int const idx, address const& addr, timestamp const now)
+		{
+			Item& item = m_table[idx];
+			item.last_seen = now;
+
+			// maybe increase num_announcers if we haven't seen this IP before
+			sha1_hash const iphash = hash_address(addr);
+			if (!item.ips.find(iphash))
+			{
+				item.ips.set(iphash);
+				++item.num_announcers;
+			}
+
+			unlink(idx);
+			link(idx);
+		}
+
+		void erase(int const idx)
+		{
+			unlink(idx);
+			int const moved = m_table.erase(idx);
+			if (moved < 0) return;
+
+			// the last item was moved into idx, update its neighbors
+			Item const& item = m_table[idx];
+			if (item.prev >= 0) m_table[item.prev].next = idx;
+			else m_oldest = idx;
+			if (item.next >= 0) m_table[item.next].prev = idx;
+			else m_newest = idx;
+		}
+
+		// removes the items not seen after ``cutoff``. Returns the number of
+		// items removed
+		int expire(timestamp const cutoff)
+		{
+			int ret = 0;
+			while (m_oldest >= 0 && m_table[m_oldest].last_seen <= cutoff)
+			{
+				erase(m_oldest);
+				++ret;
+			}
+			return ret;
+		}
+
+		// picks the least important of the items that have not been seen
+		// for the longest time, i.e. the one the fewest peers are
+		// announcing, and farthest from our node IDs
+		int pick_least_important(std::vector<node_id> const& node_ids) const
+		{
+			int ret = -1;
+			int ret_score = 0;
+			int idx = m_oldest;
+			for (int i = 0; i < eviction_candidates && idx >= 0; ++i)
+			{
+				Item const& item = m_table[idx];
+				// each additional 5 announcers is worth one extra bit in
+				// the distance, see immutable_item_comparator in the default
+				// storage
+				int const score = item.num_announcers / 5
+					- min_distance_exp(item.key, node_ids);
+				if (ret < 0 || score < ret_score)
+				{
+					ret = idx;
+					ret_score = score;
+				}
+				idx = item.next;
+			}
+			return ret;
+		}
+
+	private:
+
+		// inserts the item as the most recently seen
+		void link(int const idx)
+		{
+			Item& item = m_table[idx];
+			item.prev = m_newest;
+			item.next = -1;
+			if (m_newest >= 0) m_table[m_newest].next = idx;
+			else m_oldest = idx;
+			m_newest = idx;
+		}
+
+		void unlink(int const idx)
+		{
+			Item& item = m_table[idx];
+			if (item.prev >= 0) m_table[item.prev].next = item.next;
+			else m_oldest = item.next;
+			if (item.next >= 0) m_table[item.next].prev = item.prev;
+			else m_newest = item.prev;
+			item.prev = -1;
+			item.next = -1;
+		}
+
+		hashed_table<Item> m_table;
+		std::int32_t m_oldest = -1;
+		std::int32_t m_newest = -1;
+	};
+
+	template <std::size_t AddrSize>
+	void add_peer_bloom(std::vector<packed_peer<AddrSize>> const& peers
+		, bloom_filter<256>& downloaders, bloom_filter<256>& seeds)
+	{
+		for (auto const& p : peers)
+		{
+			sha1_hash const iphash = hash_address(peer_address(p));
+			if (p.seed()) seeds.set(iphash);
+			else downloaders.set(iphash);
+		}
+	}
+
+	template <std::size_t AddrSize>
+	void pick_peers(std::vector<packed_peer<AddrSize>> const& peers
+		, bool const noseed, int to_pick, entry::list_type& pe)
+	{
+		int candidates = int(std::count_if(peers.begin(), peers.end()
+			, [=](packed_peer<AddrSize> const& p) { return !(noseed && p.seed()); }));
+
+		to_pick = std::min(to_pick, candidates);
+
+		for (auto iter = peers.begin(); to_pick > 0; ++iter)
+		{
+			// if the node asking for peers is a seed, skip seeds from the
+			// peer list
+			if (noseed && iter->seed()) continue;
+
+			TORRENT_ASSERT(candidates >= to_pick);
+
+			// pick this peer with probability
+			// <peers left to pick> / <peers left in the set>
+			if (random(std::uint32_t(candidates--)) > std::uint32_t(to_pick))
+				continue;
+
+			// the peers are stored in the form they are sent in
+			pe.emplace_back(std::string(iter->buf.data()
+				, packed_peer<AddrSize>::endpoint_size));
+			--to_pick;
+		}
+	}
+
+	// returns true if there is a peer with the address ``addr`` in ``peers``
+	template <std::size_t AddrSize>
+	bool has_address(std::vector<packed_peer<AddrSize>> const& peers
+		, std::array<char, AddrSize> const& addr)
+	{
+		auto const i = std::lower_bound(peers.begin(), peers.end(), addr
+			, [](packed_peer<AddrSize> const& p, std::array<char, AddrSize> const& a)
+			{ return std::memcmp(p.buf.data(), a.data(), AddrSize) < 0; });
+		return i != peers.end()
+			&& std::memcmp(i->buf.data(), addr.data(), AddrSize) == 0;
+	}
+
+	// returns true if the peer was added, false if it was already in the
+	// list, or the list is full
+	template <std::size_t AddrSize>
+	bool add_peer(std::vector<packed_peer<AddrSize>>& peers
+		, packed_peer<AddrSize> const& peer, int const max_peers)
+	{
+		auto const i = std::lower_bound(peers.begin(), peers.end(), peer);
+		if (i != peers.end() && !(peer < *i))
+		{
+			*i = peer;
+			return false;
+		}
+		// we're at capacity, drop the announce
+		if (int(peers.size()) >= max_peers) return false;
+		peers.insert(i, peer);
+		return true;
+	}
+
+	// removes the peers that last announced before ``cutoff``. Returns the
+	// number of peers removed
+	template <std::size_t AddrSize>
+	int purge_peers(std::vector<packed_peer<AddrSize>>& peers, timestamp const cutoff)
+	{
+		auto const new_end = std::remove_if(peers.begin(), peers.end()
+			, [=](packed_peer<AddrSize> const& p) { return p.added() < cutoff; });
+
+		int const ret = int(std::distance(new_end, peers.end()));
+		peers.erase(new_end, peers.end());
+		// if we're using less than 1/4 of the capacity free up the excess
+		if (peers.capacity() / std::max(peers.size(), std::size_t(1)) >= 4U)
+			peers.shrink_to_fit();
+		return ret;
+	}
+
+	// This storage behaves like the default one, but is designed to hold a
+	// very large number of torrents and items. Torrents and items are kept in
+	// hash tables, peers are stored in the compact form they are sent in, and
+	// neither evicting nor expiring entries requires visiting all of them
+	class dht_compact_storage final : public dht_storage_interface
+	{
+	public:
+
+		explicit dht_compact_storage(settings_interface const& settings)
+			: m_settings(settings)
+			, m_created(aux::time_now())
+		{
+			m_counters.reset();
+		}
+
+		~dht_compact_storage() override = default;
+
+		dht_compact_storage(dht_compact_storage const&) = delete;
+		dht_compact_storage& operator=(dht_compact_storage const&) = delete;
+
+#if TORRENT_ABI_VERSION == 1
+		size_t num_torrents() const override { return size_t(m_torrents.size()); }
+		size_t num_peers() const override { return size_t(m_counters.peers); }
+#endif
+		void update_node_ids(std::vector<node_id> const& ids) override
+		{
+			m_node_ids = ids;
+		}
+
+		bool get_peers(sha1_hash const& info_hash
+			, bool const noseed, bool const scrape, address const& requester
+			, entry& peers) const override
+		{
+			int const idx = m_torrents.find(info_hash);
+			if (idx < 0) return m_torrents.size() >= m_settings.get_int(settings_pack::dht_max_torrents);
+
+			torrent_entry const& v = m_torrents[idx];
+			bool const v4 = requester.is_v4();
+			int const num_peers = int(v4 ? v.peers4.size() : v.peers6.size());
+
+			if (!v.name.empty()) peers["n"] = v.name;
+
+			if (scrape)
+			{
+				bloom_filter<256> downloaders;
+				bloom_filter<256> seeds;
+
+				if (v4) add_peer_bloom(v.peers4, downloaders, seeds);
+				else add_peer_bloom(v.peers6, downloaders, seeds);
+
+				peers["BFpe"] = downloaders.to_string();
+				peers["BFsd"] = seeds.to_string();
+			}
+			else
+			{
+				int to_pick = m_settings.get_int(settings_pack::dht_max_peers_reply);
+				TORRENT_ASSERT(to_pick >= 0);
+				// if these are IPv6 peers their addresses are 4x the size of IPv4
+				// so reduce the max peers 4 fold to compensate
+				// max_peers_reply should probably be specified in bytes
+				if (num_peers > 0 && !v4)
+					to_pick /= 4;
+				entry::list_type& pe = peers["values"].list();
+
+				if (v4) pick_peers(v.peers4, noseed, to_pick, pe);
+				else pick_peers(v.peers6, noseed, to_pick, pe);
+			}
+
+			if (num_peers < m_settings.get_int(settings_pack::dht_max_peers))
+				return false;
+
+			// we're at the max peers stored for this torrent
+			// only send a write token if the requester is already in the set
+			// only check for a match on IP because the peer may be announcing
+			// a different port than the one it is using to send DHT messages
+			return v4 ? !has_address(v.peers4, address_bytes(requester.to_v4()))
+				: !has_address(v.peers6, address_bytes(requester.to_v6()));
+		}
+
+		void announce_peer(sha1_hash const& info_hash
+			, tcp::endpoint const& endp
+			, string_view name, bool const seed) override
+		{
+			int idx = m_torrents.find(info_hash);
+			if (idx < 0)
+			{
+				if (m_torrents.size() >= m_settings.get_int(settings_pack::dht_max_torrents))
+				{
+					// we're at capacity, drop the announce
+					return;
+				}
+
+				m_counters.torrents += 1;
+				idx = m_torrents.insert(info_hash);
+			}
+			torrent_entry& v = m_torrents[idx];
+
+			// the peer announces a torrent name, and we don't have a name
+			// for this torrent. Store it.
+			if (!name.empty() && v.name.empty())
+			{
+				v.name = name.substr(0, 100).to_string();
+			}
+
+			int const max_peers = m_settings.get_int(settings_pack::dht_max_peers);
+			timestamp const now = current_time();
+			bool added;
+			if (aux::is_v4(endp))
+			{
+				peer4 p;
+				char* out = p.buf.data();
+				aux::write_endpoint(endp, out);
+				p.set(now, seed);
+				added = add_peer(v.peers4, p, max_peers);
+			}
+			else
+			{
+				peer6 p;
+				char* out = p.buf.data();
+				aux::write_endpoint(endp, out);
+				p.set(now, seed);
+				added = add_peer(v.peers6, p, max_peers);
+			}
+			if (added) m_counters.peers += 1;
+		}
+
+		bool get_immutable_item(sha1_hash const& target
+			, entry& item) const override
+		{
+			int const idx = m_immutable_table.find(target);
+			if (idx < 0) return false;
+
+			auto const& f = m_immutable_table[idx];
+			error_code ec;
+			item["v"] = bdecode({f.value.get(), f.size}, ec);
+			return true;
+		}
+
+		void put_immutable_item(sha1_hash const& target
+			, span<char const> buf
+			, address const& addr) override
+		{
+			TORRENT_ASSERT(!m_node_ids.empty());
+			int idx = m_immutable_table.find(target);
+			if (idx < 0)
+			{
+				// make sure we don't add too many items
+				if (m_immutable_table.size() >= m_settings.get_int(settings_pack::dht_max_dht_items))
+				{
+					int const j = m_immutable_table.pick_least_important(m_node_ids);
+					TORRENT_ASSERT(j >= 0);
+					m_immutable_table.erase(j);
+					m_counters.immutable_data -= 1;
+				}
+				idx = m_immutable_table.insert(target);
+				set_value(m_immutable_table[idx], buf);
+				m_counters.immutable_data += 1;
+			}
+
+			m_immutable_table.touch(idx, addr, current_time());
+		}
+
+		bool get_mutable_item_seq(sha1_hash const& target
+			, sequence_number& seq) const override
+		{
+			int const idx = m_mutable_table.find(target);
+			if (idx < 0) return false;
+
+			seq = m_mutable_table[idx].seq;
+			return true;
+		}
+
+		bool get_mutable_item(sha1_hash const& target
+			, sequence_number const seq, bool const force_fill
+			, entry& item) const override
+		{
+			int const idx = m_mutable_table.find(target);
+			if (idx < 0) return false;
+
+			mutable_item_entry const& f = m_mutable_table[idx];
+			item["seq"] = f.seq.value;
+			if (force_fill || (sequence_number(0) <= seq && seq < f.seq))
+			{
+				error_code ec;
+				item["v"] = bdecode({f.value.get(), f.size}, ec);
+				item["sig"] = f.sig.bytes;
+				item["k"] = f.pk.bytes;
+			}
+			return true;
+		}
+
+		void put_mutable_item(sha1_hash const& target
+			, span<char const> buf
+			, signature const& sig
+			, sequence_number const seq
+			, public_key const& pk
+			, span<char const> salt
+			, address const& addr) override
+		{
+			TORRENT_ASSERT(!m_node_ids.empty());
+			int idx = m_mutable_table.find(target);
+			if (idx < 0)
+			{
+				// this is the case where we don't have an item in this slot
+				// make sure we don't add too many items
+				if (m_mutable_table.size() >= m_settings.get_int(settings_pack::dht_max_dht_items))
+				{
+					int const j = m_mutable_table.pick_least_important(m_node_ids);
+					TORRENT_ASSERT(j >= 0);
+					m_mutable_table.erase(j);
+					m_counters.mutable_data -= 1;
+				}
+				idx = m_mutable_table.insert(target);
+				mutable_item_entry& item = m_mutable_table[idx];
+				set_value(item, buf);
+				item.seq = seq;
+				item.salt = {salt.begin(), salt.end()};
+				item.sig = sig;
+				item.pk = pk;
+				m_counters.mutable_data += 1;
+			}
+			else
+			{
+				// this is the case where we already have an item in this slot
+				mutable_item_entry& item = m_mutable_table[idx];
+
+				if (item.seq < seq)
+				{
+					set_value(item, buf);
+					item.seq = seq;
+					item.sig = sig;
+				}
+			}
+
+			m_mutable_table.touch(idx, addr, current_time());
+		}
+
+		int get_infohashes_sample(entry& item) override
+		{
+			item["interval"] = aux::clamp(m_settings.get_int(settings_pack::dht_sample_infohashes_interval)
+				, 0, sample_infohashes_interval_max);
+			item["num"] = m_torrents.size();
+
+			refresh_infohashes_sample();
+
+			aux::vector<sha1_hash> const& samples = m_infohashes_sample;
+			item["samples"] = span<char const>(
+				reinterpret_cast<char const*>(samples.data()), static_cast<std::ptrdiff_t>(samples.size()) * 20);
+
+			return int(samples.size());
+		}
+
+		void tick() override
+		{
+			timestamp const now = current_time();
+			expire_peers(now);
+
+			if (0 == m_settings.get_int(settings_pack::dht_item_lifetime)) return;
+
+			// item lifetime must >= 120 minutes.
+			timestamp const lifetime = timestamp(std::max(
+				m_settings.get_int(settings_pack::dht_item_lifetime)
+				, int(total_seconds(minutes(120)))));
+			if (now < lifetime) return;
+
+			m_counters.immutable_data -= m_immutable_table.expire(now - lifetime);
+			m_counters.mutable_data -= m_mutable_table.expire(now - lifetime);
+		}
+
+		dht_storage_counters counters() const override
+		{
+			return m_counters;
+		}
+
+	private:
+
+		timestamp current_time() const
+		{
+			return timestamp(total_seconds(aux::time_now() - m_created));
+		}
+
+		// visits as many torrents as needed to check all of them for timed
+		// out peers once every peer_sweep_interval
+		void expire_peers(timestamp const now)
+		{
+			timestamp const elapsed = now - m_last_peer_sweep;
+			m_last_peer_sweep = now;
+
+			int const num_torrents = m_torrents.size();
+			if (num_torrents == 0) return;
+
+			timestamp const sweep_interval = timestamp(total_seconds(peer_sweep_interval));
+			int to_visit = num_torrents;
+			if (elapsed < sweep_interval)
+			{
+				to_visit = int(std::int64_t(num_torrents) * elapsed / sweep_interval) + 1;
+			}
+			else
+			{
+				// every torrent will be visited, start from the beginning
+				// to not visit the ones moved from the end twice
+				m_sweep_cursor = 0;
+			}
+
+			timestamp const timeout = timestamp(total_seconds(peer_timeout));
+			timestamp const cutoff = now > timeout ? now - timeout : 0;
+			for (; to_visit > 0 && !m_torrents.empty(); --to_visit)
+			{
+				if (m_sweep_cursor >= m_torrents.size()) m_sweep_cursor = 0;
+
+				torrent_entry& t = m_torrents[m_sweep_cursor];
+				m_counters.peers -= purge_peers(t.peers4, cutoff);
+				m_counters.peers -= purge_peers(t.peers6, cutoff);
+
+				if (!t.peers4.empty() || !t.peers6.empty())
+				{
+					++m_sweep_cursor;
+					continue;
+				}
+
+				// if there are no more peers, remove the entry altogether.
+				// The last torrent is moved into its place, and is visited
+				// next
+				m_torrents.erase(m_sweep_cursor);
+				m_counters.torrents -= 1;
+			}
+		}
+
+		void refresh_infohashes_sample()
+		{
+			time_point const now = aux::time_now();
+			int const interval = aux::clamp(m_settings.get_int(settings_pack::dht_sample_infohashes_interval)
+				, 0, sample_infohashes_interval_max);
+
+			int const max_count = aux::clamp(m_settings.get_int(settings_pack::dht_max_infohashes_sample_count)
+				, 0, infohashes_sample_count_max);
+			int const count = std::min(max_count, m_torrents.size());
+
+			if (interval > 0
+				&& m_infohashes_sample_created + seconds(interval) > now
+				&& int(m_infohashes_sample.size()) >= max_count)
+				return;
+
+			aux::vector<sha1_hash>& samples = m_infohashes_sample;
+			samples.clear();
+			samples.reserve(count);
+
+			// the torrents are stored densely, pick random ones. The sample
+			// is small, so checking for duplicates is cheap
+			while (int(samples.size()) < count)
+			{
+				int const idx = count == m_torrents.size() ? int(samples.size())
+					: int(random(std::uint32_t(m_torrents.size() - 1)));
+				sha1_hash const& ih = m_torrents[idx].key;
+				if (std::find(samples.begin(), samples.end(), ih) != samples.end())
+					continue;
+				samples.push_back(ih);
+			}
+
+			m_infohashes_sample_created = now;
+		}
+
+		settings_interface const& m_settings;
+		dht_storage_counters m_counters;
+
+		std::vector<node_id> m_node_ids;
+		hashed_table<torrent_entry> m_torrents;
+		item_table<immutable_item_entry> m_immutable_table;
+		item_table<mutable_item_entry> m_mutable_table;
+
+		// the time all timestamps are relative to
+		time_point const m_created;
+
+		// the time of the last call to expire_peers(), and the torrent it
+		// will continue from
+		timestamp m_last_peer_sweep = 0;
+		int m_sweep_cursor = 0;
+
+		aux::vector<sha1_hash> m_infohashes_sample;
+		time_point m_infohashes_sample_created = min_time();
+	};
+}
+
+std::unique_ptr<dht_storage_interface> dht_compact_storage_constructor(
+	settings_interface const& settings)
+{
+	return std::make_unique<dht_compact_storage>(settings);
+}
+
+} } // namespace libtorrent::dht
@@ -189,10 +189,22 @@ rpc_manager::~rpc_manager()
 
 	for (auto const& t : m_transactions)
 	{
-		t.second->abort();
+		if (t.o) t.o->abort();
 	}
 }
 
+void intrusive_ptr_release(observer const* o)
+{
+	TORRENT_ASSERT(o->m_refs > 0);
+	if (--o->m_refs > 0) return;
+
+	TORRENT_ASSERT(o->m_in_use);
+	rpc_manager* rpc = o->m_rpc;
+	observer* ptr = const_cast<observer*>(o);
+	ptr->~observer();
+	rpc->free_observer(ptr);
+}
+
 void* rpc_manager::allocate_observer()
 {
 	m_pool_allocator.set_next_size(10);
@@ -217,13 +229,80 @@ size_t rpc_manager::allocation_size() const
 #if TORRENT_USE_INVARIANT_CHECKS
 void rpc_manager::check_invariant() const
 {
+	int num = 0;
 	for (auto const& t : m_transactions)
 	{
-		TORRENT_ASSERT(t.second);
+		if (!t.o) continue;
+		++num;
+		TORRENT_ASSERT(find_transaction(t.tid) == &t - m_transactions.data());
 	}
+	TORRENT_ASSERT(num == m_num_transactions);
+	TORRENT_ASSERT(m_short_timeouts <= m_timeout_queue.size());
 }
 #endif
 
+int rpc_manager::find_transaction(std::uint16_t const tid) const
+{
+	if (m_transactions.empty()) return -1;
+	std::size_t const mask = m_transactions.size() - 1;
+	for (std::size_t i = tid & mask;; i = (i + 1) & mask)
+	{
+		transaction const& t = m_transactions[i];
+		if (!t.o) return -1;
+		if (t.tid == tid) return int(i);
+	}
+}
+
+void rpc_manager::add_transaction(std::uint16_t const tid, observer_ptr o)
+{
+	TORRENT_ASSERT(find_transaction(tid) == -1);
+	if ((std::size_t(m_num_transactions) + 1) * 2 > m_transactions.size())
+	{
+		std::vector<transaction> old(std::max(std::size_t(64), m_transactions.size() * 2));
+		old.swap(m_transactions);
+		std::size_t const mask = m_transactions.size() - 1;
+		for (auto& t : old)
+		{
+			if (!t.o) continue;
+			std::size_t i = t.tid & mask;
+			while (m_transactions[i].o) i = (i + 1) & mask;
+			m_transactions[i] = std::move(t);
+		}
+	}
+
+	std::size_t const mask = m_transactions.size() - 1;
+	std::size_t i = tid & mask;
+	while (m_transactions[i].o) i = (i + 1) & mask;
+	transaction& t = m_transactions[i];
+	t.o = std::move(o);
+	t.tid = tid;
+	t.seq = m_next_seq++;
+	++m_num_transactions;
+	m_timeout_queue.emplace_back(tid, t.seq);
+}
+
+observer_ptr rpc_manager::remove_transaction(int const idx)
+{
+	std::size_t const mask = m_transactions.size() - 1;
+	std::size_t i = std::size_t(idx);
+	observer_ptr ret = std::move(m_transactions[i].o);
+	--m_num_transactions;
+
+	// shift back the transactions after this one that would otherwise not
+	// be found, instead of leaving a tombstone
+	for (std::size_t j = (i + 1) & mask; m_transactions[j].o; j = (j + 1) & mask)
+	{
+		std::size_t const home = m_transactions[j].tid & mask;
+		// the transaction can stay if its home slot is cyclically in (i, j]
+		bool const stays = i < j ? (home > i && home <= j) : (home > i || home <= j);
+		if (stays) continue;
+		m_transactions[i] = std::move(m_transactions[j]);
+		m_transactions[j].o.reset();
+		i = j;
+	}
+	return ret;
+}
+
 void rpc_manager::unreachable(udp::endpoint const& ep)
 {
 #ifndef TORRENT_DISABLE_LOGGING
@@ -234,16 +313,14 @@ void rpc_manager::unreachable(udp::endpoint const& ep)
 	}
 #endif
 
-	for (auto i = m_transactions.begin(); i != m_transactions.end();)
+	for (auto const& t : m_transactions)
 	{
-		TORRENT_ASSERT(i->second);
-		if (i->second->target_ep() != ep) { ++i; continue; }
-		observer_ptr o = i->second;
+		if (!t.o || t.o->target_ep() != ep) continue;
 #ifndef TORRENT_DISABLE_LOGGING
 		m_log->log(dht_logger::rpc_manager, "[%u] found transaction [ tid: %d ]"
-			, o->algorithm()->id(), i->first);
+			, t.o->algorithm()->id(), int(t.tid));
 #endif
-		i = m_transactions.erase(i);
+		observer_ptr o = remove_transaction(int(&t - m_transactions.data()));
 		o->timeout();
 		break;
 	}
@@ -269,14 +346,9 @@ bool rpc_manager::incoming(msg const& m, node_id* id)
 	std::uint16_t const tid = transaction_id.size() != 2 ? std::uint64_t(0xffff) : aux::read_uint16(ptr);
 
 	observer_ptr o;
-	auto range = m_transactions.equal_range(tid);
-	for (auto i = range.first; i != range.second; ++i)
-	{
-		if (m.addr.address() != i->second->target_addr()) continue;
-		o = i->second;
-		i = m_transactions.erase(i);
-		break;
-	}
+	int const idx = find_transaction(tid);
+	if (idx >= 0 && m.addr.address() == m_transactions[std::size_t(idx)].o->target_addr())
+		o = remove_transaction(idx);
 
 	if (!o)
 	{
@@ -392,60 +464,86 @@ time_duration rpc_manager::tick()
 	constexpr auto short_timeout = seconds(1);
 	constexpr auto timeout = seconds(15);
 
-	// look for observers that have timed out
-
-	if (m_transactions.empty()) return short_timeout;
+	if (m_num_transactions == 0)
+	{
+		m_timeout_queue.clear();
+		m_short_timeouts = 0;
+		return short_timeout;
+	}
 
 	std::vector<observer_ptr> timeouts;
 	std::vector<observer_ptr> short_timeouts;
 
 	time_duration ret = short_timeout;
-	time_point now = aux::time_now();
+	time_point const now = aux::time_now();
 
-	for (auto i = m_transactions.begin(); i != m_transactions.end();)
+	// returns the index of the transaction, or -1 if it has completed
+	auto outstanding = [this](std::pair<std::uint16_t, std::uint32_t> const& q)
 	{
-		observer_ptr o = i->second;
-
-		time_duration diff = now - o->sent();
-		if (diff >= timeout)
+		int const idx = find_transaction(q.first);
+		return idx >= 0 && m_transactions[std::size_t(idx)].seq == q.second ? idx : -1;
+	};
+
+	// the requests are queued in the order they were sent. Look for the ones
+	// that have timed out from the front, and stop at the first one that
+	// hasn't
+	while (!m_timeout_queue.empty())
+	{
+		int const idx = outstanding(m_timeout_queue.front());
+		if (idx >= 0)
 		{
+			observer_ptr const& o = m_transactions[std::size_t(idx)].o;
+			time_duration const diff = now - o->sent();
+			if (diff < timeout)
+			{
+				ret = std::min(duration_cast<time_duration>(timeout - diff), ret);
+				break;
+			}
 #ifndef TORRENT_DISABLE_LOGGING
 			if (m_log->should_log(dht_logger::rpc_manager))
 			{
 				m_log->log(dht_logger::rpc_manager, "[%u] timing out transaction id: %d from: %s"
-					, o->algorithm()->id(), i->first
+					, o->algorithm()->id(), int(m_timeout_queue.front().first)
 					, print_endpoint(o->target_ep()).c_str());
 			}
 #endif
-			i = m_transactions.erase(i);
-			timeouts.push_back(o);
-			continue;
+			timeouts.push_back(remove_transaction(idx));
+		}
+		m_timeout_queue.pop_front();
+		if (m_short_timeouts > 0) --m_short_timeouts;
+	}
+
+	// the same goes for the short timeouts. The requests before
+	// m_short_timeouts have already been checked
+	for (; m_short_timeouts < m_timeout_queue.size(); ++m_short_timeouts)
+	{
+		auto const& q = m_timeout_queue[m_short_timeouts];
+		int const idx = outstanding(q);
+		if (idx < 0) continue;
+		observer_ptr const& o = m_transactions[std::size_t(idx)].o;
+		time_duration const diff = now - o->sent();
+		if (diff < short_timeout)
+		{
+			ret = std::min(duration_cast<time_duration>(short_timeout - diff), ret);
+			break;
 		}
 
 		// don't call short_timeout() again if we've
 		// already called it once
-		if (diff >= short_timeout && !o->has_short_timeout())
-		{
+		if (o->has_short_timeout()) continue;
 #ifndef TORRENT_DISABLE_LOGGING
-			if (m_log->should_log(dht_logger::rpc_manager))
-			{
-				m_log->log(dht_logger::rpc_manager, "[%u] short-timing out transaction id: %d from: %s"
-					, o->algorithm()->id(), i->first
-					, print_endpoint(o->target_ep()).c_str());
-			}
-#endif
-			++i;
-
-			short_timeouts.push_back(o);
-			continue;
+		if (m_log->should_log(dht_logger::rpc_manager))
+		{
+			m_log->log(dht_logger::rpc_manager, "[%u] short-timing out transaction id: %d from: %s"
+				, o->algorithm()->id(), int(q.first)
+				, print_endpoint(o->target_ep()).c_str());
 		}
-
-		ret = std::min(duration_cast<time_duration>(timeout - diff), ret);
-		++i;
+#endif
+		short_timeouts.push_back(o);
 	}
 
-	std::for_each(timeouts.begin(), timeouts.end(), std::bind(&observer::timeout, _1));
-	std::for_each(short_timeouts.begin(), short_timeouts.end(), std::bind(&observer::short_timeout, _1));
+	for (auto const& o : timeouts) o->timeout();
+	for (auto const& o : short_timeouts) o->short_timeout();
 
 	return std::max(ret, duration_cast<time_duration>(milliseconds(200)));
 }
@@ -466,10 +564,16 @@ bool rpc_manager::invoke(entry& e, udp::endpoint const& target_addr
 	entry& a = e["a"];
 	add_our_id(a);
 
+	// pick a transaction ID that's not used by any other outstanding
+	// request. There are at most a few thousand of them, so this rarely
+	// takes more than one attempt
+	std::uint16_t tid;
+	do tid = std::uint16_t(random(0xffff));
+	while (find_transaction(tid) >= 0);
+
 	std::string transaction_id;
 	transaction_id.resize(2);
 	char* out = &transaction_id[0];
-	std::uint16_t const tid = std::uint16_t(random(0xffff));
 	aux::write_uint16(tid, out);
 	e["t"] = transaction_id;
 
@@ -496,10 +600,10 @@ bool rpc_manager::invoke(entry& e, udp::endpoint const& target_addr
 
 	if (m_sock_man->send_packet(m_sock, e, target_addr))
 	{
-		m_transactions.emplace(tid, o);
 #if TORRENT_USE_ASSERTS
 		o->m_was_sent = true;
 #endif
+		add_transaction(tid, std::move(o));
 		return true;
 	}
 	return false;
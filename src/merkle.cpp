@@ -34,9 +34,38 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "libtorrent/aux_/merkle.hpp"
 #include "libtorrent/aux_/vector.hpp"
+#include "libtorrent/aux_/sha_multi.hpp"
+
+#include <array>
+#include <algorithm> // for min
 
 namespace libtorrent {
 
+namespace {
+
+	// hashes each pair of adjacent nodes in ``children`` into the
+	// corresponding node in ``parents``. The pairs are hashed in batches, to
+	// make use of multi-buffer SHA-256 where the CPU supports it. ``parents``
+	// may overlap ``children``, as long as it doesn't start after it
+	void merkle_hash_pairs(sha256_hash const* children, sha256_hash* parents, int num_parents)
+	{
+		static_assert(sizeof(sha256_hash) * 2 == 64, "nodes are assumed to be packed");
+		std::array<span<char const>, 64> bufs;
+		std::array<sha256_hash, 64> batch;
+		while (num_parents > 0)
+		{
+			int const n = std::min(num_parents, int(bufs.size()));
+			for (int i = 0; i < n; ++i)
+				bufs[std::size_t(i)] = {children[i * 2].data(), 64};
+			aux::sha256_multi({bufs.data(), n}, {batch.data(), n});
+			std::copy(batch.begin(), batch.begin() + n, parents);
+			children += n * 2;
+			parents += n;
+			num_parents -= n;
+		}
+	}
+}
+
 	int merkle_layer_start(int const layer)
 	{
 		TORRENT_ASSERT(layer >= 0);
@@ -128,14 +157,8 @@ namespace libtorrent {
 		int level_size = num_leafs;
 		while (level_size > 1)
 		{
-			int parent = merkle_get_parent(level_start);
-			for (int i = level_start; i < level_start + level_size; i += 2, ++parent)
-			{
-				hasher256 h;
-				h.update(tree[i]);
-				h.update(tree[i + 1]);
-				tree[parent] = h.final();
-			}
+			int const parent = merkle_get_parent(level_start);
+			merkle_hash_pairs(&tree[level_start], &tree[parent], level_size / 2);
 			level_start = merkle_get_parent(level_start);
 			level_size /= 2;
 		}
@@ -242,14 +265,8 @@ namespace libtorrent {
 
 		while (num_leafs > 1)
 		{
-			int i = 0;
-			for (; i < int(leaves.size()) / 2; ++i)
-			{
-				scratch_space[std::size_t(i)] = hasher256()
-					.update(leaves[i * 2])
-					.update(leaves[i * 2 + 1])
-					.final();
-			}
+			int i = int(leaves.size()) / 2;
+			merkle_hash_pairs(leaves.data(), scratch_space.data(), i);
 			if (leaves.size() & 1)
 			{
 				// if we have an odd number of leaves, compute the boundary hash
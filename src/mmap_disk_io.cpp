@@ -51,9 +51,14 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/debug.hpp"
 #include "libtorrent/units.hpp"
 #include "libtorrent/hasher.hpp"
+#include "libtorrent/aux_/sha_multi.hpp"
 #include "libtorrent/aux_/disk_job_pool.hpp"
 #include "libtorrent/aux_/disk_io_thread_pool.hpp"
+#include "libtorrent/aux_/disk_device.hpp"
+#include "libtorrent/aux_/disk_job_queue.hpp"
+#include "libtorrent/aux_/extent_cache.hpp"
 #include "libtorrent/aux_/store_buffer.hpp"
+#include "libtorrent/aux_/write_hasher.hpp"
 #include "libtorrent/aux_/time.hpp"
 #include "libtorrent/aux_/alloca.hpp"
 #include "libtorrent/aux_/array.hpp"
@@ -69,8 +74,13 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/aux_/win_util.hpp"
 #endif
 
+#include <algorithm>
+#include <cinttypes> // for PRIu64
 #include <functional>
 #include <condition_variable>
+#include <memory>
+#include <array>
+#include <cstring> // for memcpy
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 #include <boost/variant/get.hpp>
@@ -140,6 +150,21 @@ namespace {
 		return ret;
 	}
 
+	// the most checking jobs hashed together, one per lane of
+	// sha1_multi_context
+	constexpr int hash_batch_size = 8;
+
+	// jobs checking v1 (or hybrid) pieces can be hashed together. The pieces
+	// of v2-only torrents are hashed a block at a time, see do_hash_v2_batch()
+	bool can_batch_hash(aux::disk_io_job const* j)
+	{
+		return j->action == aux::job_action_t::hash
+			&& (j->flags & disk_interface::volatile_read)
+			&& (j->flags & disk_interface::v1_hash)
+			&& !(j->flags & aux::disk_io_job::aborted)
+			&& aux::sha_multi_accelerated();
+	}
+
 	storage_index_t pop(std::vector<storage_index_t>& q)
 	{
 		TORRENT_ASSERT(!q.empty());
@@ -176,6 +201,12 @@ struct TORRENT_EXTRA_EXPORT mmap_disk_io final
 		, char const* buf, std::shared_ptr<disk_observer> o
 		, std::function<void(storage_error const&)> handler
 		, disk_job_flags_t flags = {}) override;
+	disk_buffer_holder allocate_receive_buffer(bool& exceeded
+		, std::shared_ptr<disk_observer> o, char const* category) override;
+	bool async_write_buffer(storage_index_t storage, peer_request const& r
+		, disk_buffer_holder buffer, std::shared_ptr<disk_observer> o
+		, std::function<void(storage_error const&)> handler
+		, disk_job_flags_t flags = {}) override;
 	void async_hash(storage_index_t storage, piece_index_t piece, span<sha256_hash> v2
 		, disk_job_flags_t flags
 		, std::function<void(piece_index_t, sha1_hash const&, storage_error const&)> handler) override;
@@ -217,7 +248,11 @@ struct TORRENT_EXTRA_EXPORT mmap_disk_io final
 	status_t do_partial_read(aux::disk_io_job* j);
 	status_t do_read(aux::disk_io_job* j);
 	status_t do_write(aux::disk_io_job* j);
+	void hash_written_block(aux::disk_io_job* j, disk_buffer_holder& buffer, int ret);
 	status_t do_hash(aux::disk_io_job* j);
+	status_t do_hash_v2_batch(aux::disk_io_job* j
+		, aux::write_hasher::piece_state const& ws, int& in_flight);
+	void do_hash_batch(span<aux::disk_io_job*> jobs);
 	status_t do_hash2(aux::disk_io_job* j);
 
 	status_t do_move_storage(aux::disk_io_job* j);
@@ -261,7 +296,36 @@ private:
 		std::condition_variable m_job_cond;
 
 		// jobs queued for servicing
-		jobqueue_t m_queued_jobs;
+		aux::disk_job_queue m_queued_jobs;
+
+		// this is set for per-device queues, whose jobs are timed
+		bool m_per_device = false;
+
+		// moving average of the time jobs spend in this queue, in
+		// microseconds. Only maintained for per-device queues
+		std::int64_t m_avg_queue_time = 0;
+
+		// true if there's a job a thread may start on
+		bool ready() const { return m_queued_jobs.ready(); }
+
+		void push_job(aux::disk_io_job* j);
+		aux::disk_io_job* pop_job();
+	};
+
+	// the queue and threads serving the jobs for torrents whose save path is
+	// on one storage device
+	struct device_queue
+	{
+		device_queue(mmap_disk_io& owner, io_context& ios, aux::disk_device const& dev)
+			: device(dev), jobs(owner), threads(jobs, ios)
+		{
+			jobs.m_per_device = true;
+			jobs.m_queued_jobs.set_elevator(dev.rotational);
+		}
+
+		aux::disk_device const device;
+		job_queue jobs;
+		aux::disk_io_thread_pool threads;
 	};
 
 	void thread_fun(job_queue& queue, aux::disk_io_thread_pool& pool);
@@ -276,12 +340,14 @@ private:
 	void fail_jobs_impl(storage_error const& e, jobqueue_t& src, jobqueue_t& dst);
 
 	void perform_job(aux::disk_io_job* j, jobqueue_t& completed_jobs);
+	void perform_hash_batch(span<aux::disk_io_job*> jobs, jobqueue_t& completed_jobs);
 
 	// this queues up another job to be submitted
 	void add_job(aux::disk_io_job* j, bool user_add = true);
 	void add_fence_job(aux::disk_io_job* j, bool user_add = true);
 
 	void execute_job(aux::disk_io_job* j);
+	void execute_hash_batch(span<aux::disk_io_job*> jobs);
 	void immediate_execute();
 	void abort_jobs();
 	void abort_hash_jobs(storage_index_t storage);
@@ -292,6 +358,15 @@ private:
 	job_queue& queue_for_job(aux::disk_io_job* j);
 	aux::disk_io_thread_pool& pool_for_job(aux::disk_io_job* j);
 
+	// returns the per-device queue the job should be posted to, if any. Must
+	// hold m_job_mutex
+	device_queue* device_for_job(aux::disk_io_job const* j) const;
+
+	// looks up the device the storage's save path is on, and routes its jobs
+	// to the queue for that device from now on. This is called from the
+	// disk threads, by jobs holding a fence on the storage
+	void assign_device(mmap_storage const& st);
+
 	// set to true once we start shutting down
 	std::atomic<bool> m_abort{false};
 
@@ -314,6 +389,19 @@ private:
 	job_queue m_hash_io_jobs;
 	aux::disk_io_thread_pool m_hash_threads;
 
+	// when disk_device_threads is non-zero, reads, writes and hashes are
+	// posted to the queue of the device the torrent is saved to. The queues
+	// are created as torrents are checked, and never removed. These are
+	// protected by m_job_mutex
+	std::vector<std::unique_ptr<device_queue>> m_device_queues;
+	aux::vector<device_queue*, storage_index_t> m_storage_devices;
+	int m_device_threads = 0;
+	int m_device_max_in_flight = 0;
+
+	// the maintenance performed by the first thread of every pool (except
+	// the hashing threads) must not run in more than one thread at a time
+	std::mutex m_maintenance_mutex;
+
 	// every write job is inserted into this map while it is in the job queue.
 	// It is removed after the write completes. This will let subsequent reads
 	// pull the buffers straight out of the queue instead of having to
@@ -332,6 +420,18 @@ private:
 	// disk cache
 	aux::disk_buffer_pool m_buffer_pool;
 
+	// the cumulative counts of the store buffer and the buffer arena that
+	// have been reported as stats counters so far
+	mutable aux::reported_count m_reported_contention;
+	mutable aux::reported_count m_reported_cache_hits;
+	mutable aux::reported_count m_reported_central_transfers;
+
+	// when the hash_on_write setting is enabled, this keeps the hash state of
+	// pieces as their blocks are written, to not have to read them back when
+	// the piece is hashed. It holds buffers from m_buffer_pool, for blocks
+	// written out of order
+	aux::write_hasher m_write_hasher;
+
 	// total number of blocks in use by both the read
 	// and the write cache. This is not supposed to
 	// exceed m_cache_size
@@ -412,6 +512,7 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 		auto storage = std::make_shared<mmap_storage>(params, m_file_pool);
 		storage->set_storage_index(idx);
 		storage->set_owner(owner);
+		m_write_hasher.clear_storage(idx);
 		if (idx == m_torrents.end_index())
 		{
 			// make sure there's always space in here to add another free slot.
@@ -425,8 +526,14 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 
 	void mmap_disk_io::remove_torrent(storage_index_t const idx)
 	{
+		{
+			std::lock_guard<std::mutex> l(m_job_mutex);
+			if (idx < m_storage_devices.end_index())
+				m_storage_devices[idx] = nullptr;
+		}
 		m_torrents[idx].reset();
 		m_free_slots.push_back(idx);
+		m_write_hasher.clear_storage(idx);
 	}
 
 #if TORRENT_USE_ASSERTS
@@ -437,6 +544,8 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 		m_magic = 0xdead;
 		TORRENT_ASSERT(m_generic_io_jobs.m_queued_jobs.empty());
 		TORRENT_ASSERT(m_hash_io_jobs.m_queued_jobs.empty());
+		for (auto const& d : m_device_queues)
+			TORRENT_ASSERT(d->jobs.m_queued_jobs.empty());
 	}
 #endif
 
@@ -452,13 +561,23 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 		// see also the comment in thread_fun
 		std::unique_lock<std::mutex> l(m_job_mutex);
 		if (m_abort.exchange(true)) return;
-		bool const no_threads = m_generic_threads.num_threads() == 0
+		bool no_threads = m_generic_threads.num_threads() == 0
 			&& m_hash_threads.num_threads() == 0;
 		// abort outstanding jobs belonging to this torrent
 
 		DLOG("aborting hash jobs\n");
-		for (auto i = m_hash_io_jobs.m_queued_jobs.iterate(); i.get(); i.next())
-			i.get()->flags |= aux::disk_io_job::aborted;
+		m_hash_io_jobs.m_queued_jobs.for_each([](aux::disk_io_job* j)
+			{ j->flags |= aux::disk_io_job::aborted; });
+		for (auto const& d : m_device_queues)
+		{
+			if (d->threads.num_threads() > 0) no_threads = false;
+			d->jobs.m_queued_jobs.for_each([](aux::disk_io_job* j)
+			{
+				if (j->action != aux::job_action_t::hash) return;
+				j->flags |= aux::disk_io_job::aborted;
+			});
+		}
+		// no more device queues are added once m_abort is set
 		l.unlock();
 
 		// if there are no disk threads, we can't wait for the jobs here, because
@@ -474,6 +593,8 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 		// defensive programming measure
 		m_generic_threads.abort(wait);
 		m_hash_threads.abort(wait);
+		for (auto const& d : m_device_queues)
+			d->threads.abort(wait);
 	}
 
 	void mmap_disk_io::settings_updated()
@@ -488,6 +609,20 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 
 		m_generic_threads.set_max_threads(num_threads);
 		m_hash_threads.set_max_threads(num_hash_threads);
+
+		{
+			std::lock_guard<std::mutex> l(m_job_mutex);
+			m_device_threads = std::max(0, m_settings.get_int(settings_pack::disk_device_threads));
+			m_device_max_in_flight = std::max(0, m_settings.get_int(settings_pack::disk_device_max_in_flight));
+			for (auto const& d : m_device_queues)
+			{
+				d->threads.set_max_threads(m_device_threads);
+				d->jobs.m_queued_jobs.set_max_in_flight(m_device_max_in_flight);
+			}
+		}
+
+		if (!m_settings.get_bool(settings_pack::hash_on_write))
+			m_write_hasher.clear();
 	}
 
 	void mmap_disk_io::fail_jobs_impl(storage_error const& e, jobqueue_t& src, jobqueue_t& dst)
@@ -593,6 +728,43 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 		completed_jobs.push_back(j);
 	}
 
+	void mmap_disk_io::perform_hash_batch(span<aux::disk_io_job*> const jobs
+		, jobqueue_t& completed_jobs)
+	{
+		m_stats_counters.inc_stats_counter(counters::num_running_disk_jobs, jobs.size());
+
+		error_code ec;
+		try
+		{
+			do_hash_batch(jobs);
+		}
+		catch (boost::system::system_error const& err)
+		{
+			ec = err.code();
+		}
+		catch (std::bad_alloc const&)
+		{
+			ec = errors::no_memory;
+		}
+		catch (std::exception const&)
+		{
+			ec = boost::asio::error::fault;
+		}
+
+		m_stats_counters.inc_stats_counter(counters::num_running_disk_jobs, -jobs.size());
+
+		for (aux::disk_io_job* j : jobs)
+		{
+			if (ec)
+			{
+				j->ret = status_t::fatal_disk_error;
+				j->error.ec = ec;
+				j->error.operation = operation_t::exception;
+			}
+			completed_jobs.push_back(j);
+		}
+	}
+
 	status_t mmap_disk_io::do_partial_read(aux::disk_io_job* j)
 	{
 		auto& buffer = boost::get<disk_buffer_holder>(j->argument);
@@ -624,25 +796,41 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 
 	status_t mmap_disk_io::do_read(aux::disk_io_job* j)
 	{
-		j->argument = disk_buffer_holder(*this, m_buffer_pool.allocate_buffer("send buffer"), default_block_size);
-		auto& buffer = boost::get<disk_buffer_holder>(j->argument);
-		if (!buffer)
+		time_point const start_time = clock_type::now();
+		aux::open_mode_t const file_flags = file_flags_for_job(j);
+
+		// unless the caller needs a copy, hand out a reference into the file
+		// mapping rather than copying the block into a disk buffer
+		disk_buffer_holder view;
+		if (!(j->flags & disk_interface::force_copy))
 		{
-			j->error.ec = error::no_memory;
-			j->error.operation = operation_t::alloc_cache_piece;
-			return status_t::fatal_disk_error;
+			view = j->storage->read_view(m_settings, j->piece, j->d.io.offset
+				, j->d.io.buffer_size, file_flags);
 		}
 
-		time_point const start_time = clock_type::now();
+		if (view)
+		{
+			j->argument = std::move(view);
+		}
+		else
+		{
+			j->argument = disk_buffer_holder(*this, m_buffer_pool.allocate_buffer("send buffer"), default_block_size);
+			auto& buffer = boost::get<disk_buffer_holder>(j->argument);
+			if (!buffer)
+			{
+				j->error.ec = error::no_memory;
+				j->error.operation = operation_t::alloc_cache_piece;
+				return status_t::fatal_disk_error;
+			}
 
-		aux::open_mode_t const file_flags = file_flags_for_job(j);
-		iovec_t b = {buffer.data(), j->d.io.buffer_size};
+			iovec_t b = {buffer.data(), j->d.io.buffer_size};
 
-		int const ret = j->storage->readv(m_settings, b
-			, j->piece, j->d.io.offset, file_flags, j->error);
+			int const ret = j->storage->readv(m_settings, b
+				, j->piece, j->d.io.offset, file_flags, j->error);
 
-		TORRENT_ASSERT(ret >= 0 || j->error.ec);
-		TORRENT_UNUSED(ret);
+			TORRENT_ASSERT(ret >= 0 || j->error.ec);
+			TORRENT_UNUSED(ret);
+		}
 
 		if (!j->error.ec)
 		{
@@ -689,12 +877,46 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 				m_need_tick.push_back({aux::time_now() + minutes(2), j->storage});
 		}
 
+		if (m_settings.get_bool(settings_pack::hash_on_write))
+			hash_written_block(j, buffer, ret);
+
 		m_store_buffer.erase({j->storage->storage_index(), j->piece, j->d.io.offset});
 
 		return ret != j->d.io.buffer_size
 			? status_t::fatal_disk_error : status_t::no_error;
 	}
 
+	void mmap_disk_io::hash_written_block(aux::disk_io_job* j
+		, disk_buffer_holder& buffer, int const ret)
+	{
+		storage_index_t const storage = j->storage->storage_index();
+		int const offset = j->d.io.offset;
+		int const piece_size = j->storage->files().piece_size(j->piece);
+		std::ptrdiff_t const block_size = std::min(default_block_size, piece_size - offset);
+
+		// a failed, or partial, write may have left the block in any state on
+		// disk, and the piece has to be read back to be hashed
+		if (j->error.ec || ret != j->d.io.buffer_size
+			|| offset % default_block_size != 0
+			|| j->d.io.buffer_size != block_size)
+		{
+			m_write_hasher.clear_piece(storage, j->piece);
+			return;
+		}
+
+		bool const v2 = j->storage->v2_hash_wanted() && j->storage->orig_files().v2();
+		int const blocks_in_piece2 = v2 ? j->storage->orig_files().blocks_in_piece2(j->piece) : 0;
+		int const block = offset / default_block_size;
+
+		int const v1_len = j->storage->v1_hash_wanted() ? int(block_size) : 0;
+		int const v2_len = block < blocks_in_piece2
+			? std::min(default_block_size, j->storage->orig_files().piece_size2(j->piece) - offset)
+			: 0;
+
+		m_write_hasher.block_written({storage, j->piece, offset}, buffer
+			, v1_len, v2_len, blocks_in_piece2);
+	}
+
 	void mmap_disk_io::async_read(storage_index_t storage, peer_request const& r
 		, std::function<void(disk_buffer_holder, storage_error const&)> handler
 		, disk_job_flags_t const flags)
@@ -846,11 +1068,29 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 		, disk_job_flags_t const flags)
 	{
 		bool exceeded = false;
-		disk_buffer_holder buffer(*this, m_buffer_pool.allocate_buffer(
-			exceeded, o, "receive buffer"), default_block_size);
+		disk_buffer_holder buffer = allocate_receive_buffer(exceeded, o, "receive buffer");
 		if (!buffer) aux::throw_ex<std::bad_alloc>();
 		std::memcpy(buffer.data(), buf, aux::numeric_cast<std::size_t>(r.length));
 
+		async_write_buffer(storage, r, std::move(buffer), std::move(o)
+			, std::move(handler), flags);
+		return exceeded;
+	}
+
+	disk_buffer_holder mmap_disk_io::allocate_receive_buffer(bool& exceeded
+		, std::shared_ptr<disk_observer> o, char const* const category)
+	{
+		return disk_buffer_holder(*this, m_buffer_pool.allocate_buffer(
+			exceeded, std::move(o), category), default_block_size);
+	}
+
+	bool mmap_disk_io::async_write_buffer(storage_index_t const storage
+		, peer_request const& r, disk_buffer_holder buffer
+		, std::shared_ptr<disk_observer>
+		, std::function<void(storage_error const&)> handler
+		, disk_job_flags_t const flags)
+	{
+		TORRENT_ASSERT(buffer);
 		TORRENT_ASSERT(r.start % default_block_size == 0);
 		TORRENT_ASSERT(r.length <= default_block_size);
 
@@ -873,19 +1113,40 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 			DLOG("blocked job: %s (torrent: %d total: %d)\n"
 				, job_name(j->action), j->storage ? j->storage->num_blocked() : 0
 				, int(m_stats_counters[counters::blocked_disk_jobs]));
-			return exceeded;
+			return false;
 		}
 
 		add_job(j);
-		return exceeded;
+		return false;
 	}
 
 	void mmap_disk_io::async_hash(storage_index_t const storage
 		, piece_index_t const piece, span<sha256_hash> const v2, disk_job_flags_t const flags
 		, std::function<void(piece_index_t, sha1_hash const&, storage_error const&)> handler)
 	{
+		auto st = m_torrents[storage]->shared_from_this();
+
+		// when checking, pieces in holes of files whose extents are already
+		// known are answered right away, rather than being queued. This way
+		// the hash threads only read the pieces holding data, in the order of
+		// their extents, instead of taking turns with the holes in between.
+		// Fences are only raised by this thread, so without one, no job is
+		// changing the files or priorities of the storage
+		if ((flags & disk_interface::volatile_read)
+			&& !st->has_fence()
+			&& st->piece_in_known_holes(piece))
+		{
+			sha1_hash const hash = (flags & disk_interface::v1_hash)
+				? aux::zero_hash(st->files().piece_size(piece)) : sha1_hash();
+			if (!v2.empty())
+				aux::zero_block_hashes(v2, st->orig_files().piece_size2(piece));
+			m_stats_counters.inc_stats_counter(counters::num_hole_pieces_skipped);
+			post(m_ios, [=, h = std::move(handler)]{ h(piece, hash, storage_error()); });
+			return;
+		}
+
 		aux::disk_io_job* j = m_job_pool.allocate_job(aux::job_action_t::hash);
-		j->storage = m_torrents[storage]->shared_from_this();
+		j->storage = std::move(st);
 		j->piece = piece;
 		j->d.h.block_hashes = v2;
 		j->callback = std::move(handler);
@@ -936,17 +1197,19 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 
 		auto st = m_torrents[storage]->shared_from_this();
 		// hash jobs
-		for (auto i = m_hash_io_jobs.m_queued_jobs.iterate(); i.get(); i.next())
+		auto abort_volatile = [&st](aux::disk_io_job* j)
 		{
-			aux::disk_io_job* j = i.get();
-			if (j->storage != st) continue;
+			if (j->storage != st) return;
 			// only cancel volatile-read jobs. This means only full checking
 			// jobs. These jobs are likely to have a pretty deep queue and
 			// really gain from being cancelled. They can also be restarted
 			// easily.
-			if (!(j->flags & disk_interface::volatile_read)) continue;
+			if (!(j->flags & disk_interface::volatile_read)) return;
 			j->flags |= aux::disk_io_job::aborted;
-		}
+		};
+		m_hash_io_jobs.m_queued_jobs.for_each(abort_volatile);
+		for (auto const& d : m_device_queues)
+			d->jobs.m_queued_jobs.for_each(abort_volatile);
 	}
 
 	void mmap_disk_io::async_delete_files(storage_index_t const storage
@@ -1036,8 +1299,8 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 
 	status_t mmap_disk_io::do_hash(aux::disk_io_job* j)
 	{
-		// we're not using a cache. This is the simple path
-		// just read straight from the file
+		// we're not using a cache. Unless the piece was hashed as it was
+		// written, this is the simple path. just read straight from the file
 		TORRENT_ASSERT(m_magic == 0x1337);
 
 		bool const v1 = bool(j->flags & disk_interface::v1_hash);
@@ -1048,78 +1311,395 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 		int const blocks_in_piece = v1 ? (piece_size + default_block_size - 1) / default_block_size : 0;
 		int const blocks_in_piece2 = v2 ? j->storage->orig_files().blocks_in_piece2(j->piece) : 0;
 		aux::open_mode_t const file_flags = file_flags_for_job(j);
+		storage_index_t const storage = j->storage->storage_index();
 
 		TORRENT_ASSERT(!v2 || int(j->d.h.block_hashes.size()) >= blocks_in_piece2);
 
+		// rechecking files doesn't follow any writes
+		bool const hash_on_write = m_settings.get_bool(settings_pack::hash_on_write)
+			&& !(j->flags & disk_interface::volatile_read);
+
+		// when checking, pieces that are entirely in holes of sparse files
+		// were never written. Their hashes are those of zeros, without having
+		// to read anything
+		if ((j->flags & disk_interface::volatile_read)
+			&& j->storage->piece_in_holes(j->piece))
+		{
+			if (v1) j->d.h.piece_hash = aux::zero_hash(piece_size);
+			aux::zero_block_hashes(j->d.h.block_hashes, piece_size2);
+			m_stats_counters.inc_stats_counter(counters::num_hole_pieces_skipped);
+			return status_t::no_error;
+		}
+
+		aux::write_hasher::piece_state ws;
+		if (hash_on_write)
+		{
+			j->storage->set_hashes_wanted(v1, v2);
+			m_write_hasher.take(storage, j->piece, ws);
+		}
+
+		// the number of blocks we found in the store buffer, whose writes
+		// haven't completed yet
+		int in_flight = 0;
+
+		// the blocks of a v2-only piece are hashed independently of each
+		// other, so they can be hashed several at a time
+		if (!v1 && blocks_in_piece2 > 1 && aux::sha_multi_accelerated())
+		{
+			status_t const ret = do_hash_v2_batch(j, ws, in_flight);
+			if (hash_on_write) m_write_hasher.hashed(storage, j->piece, in_flight);
+			return ret;
+		}
+
+		// the first v1_blocks blocks have already been hashed, as they were
+		// written
 		hasher h;
+		int v1_blocks = 0;
+		if (v1 && ws.v1_blocks > 0)
+		{
+			h = ws.h;
+			v1_blocks = ws.v1_blocks;
+		}
+
 		int ret = 0;
 		int offset = 0;
 		int const blocks_to_read = std::max(blocks_in_piece, blocks_in_piece2);
-		for (int i = 0; i < blocks_to_read; ++i)
+		for (int i = 0; i < blocks_to_read; ++i, offset += default_block_size)
 		{
 			bool const v2_block = i < blocks_in_piece2;
+			bool const need_v1 = v1 && i >= v1_blocks;
+			bool const need_v2 = v2_block && !ws.has_v2_hash(i);
+
+			if (v2_block && !need_v2)
+				j->d.h.block_hashes[i] = ws.v2_hashes[i];
+
+			if (!need_v1 && !need_v2) continue;
 
 			DLOG("do_hash: reading (piece: %d block: %d)\n", int(j->piece), i);
 
 			time_point const start_time = clock_type::now();
 
-			std::ptrdiff_t const len = v1 ? std::min(default_block_size, piece_size - offset) : 0;
-			std::ptrdiff_t const len2 = v2_block ? std::min(default_block_size, piece_size2 - offset) : 0;
+			std::ptrdiff_t const len = need_v1 ? std::min(default_block_size, piece_size - offset) : 0;
+			std::ptrdiff_t const len2 = need_v2 ? std::min(default_block_size, piece_size2 - offset) : 0;
 
 			hasher256 h2;
 
-			if (!m_store_buffer.get({ j->storage->storage_index(), j->piece, offset }
-				, [&](char const* buf)
+			auto const hash_block = [&](char const* buf)
+			{
+				if (need_v1)
 				{
-					if (v1)
-					{
-						h.update({ buf, len });
-						ret = int(len);
-					}
-					if (v2_block)
-					{
-						h2.update({ buf, len2 });
-						ret = int(len2);
-					}
-				}))
+					h.update({ buf, len });
+					ret = int(len);
+				}
+				if (need_v2)
+				{
+					h2.update({ buf, len2 });
+					ret = int(len2);
+				}
+			};
+
+			auto const staged = std::find_if(ws.staged.begin(), ws.staged.end()
+				, [=](aux::write_hasher::piece_state::staged_block const& b) { return b.block == i; });
+
+			if (staged != ws.staged.end() && len <= staged->len && len2 <= staged->len)
+			{
+				hash_block(staged->buffer.data());
+			}
+			else if (m_store_buffer.get({ storage, j->piece, offset }, hash_block))
+			{
+				if (i >= ws.v1_blocks && !ws.has_v2_hash(i)) ++in_flight;
+			}
+			else
 			{
-				if (v1)
+				if (need_v1)
 				{
 					j->error.ec.clear();
 					ret = j->storage->hashv(m_settings, h, len, j->piece, offset, file_flags, j->error);
 					if (ret < 0) break;
 				}
-				if (v2_block)
+				if (need_v2)
 				{
 					j->error.ec.clear();
 					ret = j->storage->hashv2(m_settings, h2, len2, j->piece, offset, file_flags, j->error);
 					if (ret < 0) break;
 				}
+				m_stats_counters.inc_stats_counter(counters::num_read_back);
+				m_stats_counters.inc_stats_counter(counters::num_blocks_read);
+				m_stats_counters.inc_stats_counter(counters::num_read_ops);
 			}
 
 			if (!j->error.ec)
 			{
 				std::int64_t const read_time = total_microseconds(clock_type::now() - start_time);
 
-				m_stats_counters.inc_stats_counter(counters::num_blocks_read, blocks_to_read);
-				m_stats_counters.inc_stats_counter(counters::num_read_ops);
 				m_stats_counters.inc_stats_counter(counters::disk_hash_time, read_time);
 				m_stats_counters.inc_stats_counter(counters::disk_job_time, read_time);
 			}
 
-			if (v2_block)
+			if (need_v2)
 				j->d.h.block_hashes[i] = h2.final();
 
 			if (ret <= 0) break;
-
-			offset += default_block_size;
 		}
 
 		if (v1)
 			j->d.h.piece_hash = h.final();
+		if (hash_on_write)
+			m_write_hasher.hashed(storage, j->piece, in_flight);
+		return ret >= 0 ? status_t::no_error : status_t::fatal_disk_error;
+	}
+
+	status_t mmap_disk_io::do_hash_v2_batch(aux::disk_io_job* j
+		, aux::write_hasher::piece_state const& ws, int& in_flight)
+	{
+		TORRENT_ASSERT(m_magic == 0x1337);
+
+		int const piece_size2 = j->storage->orig_files().piece_size2(j->piece);
+		int const blocks_in_piece2 = j->storage->orig_files().blocks_in_piece2(j->piece);
+		aux::open_mode_t const file_flags = file_flags_for_job(j);
+		storage_index_t const storage = j->storage->storage_index();
+
+		// unlike with hashv2(), the blocks are copied out of the file, into
+		// this buffer, to be hashed together. One batch fills the lanes of
+		// sha256_multi()
+		int const batch_size = 8;
+		std::unique_ptr<char[]> buffer(new char[std::size_t(batch_size * default_block_size)]);
+		std::array<span<char const>, batch_size> blocks;
+		std::array<sha256_hash, batch_size> hashes;
+		// the block index of each lane
+		std::array<int, batch_size> block_idx;
+
+		int ret = 0;
+		bool done = false;
+		for (int next = 0; next < blocks_in_piece2 && !done;)
+		{
+			time_point const start_time = clock_type::now();
+
+			int num_blocks = 0;
+			int num_read = 0;
+			for (; num_blocks < batch_size && next < blocks_in_piece2; ++next)
+			{
+				// this block was hashed when it was written
+				if (ws.has_v2_hash(next))
+				{
+					j->d.h.block_hashes[next] = ws.v2_hashes[next];
+					continue;
+				}
+
+				DLOG("do_hash: reading (piece: %d block: %d)\n", int(j->piece), next);
+
+				int const offset = next * default_block_size;
+				std::ptrdiff_t const len = std::min(default_block_size, piece_size2 - offset);
+				char* const buf = buffer.get() + num_blocks * default_block_size;
+
+				if (m_store_buffer.get({ storage, j->piece, offset }
+					, [&](char const* b)
+					{
+						std::memcpy(buf, b, std::size_t(len));
+						ret = int(len);
+					}))
+				{
+					++in_flight;
+				}
+				else
+				{
+					j->error.ec.clear();
+					ret = j->storage->read2(m_settings, { buf, len }, j->piece, offset, file_flags, j->error);
+					if (ret < 0)
+					{
+						done = true;
+						break;
+					}
+					++num_read;
+				}
+
+				blocks[std::size_t(num_blocks)] = { buf, ret };
+				block_idx[std::size_t(num_blocks)] = next;
+				++num_blocks;
+				if (ret == 0)
+				{
+					done = true;
+					++next;
+					break;
+				}
+			}
+
+			if (num_blocks == 0) continue;
+
+			aux::sha256_multi({ blocks.data(), num_blocks }, { hashes.data(), num_blocks });
+			for (int k = 0; k < num_blocks; ++k)
+				j->d.h.block_hashes[block_idx[std::size_t(k)]] = hashes[std::size_t(k)];
+
+			if (!j->error.ec)
+			{
+				std::int64_t const read_time = total_microseconds(clock_type::now() - start_time);
+
+				m_stats_counters.inc_stats_counter(counters::num_read_back, num_read);
+				m_stats_counters.inc_stats_counter(counters::num_blocks_read, num_read);
+				m_stats_counters.inc_stats_counter(counters::num_read_ops, num_read);
+				m_stats_counters.inc_stats_counter(counters::disk_hash_time, read_time);
+				m_stats_counters.inc_stats_counter(counters::disk_job_time, read_time);
+			}
+		}
+
 		return ret >= 0 ? status_t::no_error : status_t::fatal_disk_error;
 	}
 
+	// hashes the pieces of several checking jobs together. Each job is given
+	// a lane of sha1_multi_context, and their blocks are read and hashed in
+	// lockstep. The blocks of hybrid pieces are also hashed together, with
+	// sha256_multi(). The jobs end up with the same hashes, errors and
+	// return values as do_hash() would give them
+	void mmap_disk_io::do_hash_batch(span<aux::disk_io_job*> const jobs)
+	{
+		TORRENT_ASSERT(m_magic == 0x1337);
+		TORRENT_ASSERT(jobs.size() <= hash_batch_size);
+
+		struct lane
+		{
+			int piece_size;
+			int piece_size2;
+			int blocks_in_piece;
+			int blocks_in_piece2;
+			aux::open_mode_t file_flags;
+			storage_index_t storage;
+			int ret;
+			bool done;
+		};
+
+		int const n = int(jobs.size());
+		std::array<lane, hash_batch_size> lanes;
+		int num_blocks = 0;
+		for (int l = 0; l < n; ++l)
+		{
+			aux::disk_io_job* j = jobs[l];
+			bool const v2 = !j->d.h.block_hashes.empty();
+			lane& ln = lanes[std::size_t(l)];
+			ln.piece_size = j->storage->files().piece_size(j->piece);
+			ln.piece_size2 = v2 ? j->storage->orig_files().piece_size2(j->piece) : 0;
+			ln.blocks_in_piece = (ln.piece_size + default_block_size - 1) / default_block_size;
+			ln.blocks_in_piece2 = v2 ? j->storage->orig_files().blocks_in_piece2(j->piece) : 0;
+			ln.file_flags = file_flags_for_job(j);
+			ln.storage = j->storage->storage_index();
+			ln.ret = 0;
+			ln.done = false;
+			TORRENT_ASSERT(!v2 || int(j->d.h.block_hashes.size()) >= ln.blocks_in_piece2);
+			num_blocks = std::max({num_blocks, ln.blocks_in_piece, ln.blocks_in_piece2});
+		}
+
+		// every lane has room for a block and, for hybrid pieces, the v2
+		// block read from the same offset
+		std::unique_ptr<char[]> buffer(new char[std::size_t(n * 2 * default_block_size)]);
+		aux::sha1_multi_context ctx(n);
+		std::array<span<char const>, hash_batch_size> v1_blocks;
+		std::array<span<char const>, hash_batch_size> v2_blocks;
+		std::array<sha256_hash, hash_batch_size> v2_hashes;
+		// the lane of each v2 block
+		std::array<int, hash_batch_size> v2_lanes;
+
+		int offset = 0;
+		for (int i = 0; i < num_blocks; ++i, offset += default_block_size)
+		{
+			time_point const start_time = clock_type::now();
+
+			int num_v2 = 0;
+			int num_read = 0;
+			for (int l = 0; l < n; ++l)
+			{
+				aux::disk_io_job* j = jobs[l];
+				lane& ln = lanes[std::size_t(l)];
+				span<char const>& v1_block = v1_blocks[std::size_t(l)];
+				v1_block = {};
+				if (ln.done) continue;
+
+				bool const need_v1 = i < ln.blocks_in_piece;
+				bool const need_v2 = i < ln.blocks_in_piece2;
+				if (!need_v1 && !need_v2) continue;
+
+				DLOG("do_hash: reading (piece: %d block: %d)\n", int(j->piece), i);
+
+				std::ptrdiff_t const len = need_v1 ? std::min(default_block_size, ln.piece_size - offset) : 0;
+				std::ptrdiff_t const len2 = need_v2 ? std::min(default_block_size, ln.piece_size2 - offset) : 0;
+				char* const buf = buffer.get() + std::ptrdiff_t(l) * 2 * default_block_size;
+				span<char const> v2_block;
+
+				bool const in_store_buffer = m_store_buffer.get({ ln.storage, j->piece, offset }
+					, [&](char const* b)
+					{
+						std::memcpy(buf, b, std::size_t(std::max(len, len2)));
+						v1_block = { buf, len };
+						v2_block = { buf, len2 };
+						ln.ret = int(need_v2 ? len2 : len);
+					});
+
+				if (!in_store_buffer)
+				{
+					if (need_v1)
+					{
+						j->error.ec.clear();
+						iovec_t const b = { buf, len };
+						ln.ret = j->storage->readv(m_settings, b, j->piece, offset, ln.file_flags, j->error);
+						if (ln.ret < 0)
+						{
+							ln.done = true;
+							continue;
+						}
+						v1_block = { buf, ln.ret };
+					}
+					if (need_v2)
+					{
+						j->error.ec.clear();
+						char* const buf2 = buf + default_block_size;
+						ln.ret = j->storage->read2(m_settings, { buf2, len2 }, j->piece, offset, ln.file_flags, j->error);
+						if (ln.ret < 0)
+						{
+							ln.done = true;
+							continue;
+						}
+						v2_block = { buf2, ln.ret };
+					}
+					++num_read;
+				}
+
+				if (need_v2)
+				{
+					v2_blocks[std::size_t(num_v2)] = v2_block;
+					v2_lanes[std::size_t(num_v2)] = l;
+					++num_v2;
+				}
+
+				// like hashv(), a read of nothing means the file is shorter
+				// than expected. The rest of the piece is left out of the hash
+				if (ln.ret <= 0) ln.done = true;
+			}
+
+			ctx.update({ v1_blocks.data(), n });
+
+			if (num_v2 > 0)
+			{
+				aux::sha256_multi({ v2_blocks.data(), num_v2 }, { v2_hashes.data(), num_v2 });
+				for (std::size_t k = 0; k < std::size_t(num_v2); ++k)
+					jobs[v2_lanes[k]]->d.h.block_hashes[i] = v2_hashes[k];
+			}
+
+			std::int64_t const read_time = total_microseconds(clock_type::now() - start_time);
+			m_stats_counters.inc_stats_counter(counters::num_read_back, num_read);
+			m_stats_counters.inc_stats_counter(counters::num_blocks_read, num_read);
+			m_stats_counters.inc_stats_counter(counters::num_read_ops, num_read);
+			m_stats_counters.inc_stats_counter(counters::disk_hash_time, read_time);
+			m_stats_counters.inc_stats_counter(counters::disk_job_time, read_time);
+		}
+
+		std::array<sha1_hash, hash_batch_size> hashes;
+		ctx.final({ hashes.data(), n });
+		for (int l = 0; l < n; ++l)
+		{
+			jobs[l]->d.h.piece_hash = hashes[std::size_t(l)];
+			jobs[l]->ret = lanes[std::size_t(l)].ret >= 0
+				? status_t::no_error : status_t::fatal_disk_error;
+		}
+	}
+
 	status_t mmap_disk_io::do_hash2(aux::disk_io_job* j)
 	{
 		TORRENT_ASSERT(m_magic == 0x1337);
@@ -1173,6 +1753,9 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 		std::tie(ret, p) = j->storage->move_storage(boost::get<std::string>(j->argument)
 			, j->move_flags, j->error);
 
+		// the storage may have moved to a different device
+		assign_device(*j->storage);
+
 		boost::get<std::string>(j->argument) = p;
 		return ret;
 	}
@@ -1191,6 +1774,7 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 
 		// if this assert fails, something's wrong with the fence logic
 		TORRENT_ASSERT(j->storage->num_outstanding_jobs() == 1);
+		m_write_hasher.clear_storage(j->storage->storage_index());
 		j->storage->delete_files(boost::get<remove_flags_t>(j->argument), j->error);
 		return j->error ? status_t::fatal_disk_error : status_t::no_error;
 	}
@@ -1220,6 +1804,8 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 		j->storage->initialize(m_settings, j->error);
 		if (j->error) return status_t::fatal_disk_error;
 
+		assign_device(*j->storage);
+
 		// we must call verify_resume() unconditionally of the setting below, in
 		// order to set up the links (if present)
 		bool const verify_success = j->storage->verify_resume_data(*rd
@@ -1262,6 +1848,7 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 	{
 		// if this assert fails, something's wrong with the fence logic
 		TORRENT_ASSERT(j->storage->num_outstanding_jobs() == 1);
+		m_write_hasher.clear_storage(j->storage->storage_index());
 		j->storage->release_files(j->error);
 		return j->error ? status_t::fatal_disk_error : status_t::no_error;
 	}
@@ -1275,13 +1862,38 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 		c.set_value(counters::num_read_jobs, m_job_pool.read_jobs_in_use());
 		c.set_value(counters::num_write_jobs, m_job_pool.write_jobs_in_use());
 		c.set_value(counters::num_jobs, m_job_pool.jobs_in_use());
-		c.set_value(counters::queued_disk_jobs, m_generic_io_jobs.m_queued_jobs.size()
-			+ m_hash_io_jobs.m_queued_jobs.size());
+		int queued_jobs = m_generic_io_jobs.m_queued_jobs.size()
+			+ m_hash_io_jobs.m_queued_jobs.size();
+		int max_device_depth = 0;
+		std::int64_t max_device_latency = 0;
+		for (auto const& d : m_device_queues)
+		{
+			int const depth = d->jobs.m_queued_jobs.size();
+			queued_jobs += depth;
+			max_device_depth = std::max(max_device_depth, depth);
+			max_device_latency = std::max(max_device_latency, d->jobs.m_avg_queue_time);
+		}
+		c.set_value(counters::queued_disk_jobs, queued_jobs);
+		c.set_value(counters::disk_device_queues, std::int64_t(m_device_queues.size()));
+		c.set_value(counters::disk_device_max_queue_depth, max_device_depth);
+		c.set_value(counters::disk_device_max_queue_latency, max_device_latency);
 
 		jl.unlock();
 
+		m_reported_contention.report(c, counters::store_buffer_contention
+			, m_store_buffer.lock_contention());
+
+		aux::disk_buffer_arena::stats const arena = m_buffer_pool.arena_stats();
+		m_reported_cache_hits.report(c, counters::disk_arena_cache_hits, arena.cache_hits);
+		m_reported_central_transfers.report(c, counters::disk_arena_central_transfers
+			, arena.central_transfers);
+
 		// gauges
 		c.set_value(counters::disk_blocks_in_use, m_buffer_pool.in_use());
+		c.set_value(counters::disk_arena_slabs, arena.slabs);
+		c.set_value(counters::disk_arena_hugepage_slabs, arena.hugepage_slabs);
+		c.set_value(counters::disk_arena_free_blocks, arena.free_blocks);
+		c.set_value(counters::disk_arena_cached_blocks, arena.cached_blocks);
 	}
 
 	status_t mmap_disk_io::do_file_priority(aux::disk_io_job* j)
@@ -1295,10 +1907,13 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 	// this job won't return until all outstanding jobs on this
 	// piece are completed or cancelled and the buffers for it
 	// have been evicted
-	status_t mmap_disk_io::do_clear_piece(aux::disk_io_job*)
+	status_t mmap_disk_io::do_clear_piece(aux::disk_io_job* j)
 	{
-		// there's nothing to do here, by the time this is called the jobs for
-		// this storage has been completed since this is a fence job
+		// by the time this is called the jobs for this storage has been
+		// completed since this is a fence job. All that's left is the hash
+		// state of the piece, which doesn't reflect what will be written to it
+		// next
+		m_write_hasher.clear_piece(j->storage->storage_index(), j->piece);
 		return status_t::no_error;
 	}
 
@@ -1345,13 +1960,13 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 		// before the disk threads are shut down
 		TORRENT_ASSERT(!m_abort);
 
-		// this happens for read jobs that get hung on pieces in the
-		// block cache, and then get issued
+		// this happens for read and write jobs, which have already been
+		// checked against the storage's fence
 		if (j->flags & aux::disk_io_job::in_progress)
 		{
 			std::unique_lock<std::mutex> l(m_job_mutex);
 			TORRENT_ASSERT((j->flags & aux::disk_io_job::in_progress) || !j->storage);
-			m_generic_io_jobs.m_queued_jobs.push_back(j);
+			queue_for_job(j).push_job(j);
 
 			// if we literally have 0 disk threads, we have to execute the jobs
 			// immediately. If add job is called internally by the mmap_disk_io,
@@ -1388,7 +2003,7 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 		TORRENT_ASSERT((j->flags & aux::disk_io_job::in_progress) || !j->storage);
 
 		job_queue& q = queue_for_job(j);
-		q.m_queued_jobs.push_back(j);
+		q.push_job(j);
 		// if we literally have 0 disk threads, we have to execute the jobs
 		// immediately. If add job is called internally by the mmap_disk_io,
 		// we need to defer executing it. We only want the top level to loop
@@ -1422,6 +2037,12 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 			m_hash_io_jobs.m_job_cond.notify_all();
 			m_hash_threads.job_queued(m_hash_io_jobs.m_queued_jobs.size());
 		}
+		for (auto const& d : m_device_queues)
+		{
+			if (d->jobs.m_queued_jobs.empty()) continue;
+			d->jobs.m_job_cond.notify_all();
+			d->threads.job_queued(d->jobs.m_queued_jobs.size());
+		}
 	}
 
 	void mmap_disk_io::execute_job(aux::disk_io_job* j)
@@ -1441,6 +2062,36 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 			add_completed_jobs(completed_jobs);
 	}
 
+	void mmap_disk_io::execute_hash_batch(span<aux::disk_io_job*> const jobs)
+	{
+		jobqueue_t completed_jobs;
+		std::array<aux::disk_io_job*, hash_batch_size> lanes;
+		int n = 0;
+		for (aux::disk_io_job* j : jobs)
+		{
+			if (j->flags & aux::disk_io_job::aborted)
+			{
+				j->ret = status_t::fatal_disk_error;
+				j->error = storage_error(boost::asio::error::operation_aborted);
+				completed_jobs.push_back(j);
+			}
+			// pieces in holes of sparse files aren't read. do_hash() answers
+			// them right away
+			else if (j->storage->piece_in_holes(j->piece))
+				perform_job(j, completed_jobs);
+			else
+				lanes[std::size_t(n++)] = j;
+		}
+
+		if (n == 1)
+			perform_job(lanes[0], completed_jobs);
+		else if (n > 1)
+			perform_hash_batch({ lanes.data(), n }, completed_jobs);
+
+		if (!completed_jobs.empty())
+			add_completed_jobs(completed_jobs);
+	}
+
 	bool mmap_disk_io::wait_for_job(job_queue& jobq, aux::disk_io_thread_pool& threads
 		, std::unique_lock<std::mutex>& l)
 	{
@@ -1451,7 +2102,7 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 		// count to be lower than it should be
 		// for performance reasons we also want to avoid going idle and active again
 		// if there is already work to do
-		if (jobq.m_queued_jobs.empty())
+		if (!jobq.ready())
 		{
 			threads.thread_idle();
 
@@ -1474,7 +2125,7 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 
 				using namespace std::literals::chrono_literals;
 				jobq.m_job_cond.wait_for(l, 1s);
-			} while (jobq.m_queued_jobs.empty());
+			} while (!jobq.ready());
 
 			threads.thread_active();
 		}
@@ -1516,12 +2167,35 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 			aux::disk_io_job* j = nullptr;
 			bool const should_exit = wait_for_job(queue, pool, l);
 			if (should_exit) break;
-			j = queue.m_queued_jobs.pop_front();
+			j = queue.pop_job();
+			queue.m_queued_jobs.job_started();
+
+			// when checking files, the pieces of the jobs queued up behind
+			// this one are hashed together with it, in lanes
+			std::array<aux::disk_io_job*, hash_batch_size> batch;
+			int batch_jobs = 1;
+			if (can_batch_hash(j))
+			{
+				batch[0] = j;
+				while (batch_jobs < hash_batch_size
+					&& queue.ready()
+					&& can_batch_hash(queue.m_queued_jobs.front()))
+				{
+					batch[std::size_t(batch_jobs++)] = queue.pop_job();
+					queue.m_queued_jobs.job_started();
+				}
+			}
 			l.unlock();
 
 			TORRENT_ASSERT((j->flags & aux::disk_io_job::in_progress) || !j->storage);
 
-			if (&pool == &m_generic_threads && thread_id == pool.first_thread_id())
+			// with per-device queues, the generic threads may be idle for long
+			// stretches, so the first thread of every device queue also
+			// performs the maintenance
+			std::unique_lock<std::mutex> ml(m_maintenance_mutex, std::defer_lock);
+			if (&pool != &m_hash_threads
+				&& thread_id == pool.first_thread_id()
+				&& ml.try_lock())
 			{
 				time_point const now = aux::time_now();
 				{
@@ -1555,9 +2229,16 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 				}
 			}
 
-			execute_job(j);
+			if (ml.owns_lock()) ml.unlock();
+
+			if (batch_jobs > 1)
+				execute_hash_batch({ batch.data(), batch_jobs });
+			else
+				execute_job(j);
 
 			l.lock();
+			for (int i = 0; i < batch_jobs; ++i)
+				queue.m_queued_jobs.job_finished();
 		}
 
 		// do cleanup in the last running thread
@@ -1617,6 +2298,7 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 		// the disk thread in parallel with stopping
 		// trackers.
 		m_file_pool.release();
+		m_write_hasher.clear();
 		TORRENT_ASSERT(m_magic == 0x1337);
 	}
 
@@ -1629,6 +2311,8 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 	{
 		if (m_hash_threads.max_threads() > 0 && j->action == aux::job_action_t::hash)
 			return m_hash_io_jobs;
+		else if (device_queue* d = device_for_job(j))
+			return d->jobs;
 		else
 			return m_generic_io_jobs;
 	}
@@ -1637,10 +2321,89 @@ TORRENT_EXPORT std::unique_ptr<disk_interface> mmap_disk_io_constructor(
 	{
 		if (m_hash_threads.max_threads() > 0 && j->action == aux::job_action_t::hash)
 			return m_hash_threads;
+		else if (device_queue* d = device_for_job(j))
+			return d->threads;
 		else
 			return m_generic_threads;
 	}
 
+	mmap_disk_io::device_queue* mmap_disk_io::device_for_job(aux::disk_io_job const* j) const
+	{
+		// when disk jobs are run in the network thread, there's no point in
+		// separating them by device
+		if (m_device_threads == 0 || m_generic_threads.max_threads() == 0)
+			return nullptr;
+		if (!j->storage) return nullptr;
+
+		switch (j->action)
+		{
+			case aux::job_action_t::read:
+			case aux::job_action_t::partial_read:
+			case aux::job_action_t::write:
+			case aux::job_action_t::hash:
+			case aux::job_action_t::hash2:
+				break;
+			default:
+				return nullptr;
+		}
+
+		storage_index_t const idx = j->storage->storage_index();
+		if (idx >= m_storage_devices.end_index()) return nullptr;
+		return m_storage_devices[idx];
+	}
+
+	void mmap_disk_io::assign_device(mmap_storage const& st)
+	{
+		// this may hit the disk, don't hold the mutex
+		aux::disk_device const dev = aux::device_for_path(st.save_path());
+
+		std::lock_guard<std::mutex> l(m_job_mutex);
+		if (m_abort) return;
+
+		storage_index_t const idx = st.storage_index();
+		if (idx >= m_storage_devices.end_index())
+			m_storage_devices.resize(static_cast<int>(idx) + 1, nullptr);
+
+		if (!dev.valid)
+		{
+			m_storage_devices[idx] = nullptr;
+			return;
+		}
+
+		auto i = std::find_if(m_device_queues.begin(), m_device_queues.end()
+			, [&](std::unique_ptr<device_queue> const& d) { return d->device.id == dev.id; });
+		if (i == m_device_queues.end())
+		{
+			DLOG("new device queue: %" PRIu64 " rotational: %d\n", dev.id, int(dev.rotational));
+			auto d = std::make_unique<device_queue>(*this, m_ios, dev);
+			d->threads.set_max_threads(m_device_threads);
+			d->jobs.m_queued_jobs.set_max_in_flight(m_device_max_in_flight);
+			m_device_queues.push_back(std::move(d));
+			i = std::prev(m_device_queues.end());
+		}
+		m_storage_devices[idx] = i->get();
+	}
+
+	void mmap_disk_io::job_queue::push_job(aux::disk_io_job* j)
+	{
+		if (m_per_device) j->queued = clock_type::now();
+		m_queued_jobs.push_back(j);
+	}
+
+	aux::disk_io_job* mmap_disk_io::job_queue::pop_job()
+	{
+		aux::disk_io_job* j = m_queued_jobs.pop_front();
+
+		if (m_per_device && j->queued != min_time())
+		{
+			std::int64_t const waited = total_microseconds(clock_type::now() - j->queued);
+			m_avg_queue_time = (m_avg_queue_time * 15 + waited) / 16;
+			m_owner.m_stats_counters.inc_stats_counter(counters::disk_device_queue_time, waited);
+			m_owner.m_stats_counters.inc_stats_counter(counters::disk_device_jobs);
+		}
+		return j;
+	}
+
 	void mmap_disk_io::add_completed_jobs(jobqueue_t& jobs)
 	{
 		do
@@ -72,6 +72,20 @@ POSSIBILITY OF SUCH DAMAGE.
 
 namespace libtorrent {
 
+namespace {
+
+#if !TORRENT_HAVE_MAP_VIEW_OF_FILE
+	// the "allocator" of a block handed out by read_view(). It keeps the file
+	// mapping alive until the disk_buffer_holder frees the block
+	struct mapped_buffer final : buffer_allocator_interface
+	{
+		explicit mapped_buffer(std::shared_ptr<void const> m) : mapping(std::move(m)) {}
+		void free_disk_buffer(char*) override { delete this; }
+		std::shared_ptr<void const> mapping;
+	};
+#endif
+}
+
 	mmap_storage::mmap_storage(storage_params const& params
 		, aux::file_view_pool& pool)
 		: m_files(params.files)
@@ -238,6 +252,7 @@ namespace libtorrent {
 	void mmap_storage::initialize(settings_interface const& sett, storage_error& ec)
 	{
 		m_stat_cache.reserve(files().num_files());
+		m_extent_cache.clear();
 
 #ifdef TORRENT_WINDOWS
 		// don't do full file allocations on network drives
@@ -481,6 +496,7 @@ namespace libtorrent {
 		// make sure we can pick up new files added to the download directory when
 		// we start the torrent again
 		m_stat_cache.clear();
+		m_extent_cache.clear();
 	}
 
 	void mmap_storage::delete_files(remove_flags_t const options, storage_error& ec)
@@ -496,6 +512,16 @@ namespace libtorrent {
 		aux::delete_files(files(), m_save_path, m_part_file_name, options, ec);
 	}
 
+	bool mmap_storage::piece_in_holes(piece_index_t const piece)
+	{
+		return m_extent_cache.piece_in_holes(files(), m_save_path, m_file_priority, piece);
+	}
+
+	bool mmap_storage::piece_in_known_holes(piece_index_t const piece)
+	{
+		return m_extent_cache.piece_in_known_holes(files(), m_file_priority, piece);
+	}
+
 	bool mmap_storage::verify_resume_data(add_torrent_params const& rd
 		, aux::vector<std::string, file_index_t> const& links
 		, storage_error& ec)
@@ -520,6 +546,7 @@ namespace libtorrent {
 
 		// clear the stat cache in case the new location has new files
 		m_stat_cache.clear();
+		m_extent_cache.clear();
 
 		return { ret, m_save_path };
 	}
@@ -791,6 +818,104 @@ namespace libtorrent {
 		return static_cast<int>(file_range.size());
 	}
 
+	int mmap_storage::read2(settings_interface const& sett
+		, span<char> const buf, piece_index_t const piece, int const offset
+		, aux::open_mode_t const flags, storage_error& error)
+	{
+		std::int64_t const start_offset = static_cast<int>(piece) * std::int64_t(files().piece_length()) + offset;
+		file_index_t const file_index = files().file_index_at_offset(start_offset);
+		std::int64_t const file_offset = start_offset - files().file_offset(file_index);
+		TORRENT_ASSERT(file_offset >= 0);
+		TORRENT_ASSERT(!files().pad_file_at(file_index));
+
+		if (file_index < m_file_priority.end_index()
+			&& m_file_priority[file_index] == dont_download
+			&& use_partfile(file_index))
+		{
+			error_code e;
+			peer_request map = files().map_file(file_index, file_offset, 0);
+			iovec_t const b = buf;
+			int const ret = m_part_file->readv(b, map.piece, map.start, e);
+
+			if (e)
+			{
+				error.ec = e;
+				error.file(file_index);
+				error.operation = operation_t::partfile_read;
+				return -1;
+			}
+			return ret;
+		}
+
+		auto handle = open_file(sett, file_index, flags, error);
+		if (error) return -1;
+
+		span<byte const> file_range = handle->range();
+		if (std::int64_t(file_range.size()) <= file_offset)
+			return 0;
+		file_range = file_range.subspan(std::ptrdiff_t(file_offset));
+		file_range = file_range.first(std::min(buf.size(), file_range.size()));
+		sig::try_signal([&]{
+			std::memcpy(buf.data(), const_cast<char const*>(file_range.data())
+				, static_cast<std::size_t>(file_range.size()));
+		});
+
+		return static_cast<int>(file_range.size());
+	}
+
+	disk_buffer_holder mmap_storage::read_view(settings_interface const& sett
+		, piece_index_t const piece, int const offset, int const len
+		, aux::open_mode_t const flags)
+	{
+#if TORRENT_HAVE_MAP_VIEW_OF_FILE
+		// on windows, a mapping that's kept alive prevents the file from being
+		// moved or deleted, so blocks are always copied
+		TORRENT_UNUSED(sett);
+		TORRENT_UNUSED(piece);
+		TORRENT_UNUSED(offset);
+		TORRENT_UNUSED(len);
+		TORRENT_UNUSED(flags);
+		return {};
+#else
+		std::int64_t const start_offset = static_cast<int>(piece) * std::int64_t(files().piece_length()) + offset;
+		file_index_t const file_index = files().file_index_at_offset(start_offset);
+		std::int64_t const file_offset = start_offset - files().file_offset(file_index);
+		TORRENT_ASSERT(file_offset >= 0);
+
+		if (files().pad_file_at(file_index)
+			|| file_offset + len > files().file_size(file_index))
+			return {};
+
+		if (file_index < m_file_priority.end_index()
+			&& m_file_priority[file_index] == dont_download
+			&& use_partfile(file_index))
+			return {};
+
+		storage_error ec;
+		auto handle = open_file(sett, file_index, flags, ec);
+		if (ec) return {};
+
+		span<byte const> file_range = handle->range();
+		if (std::int64_t(file_range.size()) < file_offset + len)
+			return {};
+		file_range = file_range.subspan(std::ptrdiff_t(file_offset), len);
+
+		// fault the pages in here, on the disk thread, rather than when the
+		// network thread sends them. Like with readv(), a file that was
+		// truncated under us raises an error here
+		sig::try_signal([&]{
+			std::uint8_t volatile sum = 0;
+			for (std::ptrdiff_t i = 0; i < file_range.size(); i += 4096)
+				sum ^= static_cast<std::uint8_t>(file_range[i]);
+			sum ^= static_cast<std::uint8_t>(file_range[file_range.size() - 1]);
+		});
+
+		auto* ref = new mapped_buffer(handle->mapping());
+		return disk_buffer_holder(*ref
+			, const_cast<char*>(reinterpret_cast<char const*>(file_range.data())), len);
+#endif
+	}
+
 	// a wrapper around open_file_impl that, if it fails, makes sure the
 	// directories have been created and retries
 	boost::optional<aux::file_view> mmap_storage::open_file(settings_interface const& sett
@@ -41,6 +41,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include <functional>
 #include <cstdint>
+#include <array>
+#include <cstring> // for memcpy
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
 #include <boost/logic/tribool.hpp>
@@ -105,6 +107,18 @@ namespace libtorrent {
 	// the limits of the download queue size
 	constexpr int min_request_queue = 2;
 
+	// idle peers are still ticked at least this often (in seconds), for the
+	// checks that don't have a deadline of their own (like the ones in peer
+	// plugins)
+	constexpr int max_tick_delay = 10;
+
+	// the number of whole seconds until ``deadline``, rounded up
+	int seconds_until(time_point const deadline, time_point const now)
+	{
+		if (deadline <= now) return 0;
+		return int((total_milliseconds(deadline - now) + 999) / 1000);
+	}
+
 	bool pending_block_in_buffer(pending_block const& pb)
 	{
 		return pb.send_buffer_offset != pending_block::not_in_buffer;
@@ -366,6 +380,9 @@ namespace libtorrent {
 
 		m_ses.set_peer_classes(this, m_remote.address(), socket_type_idx(m_socket));
 
+		aux::timer_wheel& timers = m_ses.peer_timers();
+		timers.schedule(*this, timers.now() + 1);
+
 #ifndef TORRENT_DISABLE_LOGGING
 		if (should_log(peer_log_alert::info))
 		{
@@ -2719,6 +2736,61 @@ namespace libtorrent {
 		}
 	}
 
+	bool peer_connection::start_disk_receive(peer_request const& r
+		, span<char const> const received)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		TORRENT_ASSERT(!m_disk_recv_buffer);
+
+		if (m_disconnecting) return false;
+
+		// only whole, aligned blocks are received into disk buffers, and only
+		// if there's something left to receive
+		if (r.length <= 0 || r.length > default_block_size
+			|| r.start % default_block_size != 0
+			|| int(received.size()) >= r.length)
+			return false;
+
+		std::shared_ptr<torrent> t = m_torrent.lock();
+		if (!t || t->is_seed() || t->is_deleted()) return false;
+
+		bool exceeded = false;
+		disk_buffer_holder buffer = m_disk_thread.allocate_receive_buffer(
+			exceeded, self(), "receive buffer");
+		if (!buffer) return false;
+
+		if (!received.empty())
+			std::memcpy(buffer.data(), received.data(), std::size_t(received.size()));
+
+		m_disk_recv_buffer = std::move(buffer);
+		m_disk_recv_request = r;
+		m_disk_recv_pos = int(received.size());
+		m_disk_recv_exceeded = exceeded;
+
+#ifndef TORRENT_DISABLE_LOGGING
+		if (should_log(peer_log_alert::incoming))
+		{
+			peer_log(peer_log_alert::incoming, "DISK_RECEIVE"
+				, "piece: %d s: %x l: %x received: %d exceeded: %d"
+				, static_cast<int>(r.piece), r.start, r.length
+				, m_disk_recv_pos, int(exceeded));
+		}
+#endif
+		return true;
+	}
+
+	piece_block_progress peer_connection::disk_receive_progress() const
+	{
+		if (!m_disk_recv_buffer) return {};
+
+		piece_block_progress p;
+		p.piece_index = m_disk_recv_request.piece;
+		p.block_index = m_disk_recv_request.start / default_block_size;
+		p.bytes_downloaded = m_disk_recv_pos;
+		p.full_block_bytes = m_disk_recv_request.length;
+		return p;
+	}
+
 #if TORRENT_USE_INVARIANT_CHECKS
 	struct check_postcondition
 	{
@@ -2755,6 +2827,19 @@ namespace libtorrent {
 	// -----------------------------
 
 	void peer_connection::incoming_piece(peer_request const& p, char const* data)
+	{
+		incoming_piece_impl(p, data, disk_buffer_holder());
+	}
+
+	void peer_connection::incoming_piece(peer_request const& p, disk_buffer_holder data)
+	{
+		TORRENT_ASSERT(data);
+		char const* const buf = data.data();
+		incoming_piece_impl(p, buf, std::move(data));
+	}
+
+	void peer_connection::incoming_piece_impl(peer_request const& p
+		, char const* const data, disk_buffer_holder buffer)
 	{
 		TORRENT_ASSERT(is_single_thread());
 		INVARIANT_CHECK;
@@ -2762,6 +2847,12 @@ namespace libtorrent {
 		std::shared_ptr<torrent> t = m_torrent.lock();
 		TORRENT_ASSERT(t);
 
+		// if the disk cache was full when the buffer this block was received
+		// into was allocated, we're expected to stop reading once it's handed
+		// over to the disk
+		bool const buffer_exceeded = m_disk_recv_exceeded;
+		m_disk_recv_exceeded = false;
+
 		// we're not receiving any block right now
 		m_receiving_block = piece_block::invalid;
 
@@ -2952,9 +3043,14 @@ namespace libtorrent {
 
 		if (t->is_deleted()) return;
 
-		bool const exceeded = m_disk_thread.async_write(t->storage(), p, data, self()
-			, [conn = self(), p, t] (storage_error const& e)
-			{ conn->wrap(&peer_connection::on_disk_write_complete, e, p, t); });
+		auto write_handler = [conn = self(), p, t] (storage_error const& e)
+			{ conn->wrap(&peer_connection::on_disk_write_complete, e, p, t); };
+		bool const exceeded = (buffer
+			? m_disk_thread.async_write_buffer(t->storage(), p, std::move(buffer)
+				, self(), std::move(write_handler))
+			: m_disk_thread.async_write(t->storage(), p, data, self()
+				, std::move(write_handler)))
+			|| buffer_exceeded;
 		m_ses.deferred_submit_jobs();
 
 		// every peer is entitled to have two disk blocks allocated at any given
@@ -4275,6 +4371,13 @@ namespace libtorrent {
 			m_send_buffer.clear();
 		}
 
+		if (!(m_channel_state[download_channel] & peer_info::bw_network))
+		{
+			// the same goes for a buffer we were receiving a block into. If
+			// there's an outstanding read into it, it's freed once it completes
+			m_disk_recv_buffer.reset();
+		}
+
 		// we cannot do this in a constructor
 		TORRENT_ASSERT(m_in_constructor == false);
 		if (error > normal)
@@ -4415,6 +4518,7 @@ namespace libtorrent {
 		}
 
 		m_disconnecting = true;
+		m_ses.peer_timers().cancel(*this);
 
 		if (t)
 		{
@@ -4915,10 +5019,6 @@ namespace libtorrent {
 		// can enforce the timeouts.
 		bool const reading_socket = bool(m_channel_state[download_channel] & peer_info::bw_network);
 
-		// TODO: 2 use a deadline_timer for timeouts. Don't rely on second_tick()!
-		// Hook this up to connect timeout as well. This would improve performance
-		// because of less work in second_tick(), and might let use remove ticking
-		// entirely eventually
 		if (reading_socket && d > seconds(timeout()) && !m_connecting && m_reading_bytes == 0
 			&& can_disconnect(errors::timed_out_inactivity))
 		{
@@ -5096,6 +5196,105 @@ namespace libtorrent {
 		fill_send_buffer();
 	}
 
+	void peer_connection::timer_tick(int const tick_interval_ms)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		if (m_disconnecting) return;
+
+		std::shared_ptr<peer_connection> me(self());
+		aux::timer_wheel& timers = m_ses.peer_timers();
+
+		if (m_torrent.expired())
+		{
+			// this is an incoming connection that hasn't told us which torrent
+			// it's for yet. Just make sure it doesn't stall in the handshake
+			int timeout = m_settings.get_int(settings_pack::handshake_timeout);
+#if TORRENT_USE_I2P
+			timeout *= is_i2p(m_socket) ? 4 : 1;
+#endif
+			time_point const now = aux::time_now();
+			time_point const deadline = m_connect + seconds(timeout);
+			if (now > deadline)
+			{
+				disconnect(errors::timed_out, operation_t::bittorrent);
+				return;
+			}
+			// once it's attached to a torrent, the next message it sends wakes
+			// it up
+			timers.schedule(*this, timers.now()
+				+ std::max(1, seconds_until(deadline, now)));
+			return;
+		}
+
+		second_tick(tick_interval_ms);
+		if (m_disconnecting) return;
+
+		timers.schedule(*this, timers.now() + next_tick_delay());
+	}
+
+	void peer_connection::wake_tick()
+	{
+		// while the peer is being ticked it's not scheduled. It's rescheduled
+		// at the end of the tick
+		if (!scheduled()) return;
+		aux::timer_wheel& timers = m_ses.peer_timers();
+		if (due() > timers.now() + 1)
+			timers.schedule(*this, timers.now() + 1);
+	}
+
+	int peer_connection::next_tick_delay() const
+	{
+		std::shared_ptr<torrent> t = m_torrent.lock();
+		if (!t) return 1;
+
+		// peers that we're exchanging data with, or are about to, as well as
+		// ones whose rates haven't decayed to 0 yet are ticked every second
+		if (m_connecting
+			|| in_handshake()
+			|| m_interesting
+			|| !m_download_queue.empty()
+			|| !m_request_queue.empty()
+			|| !m_requests.empty()
+			|| m_reading_bytes > 0
+			|| !m_send_buffer.empty()
+			|| !m_statistics.is_idle()
+			|| !t->valid_metadata()
+#ifndef TORRENT_DISABLE_SUPERSEEDING
+			|| t->super_seeding()
+#endif
+			)
+		{
+			return 1;
+		}
+
+		// otherwise the peer only needs to be ticked in time for the next
+		// keep-alive or timeout. See second_tick() for the conditions
+		time_point const now = aux::time_now();
+		time_point next = now + seconds(max_tick_delay);
+
+		next = std::min(next, m_last_sent.get(m_connect) + seconds(timeout() / 2));
+		next = std::min(next, m_last_receive.get(m_connect) + seconds(timeout()));
+
+		if (!m_peer_interested)
+		{
+			time_point const uninterested = std::max(m_became_uninterested.get(m_connect)
+				, m_became_uninteresting.get(m_connect));
+			next = std::min(next, uninterested
+				+ seconds(m_settings.get_int(settings_pack::inactivity_timeout)));
+		}
+		else if (!m_choked && t->is_upload_only())
+		{
+			time_point const last_active = std::max(std::max(m_last_unchoke.get(m_connect)
+				, m_last_incoming_request.get(m_connect))
+				, m_last_sent_payload.get(m_connect));
+			next = std::min(next, last_active + seconds(60));
+		}
+
+		// the timeouts are checked as "more than n seconds ago", so tick one
+		// second past the deadline
+		return std::max(1, std::min(max_tick_delay, seconds_until(next, now) + 1));
+	}
+
 	void peer_connection::snub_peer()
 	{
 		TORRENT_ASSERT(is_single_thread());
@@ -5335,7 +5534,8 @@ namespace libtorrent {
 
 				m_disk_thread.async_read(t->storage(), r
 					, [conn = self(), r](disk_buffer_holder buf, storage_error const& ec)
-					{ conn->wrap(&peer_connection::on_disk_read_complete, std::move(buf), ec, r, clock_type::now()); });
+					{ conn->wrap(&peer_connection::on_disk_read_complete, std::move(buf), ec, r, clock_type::now()); }
+					, can_send_references() ? disk_job_flags_t{} : disk_interface::force_copy);
 			}
 			m_last_sent_payload.set(m_connect, clock_type::now());
 			m_requests.erase(m_requests.begin() + i);
@@ -5730,6 +5930,8 @@ namespace libtorrent {
 
 		if (m_disconnecting || m_send_buffer.empty()) return;
 
+		wake_tick();
+
 		// we may want to request more quota at this point
 		request_bandwidth(upload_channel);
 
@@ -5882,6 +6084,9 @@ namespace libtorrent {
 	void peer_connection::on_disk()
 	{
 		TORRENT_ASSERT(is_single_thread());
+		// the disk cache has already drained below the low watermark, there's
+		// no need to stop reading once the block we're receiving is written
+		m_disk_recv_exceeded = false;
 		if (!(m_channel_state[download_channel] & peer_info::bw_disk)) return;
 		std::shared_ptr<peer_connection> me(self());
 
@@ -5906,8 +6111,18 @@ namespace libtorrent {
 			m_recv_buffer.reserve(100);
 		}
 
+		// when receiving a block into a disk buffer, we only read as far as
+		// the length prefix and header of the next piece message, past the
+		// end of the block. That way the payload of the next block can be
+		// received straight into a disk buffer too
+		int const disk_recv_left = m_disk_recv_buffer
+			? m_disk_recv_request.length - m_disk_recv_pos : 0;
+		int const lookahead = 4 + 9;
+
 		// we may want to request more quota at this point
-		int const buffer_size = m_recv_buffer.max_receive();
+		int const buffer_size = m_disk_recv_buffer
+			? disk_recv_left + lookahead
+			: m_recv_buffer.max_receive();
 		request_bandwidth(download_channel, buffer_size);
 
 		if (m_channel_state[download_channel] & peer_info::bw_network) return;
@@ -5946,7 +6161,6 @@ namespace libtorrent {
 
 		if (max_receive == 0) return;
 
-		span<char> const vec = m_recv_buffer.reserve(max_receive);
 		TORRENT_ASSERT(!(m_channel_state[download_channel] & peer_info::bw_network));
 		m_channel_state[download_channel] |= peer_info::bw_network;
 #ifndef TORRENT_DISABLE_LOGGING
@@ -5967,7 +6181,28 @@ namespace libtorrent {
 			>;
 		static_assert(sizeof(read_handler_type) == sizeof(std::shared_ptr<peer_connection>)
 			, "read handler does not have the expected size");
-		m_socket.async_read_some(boost::asio::buffer(vec.data(), std::size_t(vec.size())), read_handler_type(self()));
+
+		if (m_disk_recv_buffer)
+		{
+			int const disk_bytes = std::min(disk_recv_left, max_receive);
+			span<char> const tail = max_receive > disk_bytes
+				? m_recv_buffer.reserve(max_receive - disk_bytes) : span<char>();
+			std::array<boost::asio::mutable_buffer, 2> const vec{{
+				{m_disk_recv_buffer.data() + m_disk_recv_pos, std::size_t(disk_bytes)}
+				, {tail.data(), std::size_t(tail.size())}}};
+			m_socket.async_read_some(vec
+				, read_handler_type(self()));
+			return;
+		}
+
+		span<char> const vec = m_recv_buffer.reserve(max_receive);
+		m_socket.async_read_some(boost::asio::buffer(vec.data(), std::size_t(vec.size()))
+			, read_handler_type(self()));
+	}
+
+	bool peer_connection::can_send_references() const
+	{
+		return !aux::is_utp(m_socket) && !aux::is_ssl(m_socket);
 	}
 
 	piece_block_progress peer_connection::downloading_piece_progress() const
@@ -6008,11 +6243,14 @@ namespace libtorrent {
 	// RECEIVE DATA
 	// --------------------------
 
-	void peer_connection::account_received_bytes(int const bytes_transferred)
+	void peer_connection::account_received_bytes(int const bytes_transferred
+		, int const disk_bytes)
 	{
-		// tell the receive buffer we just fed it this many bytes of incoming data
+		// tell the receive buffer we just fed it this many bytes of incoming
+		// data. The first disk_bytes were received into m_disk_recv_buffer
 		TORRENT_ASSERT(bytes_transferred > 0);
-		m_recv_buffer.received(bytes_transferred);
+		TORRENT_ASSERT(disk_bytes >= 0 && disk_bytes <= bytes_transferred);
+		m_recv_buffer.received(bytes_transferred - disk_bytes);
 
 		// update the dl quota
 		TORRENT_ASSERT(bytes_transferred <= m_quota[download_channel]);
@@ -6068,10 +6306,12 @@ namespace libtorrent {
 #endif
 			on_receive(error, bytes_transferred);
 			disconnect(error, operation_t::sock_read);
+			m_disk_recv_buffer.reset();
 			return;
 		}
 
 		m_last_receive.set(m_connect, aux::time_now());
+		wake_tick();
 
 		// submit all disk jobs later
 		m_ses.deferred_submit_jobs();
@@ -6087,12 +6327,20 @@ namespace libtorrent {
 		// flush the send buffer at the end of this function
 		cork _c(*this);
 
+		// when receiving a block into a disk buffer, the first bytes are its
+		// payload. Anything past the end of it went into the receive buffer
+		int const disk_bytes = m_disk_recv_buffer
+			? std::min(int(bytes_transferred), m_disk_recv_request.length - m_disk_recv_pos)
+			: 0;
+
 		// if we received exactly as many bytes as we provided a receive buffer
 		// for. There most likely are more bytes to read, and we should grow our
-		// receive buffer.
-		TORRENT_ASSERT(int(bytes_transferred) <= m_recv_buffer.max_receive());
-		bool const grow_buffer = (int(bytes_transferred) == m_recv_buffer.max_receive());
-		account_received_bytes(int(bytes_transferred));
+		// receive buffer. Not while receiving into a disk buffer though, the
+		// next read will pick up where this one left off
+		TORRENT_ASSERT(int(bytes_transferred) - disk_bytes <= m_recv_buffer.max_receive());
+		bool const grow_buffer = !m_disk_recv_buffer
+			&& int(bytes_transferred) == m_recv_buffer.max_receive();
+		account_received_bytes(int(bytes_transferred), disk_bytes);
 
 		if (m_extension_outstanding_bytes > 0)
 			m_extension_outstanding_bytes -= std::min(m_extension_outstanding_bytes, int(bytes_transferred));
@@ -6100,6 +6348,28 @@ namespace libtorrent {
 		check_graceful_pause();
 		if (m_disconnecting) return;
 
+		if (disk_bytes > 0)
+		{
+			received_bytes(disk_bytes, 0);
+			if (m_torrent.expired())
+			{
+				disconnect(errors::torrent_removed, operation_t::bittorrent, failure);
+				return;
+			}
+
+			m_disk_recv_pos += disk_bytes;
+			incoming_piece_fragment(disk_bytes);
+
+			if (m_disk_recv_pos == m_disk_recv_request.length)
+			{
+				peer_request const r = m_disk_recv_request;
+				disk_buffer_holder buffer = std::move(m_disk_recv_buffer);
+				m_disk_recv_pos = 0;
+				incoming_piece(r, std::move(buffer));
+				if (m_disconnecting) return;
+			}
+		}
+
 		// this is the case where we try to grow the receive buffer and try to
 		// drain the socket
 		if (grow_buffer)
@@ -6150,7 +6420,7 @@ namespace libtorrent {
 				}
 				else
 				{
-					account_received_bytes(int(bytes));
+					account_received_bytes(int(bytes), 0);
 					bytes_transferred += bytes;
 				}
 			}
@@ -6159,15 +6429,16 @@ namespace libtorrent {
 		// feed bytes in receive buffer to upper layer by calling on_receive()
 
 		bool const prev_choked = m_peer_choked;
-		int bytes = int(bytes_transferred);
-		int sub_transferred = 0;
-		do {
-			sub_transferred = m_recv_buffer.advance_pos(bytes);
+		int bytes = int(bytes_transferred) - disk_bytes;
+		while (bytes > 0)
+		{
+			int const sub_transferred = m_recv_buffer.advance_pos(bytes);
 			TORRENT_ASSERT(sub_transferred > 0);
 			on_receive(error, std::size_t(sub_transferred));
 			bytes -= sub_transferred;
 			if (m_disconnecting) return;
-		} while (bytes > 0 && sub_transferred > 0);
+			if (sub_transferred == 0) break;
+		}
 
 		// if the peer went from unchoked to choked, suggest to the receive
 		// buffer that it shrinks to 100 bytes
@@ -37,13 +37,30 @@ POSSIBILITY OF SUCH DAMAGE.
 
 namespace libtorrent {
 
+#ifdef ATOMIC_LLONG_LOCK_FREE
+	constexpr int counters::num_shards;
+	constexpr int counters::shard_stride;
+
+	int counters::thread_shard() noexcept
+	{
+		// threads are assigned shards round-robin, the first time they touch
+		// a counter
+		static std::atomic<int> next_shard{0};
+		thread_local int const shard
+			= next_shard.fetch_add(1, std::memory_order_relaxed) % num_shards;
+		return shard;
+	}
+#endif
+
 	// TODO: move stats_counter_t out of counters
 	// TODO: should bittorrent keep-alive messages have a counter too?
 	// TODO: It would be nice if this could be an internal type. default_disk_constructor depends on it now
 	counters::counters() TORRENT_COUNTER_NOEXCEPT
 	{
 #ifdef ATOMIC_LLONG_LOCK_FREE
-		for (auto& counter : m_stats_counter)
+		for (auto& counter : m_stats_shards)
+			counter.store(0, std::memory_order_relaxed);
+		for (auto& counter : m_gauges)
 			counter.store(0, std::memory_order_relaxed);
 #else
 		m_stats_counter.fill(0);
@@ -53,9 +70,14 @@ namespace libtorrent {
 	counters::counters(counters const& c) TORRENT_COUNTER_NOEXCEPT
 	{
 #ifdef ATOMIC_LLONG_LOCK_FREE
-		for (int i = 0; i < m_stats_counter.end_index(); ++i)
-			m_stats_counter[i].store(
-				c.m_stats_counter[i].load(std::memory_order_relaxed)
+		// the copy holds the totals in its first shard
+		for (auto& counter : m_stats_shards)
+			counter.store(0, std::memory_order_relaxed);
+		for (int i = 0; i < num_stats_counters; ++i)
+			stats_counter(0, i).store(c[i], std::memory_order_relaxed);
+		for (int i = 0; i < m_gauges.end_index(); ++i)
+			m_gauges[i].store(
+				c.m_gauges[i].load(std::memory_order_relaxed)
 					, std::memory_order_relaxed);
 #else
 		std::lock_guard<std::mutex> l(c.m_mutex);
@@ -67,9 +89,16 @@ namespace libtorrent {
 	{
 		if (&c == this) return *this;
 #ifdef ATOMIC_LLONG_LOCK_FREE
-		for (int i = 0; i < m_stats_counter.end_index(); ++i)
-			m_stats_counter[i].store(
-				c.m_stats_counter[i].load(std::memory_order_relaxed)
+		for (int i = 0; i < num_stats_counters; ++i)
+		{
+			std::int64_t const value = c[i];
+			stats_counter(0, i).store(value, std::memory_order_relaxed);
+			for (int shard = 1; shard < num_shards; ++shard)
+				stats_counter(shard, i).store(0, std::memory_order_relaxed);
+		}
+		for (int i = 0; i < m_gauges.end_index(); ++i)
+			m_gauges[i].store(
+				c.m_gauges[i].load(std::memory_order_relaxed)
 					, std::memory_order_relaxed);
 #else
 		std::lock_guard<std::mutex> l(m_mutex);
@@ -85,7 +114,13 @@ namespace libtorrent {
 		TORRENT_ASSERT(i < num_counters);
 
 #ifdef ATOMIC_LLONG_LOCK_FREE
-		return m_stats_counter[i].load(std::memory_order_relaxed);
+		if (i >= num_stats_counters)
+			return m_gauges[i - num_stats_counters].load(std::memory_order_relaxed);
+
+		std::int64_t ret = 0;
+		for (int shard = 0; shard < num_shards; ++shard)
+			ret += stats_counter(shard, i).load(std::memory_order_relaxed);
+		return ret;
 #else
 		std::lock_guard<std::mutex> l(m_mutex);
 		return m_stats_counter[i];
@@ -104,9 +139,17 @@ namespace libtorrent {
 		TORRENT_ASSERT(c < num_counters);
 
 #ifdef ATOMIC_LLONG_LOCK_FREE
-		std::int64_t pv = m_stats_counter[c].fetch_add(value, std::memory_order_relaxed);
-		TORRENT_ASSERT(pv + value >= 0);
-		return pv + value;
+		if (c >= num_stats_counters)
+		{
+			std::int64_t pv = m_gauges[c - num_stats_counters].fetch_add(value, std::memory_order_relaxed);
+			TORRENT_ASSERT(pv + value >= 0);
+			return pv + value;
+		}
+
+		// a shard is normally only touched by a single thread, so this
+		// doesn't contend with other threads
+		return stats_counter(thread_shard(), c).fetch_add(value
+			, std::memory_order_relaxed) + value;
 #else
 		std::lock_guard<std::mutex> l(m_mutex);
 		TORRENT_ASSERT(m_stats_counter[c] + value >= 0);
@@ -124,10 +167,11 @@ namespace libtorrent {
 		TORRENT_ASSERT(ratio <= 100);
 
 #ifdef ATOMIC_LLONG_LOCK_FREE
-		std::int64_t current = m_stats_counter[c].load(std::memory_order_relaxed);
+		auto& counter = m_gauges[c - num_stats_counters];
+		std::int64_t current = counter.load(std::memory_order_relaxed);
 		std::int64_t new_value = (current * (100 - ratio) + value * ratio) / 100;
 
-		while (!m_stats_counter[c].compare_exchange_weak(current, new_value
+		while (!counter.compare_exchange_weak(current, new_value
 			, std::memory_order_relaxed))
 		{
 			new_value = (current * (100 - ratio) + value * ratio) / 100;
@@ -141,11 +185,21 @@ namespace libtorrent {
 
 	void counters::set_value(int const c, std::int64_t const value) TORRENT_COUNTER_NOEXCEPT
 	{
-		TORRENT_ASSERT(c >= 0);
+		// only gauges can be set. Stats counters are sharded across threads,
+		// resetting them would race with increments from other threads. Use
+		// aux::reported_count for cumulative counts maintained elsewhere
+		TORRENT_ASSERT(c >= num_stats_counters);
 		TORRENT_ASSERT(c < num_counters);
 
 #ifdef ATOMIC_LLONG_LOCK_FREE
-		m_stats_counter[c].store(value);
+		if (c < num_stats_counters)
+		{
+			// in release builds, don't lose increments made by other threads,
+			// just move the total by the difference
+			inc_stats_counter(c, value - (*this)[c]);
+			return;
+		}
+		m_gauges[c - num_stats_counters].store(value);
 #else
 		std::lock_guard<std::mutex> l(m_mutex);
 
@@ -171,6 +171,7 @@ namespace libtorrent {
 		m_cursor = piece_index_t(0);
 
 		for (auto& c : m_downloads) c.clear();
+		m_download_slot.assign(std::size_t(total_num_pieces), -1);
 		m_block_info.clear();
 		m_free_block_infos.clear();
 
@@ -274,10 +275,7 @@ namespace libtorrent {
 		downloading_piece ret;
 		ret.index = piece;
 		auto const download_state = piece_pos::piece_downloading;
-		auto downloading_iter = std::lower_bound(m_downloads[download_state].begin()
-			, m_downloads[download_state].end(), ret);
-		TORRENT_ASSERT(downloading_iter == m_downloads[download_state].end()
-			|| downloading_iter->index != piece);
+		TORRENT_ASSERT(find_dl_piece(download_state, piece) == m_downloads[download_state].end());
 		TORRENT_ASSERT(block_index >= 0);
 		TORRENT_ASSERT(block_index < std::numeric_limits<std::uint16_t>::max());
 		ret.info_idx = std::uint16_t(block_index);
@@ -305,7 +303,7 @@ namespace libtorrent {
 			info.peers.clear();
 #endif
 		}
-		downloading_iter = m_downloads[download_state].insert(downloading_iter, ret);
+		auto downloading_iter = add_to_download_queue(download_state, ret);
 
 		// in case every block was a pad block, we need to make sure the piece
 		// structure is correctly categorised
@@ -336,7 +334,8 @@ namespace libtorrent {
 
 		TORRENT_ASSERT(find_dl_piece(download_state, i->index) == i);
 		m_piece_map[i->index].state(piece_pos::piece_open);
-		m_downloads[download_state].erase(i);
+		m_download_slot[i->index] = -1;
+		remove_from_download_queue(download_state, i);
 
 		TORRENT_ASSERT(prev_size == int(m_downloads[download_state].size()) + 1);
 
@@ -353,7 +352,10 @@ namespace libtorrent {
 
 		std::vector<downloading_piece> ret;
 		for (auto const& c : m_downloads)
-			ret.insert(ret.end(), c.begin(), c.end());
+		{
+			auto const mid = ret.insert(ret.end(), c.begin(), c.end());
+			std::sort(mid, ret.end());
+		}
 		return ret;
 	}
 
@@ -392,12 +394,10 @@ namespace libtorrent {
 	{
 		for (auto const k : categories())
 		{
-			if (m_downloads[k].empty()) continue;
-			for (auto i = m_downloads[k].begin(); i != m_downloads[k].end() - 1; ++i)
+			for (auto i = m_downloads[k].begin(); i != m_downloads[k].end(); ++i)
 			{
 				downloading_piece const& dp = *i;
-				downloading_piece const& next = *(i + 1);
-				TORRENT_ASSERT(dp.index < next.index);
+				TORRENT_ASSERT(m_download_slot[dp.index] == int(i - m_downloads[k].begin()));
 				TORRENT_ASSERT(int(dp.info_idx) * m_blocks_per_piece
 					+ m_blocks_per_piece <= int(m_block_info.size()));
 				for (auto const& bl : blocks_for_piece(dp))
@@ -1765,6 +1765,7 @@ namespace libtorrent {
 		m_num_have = num_pieces();
 
 		for (auto& queue : m_downloads) queue.clear();
+		std::fill(m_download_slot.begin(), m_download_slot.end(), -1);
 		for (auto& p : m_piece_map)
 		{
 			p.set_have();
@@ -2024,11 +2025,8 @@ namespace {
 		{
 			// first, allocate a small array on the stack of all the partial
 			// pieces (downloading_piece). We'll then sort this list by
-			// availability or by some other condition. The list of partial pieces
-			// in m_downloads is ordered by piece index, this is to have O(log n)
-			// lookups when finding a downloading_piece for a specific piece index.
-			// this is important and needs to stay sorted that way, that's why
-			// we're copying it here
+			// availability or by piece index. The list of partial pieces in
+			// m_downloads is not ordered, see m_download_slot
 			TORRENT_ALLOCA(ordered_partials, downloading_piece const*
 				, m_downloads[piece_pos::piece_downloading].size());
 			int num_ordered_partials = 0;
@@ -2067,6 +2065,12 @@ namespace {
 					, std::bind(&piece_picker::partial_compare_rarest_first, this
 						, _1, _2));
 			}
+			else
+			{
+				std::sort(ordered_partials.begin(), ordered_partials.begin() + num_ordered_partials
+					, [](downloading_piece const* lhs, downloading_piece const* rhs)
+					{ return lhs->index < rhs->index; });
+			}
 
 			for (int i = 0; i < num_ordered_partials; ++i)
 			{
@@ -2955,13 +2959,37 @@ get_out:
 			|| queue == piece_pos::piece_finished
 			|| queue == piece_pos::piece_zero_prio);
 
-		downloading_piece cmp;
-		cmp.index = index;
-		auto const i = std::lower_bound(
-			m_downloads[queue].begin(), m_downloads[queue].end(), cmp);
-		if (i == m_downloads[queue].end()) return i;
-		if (i->index == index) return i;
-		return m_downloads[queue].end();
+		// the slot refers to the list the piece is in, which may not be the
+		// one we're asked to look in
+		auto& list = m_downloads[queue];
+		int const slot = m_download_slot[index];
+		if (slot < 0 || slot >= int(list.size())
+			|| list[slot].index != index)
+			return list.end();
+		return list.begin() + slot;
+	}
+
+	std::vector<piece_picker::downloading_piece>::iterator
+	piece_picker::add_to_download_queue(download_queue_t const queue
+		, downloading_piece const& dp)
+	{
+		auto& list = m_downloads[queue];
+		m_download_slot[dp.index] = int(list.size());
+		list.push_back(dp);
+		return list.end() - 1;
+	}
+
+	void piece_picker::remove_from_download_queue(download_queue_t const queue
+		, std::vector<downloading_piece>::iterator const i)
+	{
+		auto& list = m_downloads[queue];
+		TORRENT_ASSERT(i != list.end());
+		if (i != list.end() - 1)
+		{
+			*i = std::move(list.back());
+			m_download_slot[i->index] = int(i - list.begin());
+		}
+		list.pop_back();
 	}
 
 	std::vector<piece_picker::downloading_piece>::const_iterator piece_picker::find_dl_piece(
@@ -3027,7 +3055,7 @@ get_out:
 		// remove the downloading_piece from the list corresponding
 		// to the old state
 		downloading_piece dp_info = *dp;
-		m_downloads[p.download_queue()].erase(dp);
+		remove_from_download_queue(p.download_queue(), dp);
 
 		int const prio = p.priority(this);
 		TORRENT_ASSERT(prio < int(m_priority_boundaries.size()) || m_dirty);
@@ -3038,13 +3066,7 @@ get_out:
 
 		// insert the downloading_piece in the list corresponding to
 		// the new state
-		downloading_piece cmp;
-		cmp.index = dp_info.index;
-		auto i = std::lower_bound(m_downloads[p.download_queue()].begin()
-			, m_downloads[p.download_queue()].end(), cmp);
-		TORRENT_ASSERT(i == m_downloads[p.download_queue()].end()
-			|| i->index != dp_info.index);
-		i = m_downloads[p.download_queue()].insert(i, dp_info);
+		auto const i = add_to_download_queue(p.download_queue(), dp_info);
 
 		if (!m_dirty)
 		{
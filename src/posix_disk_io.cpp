@@ -42,6 +42,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/aux_/path.hpp"
 #include "libtorrent/aux_/numeric_cast.hpp"
 #include "libtorrent/aux_/posix_storage.hpp"
+#include "libtorrent/aux_/extent_cache.hpp"
+#include "libtorrent/aux_/posix_file_pool.hpp"
 #include "libtorrent/stat_cache.hpp"
 #include "libtorrent/file_storage.hpp"
 #include "libtorrent/hasher.hpp"
@@ -71,7 +73,8 @@ namespace {
 		, buffer_allocator_interface
 	{
 		posix_disk_io(io_context& ios, settings_interface const& sett, counters& cnt)
-			: m_settings(sett)
+			: m_file_pool(sett.get_int(settings_pack::file_pool_size))
+			, m_settings(sett)
 			, m_buffer_pool(ios)
 			, m_stats_counters(cnt)
 			, m_ios(ios)
@@ -82,6 +85,7 @@ namespace {
 		void settings_updated() override
 		{
 			m_buffer_pool.set_settings(m_settings);
+			m_file_pool.resize(m_settings.get_int(settings_pack::file_pool_size));
 		}
 
 		storage_holder new_torrent(storage_params const& params
@@ -93,7 +97,8 @@ namespace {
 			storage_index_t const idx = m_free_slots.empty()
 				? m_torrents.end_index()
 				: pop(m_free_slots);
-			auto storage = std::make_unique<posix_storage>(params);
+			auto storage = std::make_unique<posix_storage>(params, m_file_pool);
+			storage->set_storage_index(idx);
 			if (idx == m_torrents.end_index()) m_torrents.emplace_back(std::move(storage));
 			else m_torrents[idx] = std::move(storage);
 			return storage_holder(idx, *this);
@@ -199,6 +204,17 @@ namespace {
 
 			TORRENT_ASSERT(!v2 || int(block_hashes.size()) >= blocks_in_piece2);
 
+			// when checking, pieces that are entirely in holes of sparse files
+			// hash to zeros, without reading them
+			if ((flags & disk_interface::volatile_read) && st->piece_in_holes(piece))
+			{
+				sha1_hash const hash = v1 ? aux::zero_hash(piece_size) : sha1_hash();
+				aux::zero_block_hashes(block_hashes, piece_size2);
+				m_stats_counters.inc_stats_counter(counters::num_hole_pieces_skipped);
+				post(m_ios, [=, h = std::move(handler)]{ h(piece, hash, error); });
+				return;
+			}
+
 			int offset = 0;
 			int const blocks_to_read = std::max(blocks_in_piece, blocks_in_piece2);
 			for (int i = 0; i < blocks_to_read; ++i)
@@ -358,8 +374,10 @@ namespace {
 				{ h(std::move(n), idx, error); });
 		}
 
-		void async_stop_torrent(storage_index_t, std::function<void()> handler) override
+		void async_stop_torrent(storage_index_t const storage, std::function<void()> handler) override
 		{
+			// a stopped torrent should not keep its files open
+			m_file_pool.release(storage);
 			if (!handler) return;
 			post(m_ios, std::move(handler));
 		}
@@ -388,13 +406,17 @@ namespace {
 
 		void update_stats_counters(counters&) const override {}
 
-		std::vector<open_file_state> get_status(storage_index_t) const override
-		{ return {}; }
+		std::vector<open_file_state> get_status(storage_index_t const storage) const override
+		{ return m_file_pool.get_status(storage); }
 
 		void submit_jobs() override {}
 
 	private:
 
+		// open files, shared by all torrents. This must outlive the storages
+		// in m_torrents, since they release their files when destructed
+		aux::posix_file_pool m_file_pool;
+
 		aux::vector<std::unique_ptr<posix_storage>, storage_index_t> m_torrents;
 
 		// slots that are unused in the m_torrents vector
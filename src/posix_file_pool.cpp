@@ -0,0 +1,487 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/assert.hpp"
+#include "libtorrent/aux_/posix_file_pool.hpp"
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/file_storage.hpp"
+#include "libtorrent/disk_interface.hpp" // for open_file_state
+#include "libtorrent/aux_/path.hpp"
+#include "libtorrent/aux_/numeric_cast.hpp"
+#ifdef TORRENT_WINDOWS
+#include "libtorrent/utf8.hpp"
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h> // for preadv, pwritev
+#endif
+
+#include <limits>
+#include <algorithm>
+
+using namespace libtorrent::flags;
+
+namespace libtorrent { namespace aux {
+
+namespace {
+
+	file_open_mode_t to_open_state(open_mode_t const mode)
+	{
+		return ((mode & open_mode::write)
+				? file_open_mode::read_write : file_open_mode::read_only)
+			| ((mode & open_mode::no_atime)
+				? file_open_mode::no_atime : file_open_mode::read_only)
+			;
+	}
+
+#ifdef TORRENT_WINDOWS
+	FILE* open_native(std::string const& fn, open_mode_t const mode, bool const create)
+	{
+		wchar_t const* mode_str = create ? L"wb+"
+			: (mode & open_mode::write) ? L"rb+" : L"rb";
+		return ::_wfopen(convert_to_native_path_string(fn).c_str(), mode_str);
+	}
+#else
+	int file_flags(open_mode_t const mode, bool const create)
+	{
+		return ((mode & open_mode::write) ? O_RDWR : O_RDONLY)
+			| (create ? O_CREAT : 0)
+#ifdef O_CLOEXEC
+			| O_CLOEXEC
+#endif
+#ifdef O_NOATIME
+			| ((mode & open_mode::no_atime) ? O_NOATIME : 0)
+#endif
+			;
+	}
+
+	int open_native(std::string const& fn, open_mode_t const mode, bool const create)
+	{
+		int fd = ::open(fn.c_str(), file_flags(mode, create), 0666);
+#ifdef O_NOATIME
+		if (fd < 0 && (mode & open_mode::no_atime) && errno == EPERM)
+		{
+			// NOATIME may not be allowed for certain files, it's best-effort,
+			// so just try again without NOATIME
+			fd = ::open(fn.c_str(), file_flags(mode & ~open_mode::no_atime, create), 0666);
+		}
+#endif
+		return fd;
+	}
+#endif
+} // anonymous namespace
+
+#ifdef TORRENT_WINDOWS
+	int posix_file::readv(std::int64_t const offset, span<iovec_t const> bufs
+		, error_code& ec)
+	{
+		if (portable_fseeko(file(), offset, SEEK_SET) != 0)
+		{
+			ec.assign(errno, generic_category());
+			return -1;
+		}
+
+		int ret = 0;
+		for (auto buf : bufs)
+		{
+			int const r = static_cast<int>(fread(buf.data(), 1
+				, static_cast<std::size_t>(buf.size()), file()));
+			if (r == 0)
+			{
+				if (ferror(file())) ec.assign(errno, generic_category());
+				break;
+			}
+			ret += r;
+
+			// the file may be shorter than we think
+			if (r < buf.size()) break;
+		}
+		return ec ? -1 : ret;
+	}
+
+	int posix_file::writev(std::int64_t const offset, span<iovec_t const> bufs
+		, error_code& ec)
+	{
+		if (portable_fseeko(file(), offset, SEEK_SET) != 0)
+		{
+			ec.assign(errno, generic_category());
+			return -1;
+		}
+
+		int ret = 0;
+		for (auto buf : bufs)
+		{
+			auto const r = static_cast<int>(fwrite(buf.data(), 1
+				, static_cast<std::size_t>(buf.size()), file()));
+			if (r != buf.size())
+			{
+				if (ferror(file())) ec.assign(errno, generic_category());
+				else ec.assign(errors::file_too_short, libtorrent_category());
+				return -1;
+			}
+			ret += r;
+		}
+		return ret;
+	}
+#else
+	posix_file::~posix_file()
+	{
+		if (m_fd >= 0) ::close(m_fd);
+	}
+
+	int posix_file::readv(std::int64_t offset, span<iovec_t const> bufs
+		, error_code& ec)
+	{
+		int ret = 0;
+		while (!bufs.empty())
+		{
+#if TORRENT_USE_PREADV
+			// the iovec_t spans are not layout compatible with struct iovec, so
+			// they have to be converted
+			::iovec vec[16];
+			int const num_bufs = std::min(int(bufs.size()), int(sizeof(vec) / sizeof(vec[0])));
+			for (int i = 0; i < num_bufs; ++i)
+			{
+				vec[i].iov_base = bufs[i].data();
+				vec[i].iov_len = static_cast<std::size_t>(bufs[i].size());
+			}
+			auto const r = ::preadv(m_fd, vec, num_bufs, static_cast<off_t>(offset));
+#else
+			auto const r = ::pread(m_fd, bufs.front().data()
+				, static_cast<std::size_t>(bufs.front().size()), static_cast<off_t>(offset));
+#endif
+			if (r < 0)
+			{
+				if (errno == EINTR) continue;
+				ec.assign(errno, generic_category());
+				return -1;
+			}
+			// we hit the end of the file
+			if (r == 0) break;
+
+			ret += int(r);
+			offset += r;
+
+			// advance the buffers past the bytes we just read
+			auto left = std::int64_t(r);
+			while (!bufs.empty() && left >= bufs.front().size())
+			{
+				left -= bufs.front().size();
+				bufs = bufs.subspan(1);
+			}
+			// the file may be shorter than we think
+			if (left > 0) break;
+		}
+		return ret;
+	}
+
+	int posix_file::writev(std::int64_t offset, span<iovec_t const> bufs
+		, error_code& ec)
+	{
+		int ret = 0;
+		// if a write is cut short, this is the remainder of the first buffer
+		iovec_t partial;
+		while (!bufs.empty())
+		{
+			iovec_t const first = partial.empty() ? bufs.front() : partial;
+#if TORRENT_USE_PREADV
+			::iovec vec[16];
+			int const num_bufs = std::min(int(bufs.size()), int(sizeof(vec) / sizeof(vec[0])));
+			vec[0].iov_base = first.data();
+			vec[0].iov_len = static_cast<std::size_t>(first.size());
+			for (int i = 1; i < num_bufs; ++i)
+			{
+				vec[i].iov_base = bufs[i].data();
+				vec[i].iov_len = static_cast<std::size_t>(bufs[i].size());
+			}
+			auto const r = ::pwritev(m_fd, vec, num_bufs, static_cast<off_t>(offset));
+#else
+			auto const r = ::pwrite(m_fd, first.data()
+				, static_cast<std::size_t>(first.size()), static_cast<off_t>(offset));
+#endif
+			if (r < 0)
+			{
+				if (errno == EINTR) continue;
+				ec.assign(errno, generic_category());
+				return -1;
+			}
+			if (r == 0)
+			{
+				ec.assign(errors::file_too_short, libtorrent_category());
+				return -1;
+			}
+
+			ret += int(r);
+			offset += r;
+
+			auto left = std::int64_t(r);
+			if (left < first.size())
+			{
+				partial = first.subspan(left);
+				continue;
+			}
+			left -= first.size();
+			partial = iovec_t{};
+			bufs = bufs.subspan(1);
+			while (!bufs.empty() && left >= bufs.front().size())
+			{
+				left -= bufs.front().size();
+				bufs = bufs.subspan(1);
+			}
+			if (left > 0) partial = bufs.front().subspan(left);
+		}
+		return ret;
+	}
+#endif
+
+	posix_file_pool::posix_file_pool(int size) : m_size(size) {}
+	posix_file_pool::~posix_file_pool() = default;
+
+	std::shared_ptr<posix_file> posix_file_pool::open_file(storage_index_t st
+		, std::string const& p, file_index_t const file_index
+		, file_storage const& fs, open_mode_t const m
+		, error_code& ec, operation_t& op)
+	{
+		// potentially used to hold a reference to a file object that's
+		// about to be destructed. If we have such object we assign it to
+		// this member to be destructed after we release the std::mutex. On some
+		// operating systems (such as OSX) closing a file may take a long
+		// time. We don't want to hold the std::mutex for that.
+		std::shared_ptr<posix_file> defer_destruction1;
+		std::shared_ptr<posix_file> defer_destruction2;
+
+		std::unique_lock<std::mutex> l(m_mutex);
+
+		auto& key_view = m_files.get<0>();
+		auto i = key_view.find(file_id{st, file_index});
+
+		// make sure the write bit is set if we asked for it
+		// it's OK to use a read-write file if we just asked for read. But if
+		// we asked for write, the file we serve back must be opened in write
+		// mode
+		if (i != key_view.end()
+			&& (!(m & open_mode::write) || (i->mode & open_mode::write)))
+		{
+			key_view.modify(i, [&](file_entry& e)
+			{
+				e.last_use = aux::time_now();
+			});
+
+			auto& lru_view = m_files.get<1>();
+			lru_view.relocate(m_files.project<1>(i), lru_view.begin());
+
+			return i->file;
+		}
+
+		if (int(m_files.size()) >= m_size)
+		{
+			// the file cache is at its maximum size, close
+			// the least recently used file
+			defer_destruction1 = remove_oldest(l);
+		}
+
+		l.unlock();
+
+		std::string const fn = fs.file_path(file_index, p);
+		auto f = open_native(fn, m, false);
+#ifdef TORRENT_WINDOWS
+		if (f == nullptr)
+#else
+		if (f < 0)
+#endif
+		{
+			ec.assign(errno, generic_category());
+
+			// if we fail to open a file for writing, and the error is ENOENT,
+			// it is likely because the directory we're creating the file in
+			// does not exist. Create the directory and try again.
+			if (!(m & open_mode::write)
+				|| ec != boost::system::errc::no_such_file_or_directory)
+			{
+				op = operation_t::file_open;
+				return {};
+			}
+
+			// this means the directory the file is in doesn't exist.
+			// so create it
+			ec.clear();
+			create_directories(parent_path(fn), ec);
+			if (ec)
+			{
+				op = operation_t::mkdir;
+				return {};
+			}
+
+			// now that we've created the directories, try again
+			// and make sure we create the file this time
+			f = open_native(fn, m, true);
+#ifdef TORRENT_WINDOWS
+			if (f == nullptr)
+#else
+			if (f < 0)
+#endif
+			{
+				ec.assign(errno, generic_category());
+				op = operation_t::file_open;
+				return {};
+			}
+		}
+
+		file_entry e({st, file_index}, std::make_shared<posix_file>(f), m);
+
+		l.lock();
+
+		// there's an edge case where two threads are racing to insert a newly
+		// opened file, one thread is opening a file for writing and the other
+		// fore reading. If the reading thread wins, it's important that the
+		// thread opening for writing still overwrites the file in the pool,
+		// since a file opened for reading and writing can be used for both.
+		bool added;
+		std::tie(i, added) = key_view.insert(e);
+		if (added == false)
+		{
+			TORRENT_ASSERT(i != key_view.end());
+
+			if ((m & open_mode::write) && !(i->mode & open_mode::write))
+			{
+				key_view.modify(i, [&](file_entry& fe)
+				{
+					defer_destruction2 = std::move(fe.file);
+					fe = std::move(e);
+				});
+			}
+
+			auto& lru_view = m_files.get<1>();
+			lru_view.relocate(m_files.project<1>(i), lru_view.begin());
+		}
+
+		return i->file;
+	}
+
+	std::vector<open_file_state> posix_file_pool::get_status(storage_index_t const st) const
+	{
+		std::vector<open_file_state> ret;
+		{
+			std::unique_lock<std::mutex> l(m_mutex);
+
+			auto& key_view = m_files.get<0>();
+			auto const start = key_view.lower_bound(file_id{st, file_index_t(0)});
+			auto const end = key_view.upper_bound(file_id{st, std::numeric_limits<file_index_t>::max()});
+
+			for (auto i = start; i != end; ++i)
+			{
+				ret.push_back({i->key.second
+					, to_open_state(i->mode)
+					, i->last_use});
+			}
+		}
+		return ret;
+	}
+
+	std::shared_ptr<posix_file> posix_file_pool::remove_oldest(std::unique_lock<std::mutex>&)
+	{
+		auto& lru_view = m_files.get<1>();
+		if (lru_view.size() == 0) return {};
+
+		auto file = std::move(lru_view.back().file);
+		lru_view.pop_back();
+
+		// closing a file may be long running operation (mac os x)
+		// let the caller destruct it once it has released the mutex
+		return file;
+	}
+
+	void posix_file_pool::release(storage_index_t const st, file_index_t file_index)
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+
+		auto& key_view = m_files.get<0>();
+		auto const i = key_view.find(file_id{st, file_index});
+		if (i == key_view.end()) return;
+
+		auto file = std::move(i->file);
+		key_view.erase(i);
+
+		// closing a file may take a long time (mac os x), so make sure
+		// we're not holding the mutex
+		l.unlock();
+	}
+
+	void posix_file_pool::release()
+	{
+		std::vector<std::shared_ptr<posix_file>> defer_destruction;
+
+		std::unique_lock<std::mutex> l(m_mutex);
+		for (auto const& e : m_files)
+			defer_destruction.emplace_back(std::move(e.file));
+		m_files.clear();
+		l.unlock();
+		// the files are closed here while the lock is not held
+	}
+
+	void posix_file_pool::release(storage_index_t const st)
+	{
+		std::vector<std::shared_ptr<posix_file>> defer_destruction;
+
+		std::unique_lock<std::mutex> l(m_mutex);
+
+		auto& key_view = m_files.get<0>();
+		auto const begin = key_view.lower_bound(file_id{st, file_index_t(0)});
+		auto const end = key_view.upper_bound(file_id{st, std::numeric_limits<file_index_t>::max()});
+
+		for (auto it = begin; it != end; ++it)
+			defer_destruction.emplace_back(std::move(it->file));
+
+		if (begin != end) key_view.erase(begin, end);
+		l.unlock();
+		// the files are closed here while the lock is not held
+	}
+
+	void posix_file_pool::resize(int const size)
+	{
+		// these are destructed _after_ the mutex is released
+		std::vector<std::shared_ptr<posix_file>> defer_destruction;
+
+		std::unique_lock<std::mutex> l(m_mutex);
+
+		TORRENT_ASSERT(size > 0);
+
+		if (size == m_size) return;
+		m_size = size;
+
+		// close the least recently used files
+		while (int(m_files.size()) > m_size)
+			defer_destruction.emplace_back(remove_oldest(l));
+	}
+}
+}
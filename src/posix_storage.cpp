@@ -36,11 +36,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/aux_/posix_storage.hpp"
 #include "libtorrent/aux_/path.hpp" // for bufs_size
 #include "libtorrent/aux_/open_mode.hpp"
-#include "libtorrent/aux_/file_pointer.hpp"
+#include "libtorrent/aux_/posix_file_pool.hpp"
 #include "libtorrent/torrent_status.hpp"
-#ifdef TORRENT_WINDOWS
-#include "libtorrent/utf8.hpp"
-#endif
+#include "libtorrent/disk_interface.hpp" // for open_file_state
 
 #if TORRENT_HAS_SYMLINK
 #include <unistd.h> // for symlink()
@@ -61,10 +59,11 @@ static_assert(sizeof(off_t) >= 8, "64 bit file operations are required");
 namespace libtorrent {
 namespace aux {
 
-	posix_storage::posix_storage(storage_params const& p)
+	posix_storage::posix_storage(storage_params const& p, posix_file_pool& pool)
 		: m_files(p.files)
 		, m_save_path(p.path)
 		, m_part_file_name("." + to_hex(p.info_hash) + ".parts")
+		, m_pool(pool)
 	{
 		if (p.mapped_files) m_mapped_files.reset(new file_storage(*p.mapped_files));
 	}
@@ -75,6 +74,10 @@ namespace aux {
 	{
 		error_code ec;
 		if (m_part_file) m_part_file->flush_metadata(ec);
+
+		// this may be called from a different
+		// thread than the disk thread
+		m_pool.release(storage_index());
 	}
 
 	void posix_storage::need_partfile()
@@ -109,16 +112,10 @@ namespace aux {
 					m_part_file->export_file([this, i, &ec](std::int64_t file_offset, span<char> buf)
 					{
 						// move stuff out of the part file
-						file_pointer const f = open_file(i, open_mode::write, file_offset, ec);
+						auto const f = open_file(i, open_mode::write, ec);
 						if (ec) return;
-						int const r = static_cast<int>(fwrite(buf.data(), 1
-							, static_cast<std::size_t>(buf.size()), f.file()));
-						if (r != buf.size())
-						{
-							if (ferror(f.file())) ec.ec.assign(errno, generic_category());
-							else ec.ec.assign(errors::file_too_short, libtorrent_category());
-							return;
-						}
+						iovec_t const v = buf;
+						f->writev(file_offset, v, ec.ec);
 					}, fs.file_offset(i), fs.file_size(i), ec.ec);
 
 					if (ec)
@@ -195,30 +192,18 @@ namespace aux {
 				return ret;
 			}
 
-			file_pointer const f = open_file(file_index, open_mode::read_only
-				, file_offset, ec);
+			auto const f = open_file(file_index, open_mode::read_only, ec);
 			if (ec.ec) return -1;
 
 			// set this unconditionally in case the upper layer would like to treat
 			// short reads as errors
 			ec.operation = operation_t::file_read;
 
-			int ret = 0;
-			for (auto buf : vec)
-			{
-				int const r = static_cast<int>(fread(buf.data(), 1
-					, static_cast<std::size_t>(buf.size()), f.file()));
-				if (r == 0)
-				{
-					if (ferror(f.file())) ec.ec.assign(errno, generic_category());
-					else ec.ec.assign(errors::file_too_short, libtorrent_category());
-					break;
-				}
-				ret += r;
-
-				// the file may be shorter than we think
-				if (r < buf.size()) break;
-			}
+			// the file may be shorter than we think, in which case this is a
+			// short read
+			int const ret = f->readv(file_offset, vec, ec.ec);
+			if (ret == 0 && !ec.ec)
+				ec.ec.assign(errors::file_too_short, libtorrent_category());
 
 			// we either get an error or 0 or more bytes read
 			TORRENT_ASSERT(ec.ec || ret > 0);
@@ -271,27 +256,14 @@ namespace aux {
 				return ret;
 			}
 
-			file_pointer const f = open_file(file_index, open_mode::write
-				, file_offset, ec);
+			auto const f = open_file(file_index, open_mode::write, ec);
 			if (ec.ec) return -1;
 
 			// set this unconditionally in case the upper layer would like to treat
 			// short reads as errors
 			ec.operation = operation_t::file_write;
 
-			int ret = 0;
-			for (auto buf : vec)
-			{
-				auto const r = static_cast<int>(fwrite(buf.data(), 1
-					, static_cast<std::size_t>(buf.size()), f.file()));
-				if (r != buf.size())
-				{
-					if (ferror(f.file())) ec.ec.assign(errno, generic_category());
-					else ec.ec.assign(errors::file_too_short, libtorrent_category());
-					break;
-				}
-				ret += r;
-			}
+			int const ret = f->writev(file_offset, vec, ec.ec);
 
 			// invalidate our stat cache for this file, since
 			// we're writing to it
@@ -321,9 +293,16 @@ namespace aux {
 			, m_file_priority, m_stat_cache, m_save_path, ec);
 	}
 
+	bool posix_storage::piece_in_holes(piece_index_t const piece)
+	{
+		return m_extent_cache.piece_in_holes(files(), m_save_path, m_file_priority, piece);
+	}
+
 	void posix_storage::release_files()
 	{
+		m_pool.release(storage_index());
 		m_stat_cache.clear();
+		m_extent_cache.clear();
 		if (m_part_file)
 		{
 			error_code ignore;
@@ -337,6 +316,10 @@ namespace aux {
 		// release the underlying part file. Otherwise we may not be able to
 		// delete it
 		if (m_part_file) m_part_file.reset();
+
+		// make sure we don't have the files open
+		m_pool.release(storage_index());
+
 		aux::delete_files(files(), m_save_path, m_part_file_name, options, error);
 	}
 
@@ -349,11 +332,15 @@ namespace aux {
 			if (!m_part_file) return;
 			m_part_file->move_partfile(new_save_path, e);
 		};
+		// files have to be closed before they can be moved
+		m_pool.release(storage_index());
+
 		std::tie(ret, m_save_path) = aux::move_storage(files(), m_save_path, sp
 			, std::move(move_partfile), flags, ec);
 
 		// clear the stat cache in case the new location has new files
 		m_stat_cache.clear();
+		m_extent_cache.clear();
 
 		return { ret, m_save_path };
 	}
@@ -370,6 +357,9 @@ namespace aux {
 			else new_path = combine_path(m_save_path, new_filename);
 			std::string new_dir = parent_path(new_path);
 
+			// we don't want to rename the file while it's open
+			m_pool.release(storage_index(), index);
+
 			// create any missing directories that the new filename
 			// lands in
 			create_directories(new_dir, ec.ec);
@@ -410,6 +400,7 @@ namespace aux {
 	void posix_storage::initialize(settings_interface const&, storage_error& ec)
 	{
 		m_stat_cache.reserve(files().num_files());
+		m_extent_cache.clear();
 
 		file_storage const& fs = files();
 		// if some files have priority 0, we need to check if they exist on the
@@ -516,7 +507,7 @@ namespace aux {
 					// there's a race here and some other process truncates the file,
 					// it's not a problem, we won't access empty files ever again
 					ec.ec.clear();
-					file_pointer f = open_file(file_index, aux::open_mode::write, 0, ec);
+					auto const f = open_file(file_index, aux::open_mode::write, ec);
 					if (ec) return;
 				}
 			}
@@ -524,82 +515,25 @@ namespace aux {
 		}
 	}
 
-	file_pointer posix_storage::open_file(file_index_t idx, open_mode_t const mode
-		, std::int64_t const offset, storage_error& ec)
+	std::shared_ptr<posix_file> posix_storage::open_file(file_index_t const idx
+		, open_mode_t const mode, storage_error& ec)
 	{
-		std::string const fn = files().file_path(idx, m_save_path);
-
-		auto const* mode_str = (mode & open_mode::write)
-#ifdef TORRENT_WINDOWS
-			? L"rb+" : L"rb";
-#else
-			? "rb+" : "rb";
-#endif
-
-#ifdef TORRENT_WINDOWS
-		FILE* f = ::_wfopen(convert_to_native_path_string(fn).c_str(), mode_str);
-#else
-		FILE* f = std::fopen(fn.c_str(), mode_str);
-#endif
-		if (f == nullptr)
-		{
-			ec.ec.assign(errno, generic_category());
-
-			// if we fail to open a file for writing, and the error is ENOENT,
-			// it is likely because the directory we're creating the file in
-			// does not exist. Create the directory and try again.
-			if ((mode & open_mode::write)
-				&& ec.ec == boost::system::errc::no_such_file_or_directory)
-			{
-				// this means the directory the file is in doesn't exist.
-				// so create it
-				ec.ec.clear();
-				create_directories(parent_path(fn), ec.ec);
-
-				if (ec.ec)
-				{
-					ec.file(idx);
-					ec.operation = operation_t::mkdir;
-					return file_pointer{};
-				}
-
-				// now that we've created the directories, try again
-				// and make sure we create the file this time ("r+") opens for
-				// reading and writing, but doesn't create the file. "w+" creates
-				// the file and truncates it
-#ifdef TORRENT_WINDOWS
-				f = ::_wfopen(convert_to_native_path_string(fn).c_str(), L"wb+");
-#else
-				f = std::fopen(fn.c_str(), "wb+");
-#endif
-				if (f == nullptr)
-				{
-					ec.ec.assign(errno, generic_category());
-					ec.file(idx);
-					ec.operation = operation_t::file_open;
-					return file_pointer{};
-				}
-			}
-			else
-			{
-				ec.file(idx);
-				ec.operation = operation_t::file_open;
-				return file_pointer{};
-			}
-		}
+		auto f = m_pool.open_file(storage_index(), m_save_path, idx, files()
+			, mode, ec.ec, ec.operation);
+		if (ec.ec) ec.file(idx);
+		return f;
+	}
 
-		if (offset != 0)
-		{
-			if (portable_fseeko(f, offset, SEEK_SET) != 0)
-			{
-				ec.ec.assign(errno, generic_category());
-				ec.file(idx);
-				ec.operation = operation_t::file_seek;
-				return file_pointer{};
-			}
-		}
+	std::vector<open_file_state> posix_storage::get_status() const
+	{
+		return m_pool.get_status(storage_index());
+	}
 
-		return file_pointer{f};
+	bool posix_storage::uses_partfile(file_index_t const index) const
+	{
+		return index < m_file_priority.end_index()
+			&& m_file_priority[index] == dont_download
+			&& use_partfile(index);
 	}
 
 	bool posix_storage::use_partfile(file_index_t const index) const
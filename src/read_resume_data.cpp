@@ -35,6 +35,7 @@ POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <cstdint>
+#include <algorithm>
 
 #include "libtorrent/bdecode.hpp"
 #include "libtorrent/read_resume_data.hpp"
@@ -64,85 +65,8 @@ namespace {
 		}
 	}
 
-} // anonyous namespace
-
-	add_torrent_params read_resume_data(bdecode_node const& rd, error_code& ec
-		, int const piece_limit)
+	void read_trees(bdecode_node const& rd, add_torrent_params& ret)
 	{
-		add_torrent_params ret;
-		if (rd.type() != bdecode_node::dict_t)
-		{
-			ec = errors::not_a_dictionary;
-			return ret;
-		}
-
-		if (bdecode_node const alloc = rd.dict_find_string("allocation"))
-		{
-			ret.storage_mode = (alloc.string_value() == "allocate"
-				|| alloc.string_value() == "full")
-				? storage_mode_allocate : storage_mode_sparse;
-		}
-
-		if (rd.dict_find_string_value("file-format")
-			!= "libtorrent resume file")
-		{
-			ec = errors::invalid_file_tag;
-			return ret;
-		}
-
-		auto info_hash = rd.dict_find_string_value("info-hash");
-		auto info_hash2 = rd.dict_find_string_value("info-hash2");
-		if (info_hash.size() != std::size_t(sha1_hash::size())
-			&& info_hash2.size() != std::size_t(sha256_hash::size()))
-		{
-			ec = errors::missing_info_hash;
-			return ret;
-		}
-
-		ret.name = rd.dict_find_string_value("name").to_string();
-
-		if (info_hash.size() == 20)
-			ret.info_hashes.v1.assign(info_hash.data());
-		if (info_hash2.size() == 32)
-			ret.info_hashes.v2.assign(info_hash2.data());
-
-		bdecode_node const info = rd.dict_find_dict("info");
-		if (info)
-		{
-			// verify the info-hash of the metadata stored in the resume file matches
-			// the torrent we're loading
-			info_hash_t const resume_ih(hasher(info.data_section()).final()
-				, hasher256(info.data_section()).final());
-
-			// if url is set, the info_hash is not actually the info-hash of the
-			// torrent, but the hash of the URL, until we have the full torrent
-			// only require the info-hash to match if we actually passed in one
-			if ((!ret.info_hashes.has_v1() || resume_ih.v1 == ret.info_hashes.v1)
-				&& (!ret.info_hashes.has_v2() || resume_ih.v2 == ret.info_hashes.v2))
-			{
-				ret.ti = std::make_shared<torrent_info>(resume_ih);
-
-				error_code err;
-				if (!ret.ti->parse_info_section(info, err, piece_limit))
-				{
-					ec = err;
-				}
-				else
-				{
-					// time_t might be 32 bit if we're unlucky, but there isn't
-					// much to do about it
-					ret.ti->internal_set_creation_date(static_cast<std::time_t>(
-						rd.dict_find_int_value("creation date", 0)));
-					ret.ti->internal_set_creator(rd.dict_find_string_value("created by", ""));
-					ret.ti->internal_set_comment(rd.dict_find_string_value("comment", ""));
-				}
-			}
-		}
-
-#if TORRENT_ABI_VERSION < 3
-		ret.info_hash = ret.info_hashes.get_best();
-#endif
-
 		bdecode_node const trees = rd.dict_find_list("trees");
 		if (trees)
 		{
@@ -177,6 +101,12 @@ namespace {
 					ret.merkle_tree_mask.back().emplace_back(bit == '1');
 			}
 		}
+	}
+
+	// the small fields, that are saved in every record
+	void read_state(bdecode_node const& rd, add_torrent_params& ret)
+	{
+		ret.name = rd.dict_find_string_value("name").to_string();
 
 		ret.total_uploaded = rd.dict_find_int_value("total_uploaded");
 		ret.total_downloaded = rd.dict_find_int_value("total_downloaded");
@@ -240,30 +170,6 @@ namespace {
 		ret.added_time = std::time_t(rd.dict_find_int_value("added_time", 0));
 		ret.completed_time = std::time_t(rd.dict_find_int_value("completed_time", 0));
 
-		// load file priorities except if the add_torrent_param file was set to
-		// override resume data
-		bdecode_node const file_priority = rd.dict_find_list("file_priority");
-		if (file_priority)
-		{
-			int const num_files = file_priority.list_size();
-			ret.file_priorities.resize(aux::numeric_cast<std::size_t>(num_files)
-				, default_priority);
-			for (int i = 0; i < num_files; ++i)
-			{
-				auto const idx = static_cast<std::size_t>(i);
-				ret.file_priorities[idx] = aux::clamp(
-					download_priority_t(static_cast<std::uint8_t>(
-						file_priority.list_int_value_at(i
-							, static_cast<std::uint8_t>(default_priority))))
-						, dont_download, top_priority);
-				// this is suspicious, leave seed mode
-				if (ret.file_priorities[idx] == dont_download)
-				{
-					ret.flags &= ~torrent_flags::seed_mode;
-				}
-			}
-		}
-
 		bdecode_node const trackers = rd.dict_find_list("trackers");
 		if (trackers)
 		{
@@ -322,6 +228,53 @@ namespace {
 			}
 		}
 
+		// parse unfinished pieces
+		if (bdecode_node const unfinished_entry = rd.dict_find_list("unfinished"))
+		{
+			for (int i = 0; i < unfinished_entry.list_size(); ++i)
+			{
+				bdecode_node const e = unfinished_entry.list_at(i);
+				if (e.type() != bdecode_node::dict_t) continue;
+				piece_index_t const piece = piece_index_t(int(e.dict_find_int_value("piece", -1)));
+				if (piece < piece_index_t(0)) continue;
+
+				bdecode_node const bitmask = e.dict_find_string("bitmask");
+				if (!bitmask || bitmask.string_length() == 0) continue;
+				ret.unfinished_pieces[piece].assign(
+					bitmask.string_ptr(), bitmask.string_length() * CHAR_BIT);
+			}
+		}
+	}
+
+	void read_file_priorities(bdecode_node const& rd, add_torrent_params& ret)
+	{
+		// load file priorities except if the add_torrent_param file was set to
+		// override resume data
+		bdecode_node const file_priority = rd.dict_find_list("file_priority");
+		if (file_priority)
+		{
+			int const num_files = file_priority.list_size();
+			ret.file_priorities.resize(aux::numeric_cast<std::size_t>(num_files)
+				, default_priority);
+			for (int i = 0; i < num_files; ++i)
+			{
+				auto const idx = static_cast<std::size_t>(i);
+				ret.file_priorities[idx] = aux::clamp(
+					download_priority_t(static_cast<std::uint8_t>(
+						file_priority.list_int_value_at(i
+							, static_cast<std::uint8_t>(default_priority))))
+						, dont_download, top_priority);
+				// this is suspicious, leave seed mode
+				if (ret.file_priorities[idx] == dont_download)
+				{
+					ret.flags &= ~torrent_flags::seed_mode;
+				}
+			}
+		}
+	}
+
+	void read_pieces(bdecode_node const& rd, add_torrent_params& ret)
+	{
 		// some sanity checking. Maybe we shouldn't be in seed mode anymore
 		if (bdecode_node const pieces = rd.dict_find_string("pieces"))
 		{
@@ -340,7 +293,10 @@ namespace {
 				else ret.verified_pieces.clear_bit(i);
 			}
 		}
+	}
 
+	void read_piece_priorities(bdecode_node const& rd, add_torrent_params& ret)
+	{
 		if (bdecode_node const piece_priority = rd.dict_find_string("piece_priority"))
 		{
 			char const* prio_str = piece_priority.string_ptr();
@@ -353,6 +309,181 @@ namespace {
 					, static_cast<std::uint8_t>(top_priority)));
 			}
 		}
+	}
+
+	std::vector<tcp::endpoint> read_peers(bdecode_node const& rd
+		, char const* key, char const* key6)
+	{
+		int const v6_size = 18;
+		int const v4_size = 6;
+		using namespace libtorrent::aux; // for read_*_endpoint()
+		std::vector<tcp::endpoint> ret;
+		if (bdecode_node const peers_entry = rd.dict_find_string(key))
+		{
+			char const* ptr = peers_entry.string_ptr();
+			for (int i = v4_size - 1; i < peers_entry.string_length(); i += v4_size)
+				ret.push_back(read_v4_endpoint<tcp::endpoint>(ptr));
+		}
+
+		if (bdecode_node const peers_entry = rd.dict_find_string(key6))
+		{
+			char const* ptr = peers_entry.string_ptr();
+			for (int i = v6_size - 1; i < peers_entry.string_length(); i += v6_size)
+				ret.push_back(read_v6_endpoint<tcp::endpoint>(ptr));
+		}
+		return ret;
+	}
+
+	// applies a record written by aux::write_resume_journal() to the resume
+	// data in ``ret``. Fields that are not in the record are left as they are
+	void apply_journal_record(bdecode_node const& rd, add_torrent_params& ret
+		, error_code& ec)
+	{
+		// the record must be for the same torrent
+		auto const info_hash = rd.dict_find_string_value("info-hash");
+		auto const info_hash2 = rd.dict_find_string_value("info-hash2");
+		info_hash_t ih;
+		if (info_hash.size() == 20) ih.v1.assign(info_hash.data());
+		if (info_hash2.size() == 32) ih.v2.assign(info_hash2.data());
+		if (ih != ret.info_hashes)
+		{
+			ec = errors::mismatching_info_hash;
+			return;
+		}
+
+		ret.trackers.clear();
+		ret.tracker_tiers.clear();
+		ret.url_seeds.clear();
+		ret.http_seeds.clear();
+		ret.renamed_files.clear();
+		ret.unfinished_pieces.clear();
+		read_state(rd, ret);
+
+		if (rd.dict_find_list("trees"))
+		{
+			ret.merkle_trees.clear();
+			ret.verified_leaf_hashes.clear();
+			ret.merkle_tree_mask.clear();
+			read_trees(rd, ret);
+		}
+
+		read_file_priorities(rd, ret);
+		read_pieces(rd, ret);
+		read_piece_priorities(rd, ret);
+
+		if (bdecode_node const have = rd.dict_find_list("have"))
+		{
+			for (int i = 0; i < have.list_size(); ++i)
+			{
+				piece_index_t const piece(int(have.list_int_value_at(i, -1)));
+				if (piece < piece_index_t(0) || piece >= ret.have_pieces.end_index())
+				{
+					ec = errors::invalid_piece_index;
+					return;
+				}
+				ret.have_pieces.set_bit(piece);
+			}
+		}
+
+		auto removed = read_peers(rd, "removed_peers", "removed_peers6");
+		if (!removed.empty())
+		{
+			std::sort(removed.begin(), removed.end());
+			ret.peers.erase(std::remove_if(ret.peers.begin(), ret.peers.end()
+				, [&](tcp::endpoint const& ep)
+				{ return std::binary_search(removed.begin(), removed.end(), ep); })
+				, ret.peers.end());
+		}
+
+		auto const added = read_peers(rd, "added_peers", "added_peers6");
+		ret.peers.insert(ret.peers.end(), added.begin(), added.end());
+
+		if (rd.dict_find_string("banned_peers") || rd.dict_find_string("banned_peers6"))
+			ret.banned_peers = read_peers(rd, "banned_peers", "banned_peers6");
+	}
+
+} // anonyous namespace
+
+	add_torrent_params read_resume_data(bdecode_node const& rd, error_code& ec
+		, int const piece_limit)
+	{
+		add_torrent_params ret;
+		if (rd.type() != bdecode_node::dict_t)
+		{
+			ec = errors::not_a_dictionary;
+			return ret;
+		}
+
+		if (bdecode_node const alloc = rd.dict_find_string("allocation"))
+		{
+			ret.storage_mode = (alloc.string_value() == "allocate"
+				|| alloc.string_value() == "full")
+				? storage_mode_allocate : storage_mode_sparse;
+		}
+
+		if (rd.dict_find_string_value("file-format")
+			!= "libtorrent resume file")
+		{
+			ec = errors::invalid_file_tag;
+			return ret;
+		}
+
+		auto info_hash = rd.dict_find_string_value("info-hash");
+		auto info_hash2 = rd.dict_find_string_value("info-hash2");
+		if (info_hash.size() != std::size_t(sha1_hash::size())
+			&& info_hash2.size() != std::size_t(sha256_hash::size()))
+		{
+			ec = errors::missing_info_hash;
+			return ret;
+		}
+
+		if (info_hash.size() == 20)
+			ret.info_hashes.v1.assign(info_hash.data());
+		if (info_hash2.size() == 32)
+			ret.info_hashes.v2.assign(info_hash2.data());
+
+		bdecode_node const info = rd.dict_find_dict("info");
+		if (info)
+		{
+			// verify the info-hash of the metadata stored in the resume file matches
+			// the torrent we're loading
+			info_hash_t const resume_ih(hasher(info.data_section()).final()
+				, hasher256(info.data_section()).final());
+
+			// if url is set, the info_hash is not actually the info-hash of the
+			// torrent, but the hash of the URL, until we have the full torrent
+			// only require the info-hash to match if we actually passed in one
+			if ((!ret.info_hashes.has_v1() || resume_ih.v1 == ret.info_hashes.v1)
+				&& (!ret.info_hashes.has_v2() || resume_ih.v2 == ret.info_hashes.v2))
+			{
+				ret.ti = std::make_shared<torrent_info>(resume_ih);
+
+				error_code err;
+				if (!ret.ti->parse_info_section(info, err, piece_limit))
+				{
+					ec = err;
+				}
+				else
+				{
+					// time_t might be 32 bit if we're unlucky, but there isn't
+					// much to do about it
+					ret.ti->internal_set_creation_date(static_cast<std::time_t>(
+						rd.dict_find_int_value("creation date", 0)));
+					ret.ti->internal_set_creator(rd.dict_find_string_value("created by", ""));
+					ret.ti->internal_set_comment(rd.dict_find_string_value("comment", ""));
+				}
+			}
+		}
+
+#if TORRENT_ABI_VERSION < 3
+		ret.info_hash = ret.info_hashes.get_best();
+#endif
+
+		read_trees(rd, ret);
+		read_state(rd, ret);
+		read_file_priorities(rd, ret);
+		read_pieces(rd, ret);
+		read_piece_priorities(rd, ret);
 
 		int const v6_size = 18;
 		int const v4_size = 6;
@@ -385,23 +516,6 @@ namespace {
 				ret.banned_peers.push_back(read_v6_endpoint<tcp::endpoint>(ptr));
 		}
 
-		// parse unfinished pieces
-		if (bdecode_node const unfinished_entry = rd.dict_find_list("unfinished"))
-		{
-			for (int i = 0; i < unfinished_entry.list_size(); ++i)
-			{
-				bdecode_node const e = unfinished_entry.list_at(i);
-				if (e.type() != bdecode_node::dict_t) continue;
-				piece_index_t const piece = piece_index_t(int(e.dict_find_int_value("piece", -1)));
-				if (piece < piece_index_t(0)) continue;
-
-				bdecode_node const bitmask = e.dict_find_string("bitmask");
-				if (!bitmask || bitmask.string_length() == 0) continue;
-				ret.unfinished_pieces[piece].assign(
-					bitmask.string_ptr(), bitmask.string_length() * CHAR_BIT);
-			}
-		}
-
 		// we're loading this torrent from resume data. There's no need to
 		// re-save the resume data immediately.
 		ret.flags &= ~torrent_flags::need_save_resume;
@@ -441,4 +555,67 @@ namespace {
 		if (ec) throw system_error(ec);
 		return ret;
 	}
+
+	add_torrent_params read_resume_data_journal(span<char const> buffer
+		, error_code& ec, load_torrent_limits const& cfg)
+	{
+		add_torrent_params ret;
+		bool have_state = false;
+		while (!buffer.empty())
+		{
+			int pos;
+			bdecode_node const record = bdecode(buffer, ec, &pos
+				, cfg.max_decode_depth, cfg.max_decode_tokens);
+			if (ec)
+			{
+				// a record that fails to decode is the last one, since we
+				// can't tell where the next one would start. Once we have
+				// state, it's an append that was cut short, for instance in
+				// the middle of a length prefix, or left as zeros by a crash
+				if (have_state)
+				{
+					ec.clear();
+					break;
+				}
+				return add_torrent_params();
+			}
+			buffer = buffer.subspan(record.data_section().size());
+
+			if (record.type() == bdecode_node::dict_t
+				&& record.dict_find_string_value("file-format") == "libtorrent resume journal")
+			{
+				if (!have_state)
+				{
+					ec = errors::invalid_file_tag;
+					return add_torrent_params();
+				}
+				apply_journal_record(record, ret, ec);
+			}
+			else
+			{
+				// a full record replaces everything before it
+				ret = read_resume_data(record, ec, cfg.max_pieces);
+				have_state = true;
+			}
+			if (ec) return add_torrent_params();
+		}
+
+		if (!have_state)
+		{
+			ec = errors::invalid_file_tag;
+			return add_torrent_params();
+		}
+
+		ret.flags &= ~torrent_flags::need_save_resume;
+		return ret;
+	}
+
+	add_torrent_params read_resume_data_journal(span<char const> buffer
+		, load_torrent_limits const& cfg)
+	{
+		error_code ec;
+		auto ret = read_resume_data_journal(buffer, ec, cfg);
+		if (ec) throw system_error(ec);
+		return ret;
+	}
 }
@@ -519,8 +519,8 @@ bool ssl_server_name_callback(ssl::stream_handle_type stream_handle, std::string
 		, m_download_rate(peer_connection::download_channel)
 		, m_upload_rate(peer_connection::upload_channel)
 		, m_host_resolver(m_io_context)
-		, m_tracker_manager(
-			std::bind(&session_impl::send_udp_packet_listen, this, _1, _2, _3, _4, _5)
+		, m_tracker_manager(m_io_context
+			, std::bind(&session_impl::send_udp_packet_listen, this, _1, _2, _3, _4, _5)
 			, std::bind(&session_impl::send_udp_packet_hostname_listen, this, _1, _2, _3, _4, _5, _6)
 			, m_stats_counters
 			, m_host_resolver
@@ -2482,7 +2482,25 @@ namespace {
 #endif
 			m_utp_socket_manager;
 
+		s->sock.begin_batch();
 		mgr.writable();
+		flush_udp_batch(s);
+	}
+
+	void session_impl::flush_udp_batch(std::shared_ptr<session_udp_socket> const& s)
+	{
+		error_code ec;
+		s->sock.flush_batch(ec);
+
+		// the packets that didn't fit in the socket's send buffer are kept
+		// by the socket, and sent once it's writable again
+		if ((ec == error::would_block || ec == error::try_again) && !s->write_blocked)
+		{
+			s->write_blocked = true;
+			ADD_OUTSTANDING_ASYNC("session_impl::on_udp_writeable");
+			s->sock.async_write(std::bind(&session_impl::on_udp_writeable
+				, this, s, _1));
+		}
 	}
 
 
@@ -2526,9 +2544,13 @@ namespace {
 #endif
 			m_utp_socket_manager;
 
+		// responses and acks sent while handling the incoming packets are
+		// queued up and sent together once the socket has been drained
+		s->sock.begin_batch();
+
 		for (;;)
 		{
-			aux::array<udp_socket::packet, 50> p;
+			aux::array<udp_socket::packet, udp_socket::read_batch_size> p;
 			error_code err;
 			int const num_packets = s->sock.read(p, err);
 
@@ -2622,6 +2644,7 @@ namespace {
 				{
 					// fatal errors. Don't try to read from this socket again
 					mgr.socket_drained();
+					flush_udp_batch(s);
 					return;
 				}
 				// non-fatal UDP errors get here, we should re-issue the read.
@@ -2630,6 +2653,7 @@ namespace {
 		}
 
 		mgr.socket_drained();
+		flush_udp_batch(s);
 
 		ADD_OUTSTANDING_ASYNC("session_impl::on_udp_packet");
 		s->sock.async_read(make_handler([this, socket, ls, ssl](error_code const& e)
@@ -3495,27 +3519,6 @@ namespace {
 			recalculate_auto_managed_torrents();
 		}
 
-		// --------------------------------------------------------------
-		// check for incoming connections that might have timed out
-		// --------------------------------------------------------------
-
-		for (auto i = m_connections.begin(); i != m_connections.end();)
-		{
-			peer_connection* p = (*i).get();
-			++i;
-			// ignore connections that already have a torrent, since they
-			// are ticked through the torrents' second_tick
-			if (!p->associated_torrent().expired()) continue;
-
-			// TODO: have a separate list for these connections, instead of having to loop through all of them
-			int timeout = m_settings.get_int(settings_pack::handshake_timeout);
-#if TORRENT_USE_I2P
-			timeout *= is_i2p(p->get_socket()) ? 4 : 1;
-#endif
-			if (m_last_tick - p->connected_time () > seconds(timeout))
-				p->disconnect(errors::timed_out, operation_t::bittorrent);
-		}
-
 		// --------------------------------------------------------------
 		// second_tick every torrent (that wants it)
 		// --------------------------------------------------------------
@@ -3540,6 +3543,14 @@ namespace {
 			if (!t.want_tick()) --i;
 		}
 
+		// --------------------------------------------------------------
+		// tick the peers that have something due
+		// --------------------------------------------------------------
+
+		m_peer_timers.advance(m_peer_timers.now() + 1
+			, [tick_interval_ms](aux::timer_wheel_entry& entry)
+			{ static_cast<peer_connection&>(entry).timer_tick(tick_interval_ms); });
+
 		// TODO: this should apply to all bandwidth channels
 		if (m_settings.get_bool(settings_pack::rate_limit_ip_overhead))
 		{
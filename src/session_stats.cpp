@@ -335,9 +335,27 @@ namespace {
 
 		METRIC(disk, disk_blocks_in_use)
 
+		// disk buffers are allocated from 2 MiB slabs. These are the number of
+		// slabs, how many of them are backed by explicit huge pages, and the
+		// number of free blocks in the slabs. Free blocks are either in the
+		// central free list, or cached by the threads that freed them
+		METRIC(disk, disk_arena_slabs)
+		METRIC(disk, disk_arena_hugepage_slabs)
+		METRIC(disk, disk_arena_free_blocks)
+		METRIC(disk, disk_arena_cached_blocks)
+
 		// ``queued_disk_jobs`` is the number of disk jobs currently queued,
 		// waiting to be executed by a disk thread.
 		METRIC(disk, queued_disk_jobs)
+
+		// when per-device disk job queues are enabled (see
+		// settings_pack::disk_device_threads), the number of devices with a
+		// queue of their own, the number of jobs queued on the one with the
+		// most jobs queued, and the largest average time jobs wait in a
+		// device queue, across devices (in microseconds)
+		METRIC(disk, disk_device_queues)
+		METRIC(disk, disk_device_max_queue_depth)
+		METRIC(disk, disk_device_max_queue_latency)
 		METRIC(disk, num_running_disk_jobs)
 		METRIC(disk, num_read_jobs)
 		METRIC(disk, num_write_jobs)
@@ -372,6 +390,22 @@ namespace {
 		// hash a piece (when verifying against the piece hash)
 		METRIC(disk, num_read_back)
 
+		// the number of pieces found to be entirely in holes of sparse files
+		// when checking a torrent. These are not read, and are considered
+		// missing
+		METRIC(disk, num_hole_pieces_skipped)
+
+		// the number of times a thread had to wait for another thread to
+		// access the store buffer, the blocks that have been submitted to the
+		// disk subsystem for writing but not yet been written
+		METRIC(disk, store_buffer_contention)
+
+		// the number of disk buffers allocated from the allocating thread's
+		// own cache, and the number of times a thread's cache was refilled
+		// from, or flushed to, the central free list, which requires a lock
+		METRIC(disk, disk_arena_cache_hits)
+		METRIC(disk, disk_arena_central_transfers)
+
 		// cumulative time spent in various disk jobs, as well
 		// as total for all disk jobs. Measured in microseconds
 		METRIC(disk, disk_read_time)
@@ -379,6 +413,11 @@ namespace {
 		METRIC(disk, disk_hash_time)
 		METRIC(disk, disk_job_time)
 
+		// the number of jobs issued from per-device queues, and the
+		// cumulative time they spent queued, in microseconds
+		METRIC(disk, disk_device_queue_time)
+		METRIC(disk, disk_device_jobs)
+
 		// for each kind of disk job, a counter of how many jobs of that kind
 		// are currently blocked by a disk fence
 		METRIC(disk, num_fenced_read)
@@ -220,6 +220,8 @@ namespace libtorrent {
 		SET(ssrf_mitigation, true, nullptr),
 		SET(allow_idna, false, nullptr),
 		SET(enable_set_file_valid_data, false, nullptr),
+		SET(hash_on_write, false, nullptr),
+		SET(disk_buffer_hugepages, false, nullptr),
 	}});
 
 	CONSTEXPR_SETTINGS
@@ -376,6 +378,9 @@ namespace libtorrent {
 		SET(dht_sample_infohashes_interval, 21600, nullptr),
 		SET(dht_max_infohashes_sample_count, 20, nullptr),
 		SET(max_piece_count, 0x200000, nullptr),
+		SET(max_udp_announces_per_second, 50, nullptr),
+		SET(disk_device_threads, 0, nullptr),
+		SET(disk_device_max_in_flight, 0, nullptr),
 	}});
 
 #undef SET
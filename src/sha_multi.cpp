@@ -0,0 +1,887 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/sha_multi.hpp"
+#include "libtorrent/aux_/cpuid.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/assert.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if TORRENT_HAS_SSE && (defined __GNUC__ || (defined _MSC_VER && _MSC_VER >= 1900))
+#define TORRENT_HAS_SHA_SIMD 1
+#else
+#define TORRENT_HAS_SHA_SIMD 0
+#endif
+
+#if TORRENT_HAS_SHA_SIMD
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+#include <immintrin.h>
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+#endif
+
+// the functions using the SHA extensions and AVX2 are compiled for those
+// instruction sets, without enabling them for the rest of the library. They
+// are only called if the CPU supports them
+#if TORRENT_HAS_SHA_SIMD && defined __GNUC__
+#define TORRENT_TARGET_SHA_NI __attribute__((target("sha,sse4.1,ssse3")))
+#define TORRENT_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TORRENT_TARGET_SHA_NI
+#define TORRENT_TARGET_AVX2
+#endif
+
+namespace libtorrent {
+namespace aux {
+
+namespace {
+
+#if TORRENT_HAS_SHA_SIMD
+
+	std::uint32_t const sha1_init[5] = {
+		0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+	};
+
+	std::uint32_t const sha256_init[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+
+	std::uint32_t const sha256_k[64] = {
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+	};
+
+	template <typename Hash>
+	Hash to_hash(std::uint32_t const* words)
+	{
+		Hash ret;
+		auto* out = reinterpret_cast<std::uint8_t*>(ret.data());
+		for (int i = 0; i < int(Hash::size()) / 4; ++i)
+		{
+			out[i * 4] = std::uint8_t(words[i] >> 24);
+			out[i * 4 + 1] = std::uint8_t(words[i] >> 16);
+			out[i * 4 + 2] = std::uint8_t(words[i] >> 8);
+			out[i * 4 + 3] = std::uint8_t(words[i]);
+		}
+		return ret;
+	}
+
+	// a buffer to be hashed, split up into the 64 byte blocks SHA-1 and
+	// SHA-256 operate on. The last one or two blocks, which hold the padding
+	// and the message length, are copied into tail
+	struct message
+	{
+		void assign(span<char const> buf)
+		{
+			data = reinterpret_cast<std::uint8_t const*>(buf.data());
+			full_blocks = int(buf.size() / 64);
+			auto const rem = std::size_t(buf.size() % 64);
+			tail.fill(0);
+			if (rem > 0) std::memcpy(tail.data(), data + std::ptrdiff_t(full_blocks) * 64, rem);
+			tail[rem] = 0x80;
+			tail_blocks = rem + 9 <= 64 ? 1 : 2;
+			std::uint64_t const bits = std::uint64_t(buf.size()) * 8;
+			std::size_t const end = std::size_t(tail_blocks) * 64;
+			for (std::size_t i = 0; i < 8; ++i)
+				tail[end - 1 - i] = std::uint8_t(bits >> (i * 8));
+		}
+
+		int num_blocks() const { return full_blocks + tail_blocks; }
+
+		std::uint8_t const* block(int const i) const
+		{
+			return i < full_blocks
+				? data + std::ptrdiff_t(i) * 64
+				: tail.data() + (i - full_blocks) * 64;
+		}
+
+		std::uint8_t const* data = nullptr;
+		int full_blocks = 0;
+		int tail_blocks = 0;
+		std::array<std::uint8_t, 128> tail;
+	};
+
+	int num_sha_blocks(span<char const> buf)
+	{
+		return int((buf.size() + 9 + 63) / 64);
+	}
+
+	// 4 rounds of SHA-256, using message words [I * 4, I * 4 + 4). The message
+	// schedule is computed 4 words at a time, in msg[I % 4]
+	template <int I>
+	TORRENT_TARGET_SHA_NI
+	void sha256_ni_rounds(__m128i& state0, __m128i& state1
+		, __m128i (&msg)[4], std::uint8_t const* data)
+	{
+		__m128i& w = msg[I & 3];
+		if (I < 4)
+		{
+			__m128i const mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+			w = _mm_shuffle_epi8(_mm_loadu_si128(
+				reinterpret_cast<__m128i const*>(data + (I & 3) * 16)), mask);
+		}
+		else
+		{
+			w = _mm_sha256msg1_epu32(w, msg[(I + 1) & 3]);
+			w = _mm_add_epi32(w, _mm_alignr_epi8(msg[(I + 3) & 3], msg[(I + 2) & 3], 4));
+			w = _mm_sha256msg2_epu32(w, msg[(I + 3) & 3]);
+		}
+		__m128i const k = _mm_add_epi32(w, _mm_loadu_si128(
+			reinterpret_cast<__m128i const*>(sha256_k + I * 4)));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, k);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(k, 0x0e));
+	}
+
+	// 4 rounds of SHA-1, using message words [G * 4, G * 4 + 4)
+	template <int G>
+	TORRENT_TARGET_SHA_NI
+	void sha1_ni_rounds(__m128i& abcd, __m128i& e_next
+		, __m128i (&msg)[4], std::uint8_t const* data)
+	{
+		__m128i& w = msg[G & 3];
+		if (G < 4)
+		{
+			__m128i const mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+			w = _mm_shuffle_epi8(_mm_loadu_si128(
+				reinterpret_cast<__m128i const*>(data + (G & 3) * 16)), mask);
+		}
+		__m128i const e = G == 0
+			? _mm_add_epi32(e_next, w)
+			: _mm_sha1nexte_epu32(e_next, w);
+		e_next = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e, G / 5);
+
+		// the message words needed by the following rounds
+		if (G >= 3 && G <= 18)
+			msg[(G + 1) & 3] = _mm_sha1msg2_epu32(msg[(G + 1) & 3], w);
+		if (G >= 2 && G <= 17)
+			msg[(G + 2) & 3] = _mm_xor_si128(msg[(G + 2) & 3], w);
+		if (G >= 1 && G <= 16)
+			msg[(G + 3) & 3] = _mm_sha1msg1_epu32(msg[(G + 3) & 3], w);
+	}
+
+	// SHA-256 using the SHA extensions, one buffer at a time
+	TORRENT_TARGET_SHA_NI
+	void sha256_ni_blocks(std::uint32_t* state, std::uint8_t const* data, int num_blocks)
+	{
+		// the rounds instructions operate on the state as ABEF and CDGH
+		__m128i tmp = _mm_loadu_si128(reinterpret_cast<__m128i const*>(state));
+		__m128i state1 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(state + 4));
+		tmp = _mm_shuffle_epi32(tmp, 0xb1);
+		state1 = _mm_shuffle_epi32(state1, 0x1b);
+		__m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+		state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+		for (; num_blocks > 0; --num_blocks, data += 64)
+		{
+			__m128i const abef = state0;
+			__m128i const cdgh = state1;
+			__m128i msg[4];
+
+			sha256_ni_rounds<0>(state0, state1, msg, data);
+			sha256_ni_rounds<1>(state0, state1, msg, data);
+			sha256_ni_rounds<2>(state0, state1, msg, data);
+			sha256_ni_rounds<3>(state0, state1, msg, data);
+			sha256_ni_rounds<4>(state0, state1, msg, data);
+			sha256_ni_rounds<5>(state0, state1, msg, data);
+			sha256_ni_rounds<6>(state0, state1, msg, data);
+			sha256_ni_rounds<7>(state0, state1, msg, data);
+			sha256_ni_rounds<8>(state0, state1, msg, data);
+			sha256_ni_rounds<9>(state0, state1, msg, data);
+			sha256_ni_rounds<10>(state0, state1, msg, data);
+			sha256_ni_rounds<11>(state0, state1, msg, data);
+			sha256_ni_rounds<12>(state0, state1, msg, data);
+			sha256_ni_rounds<13>(state0, state1, msg, data);
+			sha256_ni_rounds<14>(state0, state1, msg, data);
+			sha256_ni_rounds<15>(state0, state1, msg, data);
+
+			state0 = _mm_add_epi32(state0, abef);
+			state1 = _mm_add_epi32(state1, cdgh);
+		}
+
+		tmp = _mm_shuffle_epi32(state0, 0x1b);
+		state1 = _mm_shuffle_epi32(state1, 0xb1);
+		state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+		state1 = _mm_alignr_epi8(state1, tmp, 8);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(state), state0);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), state1);
+	}
+
+	// SHA-1 using the SHA extensions, one buffer at a time
+	TORRENT_TARGET_SHA_NI
+	void sha1_ni_blocks(std::uint32_t* state, std::uint8_t const* data, int num_blocks)
+	{
+		__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(
+			reinterpret_cast<__m128i const*>(state)), 0x1b);
+		__m128i e0 = _mm_set_epi32(int(state[4]), 0, 0, 0);
+
+		for (; num_blocks > 0; --num_blocks, data += 64)
+		{
+			__m128i const abcd_save = abcd;
+			__m128i const e_save = e0;
+			__m128i msg[4];
+			__m128i e_next = e0;
+
+			sha1_ni_rounds<0>(abcd, e_next, msg, data);
+			sha1_ni_rounds<1>(abcd, e_next, msg, data);
+			sha1_ni_rounds<2>(abcd, e_next, msg, data);
+			sha1_ni_rounds<3>(abcd, e_next, msg, data);
+			sha1_ni_rounds<4>(abcd, e_next, msg, data);
+			sha1_ni_rounds<5>(abcd, e_next, msg, data);
+			sha1_ni_rounds<6>(abcd, e_next, msg, data);
+			sha1_ni_rounds<7>(abcd, e_next, msg, data);
+			sha1_ni_rounds<8>(abcd, e_next, msg, data);
+			sha1_ni_rounds<9>(abcd, e_next, msg, data);
+			sha1_ni_rounds<10>(abcd, e_next, msg, data);
+			sha1_ni_rounds<11>(abcd, e_next, msg, data);
+			sha1_ni_rounds<12>(abcd, e_next, msg, data);
+			sha1_ni_rounds<13>(abcd, e_next, msg, data);
+			sha1_ni_rounds<14>(abcd, e_next, msg, data);
+			sha1_ni_rounds<15>(abcd, e_next, msg, data);
+			sha1_ni_rounds<16>(abcd, e_next, msg, data);
+			sha1_ni_rounds<17>(abcd, e_next, msg, data);
+			sha1_ni_rounds<18>(abcd, e_next, msg, data);
+			sha1_ni_rounds<19>(abcd, e_next, msg, data);
+
+			e0 = _mm_sha1nexte_epu32(e_next, e_save);
+			abcd = _mm_add_epi32(abcd, abcd_save);
+		}
+
+		abcd = _mm_shuffle_epi32(abcd, 0x1b);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(state), abcd);
+		state[4] = std::uint32_t(_mm_extract_epi32(e0, 3));
+	}
+
+	using lanes_t = std::array<message const*, 8>;
+	using lane_digests_t = std::array<std::array<std::uint32_t, 8>, 8>;
+
+	template <int N>
+	TORRENT_TARGET_AVX2
+	__m256i rotr(__m256i const x)
+	{
+		return _mm256_or_si256(_mm256_srli_epi32(x, N), _mm256_slli_epi32(x, 32 - N));
+	}
+
+	template <int N>
+	TORRENT_TARGET_AVX2
+	__m256i rotl(__m256i const x)
+	{
+		return _mm256_or_si256(_mm256_slli_epi32(x, N), _mm256_srli_epi32(x, 32 - N));
+	}
+
+	// loads the 16 words of the current block of each lane, byte swapped, and
+	// transposed so that w[t] holds word t of all lanes
+	TORRENT_TARGET_AVX2
+	void load_lanes(std::array<std::uint8_t const*, 8> const& blocks, __m256i* w)
+	{
+		__m256i const bswap = _mm256_set_epi8(
+			12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3
+			, 12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+		for (int half = 0; half < 2; ++half)
+		{
+			__m256i r[8];
+			for (std::size_t l = 0; l < 8; ++l)
+				r[l] = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(blocks[l] + half * 32));
+
+			__m256i const t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+			__m256i const t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+			__m256i const t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+			__m256i const t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+			__m256i const t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+			__m256i const t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+			__m256i const t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+			__m256i const t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+
+			__m256i const u0 = _mm256_unpacklo_epi64(t0, t2);
+			__m256i const u1 = _mm256_unpackhi_epi64(t0, t2);
+			__m256i const u2 = _mm256_unpacklo_epi64(t1, t3);
+			__m256i const u3 = _mm256_unpackhi_epi64(t1, t3);
+			__m256i const u4 = _mm256_unpacklo_epi64(t4, t6);
+			__m256i const u5 = _mm256_unpackhi_epi64(t4, t6);
+			__m256i const u6 = _mm256_unpacklo_epi64(t5, t7);
+			__m256i const u7 = _mm256_unpackhi_epi64(t5, t7);
+
+			__m256i* out = w + half * 8;
+			out[0] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u0, u4, 0x20), bswap);
+			out[1] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u1, u5, 0x20), bswap);
+			out[2] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u2, u6, 0x20), bswap);
+			out[3] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u3, u7, 0x20), bswap);
+			out[4] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u0, u4, 0x31), bswap);
+			out[5] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u1, u5, 0x31), bswap);
+			out[6] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u2, u6, 0x31), bswap);
+			out[7] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u3, u7, 0x31), bswap);
+		}
+	}
+
+	TORRENT_TARGET_AVX2
+	void store_lanes(__m256i const* s, int const num_words, lane_digests_t& out)
+	{
+		std::array<std::uint32_t, 8> tmp;
+		for (int j = 0; j < num_words; ++j)
+		{
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(tmp.data()), s[j]);
+			for (std::size_t l = 0; l < 8; ++l)
+				out[l][std::size_t(j)] = tmp[l];
+		}
+	}
+
+	// SHA-256 of 8 messages in parallel, one in each 32 bit lane of the AVX2
+	// registers. All messages must have the same number of blocks
+	TORRENT_TARGET_AVX2
+	void sha256_avx2(lanes_t const& msgs, lane_digests_t& out)
+	{
+		__m256i s[8];
+		for (int j = 0; j < 8; ++j) s[j] = _mm256_set1_epi32(int(sha256_init[j]));
+
+		int const num_blocks = msgs[0]->num_blocks();
+		for (int b = 0; b < num_blocks; ++b)
+		{
+			std::array<std::uint8_t const*, 8> blocks;
+			for (std::size_t l = 0; l < 8; ++l)
+			{
+				TORRENT_ASSERT(msgs[l]->num_blocks() == num_blocks);
+				blocks[l] = msgs[l]->block(b);
+			}
+
+			__m256i w[16];
+			load_lanes(blocks, w);
+
+			__m256i a = s[0];
+			__m256i b_ = s[1];
+			__m256i c = s[2];
+			__m256i d = s[3];
+			__m256i e = s[4];
+			__m256i f = s[5];
+			__m256i g = s[6];
+			__m256i h = s[7];
+
+			for (int t = 0; t < 64; ++t)
+			{
+				__m256i& wt = w[t & 15];
+				if (t >= 16)
+				{
+					__m256i const w15 = w[(t - 15) & 15];
+					__m256i const w2 = w[(t - 2) & 15];
+					__m256i const s0 = _mm256_xor_si256(_mm256_xor_si256(rotr<7>(w15), rotr<18>(w15))
+						, _mm256_srli_epi32(w15, 3));
+					__m256i const s1 = _mm256_xor_si256(_mm256_xor_si256(rotr<17>(w2), rotr<19>(w2))
+						, _mm256_srli_epi32(w2, 10));
+					wt = _mm256_add_epi32(_mm256_add_epi32(wt, s0)
+						, _mm256_add_epi32(w[(t - 7) & 15], s1));
+				}
+
+				__m256i const S1 = _mm256_xor_si256(_mm256_xor_si256(rotr<6>(e), rotr<11>(e)), rotr<25>(e));
+				__m256i const ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+				__m256i const t1 = _mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(h, S1), ch)
+					, _mm256_add_epi32(_mm256_set1_epi32(int(sha256_k[t])), wt));
+				__m256i const S0 = _mm256_xor_si256(_mm256_xor_si256(rotr<2>(a), rotr<13>(a)), rotr<22>(a));
+				__m256i const maj = _mm256_or_si256(_mm256_and_si256(a, b_)
+					, _mm256_and_si256(c, _mm256_or_si256(a, b_)));
+				__m256i const t2 = _mm256_add_epi32(S0, maj);
+
+				h = g;
+				g = f;
+				f = e;
+				e = _mm256_add_epi32(d, t1);
+				d = c;
+				c = b_;
+				b_ = a;
+				a = _mm256_add_epi32(t1, t2);
+			}
+
+			s[0] = _mm256_add_epi32(s[0], a);
+			s[1] = _mm256_add_epi32(s[1], b_);
+			s[2] = _mm256_add_epi32(s[2], c);
+			s[3] = _mm256_add_epi32(s[3], d);
+			s[4] = _mm256_add_epi32(s[4], e);
+			s[5] = _mm256_add_epi32(s[5], f);
+			s[6] = _mm256_add_epi32(s[6], g);
+			s[7] = _mm256_add_epi32(s[7], h);
+		}
+
+		store_lanes(s, 8, out);
+	}
+
+	// compresses one 64 byte block of each of the 8 lanes into the SHA-1
+	// states in s
+	TORRENT_TARGET_AVX2
+	void sha1_avx2_block(__m256i* s, std::array<std::uint8_t const*, 8> const& blocks)
+	{
+		__m256i w[16];
+		load_lanes(blocks, w);
+
+		__m256i a = s[0];
+		__m256i b_ = s[1];
+		__m256i c = s[2];
+		__m256i d = s[3];
+		__m256i e = s[4];
+
+		for (int t = 0; t < 80; ++t)
+		{
+			__m256i& wt = w[t & 15];
+			if (t >= 16)
+			{
+				wt = rotl<1>(_mm256_xor_si256(_mm256_xor_si256(w[(t - 3) & 15], w[(t - 8) & 15])
+					, _mm256_xor_si256(w[(t - 14) & 15], wt)));
+			}
+
+			__m256i f;
+			std::uint32_t k;
+			if (t < 20)
+			{
+				f = _mm256_xor_si256(_mm256_and_si256(b_, c), _mm256_andnot_si256(b_, d));
+				k = 0x5a827999;
+			}
+			else if (t < 40)
+			{
+				f = _mm256_xor_si256(_mm256_xor_si256(b_, c), d);
+				k = 0x6ed9eba1;
+			}
+			else if (t < 60)
+			{
+				f = _mm256_or_si256(_mm256_and_si256(b_, c), _mm256_and_si256(d, _mm256_or_si256(b_, c)));
+				k = 0x8f1bbcdc;
+			}
+			else
+			{
+				f = _mm256_xor_si256(_mm256_xor_si256(b_, c), d);
+				k = 0xca62c1d6;
+			}
+
+			__m256i const tmp = _mm256_add_epi32(_mm256_add_epi32(rotl<5>(a), f)
+				, _mm256_add_epi32(_mm256_add_epi32(e, _mm256_set1_epi32(int(k))), wt));
+			e = d;
+			d = c;
+			c = rotl<30>(b_);
+			b_ = a;
+			a = tmp;
+		}
+
+		s[0] = _mm256_add_epi32(s[0], a);
+		s[1] = _mm256_add_epi32(s[1], b_);
+		s[2] = _mm256_add_epi32(s[2], c);
+		s[3] = _mm256_add_epi32(s[3], d);
+		s[4] = _mm256_add_epi32(s[4], e);
+	}
+
+	// SHA-1 of 8 messages in parallel, one in each 32 bit lane of the AVX2
+	// registers. All messages must have the same number of blocks
+	TORRENT_TARGET_AVX2
+	void sha1_avx2(lanes_t const& msgs, lane_digests_t& out)
+	{
+		__m256i s[5];
+		for (int j = 0; j < 5; ++j) s[j] = _mm256_set1_epi32(int(sha1_init[j]));
+
+		int const num_blocks = msgs[0]->num_blocks();
+		for (int b = 0; b < num_blocks; ++b)
+		{
+			std::array<std::uint8_t const*, 8> blocks;
+			for (std::size_t l = 0; l < 8; ++l)
+			{
+				TORRENT_ASSERT(msgs[l]->num_blocks() == num_blocks);
+				blocks[l] = msgs[l]->block(b);
+			}
+			sha1_avx2_block(s, blocks);
+		}
+
+		store_lanes(s, 5, out);
+	}
+
+	// the 64 byte blocks to compress into one stream of a
+	// sha1_multi_context. The head blocks come first, followed by the data
+	// blocks
+	struct stream_blocks
+	{
+		std::uint8_t const* head = nullptr;
+		int head_blocks = 0;
+		std::uint8_t const* data = nullptr;
+		int data_blocks = 0;
+
+		int num_blocks() const { return head_blocks + data_blocks; }
+
+		std::uint8_t const* block(int const i) const
+		{
+			return i < head_blocks
+				? head + std::ptrdiff_t(i) * 64
+				: data + std::ptrdiff_t(i - head_blocks) * 64;
+		}
+	};
+
+	// compresses the blocks of up to 8 streams into their SHA-1 states, one
+	// stream per lane. Streams with fewer blocks than the others are given a
+	// dummy block once they run out, and keep their state
+	TORRENT_TARGET_AVX2
+	void sha1_avx2_streams(std::array<std::uint32_t*, 8> const& states
+		, std::array<stream_blocks, 8> const& blocks, int const n)
+	{
+		std::uint8_t const dummy[64] = {};
+		std::array<std::uint32_t, 8> tmp;
+
+		__m256i s[5];
+		for (std::size_t j = 0; j < 5; ++j)
+		{
+			for (std::size_t l = 0; l < 8; ++l)
+				tmp[l] = int(l) < n ? states[l][j] : 0;
+			s[j] = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(tmp.data()));
+		}
+
+		int num_blocks = 0;
+		for (std::size_t l = 0; l < std::size_t(n); ++l)
+			num_blocks = std::max(num_blocks, blocks[l].num_blocks());
+
+		for (int b = 0; b < num_blocks; ++b)
+		{
+			std::array<std::uint8_t const*, 8> lane_blocks;
+			bool all_active = true;
+			for (std::size_t l = 0; l < 8; ++l)
+			{
+				bool const active = int(l) < n && b < blocks[l].num_blocks();
+				lane_blocks[l] = active ? blocks[l].block(b) : dummy;
+				tmp[l] = active ? 0xffffffff : 0;
+				all_active &= active;
+			}
+
+			if (all_active)
+			{
+				sha1_avx2_block(s, lane_blocks);
+				continue;
+			}
+
+			__m256i const mask = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(tmp.data()));
+			__m256i prev[5];
+			for (int j = 0; j < 5; ++j) prev[j] = s[j];
+			sha1_avx2_block(s, lane_blocks);
+			for (int j = 0; j < 5; ++j) s[j] = _mm256_blendv_epi8(prev[j], s[j], mask);
+		}
+
+		for (std::size_t j = 0; j < 5; ++j)
+		{
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(tmp.data()), s[j]);
+			for (std::size_t l = 0; l < std::size_t(n); ++l)
+				states[l][j] = tmp[l];
+		}
+	}
+
+	void sha1_streams(sha_multi_impl const impl, std::array<std::uint32_t*, 8> const& states
+		, std::array<stream_blocks, 8> const& blocks, int const n)
+	{
+		if (impl == sha_multi_impl::avx2)
+		{
+			sha1_avx2_streams(states, blocks, n);
+			return;
+		}
+
+		TORRENT_ASSERT(impl == sha_multi_impl::sha_ni);
+		for (std::size_t l = 0; l < std::size_t(n); ++l)
+		{
+			sha1_ni_blocks(states[l], blocks[l].head, blocks[l].head_blocks);
+			sha1_ni_blocks(states[l], blocks[l].data, blocks[l].data_blocks);
+		}
+	}
+
+	// hashes the buffers one at a time, with the SHA extensions
+	template <typename Hash, typename Blocks, std::size_t N>
+	void hash_ni(span<span<char const> const> bufs, span<Hash> out
+		, std::uint32_t const (&init)[N], Blocks blocks)
+	{
+		message m;
+		for (int i = 0; i < int(bufs.size()); ++i)
+		{
+			m.assign(bufs[i]);
+			std::array<std::uint32_t, N> state;
+			std::memcpy(state.data(), init, sizeof(init));
+			blocks(state.data(), m.data, m.full_blocks);
+			blocks(state.data(), m.tail.data(), m.tail_blocks);
+			out[i] = to_hash<Hash>(state.data());
+		}
+	}
+
+	// hashes adjacent buffers with the same number of blocks together, 8 at
+	// a time. Groups of a single buffer are hashed by the fallback.
+	template <typename Hash, typename Lanes, typename Single>
+	void hash_lanes(span<span<char const> const> bufs, span<Hash> out
+		, Lanes lanes, Single single)
+	{
+		std::array<message, 8> group;
+		std::array<int, 8> index;
+		int n = 0;
+
+		auto flush = [&]
+		{
+			if (n == 1)
+			{
+				out[index[0]] = single(bufs[index[0]]);
+				n = 0;
+				return;
+			}
+			// unused lanes hash the first message again
+			lanes_t msgs;
+			for (std::size_t l = 0; l < 8; ++l)
+				msgs[l] = &group[int(l) < n ? l : 0];
+			lane_digests_t digests;
+			lanes(msgs, digests);
+			for (int l = 0; l < n; ++l)
+				out[index[std::size_t(l)]] = to_hash<Hash>(digests[std::size_t(l)].data());
+			n = 0;
+		};
+
+		for (int i = 0; i < int(bufs.size()); ++i)
+		{
+			if (n > 0 && (n == 8 || group[0].num_blocks() != num_sha_blocks(bufs[i])))
+				flush();
+			group[std::size_t(n)].assign(bufs[i]);
+			index[std::size_t(n)] = i;
+			++n;
+		}
+		if (n > 0) flush();
+	}
+
+#endif // TORRENT_HAS_SHA_SIMD
+
+	// hasher::update() doesn't accept empty buffers
+	template <typename Hasher>
+	auto hash_one(span<char const> const buf) -> decltype(Hasher().final())
+	{
+		Hasher h;
+		if (!buf.empty()) h.update(buf);
+		return h.final();
+	}
+
+	// the SHA extensions only process one buffer at a time, but are the
+	// fastest option for SHA-256. SHA-1 is cheap enough per round that 8 AVX2
+	// lanes come out ahead
+	sha_multi_impl pick_impl(sha_multi_impl const impl, bool const sha1)
+	{
+#if TORRENT_HAS_SHA_SIMD
+		switch (impl)
+		{
+			case sha_multi_impl::automatic:
+				if (sha1 && avx2_support) return sha_multi_impl::avx2;
+				if (sha_ni_support) return sha_multi_impl::sha_ni;
+				if (avx2_support) return sha_multi_impl::avx2;
+				return sha_multi_impl::portable;
+			case sha_multi_impl::sha_ni:
+				return sha_ni_support ? impl : sha_multi_impl::portable;
+			case sha_multi_impl::avx2:
+				return avx2_support ? impl : sha_multi_impl::portable;
+			case sha_multi_impl::portable:
+				break;
+		}
+#else
+		TORRENT_UNUSED(impl);
+		TORRENT_UNUSED(sha1);
+#endif
+		return sha_multi_impl::portable;
+	}
+
+} // anonymous namespace
+
+	void sha1_multi(span<span<char const> const> bufs, span<sha1_hash> out
+		, sha_multi_impl const impl)
+	{
+		TORRENT_ASSERT(bufs.size() == out.size());
+		switch (pick_impl(impl, true))
+		{
+#if TORRENT_HAS_SHA_SIMD
+			case sha_multi_impl::sha_ni:
+				hash_ni(bufs, out, sha1_init, &sha1_ni_blocks);
+				return;
+			case sha_multi_impl::avx2:
+				hash_lanes(bufs, out, &sha1_avx2
+					, &hash_one<hasher>);
+				return;
+#endif
+			default:
+				for (int i = 0; i < int(bufs.size()); ++i)
+					out[i] = hash_one<hasher>(bufs[i]);
+		}
+	}
+
+	void sha256_multi(span<span<char const> const> bufs, span<sha256_hash> out
+		, sha_multi_impl const impl)
+	{
+		TORRENT_ASSERT(bufs.size() == out.size());
+		switch (pick_impl(impl, false))
+		{
+#if TORRENT_HAS_SHA_SIMD
+			case sha_multi_impl::sha_ni:
+				hash_ni(bufs, out, sha256_init, &sha256_ni_blocks);
+				return;
+			case sha_multi_impl::avx2:
+				hash_lanes(bufs, out, &sha256_avx2
+					, &hash_one<hasher256>);
+				return;
+#endif
+			default:
+				for (int i = 0; i < int(bufs.size()); ++i)
+					out[i] = hash_one<hasher256>(bufs[i]);
+		}
+	}
+
+	sha1_multi_context::sha1_multi_context(int const num_streams
+		, sha_multi_impl const impl)
+		: m_impl(pick_impl(impl, true))
+	{
+		if (m_impl == sha_multi_impl::portable)
+		{
+			m_hashers.resize(std::size_t(num_streams));
+			return;
+		}
+
+		m_streams.resize(std::size_t(num_streams));
+#if TORRENT_HAS_SHA_SIMD
+		for (auto& st : m_streams)
+			std::memcpy(st.state.data(), sha1_init, sizeof(sha1_init));
+#endif
+	}
+
+	void sha1_multi_context::update(span<span<char const> const> bufs)
+	{
+		if (m_impl == sha_multi_impl::portable)
+		{
+			TORRENT_ASSERT(bufs.size() == int(m_hashers.size()));
+			for (std::size_t i = 0; i < m_hashers.size(); ++i)
+				if (!bufs[int(i)].empty()) m_hashers[i].update(bufs[int(i)]);
+			return;
+		}
+
+#if TORRENT_HAS_SHA_SIMD
+		TORRENT_ASSERT(bufs.size() == int(m_streams.size()));
+		int const num_streams = int(m_streams.size());
+		for (int first = 0; first < num_streams; first += 8)
+		{
+			int const n = std::min(8, num_streams - first);
+			std::array<std::uint32_t*, 8> states;
+			std::array<stream_blocks, 8> blocks;
+			// the bytes after the last full block of each buffer
+			std::array<span<char const>, 8> rest;
+			for (std::size_t l = 0; l < std::size_t(n); ++l)
+			{
+				stream& st = m_streams[std::size_t(first) + l];
+				span<char const> buf = bufs[first + int(l)];
+				st.length += std::uint64_t(buf.size());
+				states[l] = st.state.data();
+				if (buf.empty()) continue;
+
+				// the first bytes complete the pending block, if there is one
+				if (st.pending_len > 0)
+				{
+					std::ptrdiff_t const fill = std::min(std::ptrdiff_t(64 - st.pending_len), buf.size());
+					std::memcpy(st.pending.data() + st.pending_len, buf.data(), std::size_t(fill));
+					st.pending_len += int(fill);
+					buf = buf.subspan(fill);
+					if (st.pending_len < 64) continue;
+					blocks[l].head = reinterpret_cast<std::uint8_t const*>(st.pending.data());
+					blocks[l].head_blocks = 1;
+				}
+
+				blocks[l].data = reinterpret_cast<std::uint8_t const*>(buf.data());
+				blocks[l].data_blocks = int(buf.size() / 64);
+				rest[l] = buf.subspan(std::ptrdiff_t(blocks[l].data_blocks) * 64);
+			}
+
+			sha1_streams(m_impl, states, blocks, n);
+
+			for (std::size_t l = 0; l < std::size_t(n); ++l)
+			{
+				if (blocks[l].head == nullptr && blocks[l].data == nullptr) continue;
+				stream& st = m_streams[std::size_t(first) + l];
+				std::memcpy(st.pending.data(), rest[l].data(), std::size_t(rest[l].size()));
+				st.pending_len = int(rest[l].size());
+			}
+		}
+#endif
+	}
+
+	void sha1_multi_context::final(span<sha1_hash> out)
+	{
+		if (m_impl == sha_multi_impl::portable)
+		{
+			TORRENT_ASSERT(out.size() == int(m_hashers.size()));
+			for (std::size_t i = 0; i < m_hashers.size(); ++i)
+				out[int(i)] = m_hashers[i].final();
+			return;
+		}
+
+#if TORRENT_HAS_SHA_SIMD
+		TORRENT_ASSERT(out.size() == int(m_streams.size()));
+		int const num_streams = int(m_streams.size());
+		for (int first = 0; first < num_streams; first += 8)
+		{
+			int const n = std::min(8, num_streams - first);
+			std::array<std::uint32_t*, 8> states;
+			std::array<stream_blocks, 8> blocks;
+			// the padding and the message length, in one or two blocks
+			std::array<std::array<std::uint8_t, 128>, 8> tails;
+			for (std::size_t l = 0; l < std::size_t(n); ++l)
+			{
+				stream& st = m_streams[std::size_t(first) + l];
+				auto& tail = tails[l];
+				auto const len = std::size_t(st.pending_len);
+				tail.fill(0);
+				std::memcpy(tail.data(), st.pending.data(), len);
+				tail[len] = 0x80;
+				int const tail_blocks = len + 9 <= 64 ? 1 : 2;
+				std::uint64_t const bits = st.length * 8;
+				std::size_t const end = std::size_t(tail_blocks) * 64;
+				for (std::size_t i = 0; i < 8; ++i)
+					tail[end - 1 - i] = std::uint8_t(bits >> (i * 8));
+
+				states[l] = st.state.data();
+				blocks[l].head = tail.data();
+				blocks[l].head_blocks = tail_blocks;
+			}
+
+			sha1_streams(m_impl, states, blocks, n);
+
+			for (int l = 0; l < n; ++l)
+				out[first + l] = to_hash<sha1_hash>(states[std::size_t(l)]);
+		}
+#endif
+	}
+
+	bool sha_multi_accelerated()
+	{
+		return pick_impl(sha_multi_impl::automatic, false) != sha_multi_impl::portable;
+	}
+}
+}
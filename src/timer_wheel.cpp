@@ -0,0 +1,159 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/timer_wheel.hpp"
+#include "libtorrent/assert.hpp"
+
+#include <algorithm>
+
+namespace libtorrent {
+namespace aux {
+
+	timer_wheel_entry::~timer_wheel_entry()
+	{
+		if (m_wheel != nullptr) m_wheel->cancel(*this);
+	}
+
+	timer_wheel::timer_wheel(std::int64_t const now)
+		: m_now(now)
+	{}
+
+	timer_wheel::~timer_wheel()
+	{
+		// entries that outlive the wheel are left unscheduled
+		for (auto& s : m_slots)
+			for (timer_wheel_entry* e : s) e->m_wheel = nullptr;
+	}
+
+	void timer_wheel::schedule(timer_wheel_entry& e, std::int64_t const due)
+	{
+		if (e.m_wheel == this)
+		{
+			unlink(e);
+		}
+		else
+		{
+			if (e.m_wheel != nullptr) e.m_wheel->cancel(e);
+			e.m_wheel = this;
+			++m_size;
+		}
+		e.m_due = std::max(due, m_now + 1);
+		insert(e);
+	}
+
+	void timer_wheel::cancel(timer_wheel_entry& e)
+	{
+		if (e.m_wheel == nullptr) return;
+		TORRENT_ASSERT(e.m_wheel == this);
+		unlink(e);
+		e.m_wheel = nullptr;
+		TORRENT_ASSERT(m_size > 0);
+		--m_size;
+	}
+
+	void timer_wheel::step(std::int64_t const now)
+	{
+		TORRENT_ASSERT(now > m_now);
+		if (m_size == 0)
+		{
+			m_now = now;
+			return;
+		}
+
+		++m_now;
+
+		// each time a level has gone through all its slots, the entries of
+		// the next slot of the level above are spread out over it. The entries
+		// that are due now end up in the level 0 slot of this tick
+		for (int level = num_levels - 1; level > 0; --level)
+		{
+			std::int64_t const mask = (std::int64_t(1) << (slot_bits * level)) - 1;
+			if ((m_now & mask) != 0) continue;
+			auto const slot = std::size_t(level * num_slots)
+				+ std::size_t((m_now >> (slot_bits * level)) & (num_slots - 1));
+
+			m_cascade.clear();
+			m_cascade.swap(m_slots[slot]);
+			for (timer_wheel_entry* e : m_cascade) insert(*e);
+		}
+	}
+
+	timer_wheel_entry* timer_wheel::pop_expired()
+	{
+		// nothing is ever inserted into the slot of the current tick (other
+		// than by step()), so handing out entries from the back is safe, even
+		// when the callbacks schedule and cancel other entries
+		auto& slot = m_slots[std::size_t(m_now & (num_slots - 1))];
+		if (slot.empty()) return nullptr;
+		timer_wheel_entry* const e = slot.back();
+		TORRENT_ASSERT(e->m_due == m_now);
+		slot.pop_back();
+		e->m_wheel = nullptr;
+		TORRENT_ASSERT(m_size > 0);
+		--m_size;
+		return e;
+	}
+
+	void timer_wheel::insert(timer_wheel_entry& e)
+	{
+		std::int64_t const delta = e.m_due - m_now;
+		TORRENT_ASSERT(delta >= 0);
+
+		int level = 0;
+		while (level < num_levels - 1
+			&& delta >= (std::int64_t(1) << (slot_bits * (level + 1))))
+			++level;
+
+		// entries further out than the wheel reaches are put in the last slot
+		// it does reach, and re-inserted from there
+		std::int64_t const horizon = std::int64_t(1) << (slot_bits * num_levels);
+		std::int64_t const when = delta < horizon ? e.m_due : m_now + horizon - 1;
+
+		auto const slot = level * num_slots
+			+ int((when >> (slot_bits * level)) & (num_slots - 1));
+		auto& s = m_slots[std::size_t(slot)];
+		e.m_slot = std::int32_t(slot);
+		e.m_pos = std::int32_t(s.size());
+		s.push_back(&e);
+	}
+
+	void timer_wheel::unlink(timer_wheel_entry& e)
+	{
+		auto& s = m_slots[std::size_t(e.m_slot)];
+		TORRENT_ASSERT(s[std::size_t(e.m_pos)] == &e);
+		timer_wheel_entry* const last = s.back();
+		s[std::size_t(e.m_pos)] = last;
+		last->m_pos = e.m_pos;
+		s.pop_back();
+	}
+}
+}
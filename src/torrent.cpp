@@ -505,6 +505,11 @@ bool is_downloading_state(int const st)
 		m_verified.clear();
 		m_verifying.clear();
 
+		// the verified pieces and the file priorities are saved differently
+		// outside of seed mode
+		m_journal.pieces = true;
+		m_journal.file_priorities = true;
+
 		set_need_save_resume();
 	}
 
@@ -2256,6 +2261,7 @@ bool is_downloading_state(int const st)
 
 		// forget that we have any pieces
 		m_have_all = false;
+		m_journal.pieces = true;
 
 // removing the piece picker will clear the user priorities
 // instead, just clear which pieces we have
@@ -4045,6 +4051,21 @@ namespace {
 			p->update_interest();
 		}
 
+		if (m_journal.active && !m_journal.pieces)
+		{
+			// once the list of pieces would be larger than the have-bitfield,
+			// save the bitfield instead
+			if (int(m_journal.have.size()) < m_torrent_file->num_pieces() / 8)
+			{
+				m_journal.have.push_back(index);
+			}
+			else
+			{
+				m_journal.pieces = true;
+				m_journal.have.clear();
+			}
+		}
+
 		set_need_save_resume();
 		state_updated();
 		update_want_tick();
@@ -4989,6 +5010,7 @@ namespace {
 			download_priority_t const prev_prio = m_picker->piece_priority(piece);
 			bool const was_finished = is_finished();
 			bool const filter_updated = m_picker->set_piece_priority(piece, top_priority);
+			m_journal.piece_priorities = true;
 			if (prev_prio == dont_download)
 			{
 				update_gauge();
@@ -5014,6 +5036,7 @@ namespace {
 		download_priority_t const prev_prio = m_picker->piece_priority(piece);
 		bool const was_finished = is_finished();
 		bool const filter_updated = m_picker->set_piece_priority(piece, top_priority);
+		m_journal.piece_priorities = true;
 		if (prev_prio == dont_download)
 		{
 			update_gauge();
@@ -5087,6 +5110,7 @@ namespace {
 					get_handle(), piece, error_code(boost::system::errc::operation_canceled, generic_category()));
 			}
 			if (has_picker()) m_picker->set_piece_priority(piece, low_priority);
+			m_journal.piece_priorities = true;
 			m_time_critical_pieces.erase(i);
 			return;
 		}
@@ -5103,6 +5127,7 @@ namespace {
 					get_handle(), i->piece, error_code(boost::system::errc::operation_canceled, generic_category()));
 			}
 			if (has_picker()) m_picker->set_piece_priority(i->piece, low_priority);
+			m_journal.piece_priorities = true;
 			i = m_time_critical_pieces.erase(i);
 		}
 	}
@@ -5167,6 +5192,7 @@ namespace {
 
 		bool const was_finished = is_finished();
 		bool const filter_updated = m_picker->set_piece_priority(index, priority);
+		m_journal.piece_priorities = true;
 
 		update_gauge();
 
@@ -5229,6 +5255,7 @@ namespace {
 
 			filter_updated |= m_picker->set_piece_priority(p.first, p.second);
 		}
+		m_journal.piece_priorities = true;
 		update_gauge();
 		if (filter_updated)
 		{
@@ -5270,6 +5297,7 @@ namespace {
 			filter_updated |= m_picker->set_piece_priority(index, prio);
 			++index;
 		}
+		m_journal.piece_priorities = true;
 		update_gauge();
 		update_want_tick();
 
@@ -5341,6 +5369,7 @@ namespace {
 		{
 			update_piece_priorities(prios);
 			m_file_priority = std::move(prios);
+			m_journal.file_priorities = true;
 			set_need_save_resume();
 #ifndef TORRENT_DISABLE_SHARE_MODE
 			if (m_share_mode)
@@ -5414,6 +5443,7 @@ namespace {
 		else
 		{
 			m_file_priority = std::move(new_priority);
+			m_journal.file_priorities = true;
 			set_need_save_resume();
 		}
 	}
@@ -5463,6 +5493,7 @@ namespace {
 		else
 		{
 			m_file_priority = std::move(new_priority);
+			m_journal.file_priorities = true;
 			set_need_save_resume();
 		}
 	}
@@ -5894,8 +5925,21 @@ namespace {
 	{
 		TORRENT_ASSERT(m_iterating_connections == 0);
 		auto const i = sorted_find(m_connections, p);
-		if (i != m_connections.end())
-			m_connections.erase(i);
+		if (i == m_connections.end()) return;
+		m_connections.erase(i);
+
+		// if this peer was the one that saw a seed most recently, look for
+		// the next most recent one among the peers still connected
+		if (m_swarm_last_seen_complete > 0
+			&& p->last_seen_complete() >= m_swarm_last_seen_complete)
+		{
+			m_swarm_last_seen_complete = 0;
+			for (auto const c : m_connections)
+			{
+				m_swarm_last_seen_complete = std::max(c->last_seen_complete()
+					, m_swarm_last_seen_complete);
+			}
+		}
 	}
 
 	void torrent::remove_peer(std::shared_ptr<peer_connection> p) noexcept
@@ -6769,6 +6813,10 @@ namespace {
 
 	void torrent::write_resume_data(resume_data_flags_t const flags, add_torrent_params& ret) const
 	{
+		// for journal records, the fields that grow with the size of the
+		// torrent are only saved if they have changed
+		bool const journal = (flags & torrent_handle::journal) && m_journal.active;
+
 		ret.version = LIBTORRENT_VERSION_NUM;
 		ret.storage_mode = storage_mode();
 		ret.total_uploaded = m_total_uploaded;
@@ -6871,7 +6919,7 @@ namespace {
 			: piece_index_t(0);
 
 		TORRENT_ASSERT(ret.have_pieces.empty());
-		if (max_piece > piece_index_t(0))
+		if (max_piece > piece_index_t(0) && (!journal || m_journal.pieces))
 		{
 			if (is_seed())
 			{
@@ -6950,6 +6998,18 @@ namespace {
 		if (int(ret.peers.size()) < 100)
 		{
 			aux::random_shuffle(deferred_peers);
+
+			// prefer the ones we saved last time, to keep journal records
+			// small
+			if (journal)
+			{
+				std::stable_partition(deferred_peers.begin(), deferred_peers.end()
+					, [this](torrent_peer const* p)
+					{
+						return std::binary_search(m_journal.peers.begin()
+							, m_journal.peers.end(), p->ip());
+					});
+			}
 			for (auto const p : deferred_peers)
 			{
 				ret.peers.push_back(p->ip());
@@ -6966,13 +7026,15 @@ namespace {
 		// are file priorities set, don't save piece priorities.
 		// when in seed mode (i.e. the client promises that we have all files)
 		// it does not make sense to save file priorities.
-		if (!m_file_priority.empty() && !m_seed_mode)
+		if (!m_file_priority.empty() && !m_seed_mode
+			&& (!journal || m_journal.file_priorities))
 		{
 			// write file priorities
 			ret.file_priorities = m_file_priority;
 		}
 
-		if (valid_metadata() && has_picker())
+		if (valid_metadata() && has_picker()
+			&& (!journal || m_journal.piece_priorities))
 		{
 			// write piece priorities
 			// but only if they are not set to the default
@@ -6994,7 +7056,9 @@ namespace {
 			}
 		}
 
-		if (m_torrent_file->info_hashes().has_v2())
+		// the merkle trees change as pieces pass the hash check
+		if (m_torrent_file->info_hashes().has_v2()
+			&& (!journal || m_journal.pieces || !m_journal.have.empty()))
 		{
 			ret.merkle_trees.clear();
 			ret.merkle_trees.reserve(m_merkle_trees.size());
@@ -8177,6 +8241,7 @@ namespace {
 				m_picker.reset();
 				m_hash_picker.reset();
 				m_file_progress.clear();
+				m_journal.piece_priorities = true;
 			}
 			m_have_all = true;
 		}
@@ -8243,6 +8308,9 @@ namespace {
 			return;
 		}
 
+		m_journal.pieces = true;
+		m_journal.piece_priorities = true;
+
 		// calling pause will also trigger the auto managed
 		// recalculation
 		// if we just got here by downloading the metadata,
@@ -9155,7 +9223,30 @@ namespace {
 		state_updated();
 
 		add_torrent_params atp;
+		if ((flags & torrent_handle::journal) && m_journal.active)
+		{
+			// if we lost pieces in a way that isn't tracked, the have-bitfield
+			// is saved in full
+			if (!m_files_checked || m_seed_mode
+				|| num_have() != m_journal.num_have + int(m_journal.have.size()))
+			{
+				m_journal.pieces = true;
+			}
+
+			write_resume_data(flags, atp);
+			std::vector<char> record = aux::write_resume_journal(atp, m_journal);
+			m_journal.saved(atp, num_have());
+			alerts().emplace_alert<save_resume_data_alert>(std::move(atp)
+				, std::move(record), get_handle());
+			return;
+		}
+
 		write_resume_data(flags, atp);
+
+		// journal records can only be appended to a full record of a torrent
+		// with metadata
+		if (valid_metadata()) m_journal.saved(atp, num_have());
+		else m_journal = aux::resume_journal();
 		alerts().emplace_alert<save_resume_data_alert>(std::move(atp), get_handle());
 	}
 
@@ -9884,18 +9975,8 @@ namespace {
 
 		maybe_connect_web_seeds();
 
-		m_swarm_last_seen_complete = m_last_seen_complete;
-		for (auto p : m_connections)
-		{
-			TORRENT_INCREMENT(m_iterating_connections);
-
-			// look for the peer that saw a seed most recently
-			m_swarm_last_seen_complete = std::max(p->last_seen_complete(), m_swarm_last_seen_complete);
+		// the peers are ticked by the session, when they have work due
 
-			// updates the peer connection's ul/dl bandwidth
-			// resource requests
-			p->second_tick(tick_interval_ms);
-		}
 #if TORRENT_ABI_VERSION <= 2
 		if (m_ses.alerts().should_post<stats_alert>())
 			m_ses.alerts().emplace_alert<stats_alert>(get_handle(), tick_interval_ms, m_stat);
@@ -10111,6 +10192,7 @@ namespace {
 			if (ps.priority == 0 && (ps.have || ps.downloading))
 			{
 				m_picker->set_piece_priority(i, default_priority);
+				m_journal.piece_priorities = true;
 				continue;
 			}
 			// don't count pieces we already have or are trying to download
@@ -10144,6 +10226,7 @@ namespace {
 		int const pick = int(random(aux::numeric_cast<std::uint32_t>(rarest_pieces.end_index() - 1)));
 		bool const was_finished = is_finished();
 		m_picker->set_piece_priority(rarest_pieces[pick], default_priority);
+		m_journal.piece_priorities = true;
 		update_gauge();
 		update_peer_interest(was_finished);
 		update_want_peers();
@@ -11665,7 +11748,7 @@ namespace {
 			st->distributed_copies = -1.f;
 		}
 
-		st->last_seen_complete = m_swarm_last_seen_complete;
+		st->last_seen_complete = std::max(m_swarm_last_seen_complete, m_last_seen_complete);
 	}
 
 	int torrent::priority() const
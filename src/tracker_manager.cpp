@@ -34,6 +34,7 @@ POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <cctype>
+#include <algorithm>
 
 #include "libtorrent/tracker_manager.hpp"
 #include "libtorrent/http_tracker_connection.hpp"
@@ -49,6 +50,17 @@ using namespace std::placeholders;
 
 namespace libtorrent {
 
+namespace {
+
+	// the number of info-hashes that fit in a single UDP tracker scrape
+	// request, according to BEP 15
+	constexpr std::size_t max_udp_scrape_batch = 74;
+
+	// scrape requests are held for this long, to batch them with scrapes of
+	// other torrents to the same tracker
+	constexpr milliseconds udp_scrape_delay{100};
+}
+
 constexpr tracker_request_flags_t tracker_request::scrape_request;
 constexpr tracker_request_flags_t tracker_request::i2p;
 
@@ -191,7 +203,8 @@ constexpr tracker_request_flags_t tracker_request::i2p;
 		m_man.received_bytes(bytes);
 	}
 
-	tracker_manager::tracker_manager(send_fun_t send_fun
+	tracker_manager::tracker_manager(io_context& ios
+		, send_fun_t send_fun
 		, send_fun_hostname_t send_fun_hostname
 		, counters& stats_counters
 		, aux::resolver_interface& resolver
@@ -200,7 +213,9 @@ constexpr tracker_request_flags_t tracker_request::i2p;
 		, aux::session_logger& ses
 #endif
 		)
-		: m_send_fun(std::move(send_fun))
+		: m_udp_scrape_timer(ios)
+		, m_udp_announce_timer(ios)
+		, m_send_fun(std::move(send_fun))
 		, m_send_fun_hostname(std::move(send_fun_hostname))
 		, m_host_resolver(resolver)
 		, m_settings(sett)
@@ -241,7 +256,7 @@ constexpr tracker_request_flags_t tracker_request::i2p;
 				m_queued.pop_front();
 				m_http_conns.push_back(std::move(conn));
 				m_http_conns.back()->start();
-				m_stats_counters.set_value(counters::num_queued_tracker_announces, std::int64_t(m_queued.size()));
+				update_queued_announces();
 			}
 			return;
 		}
@@ -251,7 +266,7 @@ constexpr tracker_request_flags_t tracker_request::i2p;
 		if (j != m_queued.end())
 		{
 			m_queued.erase(j);
-			m_stats_counters.set_value(counters::num_queued_tracker_announces, std::int64_t(m_queued.size()));
+			update_queued_announces();
 		}
 	}
 
@@ -304,7 +319,7 @@ constexpr tracker_request_flags_t tracker_request::i2p;
 			else
 			{
 				m_queued.push_back(std::move(con));
-				m_stats_counters.set_value(counters::num_queued_tracker_announces, std::int64_t(m_queued.size()));
+				update_queued_announces();
 			}
 			return;
 		}
@@ -312,7 +327,7 @@ constexpr tracker_request_flags_t tracker_request::i2p;
 		{
 			auto con = std::make_shared<udp_tracker_connection>(ios, *this, std::move(req), c);
 			m_udp_conns[con->transaction_id()] = con;
-			con->start();
+			start_udp_request(std::move(con));
 			return;
 		}
 
@@ -323,6 +338,188 @@ constexpr tracker_request_flags_t tracker_request::i2p;
 				, "", seconds32(0)));
 	}
 
+	void tracker_manager::start_udp_request(std::shared_ptr<udp_tracker_connection> c)
+	{
+		tracker_request const& req = c->tracker_req();
+
+		if (req.event == event_t::stopped && !m_queued_udp.empty())
+		{
+			// announces from the same torrent that are still held back are
+			// sent first, for the tracker to see the events in order
+			auto const cb = c->requester();
+			for (auto i = m_queued_udp.begin(); cb && i != m_queued_udp.end();)
+			{
+				if ((*i)->requester() != cb)
+				{
+					++i;
+					continue;
+				}
+				auto q = std::move(*i);
+				i = m_queued_udp.erase(i);
+				if (!q->cancelled()) q->start();
+			}
+			update_queued_announces();
+		}
+
+		// scrapes are batched rather than paced, and stopped events are sent
+		// right away, since we may be shutting down
+		if ((req.kind & tracker_request::scrape_request)
+			|| req.event == event_t::stopped
+			|| (m_queued_udp.empty() && udp_announce_slot(clock_type::now())))
+		{
+			c->start();
+			return;
+		}
+
+		m_queued_udp.push_back(std::move(c));
+		update_queued_announces();
+
+		if (m_udp_announce_timer_active) return;
+		m_udp_announce_timer_active = true;
+		ADD_OUTSTANDING_ASYNC("tracker_manager::on_udp_announce_timer");
+		m_udp_announce_timer.expires_at(m_next_udp_announce - seconds(1));
+		m_udp_announce_timer.async_wait(
+			std::bind(&tracker_manager::on_udp_announce_timer, this, _1));
+	}
+
+	bool tracker_manager::udp_announce_slot(time_point const now)
+	{
+		int const rate = m_settings.get_int(settings_pack::max_udp_announces_per_second);
+		if (rate <= 0) return true;
+
+		if (m_next_udp_announce < now) m_next_udp_announce = now;
+		if (m_next_udp_announce - now >= seconds(1)) return false;
+		m_next_udp_announce += std::chrono::duration_cast<time_duration>(seconds(1)) / rate;
+		return true;
+	}
+
+	void tracker_manager::on_udp_announce_timer(error_code const& ec)
+	{
+		COMPLETE_ASYNC("tracker_manager::on_udp_announce_timer");
+		// the timer is cancelled when the tracker_manager is destructed, don't
+		// touch it in that case
+		if (ec == boost::asio::error::operation_aborted) return;
+		TORRENT_ASSERT(is_single_thread());
+		m_udp_announce_timer_active = false;
+
+		time_point const now = clock_type::now();
+		while (!m_queued_udp.empty())
+		{
+			// announces that were aborted while queued are just dropped
+			if (!m_queued_udp.front()->cancelled())
+			{
+				if (!udp_announce_slot(now)) break;
+				m_queued_udp.front()->start();
+			}
+			m_queued_udp.pop_front();
+		}
+		update_queued_announces();
+
+		if (m_queued_udp.empty()) return;
+		m_udp_announce_timer_active = true;
+		ADD_OUTSTANDING_ASYNC("tracker_manager::on_udp_announce_timer");
+		m_udp_announce_timer.expires_at(m_next_udp_announce - seconds(1));
+		m_udp_announce_timer.async_wait(
+			std::bind(&tracker_manager::on_udp_announce_timer, this, _1));
+	}
+
+	void tracker_manager::update_queued_announces()
+	{
+		m_stats_counters.set_value(counters::num_queued_tracker_announces
+			, std::int64_t(m_queued.size() + m_queued_udp.size()));
+	}
+
+	bool tracker_manager::begin_udp_connect(address const& tracker
+		, std::shared_ptr<udp_tracker_connection> c)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		auto const i = m_udp_connecting.find(tracker);
+		if (i == m_udp_connecting.end())
+		{
+			m_udp_connecting[tracker];
+			return true;
+		}
+		i->second.push_back(std::move(c));
+		return false;
+	}
+
+	void tracker_manager::end_udp_connect(address const& tracker)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		auto const i = m_udp_connecting.find(tracker);
+		TORRENT_ASSERT(i != m_udp_connecting.end());
+		if (i == m_udp_connecting.end()) return;
+		auto const waiting = std::move(i->second);
+		m_udp_connecting.erase(i);
+
+		// if the connect succeeded, the waiting connections will find the
+		// connection ID in the cache. If it failed, the first one of them to
+		// run sends a new connect message
+		for (auto const& w : waiting)
+		{
+			auto c = w.lock();
+			if (!c || c->cancelled()) continue;
+			post(c->get_executor(), std::bind(
+				&udp_tracker_connection::resume_connect, c));
+		}
+	}
+
+	void tracker_manager::queue_udp_scrape(std::shared_ptr<udp_tracker_connection> c)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		auto const key = std::make_pair(c->bind_socket(), c->m_target);
+		auto& batch = m_udp_scrapes[key];
+		batch.push_back(std::move(c));
+
+		if (batch.size() >= max_udp_scrape_batch)
+		{
+			// this may be called with the connection cache locked, so the
+			// batch is sent from a separate handler
+			auto full = std::move(batch);
+			m_udp_scrapes.erase(key);
+			auto const ex = full.front()->get_executor();
+			post(ex, [this, b = std::move(full)]() mutable
+				{ send_udp_scrapes(std::move(b)); });
+			return;
+		}
+
+		if (m_udp_scrape_timer_active) return;
+		m_udp_scrape_timer_active = true;
+		ADD_OUTSTANDING_ASYNC("tracker_manager::on_udp_scrape_timer");
+		m_udp_scrape_timer.expires_after(udp_scrape_delay);
+		m_udp_scrape_timer.async_wait(
+			std::bind(&tracker_manager::on_udp_scrape_timer, this, _1));
+	}
+
+	void tracker_manager::on_udp_scrape_timer(error_code const& ec)
+	{
+		COMPLETE_ASYNC("tracker_manager::on_udp_scrape_timer");
+		if (ec == boost::asio::error::operation_aborted) return;
+		TORRENT_ASSERT(is_single_thread());
+		m_udp_scrape_timer_active = false;
+
+		auto batches = std::move(m_udp_scrapes);
+		m_udp_scrapes.clear();
+		for (auto& b : batches)
+			send_udp_scrapes(std::move(b.second));
+	}
+
+	void tracker_manager::send_udp_scrapes(
+		std::vector<std::shared_ptr<udp_tracker_connection>> batch)
+	{
+		// scrapes that were aborted while waiting for the batch are dropped
+		batch.erase(std::remove_if(batch.begin(), batch.end()
+			, [](std::shared_ptr<udp_tracker_connection> const& c)
+			{ return c->cancelled(); }), batch.end());
+		if (batch.empty()) return;
+
+		// the first connection sends the request for the whole batch, under
+		// its transaction ID, and hands out the response
+		auto leader = batch.front();
+		batch.erase(batch.begin());
+		leader->send_udp_scrape_batch(std::move(batch));
+	}
+
 	bool tracker_manager::incoming_packet(udp::endpoint const& ep
 		, span<char const> const buf)
 	{
@@ -485,6 +682,11 @@ constexpr tracker_request_flags_t tracker_request::i2p;
 
 		for (auto const& c : close_udp_connections)
 			c->close();
+
+		m_queued_udp.erase(std::remove_if(m_queued_udp.begin(), m_queued_udp.end()
+			, [](std::shared_ptr<udp_tracker_connection> const& c)
+			{ return c->cancelled(); }), m_queued_udp.end());
+		update_queued_announces();
 	}
 
 	bool tracker_manager::empty() const
@@ -60,6 +60,14 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <mstcpip.h>
 #endif
 
+#if TORRENT_USE_MMSG
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/udp.h> // for UDP_SEGMENT
+#include <cstring> // for memcpy
+#endif
+
 namespace libtorrent {
 
 using namespace std::placeholders;
@@ -178,7 +186,7 @@ struct set_dont_frag
 udp_socket::udp_socket(io_context& ios, aux::listen_socket_handle ls)
 	: m_socket(ios)
 	, m_ioc(ios)
-	, m_buf(new receive_buffer())
+	, m_buf(new std::array<receive_buffer, read_batch_size>())
 	, m_listen_socket(std::move(ls))
 	, m_bind_port(0)
 	, m_abort(true)
@@ -186,14 +194,26 @@ udp_socket::udp_socket(io_context& ios, aux::listen_socket_handle ls)
 
 int udp_socket::read(span<packet> pkts, error_code& ec)
 {
-	auto const num = int(pkts.size());
+	auto const num = std::min(int(pkts.size()), read_batch_size);
 	int ret = 0;
-	packet p;
 
 	while (ret < num)
 	{
-		int const len = int(m_socket.receive_from(boost::asio::buffer(*m_buf)
+#if TORRENT_USE_MMSG
+		// receive as many packets as we have room for, with a single system
+		// call. They are stored in pkts, starting at ret
+		int const received = receive_batch(pkts.subspan(ret, num - ret), ret, ec);
+#else
+		packet& p = pkts[ret];
+		int const len = int(m_socket.receive_from(boost::asio::buffer((*m_buf)[std::size_t(ret)])
 			, p.from, 0, ec));
+		int const received = ec ? 0 : 1;
+		if (!ec)
+		{
+			p.data = {(*m_buf)[std::size_t(ret)].data(), len};
+			p.error.clear();
+		}
+#endif
 
 		if (ec == error::would_block
 			|| ec == error::try_again
@@ -215,12 +235,17 @@ int udp_socket::read(span<packet> pkts, error_code& ec)
 			// a proxy we must ignore these
 			if (m_proxy_settings.type != settings_pack::none) continue;
 
+			packet& p = pkts[ret];
 			p.error = ec;
 			p.data = span<char>();
+			return ret + 1;
 		}
-		else
+
+		// filter the packets we just received, and compact the ones we keep
+		int const end = ret + received;
+		for (int i = ret; i < end; ++i)
 		{
-			p.data = {m_buf->data(), len};
+			packet p = pkts[i];
 
 			// support packets coming from the SOCKS5 proxy
 			if (active_socks5())
@@ -243,19 +268,68 @@ int udp_socket::read(span<packet> pkts, error_code& ec)
 				// the proxy
 				if (m_proxy_settings.type != settings_pack::none && proxy_only) continue;
 			}
+
+			pkts[ret] = p;
+			++ret;
 		}
 
-		pkts[ret] = p;
-		++ret;
+#if TORRENT_USE_MMSG
+		// if we didn't fill up all the buffers, the socket has been drained.
+		// No need to make another system call just to find out
+		if (end < num)
+		{
+			ec = error::would_block;
+			return ret;
+		}
+#endif
+	}
+
+	return ret;
+}
 
-		// we only have a single buffer for now, so we can only return a
-		// single packet. In the future though, we could attempt to drain
-		// the socket here, or maybe even use recvmmsg()
-		break;
+#if TORRENT_USE_MMSG
+int udp_socket::receive_batch(span<packet> pkts, int const first_buf, error_code& ec)
+{
+	std::array<::mmsghdr, read_batch_size> msgs;
+	std::array<::iovec, read_batch_size> iov;
+	std::array<::sockaddr_storage, read_batch_size> addrs;
+
+	// packet i is received into buffer first_buf + i
+	int const num = std::min(int(pkts.size()), read_batch_size - first_buf);
+	for (int i = 0; i < num; ++i)
+	{
+		auto const idx = std::size_t(i);
+		receive_buffer& buf = (*m_buf)[std::size_t(first_buf + i)];
+		iov[idx].iov_base = buf.data();
+		iov[idx].iov_len = buf.size();
+		msgs[idx] = ::mmsghdr{};
+		msgs[idx].msg_hdr.msg_name = &addrs[idx];
+		msgs[idx].msg_hdr.msg_namelen = sizeof(addrs[idx]);
+		msgs[idx].msg_hdr.msg_iov = &iov[idx];
+		msgs[idx].msg_hdr.msg_iovlen = 1;
+	}
+
+	int const ret = ::recvmmsg(m_socket.native_handle(), msgs.data()
+		, static_cast<unsigned int>(num), MSG_DONTWAIT, nullptr);
+	if (ret < 0)
+	{
+		ec.assign(errno, system_category());
+		return 0;
 	}
+	ec.clear();
 
+	for (int i = 0; i < ret; ++i)
+	{
+		auto const idx = std::size_t(i);
+		packet& p = pkts[i];
+		p.data = {(*m_buf)[std::size_t(first_buf + i)].data(), int(msgs[idx].msg_len)};
+		p.error.clear();
+		std::memcpy(p.from.data(), &addrs[idx], msgs[idx].msg_hdr.msg_namelen);
+		p.from.resize(msgs[idx].msg_hdr.msg_namelen);
+	}
 	return ret;
 }
+#endif
 
 bool udp_socket::active_socks5() const
 {
@@ -332,13 +406,203 @@ void udp_socket::send(udp::endpoint const& ep, span<char const> p
 		return;
 	}
 
+	bool const df = (flags & dont_fragment) && aux::is_v4(ep);
+
+#if TORRENT_USE_MMSG
+	if (m_batching && p.size() <= std::ptrdiff_t(sizeof(receive_buffer)))
+	{
+		if (int(m_send_queue.size()) == send_batch_size)
+		{
+			flush_batch(ec);
+			m_batching = true;
+			if (ec) return;
+		}
+		if (!m_send_buf) m_send_buf.reset(new std::array<receive_buffer, send_batch_size>());
+		std::memcpy((*m_send_buf)[m_send_queue.size()].data(), p.data()
+			, static_cast<std::size_t>(p.size()));
+		m_send_queue.push_back({ep, int(p.size()), df});
+		return;
+	}
+
+	// packets must not be re-ordered, anything queued up has to go out
+	// first. That includes packets left over from a batch that didn't fit
+	// in the send buffer
+	if (!m_send_queue.empty())
+	{
+		bool const batching = m_batching;
+		flush_batch(ec);
+		m_batching = batching;
+		if (ec) return;
+	}
+#endif
+
 	// set the DF flag for the socket and clear it again in the destructor
-	set_dont_frag df(m_socket, (flags & dont_fragment)
-		&& aux::is_v4(ep));
+	set_dont_frag sdf(m_socket, df);
 
 	m_socket.send_to(boost::asio::buffer(p.data(), static_cast<std::size_t>(p.size())), ep, 0, ec);
 }
 
+void udp_socket::begin_batch()
+{
+#if TORRENT_USE_MMSG
+	TORRENT_ASSERT(is_single_thread());
+	m_batching = true;
+#endif
+}
+
+void udp_socket::flush_batch(error_code& ec)
+{
+#if TORRENT_USE_MMSG
+	TORRENT_ASSERT(is_single_thread());
+	m_batching = false;
+	if (m_send_queue.empty()) return;
+
+	span<queued_packet const> pkts = m_send_queue;
+	int first = 0;
+	while (first < int(pkts.size()))
+	{
+		// packets with and without the DF flag set have to be sent separately,
+		// since it's set on the socket
+		bool const df = pkts[first].dont_fragment;
+		int last = first + 1;
+		while (last < int(pkts.size()) && pkts[last].dont_fragment == df) ++last;
+
+		set_dont_frag sdf(m_socket, df);
+		int const sent = send_queued(pkts.subspan(first, last - first), first, ec);
+		first += sent;
+		if (ec) break;
+	}
+
+	if (first == int(m_send_queue.size()))
+	{
+		m_send_queue.clear();
+		return;
+	}
+
+	// the send buffer is full. Keep the packets that weren't sent, to send
+	// them once the socket is writable again. Packet i must stay in buffer i
+	int const left = int(m_send_queue.size()) - first;
+	std::memmove((*m_send_buf)[0].data(), (*m_send_buf)[std::size_t(first)].data()
+		, std::size_t(left) * sizeof(receive_buffer));
+	m_send_queue.erase(m_send_queue.begin(), m_send_queue.begin() + first);
+#else
+	TORRENT_UNUSED(ec);
+#endif
+}
+
+#if TORRENT_USE_MMSG
+int udp_socket::send_queued(span<queued_packet const> pkts, int const first_buf
+	, error_code& ec)
+{
+	// each message either holds a single packet, or a run of packets to the
+	// same endpoint, of the same size, which the kernel splits up into
+	// separate datagrams (generic segmentation offload). Only the last
+	// packet of such run may be smaller.
+	std::array<::mmsghdr, send_batch_size> msgs;
+	std::array<::iovec, send_batch_size> iov;
+#ifdef UDP_SEGMENT
+	using gso_cmsg = std::array<char, CMSG_SPACE(sizeof(std::uint16_t))>;
+	std::array<gso_cmsg, send_batch_size> control;
+#endif
+
+	int num_msgs = 0;
+	for (int i = 0; i < int(pkts.size()); ++i)
+	{
+		auto const idx = std::size_t(i);
+		iov[idx].iov_base = (*m_send_buf)[std::size_t(first_buf + i)].data();
+		iov[idx].iov_len = std::size_t(pkts[i].size);
+
+#ifdef UDP_SEGMENT
+		if (!m_disable_gso && num_msgs > 0)
+		{
+			::mmsghdr& prev = msgs[std::size_t(num_msgs - 1)];
+			auto const seg_size = prev.msg_hdr.msg_iov[0].iov_len;
+			auto const num_segs = prev.msg_hdr.msg_iovlen;
+			queued_packet const& first_seg = pkts[int(&prev.msg_hdr.msg_iov[0] - iov.data())];
+			// the segments must all be the same size, except the last one,
+			// which may be smaller. The kernel accepts at most 64 segments
+			if (first_seg.to == pkts[i].to
+				&& prev.msg_hdr.msg_iov[num_segs - 1].iov_len == seg_size
+				&& iov[idx].iov_len <= seg_size
+				&& num_segs < 64
+				&& (num_segs + 1) * seg_size <= 0xffff - 100)
+			{
+				++prev.msg_hdr.msg_iovlen;
+				continue;
+			}
+		}
+#endif
+
+		::mmsghdr& m = msgs[std::size_t(num_msgs)];
+		m = ::mmsghdr{};
+		m.msg_hdr.msg_name = const_cast<void*>(static_cast<void const*>(pkts[i].to.data()));
+		m.msg_hdr.msg_namelen = static_cast<socklen_t>(pkts[i].to.size());
+		m.msg_hdr.msg_iov = &iov[idx];
+		m.msg_hdr.msg_iovlen = 1;
+		++num_msgs;
+	}
+
+#ifdef UDP_SEGMENT
+	// messages made up of more than one packet need to tell the kernel the
+	// size of the segments
+	for (int i = 0; i < num_msgs; ++i)
+	{
+		::mmsghdr& m = msgs[std::size_t(i)];
+		if (m.msg_hdr.msg_iovlen < 2) continue;
+		gso_cmsg& c = control[std::size_t(i)];
+		c.fill(0);
+		m.msg_hdr.msg_control = c.data();
+		m.msg_hdr.msg_controllen = c.size();
+		::cmsghdr* cm = CMSG_FIRSTHDR(&m.msg_hdr);
+		cm->cmsg_level = IPPROTO_UDP;
+		cm->cmsg_type = UDP_SEGMENT;
+		cm->cmsg_len = CMSG_LEN(sizeof(std::uint16_t));
+		auto const seg_size = static_cast<std::uint16_t>(m.msg_hdr.msg_iov[0].iov_len);
+		std::memcpy(CMSG_DATA(cm), &seg_size, sizeof(seg_size));
+	}
+#endif
+
+	int sent = 0;
+	while (sent < num_msgs)
+	{
+		int const ret = ::sendmmsg(m_socket.native_handle(), msgs.data() + sent
+			, static_cast<unsigned int>(num_msgs - sent), MSG_DONTWAIT);
+		if (ret > 0)
+		{
+			sent += ret;
+			continue;
+		}
+
+		int const err = errno;
+		if (err == EINTR) continue;
+
+#ifdef UDP_SEGMENT
+		::mmsghdr& m = msgs[std::size_t(sent)];
+		if (m.msg_hdr.msg_iovlen > 1 && (err == EIO || err == EINVAL || err == ENOPROTOOPT))
+		{
+			// segmentation offload isn't supported, send the rest of the
+			// packets one at a time
+			m_disable_gso = true;
+			auto const first_pkt = int(m.msg_hdr.msg_iov - iov.data());
+			return first_pkt + send_queued(pkts.subspan(first_pkt), first_buf + first_pkt, ec);
+		}
+#endif
+
+		// if the send buffer is full, stop. The rest of the packets are sent
+		// once the socket is writable again. Any other error only affects
+		// this message, it's treated as packet loss and we keep sending the
+		// rest
+		if (err == EAGAIN || err == EWOULDBLOCK)
+		{
+			ec.assign(err, system_category());
+			return int(msgs[std::size_t(sent)].msg_hdr.msg_iov - iov.data());
+		}
+		++sent;
+	}
+	return int(pkts.size());
+}
+#endif
+
 void udp_socket::wrap(udp::endpoint const& ep, span<char const> p
 	, error_code& ec, udp_send_flags_t const flags)
 {
@@ -448,6 +712,10 @@ void udp_socket::close()
 	error_code ec;
 	m_socket.close(ec);
 	TORRENT_ASSERT_VAL(!ec || ec == error::bad_descriptor, ec);
+#if TORRENT_USE_MMSG
+	m_send_queue.clear();
+	m_batching = false;
+#endif
 	if (m_socks5_connection)
 	{
 		m_socks5_connection->close();
@@ -72,6 +72,8 @@ namespace libtorrent {
 		, m_attempts(0)
 		, m_state(action_t::error)
 		, m_abort(false)
+		, m_connecting(false)
+		, m_waiting_for_connect(false)
 	{
 		update_transaction_id();
 	}
@@ -135,6 +137,18 @@ namespace libtorrent {
 	void udp_tracker_connection::fail(error_code const& ec, operation_t const op
 		, char const* msg, seconds32 const interval, seconds32 const min_interval)
 	{
+		end_connect();
+		m_waiting_for_connect = false;
+
+		// the scrapes we sent on behalf of other connections failed too
+		auto const batch = std::move(m_scrape_batch);
+		m_scrape_batch.clear();
+		for (auto const& c : batch)
+		{
+			if (c->cancelled()) continue;
+			c->fail(ec, op, msg, interval, min_interval);
+		}
+
 		// m_target failed. remove it from the endpoint list
 		auto const i = std::find(m_endpoints.begin()
 			, m_endpoints.end(), make_tcp(m_target));
@@ -260,6 +274,9 @@ namespace libtorrent {
 
 	void udp_tracker_connection::start_announce()
 	{
+		if (cancelled()) return;
+		TORRENT_ASSERT(!m_connecting);
+
 		std::unique_lock<std::mutex> l(m_cache_mutex);
 		auto const cc = m_connection_cache.find(m_target.address());
 		if (cc != m_connection_cache.end())
@@ -279,9 +296,44 @@ namespace libtorrent {
 		}
 		l.unlock();
 
+		// only one connection at a time asks a tracker for a connection ID.
+		// The others wait for it, and pick the ID up from the cache. When
+		// going through a proxy, we don't know the tracker's address
+		if (m_hostname.empty())
+		{
+			if (!m_man.begin_udp_connect(m_target.address(), shared_from_this()))
+			{
+#ifndef TORRENT_DISABLE_LOGGING
+				std::shared_ptr<request_callback> cb = requester();
+				if (cb && cb->should_log())
+				{
+					cb->debug_log("*** UDP_TRACKER [ waiting for connect to: %s ]"
+						, print_endpoint(m_target).c_str());
+				}
+#endif
+				m_waiting_for_connect = true;
+				return;
+			}
+			m_connecting = true;
+		}
+
 		send_udp_connect();
 	}
 
+	void udp_tracker_connection::resume_connect()
+	{
+		if (!m_waiting_for_connect) return;
+		m_waiting_for_connect = false;
+		start_announce();
+	}
+
+	void udp_tracker_connection::end_connect()
+	{
+		if (!m_connecting) return;
+		m_connecting = false;
+		m_man.end_udp_connect(m_target.address());
+	}
+
 	void udp_tracker_connection::on_timeout(error_code const& ec)
 	{
 		if (ec)
@@ -300,6 +352,18 @@ namespace libtorrent {
 	void udp_tracker_connection::close()
 	{
 		cancel();
+		end_connect();
+
+		// we're closed before the response to a batched scrape arrived. The
+		// other scrapes in it are sent again
+		for (auto const& c : m_scrape_batch)
+		{
+			if (c->cancelled()) continue;
+			post(c->get_executor(), std::bind(
+				&udp_tracker_connection::start_announce, c));
+		}
+		m_scrape_batch.clear();
+
 		m_man.remove_request(this);
 	}
 
@@ -451,6 +515,9 @@ namespace libtorrent {
 		cce.connection_id = connection_id;
 		cce.expires = aux::time_now() + seconds(m_man.settings().get_int(settings_pack::udp_tracker_token_expiry));
 
+		// let the connections waiting for this connection ID use it
+		end_connect();
+
 		if (!(tracker_req().kind & tracker_request::scrape_request))
 			send_udp_announce();
 		else if (tracker_req().kind & tracker_request::scrape_request)
@@ -530,22 +597,69 @@ namespace libtorrent {
 	{
 		if (m_abort) return;
 
+		m_state = action_t::scrape;
+
+		// this may be called with the connection cache locked, so the request
+		// is always sent from a separate handler. When going through a proxy,
+		// we don't know the tracker's endpoint to batch scrapes on
+		if (!m_hostname.empty())
+		{
+			post(get_executor(), std::bind(&udp_tracker_connection::send_udp_scrape_batch
+				, shared_from_this(), std::vector<std::shared_ptr<udp_tracker_connection>>()));
+			return;
+		}
+
+		m_man.queue_udp_scrape(shared_from_this());
+	}
+
+	void udp_tracker_connection::send_udp_scrape_batch(
+		std::vector<std::shared_ptr<udp_tracker_connection>> batch)
+	{
+		if (m_abort || cancelled()) return;
+
+		std::unique_lock<std::mutex> l(m_cache_mutex);
 		auto const i = m_connection_cache.find(m_target.address());
-		// this isn't really supposed to happen
-		TORRENT_ASSERT(i != m_connection_cache.end());
-		if (i == m_connection_cache.end()) return;
+		if (i == m_connection_cache.end() || aux::time_now() >= i->second.expires)
+		{
+			// the connection ID expired while the scrapes were waiting to be
+			// sent. Start over
+			l.unlock();
+			for (auto const& c : batch)
+			{
+				post(c->get_executor(), std::bind(
+					&udp_tracker_connection::start_announce, c));
+			}
+			start_announce();
+			return;
+		}
+		std::int64_t const connection_id = i->second.connection_id;
+		l.unlock();
 
-		char buf[8 + 4 + 4 + 20];
+		std::vector<char> buf(8 + 4 + 4 + 20 * (batch.size() + 1));
 		span<char> view = buf;
 
-		aux::write_int64(i->second.connection_id, view); // connection_id
+		aux::write_int64(connection_id, view); // connection_id
 		aux::write_int32(action_t::scrape, view); // action (scrape)
 		aux::write_int32(m_transaction_id, view); // transaction_id
-		// info_hash
+		// info_hashes
 		std::copy(tracker_req().info_hash.begin(), tracker_req().info_hash.end()
 			, view.data());
-#if TORRENT_USE_ASSERTS
-		TORRENT_ASSERT(view.size() == 20);
+		view = view.subspan(20);
+		for (auto const& c : batch)
+		{
+			std::copy(c->tracker_req().info_hash.begin(), c->tracker_req().info_hash.end()
+				, view.data());
+			view = view.subspan(20);
+		}
+		TORRENT_ASSERT(view.empty());
+
+#ifndef TORRENT_DISABLE_LOGGING
+		std::shared_ptr<request_callback> cb = requester();
+		if (cb && cb->should_log())
+		{
+			cb->debug_log("==> UDP_TRACKER_SCRAPE [ %s info-hashes: %d ]"
+				, aux::to_hex(tracker_req().info_hash).c_str(), int(batch.size()) + 1);
+		}
 #endif
 
 		error_code ec;
@@ -560,8 +674,9 @@ namespace libtorrent {
 				, udp_socket::tracker_connection);
 		}
 		m_state = action_t::scrape;
-		sent_bytes(sizeof(buf) + 28); // assuming UDP/IP header
+		sent_bytes(int(buf.size()) + 28); // assuming UDP/IP header
 		++m_attempts;
+		m_scrape_batch = std::move(batch);
 		if (ec)
 		{
 			fail(ec, operation_t::sock_write);
@@ -569,6 +684,18 @@ namespace libtorrent {
 		}
 	}
 
+	void udp_tracker_connection::scrape_response(int const complete
+		, int const downloaded, int const incomplete)
+	{
+		std::shared_ptr<request_callback> cb = requester();
+		if (cb)
+		{
+			cb->tracker_scrape_response(tracker_req()
+				, complete, incomplete, downloaded, -1);
+		}
+		close();
+	}
+
 	bool udp_tracker_connection::on_announce_response(span<char const> buf)
 	{
 		if (buf.size() < 20) return false;
@@ -672,21 +799,30 @@ namespace libtorrent {
 			return true;
 		}
 
+		// the response has one entry per info-hash, in the order they were
+		// sent. The first one is ours
 		int const complete = aux::read_int32(buf);
 		int const downloaded = aux::read_int32(buf);
 		int const incomplete = aux::read_int32(buf);
 
-		std::shared_ptr<request_callback> cb = requester();
-		if (!cb)
+		auto const batch = std::move(m_scrape_batch);
+		m_scrape_batch.clear();
+		scrape_response(complete, downloaded, incomplete);
+
+		for (auto const& c : batch)
 		{
-			close();
-			return true;
+			if (buf.size() < 12)
+			{
+				if (!c->cancelled())
+					c->fail(error_code(errors::invalid_tracker_response_length), operation_t::bittorrent);
+				continue;
+			}
+			int const c_complete = aux::read_int32(buf);
+			int const c_downloaded = aux::read_int32(buf);
+			int const c_incomplete = aux::read_int32(buf);
+			if (c->cancelled()) continue;
+			c->scrape_response(c_complete, c_downloaded, c_incomplete);
 		}
-
-		cb->tracker_scrape_response(tracker_req()
-			, complete, incomplete, downloaded, -1);
-
-		close();
 		return true;
 	}
 
@@ -71,17 +71,21 @@ namespace aux {
 
 	void utp_socket_manager::tick(time_point now)
 	{
-		for (auto i = m_utp_sockets.begin()
-			, end(m_utp_sockets.end()); i != end;)
+		// the order sockets are ticked in doesn't matter, so deleted sockets
+		// are swapped with the last one and popped
+		for (std::size_t i = 0; i < m_utp_sockets.size();)
 		{
-			if (i->second->should_delete())
+			utp_socket_impl* s = m_utp_sockets[i].get();
+			if (s->should_delete())
 			{
-				if (m_last_socket == i->second.get()) m_last_socket = nullptr;
-				if (m_deferred_ack == i->second.get()) m_deferred_ack = nullptr;
-				i = m_utp_sockets.erase(i);
+				if (m_last_socket == s) m_last_socket = nullptr;
+				if (m_deferred_ack == s) m_deferred_ack = nullptr;
+				m_socket_index.erase(s->remote_endpoint(), s->receive_id(), s);
+				std::swap(m_utp_sockets[i], m_utp_sockets.back());
+				m_utp_sockets.pop_back();
 				continue;
 			}
-			i->second->tick(now);
+			s->tick(now);
 			++i;
 		}
 	}
@@ -167,13 +171,11 @@ namespace aux {
 			m_deferred_ack = nullptr;
 		}
 
-		auto r = m_utp_sockets.equal_range(id);
-
-		for (; r.first != r.second; ++r.first)
+		if (utp_socket_impl* s = m_socket_index.find(ep, id))
 		{
-			if (!r.first->second->match(ep, id)) continue;
-			bool const ret = r.first->second->incoming_packet(p, ep, receive_time);
-			if (ret) m_last_socket = r.first->second.get();
+			TORRENT_ASSERT(s->match(ep, id));
+			bool const ret = s->incoming_packet(p, ep, receive_time);
+			if (ret) m_last_socket = s;
 			return ret;
 		}
 
@@ -213,6 +215,7 @@ namespace aux {
 			str->get_impl()->m_sock = std::move(socket);
 			bool const ret = str->get_impl()->incoming_packet(p, ep, receive_time);
 			if (!ret) return false;
+			bind_socket(str->get_impl());
 			m_last_socket = str->get_impl();
 			m_cb(std::move(c));
 			// the connection most likely changed its connection ID here
@@ -283,20 +286,18 @@ namespace aux {
 		auto iface = sock.lock();
 		for (auto& s : m_utp_sockets)
 		{
-			if (s.second->m_sock.lock() != iface)
+			if (s->m_sock.lock() != iface)
 				continue;
 
-			s.second->abort();
+			s->abort();
 		}
 	}
 
-	void utp_socket_manager::remove_socket(std::uint16_t const id)
+	void utp_socket_manager::bind_socket(utp_socket_impl* s)
 	{
-		auto const i = m_utp_sockets.find(id);
-		if (i == m_utp_sockets.end()) return;
-		if (m_last_socket == i->second.get()) m_last_socket = nullptr;
-		if (m_deferred_ack == i->second.get()) m_deferred_ack = nullptr;
-		m_utp_sockets.erase(i);
+		// if there already is a socket with the same remote endpoint and
+		// connection ID, that one keeps receiving the packets
+		m_socket_index.insert(s->remote_endpoint(), s->receive_id(), s);
 	}
 
 	void utp_socket_manager::inc_stats_counter(int counter, int delta)
@@ -325,7 +326,7 @@ namespace aux {
 		}
 		auto impl = std::make_unique<utp_socket_impl>(recv_id, send_id, str, *this);
 		auto const ret = impl.get();
-		m_utp_sockets.emplace(recv_id, std::move(impl));
+		m_utp_sockets.push_back(std::move(impl));
 		return ret;
 	}
 }
@@ -0,0 +1,170 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/utp_socket_table.hpp"
+#include "libtorrent/assert.hpp"
+
+#include <algorithm>
+#include <cstring> // for memcpy
+
+namespace libtorrent {
+namespace aux {
+
+	utp_socket_table::slot utp_socket_table::make_key(udp::endpoint const& ep
+		, std::uint16_t const id)
+	{
+		slot ret;
+		ret.addr.fill(0);
+		ret.port = ep.port();
+		ret.id = id;
+		ret.v4 = ep.address().is_v4();
+		if (ret.v4)
+		{
+			auto const b = ep.address().to_v4().to_bytes();
+			std::memcpy(ret.addr.data(), b.data(), b.size());
+		}
+		else
+		{
+			ret.addr = ep.address().to_v6().to_bytes();
+		}
+		return ret;
+	}
+
+	bool utp_socket_table::same_key(slot const& lhs, slot const& rhs)
+	{
+		return lhs.id == rhs.id
+			&& lhs.port == rhs.port
+			&& lhs.v4 == rhs.v4
+			&& lhs.addr == rhs.addr;
+	}
+
+	std::uint64_t utp_socket_table::hash(slot const& k)
+	{
+		std::uint64_t a;
+		std::uint64_t b;
+		std::memcpy(&a, k.addr.data(), 8);
+		std::memcpy(&b, k.addr.data() + 8, 8);
+		std::uint64_t h = (a * 0x9e3779b97f4a7c15ull)
+			^ (b * 0xc2b2ae3d27d4eb4full)
+			^ ((std::uint64_t(k.port) << 16) | k.id | (std::uint64_t(k.v4) << 32));
+		// finalizer from MurmurHash3, to spread the entropy of the
+		// connection ID and port into the low bits
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ull;
+		h ^= h >> 33;
+		return h;
+	}
+
+	std::size_t utp_socket_table::home_slot(slot const& k) const
+	{
+		TORRENT_ASSERT(!m_slots.empty());
+		return std::size_t(hash(k)) & (m_slots.size() - 1);
+	}
+
+	std::size_t utp_socket_table::find_slot(slot const& k) const
+	{
+		std::size_t const mask = m_slots.size() - 1;
+		std::size_t i = home_slot(k);
+		// since the table is never full, this is guaranteed to terminate
+		while (m_slots[i].socket != nullptr && !same_key(m_slots[i], k))
+			i = (i + 1) & mask;
+		return i;
+	}
+
+	utp_socket_impl* utp_socket_table::find(udp::endpoint const& ep
+		, std::uint16_t const id) const
+	{
+		if (m_size == 0) return nullptr;
+		return m_slots[find_slot(make_key(ep, id))].socket;
+	}
+
+	bool utp_socket_table::insert(udp::endpoint const& ep, std::uint16_t const id
+		, utp_socket_impl* const s)
+	{
+		TORRENT_ASSERT(s != nullptr);
+		if ((m_size + 1) * 2 > int(m_slots.size())) grow();
+
+		slot k = make_key(ep, id);
+		std::size_t const i = find_slot(k);
+		if (m_slots[i].socket != nullptr) return false;
+		k.socket = s;
+		m_slots[i] = k;
+		++m_size;
+		return true;
+	}
+
+	bool utp_socket_table::erase(udp::endpoint const& ep, std::uint16_t const id
+		, utp_socket_impl const* const s)
+	{
+		if (m_size == 0) return false;
+		std::size_t i = find_slot(make_key(ep, id));
+		if (m_slots[i].socket != s || s == nullptr) return false;
+
+		// backward shift deletion. Move entries following the hole back into
+		// it, unless that would move them before their home slot. This keeps
+		// probe sequences intact without tombstones
+		std::size_t const mask = m_slots.size() - 1;
+		m_slots[i].socket = nullptr;
+		for (std::size_t j = (i + 1) & mask; m_slots[j].socket != nullptr; j = (j + 1) & mask)
+		{
+			std::size_t const home = home_slot(m_slots[j]);
+			// the number of steps from the home slot to the hole, and to the
+			// entry's current position
+			if (((i - home) & mask) >= ((j - home) & mask)) continue;
+			m_slots[i] = m_slots[j];
+			m_slots[j].socket = nullptr;
+			i = j;
+		}
+		--m_size;
+		return true;
+	}
+
+	void utp_socket_table::clear()
+	{
+		m_slots.clear();
+		m_size = 0;
+	}
+
+	void utp_socket_table::grow()
+	{
+		std::vector<slot> old(std::max(std::size_t(16), m_slots.size() * 2));
+		old.swap(m_slots);
+		for (auto const& s : old)
+		{
+			if (s.socket == nullptr) continue;
+			m_slots[find_slot(s)] = s;
+		}
+	}
+}
+}
@@ -706,6 +706,7 @@ void utp_socket_impl::do_connect(tcp::endpoint const& ep)
 	TORRENT_ASSERT(m_connect_handler == false);
 	m_remote_address = ep.address();
 	m_port = ep.port();
+	m_sm.bind_socket(this);
 
 	m_connect_handler = true;
 
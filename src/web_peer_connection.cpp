@@ -1097,6 +1097,25 @@ void web_peer_connection::incoming_payload(char const* buf, int len)
 		// m_piece may not hold more than the response to the next BT request
 		TORRENT_ASSERT(front_request.length > piece_size);
 
+		if (piece_size == 0 && copy_size == front_request.length)
+		{
+			// the whole response to this request is in the receive buffer.
+			// Pass it on from there, rather than copying it into m_piece first
+			len -= copy_size;
+			incoming_piece_fragment(copy_size);
+
+#ifndef TORRENT_DISABLE_LOGGING
+			peer_log(peer_log_alert::incoming_message, "POP_REQUEST"
+				, "piece: %d start: %d len: %d"
+				, static_cast<int>(front_request.piece), front_request.start, front_request.length);
+#endif
+			peer_request const front_request_copy = front_request;
+			m_requests.pop_front();
+			incoming_piece(front_request_copy, buf);
+			buf += copy_size;
+			continue;
+		}
+
 		// copy_size is the number of bytes we need to add to the end of m_piece
 		// to not exceed the size of the next bittorrent request to be delivered.
 		// m_piece can only hold the response for a single BT request at a time
@@ -0,0 +1,256 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/write_hasher.hpp"
+#include "libtorrent/disk_interface.hpp" // for default_block_size
+
+#include <algorithm>
+
+namespace libtorrent {
+namespace aux {
+
+	constexpr int write_hasher::max_pieces;
+	constexpr int write_hasher::max_staged_blocks;
+	constexpr std::size_t write_hasher::num_shards;
+
+	std::size_t write_hasher::shard_index(storage_index_t const storage
+		, piece_index_t const piece)
+	{
+		std::size_t ret = 0;
+		boost::hash_combine(ret, std::hash<storage_index_t>{}(storage));
+		boost::hash_combine(ret, std::hash<piece_index_t>{}(piece));
+		return ret % num_shards;
+	}
+
+	void write_hasher::block_written(torrent_location const loc
+		, disk_buffer_holder& buffer, int const v1_len, int const v2_len
+		, int const blocks_in_piece2)
+	{
+		if (v1_len == 0 && v2_len == 0) return;
+
+		int const block = loc.offset / default_block_size;
+
+		// v2 block hashes don't depend on any other block, compute it before
+		// taking the lock
+		sha256_hash v2_hash;
+		if (v2_len > 0) v2_hash = hasher256(buffer.data(), v2_len).final();
+
+		shard& s = m_shards[shard_index(loc.torrent, loc.piece)];
+		std::lock_guard<std::mutex> l(s.mutex);
+
+		torrent_location const key{loc.torrent, loc.piece, 0};
+		auto it = s.pieces.find(key);
+		if (it == s.pieces.end())
+		{
+			if (int(s.pieces.size()) >= max_pieces / int(num_shards))
+				evict_piece(s);
+			it = s.pieces.emplace(key, piece_state{}).first;
+		}
+
+		piece_state& st = it->second;
+		st.last_use = ++s.clock;
+
+		if (st.hashed)
+		{
+			// this is one of the writes that were outstanding when the piece
+			// was hashed
+			if (--st.outstanding_writes <= 0 && st.writes_counted)
+				s.pieces.erase(it);
+			return;
+		}
+
+		if (st.invalid) return;
+
+		if ((v1_len > 0 && (block < st.v1_blocks
+				|| std::any_of(st.staged.begin(), st.staged.end()
+					, [=](piece_state::staged_block const& b) { return b.block == block; })))
+			|| (v2_len > 0 && st.has_v2_hash(block)))
+		{
+			// this block has been written before, and the hash we have may not
+			// reflect what's on disk now
+			release_staged(st);
+			st.invalid = true;
+			return;
+		}
+
+		if (v2_len > 0)
+		{
+			if (st.v2_hashes.empty())
+			{
+				st.v2_hashes.resize(blocks_in_piece2);
+				st.v2_hashed.resize(blocks_in_piece2, false);
+			}
+			TORRENT_ASSERT(block < blocks_in_piece2);
+			st.v2_hashes[block] = v2_hash;
+			st.v2_hashed.set_bit(block);
+		}
+
+		if (v1_len == 0) return;
+
+		if (block == st.v1_blocks)
+		{
+			st.h.update(buffer.data(), v1_len);
+			++st.v1_blocks;
+			feed_staged(st);
+			return;
+		}
+
+		if (m_num_staged.fetch_add(1, std::memory_order_relaxed) >= max_staged_blocks)
+		{
+			// the staging area is full. This block will be read back from disk
+			// when the piece is hashed
+			m_num_staged.fetch_sub(1, std::memory_order_relaxed);
+			return;
+		}
+		st.staged.push_back({block, v1_len, std::move(buffer)});
+	}
+
+	void write_hasher::evict_piece(shard& s)
+	{
+		// make room by evicting the piece that was written to least recently.
+		// Its remaining blocks will be read back when it's hashed. Pieces that
+		// have been hashed are kept until their outstanding writes complete,
+		// or those writes would start a new piece state from the middle of the
+		// piece. If all pieces are in that state, the shard grows temporarily
+		auto victim = s.pieces.end();
+		for (auto it = s.pieces.begin(); it != s.pieces.end(); ++it)
+		{
+			if (it->second.hashed) continue;
+			if (victim == s.pieces.end() || it->second.last_use < victim->second.last_use)
+				victim = it;
+		}
+		if (victim == s.pieces.end()) return;
+		release_staged(victim->second);
+		s.pieces.erase(victim);
+	}
+
+	void write_hasher::feed_staged(piece_state& st)
+	{
+		for (;;)
+		{
+			auto const it = std::find_if(st.staged.begin(), st.staged.end()
+				, [&](piece_state::staged_block const& b) { return b.block == st.v1_blocks; });
+			if (it == st.staged.end()) return;
+			st.h.update(it->buffer.data(), it->len);
+			++st.v1_blocks;
+			st.staged.erase(it);
+			m_num_staged.fetch_sub(1, std::memory_order_relaxed);
+		}
+	}
+
+	void write_hasher::release_staged(piece_state& st)
+	{
+		m_num_staged.fetch_sub(int(st.staged.size()), std::memory_order_relaxed);
+		st.staged.clear();
+	}
+
+	bool write_hasher::take(storage_index_t const storage
+		, piece_index_t const piece, piece_state& st)
+	{
+		shard& s = m_shards[shard_index(storage, piece)];
+		std::lock_guard<std::mutex> l(s.mutex);
+
+		// leave an entry behind, marked as hashed, for the writes that are
+		// still outstanding to find
+		piece_state& e = s.pieces[torrent_location{storage, piece, 0}];
+		// the piece is already being hashed
+		if (e.hashed) return false;
+
+		bool const ret = !e.invalid;
+		if (ret)
+		{
+			m_num_staged.fetch_sub(int(e.staged.size()), std::memory_order_relaxed);
+			st = std::move(e);
+		}
+		else
+		{
+			release_staged(e);
+		}
+		e = piece_state{};
+		e.hashed = true;
+		return ret;
+	}
+
+	void write_hasher::hashed(storage_index_t const storage
+		, piece_index_t const piece, int const outstanding_writes)
+	{
+		shard& s = m_shards[shard_index(storage, piece)];
+		std::lock_guard<std::mutex> l(s.mutex);
+
+		auto const it = s.pieces.find(torrent_location{storage, piece, 0});
+		if (it == s.pieces.end() || !it->second.hashed || it->second.writes_counted)
+			return;
+
+		// outstanding writes that completed since take() have already
+		// decremented the counter
+		it->second.outstanding_writes += outstanding_writes;
+		it->second.writes_counted = true;
+		if (it->second.outstanding_writes <= 0) s.pieces.erase(it);
+	}
+
+	void write_hasher::clear_piece(storage_index_t const storage
+		, piece_index_t const piece)
+	{
+		shard& s = m_shards[shard_index(storage, piece)];
+		std::lock_guard<std::mutex> l(s.mutex);
+
+		auto const it = s.pieces.find(torrent_location{storage, piece, 0});
+		if (it == s.pieces.end()) return;
+		release_staged(it->second);
+		s.pieces.erase(it);
+	}
+
+	void write_hasher::clear_storage(storage_index_t const storage)
+	{
+		for (auto& s : m_shards)
+		{
+			std::lock_guard<std::mutex> l(s.mutex);
+			for (auto it = s.pieces.begin(); it != s.pieces.end();)
+			{
+				if (it->first.torrent != storage) { ++it; continue; }
+				release_staged(it->second);
+				it = s.pieces.erase(it);
+			}
+		}
+	}
+
+	void write_hasher::clear()
+	{
+		for (auto& s : m_shards)
+		{
+			std::lock_guard<std::mutex> l(s.mutex);
+			for (auto& p : s.pieces) release_staged(p.second);
+			s.pieces.clear();
+		}
+	}
+}
+}
@@ -33,6 +33,8 @@ POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <cstdint>
+#include <algorithm>
+#include <iterator>
 
 #include "libtorrent/bdecode.hpp"
 #include "libtorrent/write_resume_data.hpp"
@@ -42,20 +44,15 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/aux_/numeric_cast.hpp"
 #include "libtorrent/torrent.hpp" // for default_piece_priority
 #include "libtorrent/aux_/numeric_cast.hpp" // for clamp
+#include "libtorrent/aux_/resume_journal.hpp"
 
 namespace libtorrent {
 
-	entry write_resume_data(add_torrent_params const& atp)
-	{
-		entry ret;
-
-		using namespace libtorrent::aux; // for write_*_endpoint()
-		ret["file-format"] = "libtorrent resume file";
-		ret["file-version"] = 1;
-		ret["libtorrent-version"] = lt::version_str;
-		ret["allocation"] = atp.storage_mode == storage_mode_allocate
-			? "allocate" : "sparse";
+namespace {
 
+	// the small fields, that are saved in every record
+	void write_state(entry& ret, add_torrent_params const& atp)
+	{
 		ret["total_uploaded"] = atp.total_uploaded;
 		ret["total_downloaded"] = atp.total_downloaded;
 
@@ -100,63 +97,6 @@ namespace libtorrent {
 		if (!atp.url.empty()) ret["url"] = atp.url;
 #endif
 
-		ret["info-hash"] = atp.info_hashes.v1;
-		ret["info-hash2"] = atp.info_hashes.v2;
-
-		if (atp.ti)
-		{
-			auto const info = atp.ti->info_section();
-			ret["info"].preformatted().assign(info.data(), info.data() + info.size());
-			if (!atp.ti->comment().empty())
-				ret["comment"] = atp.ti->comment();
-			if (atp.ti->creation_date() != 0)
-				ret["creation date"] = atp.ti->creation_date();
-			if (!atp.ti->creator().empty())
-				ret["created by"] = atp.ti->creator();
-		}
-
-		if (!atp.merkle_trees.empty())
-		{
-			auto& trees = atp.merkle_trees;
-			auto& ret_trees = ret["trees"].list();
-			ret_trees.reserve(atp.merkle_trees.size());
-			for (file_index_t f(0); f < file_index_t{int(atp.merkle_trees.size())}; ++f)
-			{
-				auto const& tree = trees[f];
-				ret_trees.emplace_back(entry::dictionary_t);
-				auto& ret_dict = ret_trees.back().dict();
-				auto& ret_tree = ret_dict["hashes"].string();
-
-				ret_tree.reserve(tree.size() * 32);
-				for (auto const& n : tree)
-					ret_tree.append(n.data(), n.size());
-
-				if (f < atp.verified_leaf_hashes.end_index())
-				{
-					auto const& verified = atp.verified_leaf_hashes[f];
-					if (!verified.empty())
-					{
-						auto& ret_verified = ret_dict["verified"].string();
-						ret_verified.reserve(verified.size());
-						for (auto const bit : verified)
-							ret_verified.push_back(bit ? '1' : '0');
-					}
-				}
-
-				if (f < atp.merkle_tree_mask.end_index())
-				{
-					auto const& mask = atp.merkle_tree_mask[f];
-					if (!mask.empty())
-					{
-						auto& ret_mask = ret_dict["mask"].string();
-						ret_mask.reserve(mask.size());
-						for (auto const bit : mask)
-							ret_mask.push_back(bit ? '1' : '0');
-					}
-				}
-			}
-		}
-
 		if (!atp.unfinished_pieces.empty())
 		{
 			entry::list_type& up = ret["unfinished"].list();
@@ -201,6 +141,68 @@ namespace libtorrent {
 		entry::list_type& httpseeds_list = ret["httpseeds"].list();
 		std::copy(atp.http_seeds.begin(), atp.http_seeds.end(), std::back_inserter(httpseeds_list));
 
+		// write renamed files
+		if (!atp.renamed_files.empty())
+		{
+			entry::list_type& fl = ret["mapped_files"].list();
+			for (auto const& ent : atp.renamed_files)
+			{
+				auto const idx = static_cast<std::size_t>(static_cast<int>(ent.first));
+				if (idx >= fl.size()) fl.resize(idx + 1);
+				fl[idx] = ent.second;
+			}
+		}
+
+		ret["upload_rate_limit"] = atp.upload_limit;
+		ret["download_rate_limit"] = atp.download_limit;
+		ret["max_connections"] = atp.max_connections;
+		ret["max_uploads"] = atp.max_uploads;
+	}
+
+	void write_trees(entry& ret, add_torrent_params const& atp)
+	{
+		auto& trees = atp.merkle_trees;
+		auto& ret_trees = ret["trees"].list();
+		ret_trees.reserve(atp.merkle_trees.size());
+		for (file_index_t f(0); f < file_index_t{int(atp.merkle_trees.size())}; ++f)
+		{
+			auto const& tree = trees[f];
+			ret_trees.emplace_back(entry::dictionary_t);
+			auto& ret_dict = ret_trees.back().dict();
+			auto& ret_tree = ret_dict["hashes"].string();
+
+			ret_tree.reserve(tree.size() * 32);
+			for (auto const& n : tree)
+				ret_tree.append(n.data(), n.size());
+
+			if (f < atp.verified_leaf_hashes.end_index())
+			{
+				auto const& verified = atp.verified_leaf_hashes[f];
+				if (!verified.empty())
+				{
+					auto& ret_verified = ret_dict["verified"].string();
+					ret_verified.reserve(verified.size());
+					for (auto const bit : verified)
+						ret_verified.push_back(bit ? '1' : '0');
+				}
+			}
+
+			if (f < atp.merkle_tree_mask.end_index())
+			{
+				auto const& mask = atp.merkle_tree_mask[f];
+				if (!mask.empty())
+				{
+					auto& ret_mask = ret_dict["mask"].string();
+					ret_mask.reserve(mask.size());
+					for (auto const bit : mask)
+						ret_mask.push_back(bit ? '1' : '0');
+				}
+			}
+		}
+	}
+
+	void write_pieces(entry& ret, add_torrent_params const& atp)
+	{
 		// write have bitmask
 		entry::string_type& pieces = ret["pieces"].string();
 		pieces.resize(aux::numeric_cast<std::size_t>(std::max(
@@ -219,68 +221,101 @@ namespace libtorrent {
 			pieces[piece] |= bit ? 2 : 0;
 			++piece;
 		}
+	}
 
-		// write renamed files
-		if (!atp.renamed_files.empty())
+	void write_peers(entry& ret, char const* key, char const* key6
+		, std::vector<tcp::endpoint> const& peers)
+	{
+		using namespace libtorrent::aux; // for write_*_endpoint()
+		std::back_insert_iterator<entry::string_type> ptr(ret[key].string());
+		std::back_insert_iterator<entry::string_type> ptr6(ret[key6].string());
+		for (auto const& p : peers)
 		{
-			entry::list_type& fl = ret["mapped_files"].list();
-			for (auto const& ent : atp.renamed_files)
-			{
-				auto const idx = static_cast<std::size_t>(static_cast<int>(ent.first));
-				if (idx >= fl.size()) fl.resize(idx + 1);
-				fl[idx] = ent.second;
-			}
+			if (is_v6(p))
+				write_endpoint(p, ptr6);
+			else
+				write_endpoint(p, ptr);
 		}
+	}
 
-		// write local peers
-		if (!atp.peers.empty())
-		{
-			std::back_insert_iterator<entry::string_type> ptr(ret["peers"].string());
-			std::back_insert_iterator<entry::string_type> ptr6(ret["peers6"].string());
-			for (auto const& p : atp.peers)
-			{
-				if (is_v6(p))
-					write_endpoint(p, ptr6);
-				else
-					write_endpoint(p, ptr);
-			}
-		}
+	void write_file_priorities(entry& ret, add_torrent_params const& atp)
+	{
+		entry::list_type& prio = ret["file_priority"].list();
+		prio.reserve(atp.file_priorities.size());
+		for (auto const p : atp.file_priorities)
+			prio.emplace_back(static_cast<std::uint8_t>(p));
+	}
 
-		if (!atp.banned_peers.empty())
+	void write_piece_priorities(entry& ret, add_torrent_params const& atp)
+	{
+		entry::string_type& prio = ret["piece_priority"].string();
+		prio.reserve(atp.piece_priorities.size());
+		for (auto const p : atp.piece_priorities)
+			prio.push_back(static_cast<char>(static_cast<std::uint8_t>(p)));
+	}
+
+	std::vector<tcp::endpoint> sorted(std::vector<tcp::endpoint> v)
+	{
+		std::sort(v.begin(), v.end());
+		return v;
+	}
+
+	// the elements in ``lhs`` that are not in ``rhs``. Both are sorted
+	std::vector<tcp::endpoint> difference(std::vector<tcp::endpoint> const& lhs
+		, std::vector<tcp::endpoint> const& rhs)
+	{
+		std::vector<tcp::endpoint> ret;
+		std::set_difference(lhs.begin(), lhs.end(), rhs.begin(), rhs.end()
+			, std::back_inserter(ret));
+		return ret;
+	}
+}
+
+	entry write_resume_data(add_torrent_params const& atp)
+	{
+		entry ret;
+
+		ret["file-format"] = "libtorrent resume file";
+		ret["file-version"] = 1;
+		ret["libtorrent-version"] = lt::version_str;
+		ret["allocation"] = atp.storage_mode == storage_mode_allocate
+			? "allocate" : "sparse";
+
+		write_state(ret, atp);
+
+		ret["info-hash"] = atp.info_hashes.v1;
+		ret["info-hash2"] = atp.info_hashes.v2;
+
+		if (atp.ti)
 		{
-			std::back_insert_iterator<entry::string_type> ptr(ret["banned_peers"].string());
-			std::back_insert_iterator<entry::string_type> ptr6(ret["banned_peers6"].string());
-			for (auto const& p : atp.banned_peers)
-			{
-				if (is_v6(p))
-					write_endpoint(p, ptr6);
-				else
-					write_endpoint(p, ptr);
-			}
+			auto const info = atp.ti->info_section();
+			ret["info"].preformatted().assign(info.data(), info.data() + info.size());
+			if (!atp.ti->comment().empty())
+				ret["comment"] = atp.ti->comment();
+			if (atp.ti->creation_date() != 0)
+				ret["creation date"] = atp.ti->creation_date();
+			if (!atp.ti->creator().empty())
+				ret["created by"] = atp.ti->creator();
 		}
 
-		ret["upload_rate_limit"] = atp.upload_limit;
-		ret["download_rate_limit"] = atp.download_limit;
-		ret["max_connections"] = atp.max_connections;
-		ret["max_uploads"] = atp.max_uploads;
+		if (!atp.merkle_trees.empty())
+			write_trees(ret, atp);
+
+		write_pieces(ret, atp);
+
+		// write local peers
+		if (!atp.peers.empty())
+			write_peers(ret, "peers", "peers6", atp.peers);
+
+		if (!atp.banned_peers.empty())
+			write_peers(ret, "banned_peers", "banned_peers6", atp.banned_peers);
 
 		if (!atp.file_priorities.empty())
-		{
-			// write file priorities
-			entry::list_type& prio = ret["file_priority"].list();
-			prio.reserve(atp.file_priorities.size());
-			for (auto const p : atp.file_priorities)
-				prio.emplace_back(static_cast<std::uint8_t>(p));
-		}
+			write_file_priorities(ret, atp);
 
+		// write piece priorities
 		if (!atp.piece_priorities.empty())
-		{
-			// write piece priorities
-			entry::string_type& prio = ret["piece_priority"].string();
-			prio.reserve(atp.piece_priorities.size());
-			for (auto const p : atp.piece_priorities)
-				prio.push_back(static_cast<char>(static_cast<std::uint8_t>(p)));
-		}
+			write_piece_priorities(ret, atp);
 
 		return ret;
 	}
@@ -292,4 +327,71 @@ namespace libtorrent {
 		bencode(std::back_inserter(ret), rd);
 		return ret;
 	}
+
+namespace aux {
+
+	void resume_journal::saved(add_torrent_params const& atp, int const n)
+	{
+		have.clear();
+		num_have = n;
+		peers = sorted(atp.peers);
+		banned_peers = sorted(atp.banned_peers);
+		active = true;
+		pieces = false;
+		file_priorities = false;
+		piece_priorities = false;
+	}
+
+	std::vector<char> write_resume_journal(add_torrent_params const& atp
+		, resume_journal const& journal)
+	{
+		TORRENT_ASSERT(journal.active);
+
+		entry ret;
+		ret["file-format"] = "libtorrent resume journal";
+		ret["file-version"] = 1;
+		ret["info-hash"] = atp.info_hashes.v1;
+		ret["info-hash2"] = atp.info_hashes.v2;
+
+		write_state(ret, atp);
+
+		if (!atp.merkle_trees.empty())
+			write_trees(ret, atp);
+
+		if (journal.pieces)
+		{
+			write_pieces(ret, atp);
+		}
+		else if (!journal.have.empty())
+		{
+			entry::list_type& have = ret["have"].list();
+			have.reserve(journal.have.size());
+			for (auto const p : journal.have)
+				have.emplace_back(static_cast<int>(p));
+		}
+
+		// these are saved even if they are empty, to clear them
+		if (journal.file_priorities)
+			write_file_priorities(ret, atp);
+
+		if (journal.piece_priorities)
+			write_piece_priorities(ret, atp);
+
+		auto const peers = sorted(atp.peers);
+		auto const added = difference(peers, journal.peers);
+		auto const removed = difference(journal.peers, peers);
+		if (!added.empty())
+			write_peers(ret, "added_peers", "added_peers6", added);
+		if (!removed.empty())
+			write_peers(ret, "removed_peers", "removed_peers6", removed);
+
+		auto const banned = sorted(atp.banned_peers);
+		if (banned != journal.banned_peers)
+			write_peers(ret, "banned_peers", "banned_peers6", banned);
+
+		std::vector<char> buf;
+		bencode(std::back_inserter(buf), ret);
+		return buf;
+	}
+}
 }
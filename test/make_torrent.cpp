@@ -40,6 +40,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/bencode.hpp"
 #include "libtorrent/aux_/session_settings.hpp"
 #include "libtorrent/aux_/posix_storage.hpp"
+#include "libtorrent/aux_/posix_file_pool.hpp"
 
 using namespace lt;
 
@@ -186,7 +187,8 @@ void generate_files(lt::torrent_info const& ti, std::string const& path
 
 	// default settings
 	aux::session_settings sett;
-	aux::posix_storage st(params);
+	aux::posix_file_pool pool;
+	aux::posix_storage st(params, pool);
 
 	file_storage const& fs = ti.files();
 	std::vector<char> buffer;
@@ -41,6 +41,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/extensions.hpp"
 #include "setup_transfer.hpp"
 
+#include <atomic>
 #include <functional>
 #include <thread>
 
@@ -334,6 +335,17 @@ TORRENT_TEST(alerts_dropped_alert)
 	TEST_CHECK(a->dropped_alerts[torrent_finished_alert::alert_type] == true);
 }
 
+namespace {
+
+void post_pieces(aux::alert_manager* mgr, int const thread, int const num)
+{
+	// the piece index encodes which thread posted the alert, and in which order
+	for (int i = 0; i < num; ++i)
+		mgr->emplace_alert<piece_finished_alert>(torrent_handle(), piece_index_t(thread * num + i));
+}
+
+} // anonymous namespace
+
 #ifndef TORRENT_DISABLE_EXTENSIONS
 struct post_plugin : lt::plugin
 {
@@ -361,4 +373,167 @@ TORRENT_TEST(recursive_alerts)
 	TEST_EQUAL(pl->depth, 11);
 }
 
+namespace {
+
+struct concurrency_plugin : lt::plugin
+{
+	void on_alert(alert const* a) override
+	{
+		if (inside.fetch_add(1) != 0) overlapped = true;
+		std::this_thread::yield();
+		if (a->type() == alerts_dropped_alert::alert_type)
+			dropped_thread = std::this_thread::get_id();
+		++calls;
+		inside.fetch_sub(1);
+	}
+
+	std::atomic<int> inside{0};
+	std::atomic<bool> overlapped{false};
+	int calls = 0;
+	std::thread::id dropped_thread;
+};
+
+} // anonymous namespace
+
+// alerts are posted from multiple threads, but the plugins' on_alert() are
+// never called concurrently
+TORRENT_TEST(serialized_on_alert)
+{
+	int const num_threads = 4;
+	int const num_alerts = 2000;
+	aux::alert_manager mgr(std::numeric_limits<int>::max(), alert_category::all);
+	auto pl = std::make_shared<concurrency_plugin>();
+	mgr.add_extension(pl);
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < num_threads; ++i)
+		threads.emplace_back(&post_pieces, &mgr, i, num_alerts);
+	for (auto& t : threads) t.join();
+
+	TEST_CHECK(!pl->overlapped);
+	TEST_EQUAL(pl->calls, num_threads * num_alerts);
+}
+
+// the alerts_dropped_alert is posted by the thread dropping an alert, not by
+// the client calling get_all()
+TORRENT_TEST(dropped_alert_thread)
+{
+	aux::alert_manager mgr(1, alert_category::all);
+	auto pl = std::make_shared<concurrency_plugin>();
+	mgr.add_extension(pl);
+
+	std::thread t(&post_pieces, &mgr, 0, 3);
+	t.join();
+	TEST_CHECK(pl->dropped_thread != std::thread::id());
+	TEST_CHECK(pl->dropped_thread != std::this_thread::get_id());
+
+	std::vector<alert*> alerts;
+	mgr.get_all(alerts);
+	TEST_CHECK(pl->dropped_thread != std::this_thread::get_id());
+	TEST_CHECK(!alerts.empty());
+	if (!alerts.empty()) TEST_CHECK(alert_cast<alerts_dropped_alert>(alerts.back()));
+}
+
 #endif // TORRENT_DISABLE_EXTENSIONS
+
+TORRENT_TEST(dropped_alerts_per_category)
+{
+	aux::alert_manager mgr(1, alert_category::all);
+
+	mgr.emplace_alert<torrent_finished_alert>(torrent_handle());
+	mgr.emplace_alert<torrent_finished_alert>(torrent_handle());
+	mgr.emplace_alert<torrent_finished_alert>(torrent_handle());
+	mgr.emplace_alert<torrent_finished_alert>(torrent_handle());
+
+	// torrent_finished_alert is a status alert, the last two were dropped
+	auto const dropped = mgr.dropped_alerts_per_category();
+	for (int i = 0; i < 32; ++i)
+	{
+		bool const status = (alert_category::status & alert_category_t(1u << i)) != alert_category_t{};
+		TEST_EQUAL(dropped[std::size_t(i)], status ? 2 : 0);
+	}
+}
+
+TORRENT_TEST(multiple_producers)
+{
+	int const num_threads = 4;
+	int const num_alerts = 5000;
+	aux::alert_manager mgr(std::numeric_limits<int>::max(), alert_category::all);
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < num_threads; ++i)
+		threads.emplace_back(&post_pieces, &mgr, i, num_alerts);
+
+	// pop alerts while the threads are posting them. Each thread's alerts
+	// must come out in the order they were posted, and none may be lost
+	std::vector<int> next(num_threads, 0);
+	int received = 0;
+	std::vector<alert*> alerts;
+	auto check = [&]
+	{
+		mgr.get_all(alerts);
+		for (alert* a : alerts)
+		{
+			auto* pf = alert_cast<piece_finished_alert>(a);
+			TEST_CHECK(pf);
+			if (pf == nullptr) continue;
+			int const idx = static_cast<int>(pf->piece_index);
+			int const t = idx / num_alerts;
+			TEST_EQUAL(idx % num_alerts, next[std::size_t(t)]);
+			next[std::size_t(t)] = idx % num_alerts + 1;
+			++received;
+		}
+	};
+
+	while (received < num_threads * num_alerts && mgr.wait_for_alert(seconds(10)))
+		check();
+
+	for (auto& t : threads) t.join();
+	check();
+
+	TEST_EQUAL(received, num_threads * num_alerts);
+	for (int const n : next) TEST_EQUAL(n, num_alerts);
+}
+
+TORRENT_TEST(merge_order)
+{
+	aux::alert_manager mgr(100, alert_category::all);
+
+	// alerts posted by different threads are returned in the order they were
+	// posted
+	mgr.emplace_alert<piece_finished_alert>(torrent_handle(), 0_piece);
+	std::thread t(&post_pieces, &mgr, 1, 1);
+	t.join();
+	mgr.emplace_alert<piece_finished_alert>(torrent_handle(), 2_piece);
+
+	std::vector<alert*> alerts;
+	mgr.get_all(alerts);
+	TEST_EQUAL(alerts.size(), 3);
+	for (int i = 0; i < int(alerts.size()); ++i)
+	{
+		auto* pf = alert_cast<piece_finished_alert>(alerts[std::size_t(i)]);
+		TEST_CHECK(pf);
+		if (pf) TEST_EQUAL(pf->piece_index, piece_index_t(i));
+	}
+}
+
+TORRENT_TEST(wait_for_alert_wakeup)
+{
+	aux::alert_manager mgr(100, alert_category::all);
+
+	time_point const start = clock_type::now();
+	std::thread posting_thread(&post_pieces, &mgr, 0, 1);
+
+	// this returns as soon as the alert is posted
+	alert* a = mgr.wait_for_alert(seconds(10));
+	if (a == nullptr)
+	{
+		// the wait may be cut short by a signal
+		a = mgr.wait_for_alert(seconds(10));
+	}
+	posting_thread.join();
+
+	TEST_CHECK(a != nullptr);
+	TEST_CHECK(clock_type::now() - start < seconds(5));
+	if (a) TEST_EQUAL(a->type(), piece_finished_alert::alert_type);
+}
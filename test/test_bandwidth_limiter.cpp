@@ -43,9 +43,11 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/time.hpp"
 #include "libtorrent/aux_/session_settings.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <utility>
 
 struct torrent;
@@ -214,6 +216,47 @@ void test_equal_connections(int num, int limit)
 	TEST_CHECK(close_to(sum, float(limit), 50));
 }
 
+// with a lot of requests queued, every one of them is still visited every
+// tick. Their requests can't be satisfied at this rate, so every peer is handed
+// the bandwidth it has been assigned when its request's ttl runs out, after
+// 20 visits. That has to happen on the same tick for all of them
+void test_many_connections(int num, int rate)
+{
+	std::cout << "\ntest many connections " << num << " " << rate << std::endl;
+	aux::bandwidth_manager manager(0);
+	global_bwc.throttle(num * rate);
+
+	aux::bandwidth_channel t1;
+
+	connections_t v;
+	spawn_connections(v, manager, t1, num, "p");
+	std::for_each(v.begin(), v.end()
+		, std::bind(&peer_connection::start, _1));
+
+	lt::aux::session_settings s;
+	int const tick_interval = s.get_int(settings_pack::tick_interval);
+
+	for (int i = 0; i < 19; ++i)
+		manager.update_quotas(milliseconds(tick_interval));
+
+	for (auto const& p : v) TEST_EQUAL(p->m_quota, 0);
+
+	manager.update_quotas(milliseconds(tick_interval));
+
+	float const seconds = 20 * tick_interval / 1000.f;
+	float min_rate = std::numeric_limits<float>::max();
+	float max_rate = 0.f;
+	for (auto const& p : v)
+	{
+		min_rate = std::min(min_rate, p->m_quota / seconds);
+		max_rate = std::max(max_rate, p->m_quota / seconds);
+	}
+	std::cout << "min: " << min_rate << " max: " << max_rate << std::endl;
+	TEST_CHECK(close_to(min_rate, float(rate), rate * 0.05f));
+	TEST_CHECK(close_to(max_rate, float(rate), rate * 0.05f));
+	TEST_EQUAL(manager.queue_size(), num);
+}
+
 void test_connections_variable_rate(int num, int limit, int torrent_limit)
 {
 	std::cout << "\ntest connections variable rate" << num
@@ -517,3 +560,8 @@ TORRENT_TEST(no_starvation)
 {
 	test_no_starvation(40000);
 }
+
+TORRENT_TEST(many_connections)
+{
+	test_many_connections(10000, 1000);
+}
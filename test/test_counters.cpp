@@ -0,0 +1,122 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "test.hpp"
+#include "libtorrent/performance_counters.hpp"
+
+#include <thread>
+#include <vector>
+
+using lt::counters;
+
+TORRENT_TEST(counters_stats_counter_threads)
+{
+	counters c;
+	int const num_threads = 20;
+	int const num_increments = 10000;
+
+	// more threads than shards, to make sure threads sharing a shard don't
+	// lose increments
+	std::vector<std::thread> threads;
+	for (int t = 0; t < num_threads; ++t)
+	{
+		threads.emplace_back([&c] {
+			for (int i = 0; i < num_increments; ++i)
+			{
+				c.inc_stats_counter(counters::num_blocks_written);
+				c.inc_stats_counter(counters::disk_write_time, 2);
+			}
+		});
+	}
+	for (auto& t : threads) t.join();
+
+	TEST_EQUAL(c[counters::num_blocks_written], num_threads * num_increments);
+	TEST_EQUAL(c[counters::disk_write_time], 2 * num_threads * num_increments);
+	TEST_EQUAL(c[counters::num_blocks_read], 0);
+}
+
+TORRENT_TEST(counters_gauge)
+{
+	counters c;
+	TEST_EQUAL(c.inc_stats_counter(counters::queued_write_bytes, 100), 100);
+	TEST_EQUAL(c.inc_stats_counter(counters::queued_write_bytes, -40), 60);
+	TEST_EQUAL(c[counters::queued_write_bytes], 60);
+
+	c.set_value(counters::queued_write_bytes, 10);
+	TEST_EQUAL(c[counters::queued_write_bytes], 10);
+
+	c.blend_stats_counter(counters::request_latency, 100, 50);
+	TEST_EQUAL(c[counters::request_latency], 50);
+}
+
+TORRENT_TEST(counters_reported_count)
+{
+	counters c;
+	std::thread t([&c] { c.inc_stats_counter(counters::num_read_back, 5); });
+	t.join();
+	c.inc_stats_counter(counters::num_read_back, 5);
+	TEST_EQUAL(c[counters::num_read_back], 10);
+
+	// a count maintained elsewhere is added on top of the increments, and
+	// only its growth is added on subsequent reports
+	lt::aux::reported_count r;
+	r.report(c, counters::num_read_back, 15);
+	TEST_EQUAL(c[counters::num_read_back], 25);
+	r.report(c, counters::num_read_back, 15);
+	TEST_EQUAL(c[counters::num_read_back], 25);
+	r.report(c, counters::num_read_back, 20);
+	TEST_EQUAL(c[counters::num_read_back], 30);
+
+	// a stale, lower total doesn't count anything twice
+	r.report(c, counters::num_read_back, 18);
+	r.report(c, counters::num_read_back, 20);
+	TEST_EQUAL(c[counters::num_read_back], 30);
+}
+
+TORRENT_TEST(counters_copy)
+{
+	counters c;
+	std::thread t([&c] { c.inc_stats_counter(counters::num_piece_passed, 3); });
+	t.join();
+	c.inc_stats_counter(counters::num_piece_passed, 4);
+	c.inc_stats_counter(counters::num_checking_torrents, 2);
+
+	counters copy(c);
+	TEST_EQUAL(copy[counters::num_piece_passed], 7);
+	TEST_EQUAL(copy[counters::num_checking_torrents], 2);
+
+	counters assigned;
+	assigned.inc_stats_counter(counters::num_piece_passed, 100);
+	assigned = c;
+	TEST_EQUAL(assigned[counters::num_piece_passed], 7);
+	TEST_EQUAL(assigned[counters::num_checking_torrents], 2);
+}
@@ -79,10 +79,10 @@ namespace
 		return dht_default_storage_constructor(settings);
 	}
 
-	std::unique_ptr<dht_storage_interface> create_default_dht_storage(
-		settings_interface const& sett)
+	std::unique_ptr<dht_storage_interface> create_dht_storage(
+		settings_interface const& sett, dht_storage_constructor_type const& make_storage)
 	{
-		std::unique_ptr<dht_storage_interface> s(dht_default_storage_constructor(sett));
+		std::unique_ptr<dht_storage_interface> s(make_storage(sett));
 		TEST_CHECK(s != nullptr);
 
 		s->update_node_ids({to_hash("0000000000000000000000000000000000000200")});
@@ -96,10 +96,10 @@ sha1_hash const n2 = to_hash("5fbfbff10c5d6a4ec8a88e4c6ab4c28b95eee402");
 sha1_hash const n3 = to_hash("5fbfbff10c5d6a4ec8a88e4c6ab4c28b95eee403");
 sha1_hash const n4 = to_hash("5fbfbff10c5d6a4ec8a88e4c6ab4c28b95eee404");
 
-TORRENT_TEST(announce_peer)
+void test_announce_peer(dht_storage_constructor_type const& make_storage)
 {
 	auto const sett = test_settings();
-	std::unique_ptr<dht_storage_interface> s(create_default_dht_storage(sett));
+	std::unique_ptr<dht_storage_interface> s(create_dht_storage(sett, make_storage));
 
 	entry peers;
 	s->get_peers(n1, false, false, address(), peers);
@@ -126,10 +126,13 @@ TORRENT_TEST(announce_peer)
 	TEST_CHECK(!peers.find_key("values"));
 }
 
-TORRENT_TEST(dual_stack)
+TORRENT_TEST(announce_peer) { test_announce_peer(dht_default_storage_constructor); }
+TORRENT_TEST(announce_peer_compact) { test_announce_peer(dht_compact_storage_constructor); }
+
+void test_dual_stack(dht_storage_constructor_type const& make_storage)
 {
 	auto const sett = test_settings();
-	std::unique_ptr<dht_storage_interface> s(create_default_dht_storage(sett));
+	std::unique_ptr<dht_storage_interface> s(create_dht_storage(sett, make_storage));
 
 	tcp::endpoint const p1 = ep("124.31.75.21", 1);
 	tcp::endpoint const p2 = ep("124.31.75.22", 1);
@@ -152,10 +155,13 @@ TORRENT_TEST(dual_stack)
 	TEST_EQUAL(peers6["values"].list().size(), 2);
 }
 
-TORRENT_TEST(put_items)
+TORRENT_TEST(dual_stack) { test_dual_stack(dht_default_storage_constructor); }
+TORRENT_TEST(dual_stack_compact) { test_dual_stack(dht_compact_storage_constructor); }
+
+void test_put_items(dht_storage_constructor_type const& make_storage)
 {
 	auto const sett = test_settings();
-	std::unique_ptr<dht_storage_interface> s(create_default_dht_storage(sett));
+	std::unique_ptr<dht_storage_interface> s(create_dht_storage(sett, make_storage));
 
 	entry item;
 	bool r = s->get_immutable_item(n4, item);
@@ -182,10 +188,13 @@ TORRENT_TEST(put_items)
 	TEST_CHECK(r);
 }
 
-TORRENT_TEST(counters)
+TORRENT_TEST(put_items) { test_put_items(dht_default_storage_constructor); }
+TORRENT_TEST(put_items_compact) { test_put_items(dht_compact_storage_constructor); }
+
+void test_counters(dht_storage_constructor_type const& make_storage)
 {
 	auto const sett = test_settings();
-	std::unique_ptr<dht_storage_interface> s(create_default_dht_storage(sett));
+	std::unique_ptr<dht_storage_interface> s(create_dht_storage(sett, make_storage));
 
 	TEST_EQUAL(s->counters().peers, 0);
 	TEST_EQUAL(s->counters().torrents, 0);
@@ -222,6 +231,9 @@ TORRENT_TEST(counters)
 	TEST_EQUAL(s->counters().mutable_data, 1);
 }
 
+TORRENT_TEST(counters) { test_counters(dht_default_storage_constructor); }
+TORRENT_TEST(counters_compact) { test_counters(dht_compact_storage_constructor); }
+
 TORRENT_TEST(set_custom)
 {
 	g_storage_constructor_invoked = false;
@@ -267,11 +279,11 @@ TORRENT_TEST(default_set_custom)
 	TEST_EQUAL(g_storage_constructor_invoked, true);
 }
 
-TORRENT_TEST(peer_limit)
+void test_peer_limit(dht_storage_constructor_type const& make_storage)
 {
 	auto sett = test_settings();
 	sett.set_int(settings_pack::dht_max_peers, 42);
-	std::unique_ptr<dht_storage_interface> s(create_default_dht_storage(sett));
+	std::unique_ptr<dht_storage_interface> s(create_dht_storage(sett, make_storage));
 
 	for (int i = 0; i < 200; ++i)
 	{
@@ -284,11 +296,14 @@ TORRENT_TEST(peer_limit)
 	TEST_EQUAL(cnt.peers, 42);
 }
 
-TORRENT_TEST(torrent_limit)
+TORRENT_TEST(peer_limit) { test_peer_limit(dht_default_storage_constructor); }
+TORRENT_TEST(peer_limit_compact) { test_peer_limit(dht_compact_storage_constructor); }
+
+void test_torrent_limit(dht_storage_constructor_type const& make_storage)
 {
 	auto sett = test_settings();
 	sett.set_int(settings_pack::dht_max_torrents, 42);
-	std::unique_ptr<dht_storage_interface> s(create_default_dht_storage(sett));
+	std::unique_ptr<dht_storage_interface> s(create_dht_storage(sett, make_storage));
 
 	for (int i = 0; i < 200; ++i)
 	{
@@ -301,11 +316,14 @@ TORRENT_TEST(torrent_limit)
 	TEST_EQUAL(cnt.torrents, 42);
 }
 
-TORRENT_TEST(immutable_item_limit)
+TORRENT_TEST(torrent_limit) { test_torrent_limit(dht_default_storage_constructor); }
+TORRENT_TEST(torrent_limit_compact) { test_torrent_limit(dht_compact_storage_constructor); }
+
+void test_immutable_item_limit(dht_storage_constructor_type const& make_storage)
 {
 	auto sett = test_settings();
 	sett.set_int(settings_pack::dht_max_dht_items, 42);
-	std::unique_ptr<dht_storage_interface> s(create_default_dht_storage(sett));
+	std::unique_ptr<dht_storage_interface> s(create_dht_storage(sett, make_storage));
 
 	for (int i = 0; i < 200; ++i)
 	{
@@ -317,11 +335,14 @@ TORRENT_TEST(immutable_item_limit)
 	TEST_EQUAL(cnt.immutable_data, 42);
 }
 
-TORRENT_TEST(mutable_item_limit)
+TORRENT_TEST(immutable_item_limit) { test_immutable_item_limit(dht_default_storage_constructor); }
+TORRENT_TEST(immutable_item_limit_compact) { test_immutable_item_limit(dht_compact_storage_constructor); }
+
+void test_mutable_item_limit(dht_storage_constructor_type const& make_storage)
 {
 	auto sett = test_settings();
 	sett.set_int(settings_pack::dht_max_dht_items, 42);
-	std::unique_ptr<dht_storage_interface> s(create_default_dht_storage(sett));
+	std::unique_ptr<dht_storage_interface> s(create_dht_storage(sett, make_storage));
 
 	public_key pk;
 	signature sig;
@@ -336,7 +357,56 @@ TORRENT_TEST(mutable_item_limit)
 	TEST_EQUAL(cnt.mutable_data, 42);
 }
 
-TORRENT_TEST(get_peers_dist)
+TORRENT_TEST(mutable_item_limit) { test_mutable_item_limit(dht_default_storage_constructor); }
+TORRENT_TEST(mutable_item_limit_compact) { test_mutable_item_limit(dht_compact_storage_constructor); }
+
+// the compact storage evicts the least important of the 8 items that haven't
+// been announced for the longest time, not the least important of all of them
+TORRENT_TEST(immutable_item_eviction_compact)
+{
+	auto sett = test_settings();
+	sett.set_int(settings_pack::dht_max_dht_items, 10);
+	std::unique_ptr<dht_storage_interface> s(create_dht_storage(sett
+		, dht_compact_storage_constructor));
+
+	// the node ID is 00..0200. Items 1 through 10 are close to it, except
+	// for item 4 and item 10, which are as far away as can be
+	auto const item_hash = [](int const i)
+	{
+		sha1_hash ret = to_hash("0000000000000000000000000000000000000200");
+		ret[19] = std::uint8_t(i);
+		if (i == 4 || i == 10) ret[0] = 0x80;
+		return ret;
+	};
+
+	for (int i = 1; i <= 10; ++i)
+		s->put_immutable_item(item_hash(i), {"123", 3}, addr("124.31.75.21"));
+	TEST_EQUAL(s->counters().immutable_data, 10);
+
+	// announcing item 1 again makes it the most recently seen
+	s->put_immutable_item(item_hash(1), {"123", 3}, addr("124.31.75.22"));
+
+	// the 8 oldest items are 2 through 9, of which item 4 is the farthest
+	// from our node ID
+	s->put_immutable_item(item_hash(11), {"123", 3}, addr("124.31.75.21"));
+	TEST_EQUAL(s->counters().immutable_data, 10);
+
+	entry item;
+	TEST_CHECK(!s->get_immutable_item(item_hash(4), item));
+	for (int i = 1; i <= 11; ++i)
+	{
+		if (i == 4) continue;
+		TEST_CHECK(s->get_immutable_item(item_hash(i), item));
+	}
+
+	// now item 10 is among the 8 oldest, and the farthest one
+	s->put_immutable_item(item_hash(12), {"123", 3}, addr("124.31.75.21"));
+	TEST_CHECK(!s->get_immutable_item(item_hash(10), item));
+	TEST_CHECK(s->get_immutable_item(item_hash(2), item));
+	TEST_CHECK(s->get_immutable_item(item_hash(12), item));
+}
+
+void test_get_peers_dist(dht_storage_constructor_type const& make_storage)
 {
 	// test that get_peers returns reasonably disjoint sets of peers with each call
 	// take two samples of 100 peers from 1000 and make sure there aren't too many
@@ -344,7 +414,7 @@ TORRENT_TEST(get_peers_dist)
 	auto sett = test_settings();
 	sett.set_int(settings_pack::dht_max_peers, 2000);
 	sett.set_int(settings_pack::dht_max_peers_reply, 100);
-	std::unique_ptr<dht_storage_interface> s(create_default_dht_storage(sett));
+	std::unique_ptr<dht_storage_interface> s(create_dht_storage(sett, make_storage));
 
 	address addr = rand_v4();
 	for (int i = 0; i < 1000; ++i)
@@ -385,10 +455,13 @@ TORRENT_TEST(get_peers_dist)
 	}
 }
 
-TORRENT_TEST(update_node_ids)
+TORRENT_TEST(get_peers_dist) { test_get_peers_dist(dht_default_storage_constructor); }
+TORRENT_TEST(get_peers_dist_compact) { test_get_peers_dist(dht_compact_storage_constructor); }
+
+void test_update_node_ids(dht_storage_constructor_type const& make_storage)
 {
 	auto const sett = test_settings();
-	std::unique_ptr<dht_storage_interface> s(dht_default_storage_constructor(sett));
+	std::unique_ptr<dht_storage_interface> s(make_storage(sett));
 	TEST_CHECK(s != nullptr);
 
 	node_id const nid1 = to_hash("0000000000000000000000000000000000000200");
@@ -435,13 +508,16 @@ TORRENT_TEST(update_node_ids)
 	TEST_CHECK(r);
 }
 
-TORRENT_TEST(infohashes_sample)
+TORRENT_TEST(update_node_ids) { test_update_node_ids(dht_default_storage_constructor); }
+TORRENT_TEST(update_node_ids_compact) { test_update_node_ids(dht_compact_storage_constructor); }
+
+void test_infohashes_sample(dht_storage_constructor_type const& make_storage)
 {
 	auto sett = test_settings();
 	sett.set_int(settings_pack::dht_max_torrents, 5);
 	sett.set_int(settings_pack::dht_sample_infohashes_interval, 10);
 	sett.set_int(settings_pack::dht_max_infohashes_sample_count, 2);
-	std::unique_ptr<dht_storage_interface> s(create_default_dht_storage(sett));
+	std::unique_ptr<dht_storage_interface> s(create_dht_storage(sett, make_storage));
 
 	tcp::endpoint const p1 = ep("124.31.75.21", 1);
 	tcp::endpoint const p2 = ep("124.31.75.22", 1);
@@ -477,13 +553,16 @@ TORRENT_TEST(infohashes_sample)
 	TEST_CHECK(samples.find(aux::to_hex(n4)) != std::string::npos);
 }
 
-TORRENT_TEST(infohashes_sample_dist)
+TORRENT_TEST(infohashes_sample) { test_infohashes_sample(dht_default_storage_constructor); }
+TORRENT_TEST(infohashes_sample_compact) { test_infohashes_sample(dht_compact_storage_constructor); }
+
+void test_infohashes_sample_dist(dht_storage_constructor_type const& make_storage)
 {
 	auto sett = test_settings();
 	sett.set_int(settings_pack::dht_max_torrents, 1000);
 	sett.set_int(settings_pack::dht_sample_infohashes_interval, 0); // need this to force refresh every call
 	sett.set_int(settings_pack::dht_max_infohashes_sample_count, 1);
-	std::unique_ptr<dht_storage_interface> s(create_default_dht_storage(sett));
+	std::unique_ptr<dht_storage_interface> s(create_dht_storage(sett, make_storage));
 
 	for (int i = 0; i < 1000; ++i)
 	{
@@ -506,6 +585,9 @@ TORRENT_TEST(infohashes_sample_dist)
 	std::printf("infohashes set size: %d\n", int(infohash_set.size()));
 	TEST_CHECK(infohash_set.size() > 500);
 }
+
+TORRENT_TEST(infohashes_sample_dist) { test_infohashes_sample_dist(dht_default_storage_constructor); }
+TORRENT_TEST(infohashes_sample_dist_compact) { test_infohashes_sample_dist(dht_compact_storage_constructor); }
 #else
 TORRENT_TEST(dummy) {}
 #endif
@@ -0,0 +1,247 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "test.hpp"
+#include "libtorrent/aux_/disk_buffer_arena.hpp"
+#include "libtorrent/aux_/disk_buffer_pool.hpp"
+#include "libtorrent/disk_interface.hpp" // for default_block_size
+#include "libtorrent/disk_observer.hpp"
+#include "libtorrent/settings_pack.hpp"
+#include "libtorrent/io_context.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+struct observer : disk_observer, std::enable_shared_from_this<observer>
+{
+	void on_disk() override { ++called; }
+	int called = 0;
+};
+
+int free_blocks(aux::disk_buffer_arena::stats const& s)
+{
+	return s.free_blocks + s.cached_blocks;
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(arena_distinct_blocks)
+{
+	aux::disk_buffer_arena a;
+	int const num = aux::disk_buffer_arena::blocks_per_slab + 10;
+
+	std::vector<char*> blocks;
+	for (int i = 0; i < num; ++i)
+	{
+		char* b = a.allocate();
+		TEST_CHECK(b != nullptr);
+		std::memset(b, i & 0xff, default_block_size);
+		blocks.push_back(b);
+	}
+
+	// no two blocks overlap
+	std::sort(blocks.begin(), blocks.end());
+	for (std::size_t i = 1; i < blocks.size(); ++i)
+		TEST_CHECK(blocks[i] - blocks[i - 1] >= default_block_size);
+
+	auto s = a.get_stats();
+	TEST_EQUAL(s.slabs, 2);
+	TEST_EQUAL(free_blocks(s), 2 * aux::disk_buffer_arena::blocks_per_slab - num);
+
+	for (char* b : blocks) a.free(b);
+
+	s = a.get_stats();
+	TEST_EQUAL(s.slabs, 2);
+	TEST_EQUAL(free_blocks(s), 2 * aux::disk_buffer_arena::blocks_per_slab);
+	TEST_CHECK(s.cached_blocks <= aux::disk_buffer_arena::cache_capacity);
+}
+
+TORRENT_TEST(arena_thread_cache)
+{
+	aux::disk_buffer_arena a;
+
+	// the first allocation refills the cache, the following ones hit it
+	std::vector<char*> blocks;
+	for (int i = 0; i < aux::disk_buffer_arena::cache_batch; ++i)
+		blocks.push_back(a.allocate());
+
+	auto s = a.get_stats();
+	TEST_EQUAL(s.central_transfers, 1);
+	TEST_EQUAL(s.cache_hits, aux::disk_buffer_arena::cache_batch - 1);
+	TEST_EQUAL(s.cached_blocks, 0);
+
+	// blocks freed go into the freeing thread's cache
+	for (char* b : blocks) a.free(b);
+	s = a.get_stats();
+	TEST_EQUAL(s.cached_blocks, aux::disk_buffer_arena::cache_batch);
+
+	// the most recently freed block is handed out first
+	char* const last = blocks.back();
+	TEST_CHECK(a.allocate() == last);
+	a.free(last);
+}
+
+TORRENT_TEST(arena_cross_thread)
+{
+	aux::disk_buffer_arena a;
+	int const num = 1000;
+
+	// allocate on one thread and free on another, the way receive buffers
+	// are allocated by the network thread and freed by disk threads
+	std::vector<char*> blocks;
+	for (int round = 0; round < 10; ++round)
+	{
+		for (int i = 0; i < num; ++i) blocks.push_back(a.allocate());
+		std::thread t([&] { for (char* b : blocks) a.free(b); });
+		t.join();
+		blocks.clear();
+	}
+
+	auto const s = a.get_stats();
+	TEST_EQUAL(free_blocks(s), s.slabs * aux::disk_buffer_arena::blocks_per_slab);
+
+	// the blocks are recycled rather than allocating new slabs every round
+	TEST_CHECK(s.slabs * aux::disk_buffer_arena::blocks_per_slab
+		< num + 3 * aux::disk_buffer_arena::cache_capacity);
+
+	// the freeing threads have exited and handed their caches back, only
+	// this thread's cache is left
+	TEST_CHECK(s.cached_blocks <= aux::disk_buffer_arena::cache_capacity);
+}
+
+TORRENT_TEST(arena_release_slabs)
+{
+	aux::disk_buffer_arena a;
+	a.set_max_retained_slabs(1);
+	int const num = 3 * aux::disk_buffer_arena::blocks_per_slab;
+
+	// use other threads, which hand their caches back when they exit, to
+	// have all blocks end up in the central free list
+	std::vector<char*> blocks;
+	std::thread([&] { for (int i = 0; i < num; ++i) blocks.push_back(a.allocate()); }).join();
+	TEST_EQUAL(a.get_stats().slabs, 3);
+
+	std::thread([&] { for (char* b : blocks) a.free(b); }).join();
+
+	// the slabs beyond the limit are returned to the system once all their
+	// blocks are free
+	auto const s = a.get_stats();
+	TEST_EQUAL(s.slabs, 1);
+	TEST_EQUAL(s.free_blocks, aux::disk_buffer_arena::blocks_per_slab);
+	TEST_EQUAL(s.cached_blocks, 0);
+
+	char* b = a.allocate();
+	TEST_CHECK(b != nullptr);
+	std::memset(b, 0, default_block_size);
+	a.free(b);
+}
+
+TORRENT_TEST(arena_release_caches_on_exit)
+{
+	aux::disk_buffer_arena a1;
+	aux::disk_buffer_arena a2;
+
+	// a thread using more than one arena hands all of its caches back when
+	// it exits, not just the one it used last
+	std::thread([&] {
+		char* b1 = a1.allocate();
+		char* b2 = a2.allocate();
+		a1.free(b1);
+		a2.free(b2);
+	}).join();
+
+	for (auto const* a : {&a1, &a2})
+	{
+		auto const s = a->get_stats();
+		TEST_EQUAL(s.cached_blocks, 0);
+		TEST_EQUAL(s.free_blocks, s.slabs * aux::disk_buffer_arena::blocks_per_slab);
+	}
+}
+
+TORRENT_TEST(arena_hugepages)
+{
+	// huge pages may not be available, but allocating must work either way
+	aux::disk_buffer_arena a;
+	a.set_hugepages(true);
+	char* b = a.allocate();
+	TEST_CHECK(b != nullptr);
+	std::memset(b, 0, default_block_size);
+	a.free(b);
+	TEST_EQUAL(a.get_stats().slabs, 1);
+}
+
+TORRENT_TEST(pool_watermark)
+{
+	io_context ios;
+	aux::disk_buffer_pool pool(ios);
+
+	settings_pack sett;
+	sett.set_int(settings_pack::max_queued_disk_bytes, 8 * default_block_size);
+	pool.set_settings(sett);
+
+	auto o = std::make_shared<observer>();
+
+	// we're told the pool is exceeded at half way between the low watermark
+	// (4 blocks) and the max (8 blocks)
+	std::vector<char*> blocks;
+	bool exceeded = false;
+	while (!exceeded && blocks.size() < 100)
+		blocks.push_back(pool.allocate_buffer(exceeded, o, "test"));
+	TEST_CHECK(exceeded);
+	TEST_EQUAL(int(blocks.size()), 6);
+	TEST_EQUAL(pool.in_use(), 6);
+
+	// the observer isn't called until we drop to the low watermark
+	pool.free_buffer(blocks.back());
+	blocks.pop_back();
+	ios.poll();
+	ios.restart();
+	TEST_EQUAL(o->called, 0);
+
+	pool.free_multiple_buffers(blocks);
+	ios.poll();
+	TEST_EQUAL(o->called, 1);
+	TEST_EQUAL(pool.in_use(), 0);
+
+	exceeded = false;
+	char* b = pool.allocate_buffer(exceeded, o, "test");
+	TEST_CHECK(!exceeded);
+	pool.free_buffer(b);
+}
@@ -1132,5 +1132,146 @@ TORRENT_TEST(dht_port_no_support)
 	std::this_thread::sleep_for(lt::milliseconds(500));
 	print_session_log(*ses);
 }
+// the peer sends back-to-back piece messages, split at awkward places: in
+// the length prefix, in the message header, in the payload and across the
+// end of one message and the start of the next. The blocks must still be
+// written intact, and the progress of the block being received must be
+// reported along the way
+TORRENT_TEST(split_piece_messages)
+{
+	using namespace lt::aux;
+
+	std::cout << "\n === test split piece messages ===\n" << std::endl;
+
+	info_hash_t ih;
+	torrent_handle th;
+	std::shared_ptr<lt::session> ses;
+	io_context ios;
+	tcp::socket s(ios);
+	setup_peer(s, ios, ih, ses, true, false, false, torrent_flags_t{}, &th);
+
+	char recv_buffer[1000];
+	do_handshake(s, ih, recv_buffer);
+	send_have_all(s);
+	send_unchoke(s);
+	print_session_log(*ses);
+
+	std::vector<peer_request> requests;
+	while (requests.size() < 3)
+	{
+		int const len = read_message(s, recv_buffer);
+		if (len == -1) return;
+		auto const buffer = span<char const>(recv_buffer).first(len);
+		print_message(buffer);
+		if (len != 13 || buffer[0] != 0x6) continue;
+
+		char const* ptr = buffer.data() + 1;
+		peer_request r;
+		r.piece = piece_index_t(read_int32(ptr));
+		r.start = read_int32(ptr);
+		r.length = read_int32(ptr);
+		requests.push_back(r);
+	}
+	print_session_log(*ses);
+
+	// the torrent from setup_peer() has one block per piece, and every piece
+	// holds the same letters
+	std::vector<char> stream;
+	std::vector<int> msg_start;
+	for (auto const& r : requests)
+	{
+		TEST_EQUAL(r.start, 0);
+		msg_start.push_back(int(stream.size()));
+		char header[13];
+		char* ptr = header;
+		write_int32(9 + r.length, ptr);
+		write_uint8(7, ptr);
+		write_int32(static_cast<int>(r.piece), ptr);
+		write_int32(r.start, ptr);
+		stream.insert(stream.end(), header, header + sizeof(header));
+		for (int i = 0; i < r.length; ++i)
+			stream.push_back(char(((r.start + i) % 26) + 'A'));
+	}
+
+	auto wait_for_progress = [&](piece_index_t const piece, int const bytes)
+	{
+		for (int i = 0; i < 50; ++i)
+		{
+			std::vector<peer_info> pi;
+			th.get_peer_info(pi);
+			if (pi.size() == 1
+				&& pi[0].downloading_piece_index == piece
+				&& pi[0].downloading_progress == bytes
+				&& pi[0].downloading_total == requests.front().length)
+				return true;
+			std::this_thread::sleep_for(lt::milliseconds(100));
+		}
+		return false;
+	};
+
+	int const block = requests.front().length;
+	int const split[] = {
+		// in the length prefix
+		2,
+		// in the header, after the message ID
+		5,
+		// at the end of the header
+		13,
+		// in the payload
+		13 + 5000,
+		// in the length prefix of the second message
+		msg_start[1] + 3,
+		// in the header of the second message
+		msg_start[1] + 11,
+		// one byte short of the end of the payload
+		msg_start[1] + 13 + block - 1,
+		// the end of the second message, the header of the third and one byte
+		// of its payload
+		msg_start[2] + 13 + 1,
+		int(stream.size())
+	};
+
+	int pos = 0;
+	for (int const end : split)
+	{
+		log("==> piece data [%d, %d)", pos, end);
+		error_code ec;
+		boost::asio::write(s, boost::asio::buffer(stream.data() + pos, std::size_t(end - pos))
+			, boost::asio::transfer_all(), ec);
+		if (ec)
+		{
+			TEST_ERROR(ec.message());
+			break;
+		}
+		pos = end;
+
+		if (end == 13 + 5000)
+			TEST_CHECK(wait_for_progress(requests[0].piece, 5000));
+		else if (end == msg_start[1] + 13 + block - 1)
+			TEST_CHECK(wait_for_progress(requests[1].piece, block - 1));
+		else if (end == msg_start[2] + 13 + 1)
+			TEST_CHECK(wait_for_progress(requests[2].piece, 1));
+		else
+			std::this_thread::sleep_for(lt::milliseconds(100));
+	}
+
+	// every piece is a single block. It only passes the hash check if the
+	// block was written as it was sent
+	for (int i = 0; i < 50; ++i)
+	{
+		if (std::all_of(requests.begin(), requests.end()
+			, [&](peer_request const& r) { return th.have_piece(r.piece); }))
+			break;
+		std::this_thread::sleep_for(lt::milliseconds(100));
+	}
+	print_session_log(*ses);
+	for (auto const& r : requests)
+		TEST_CHECK(th.have_piece(r.piece));
+
+	s.close();
+	std::this_thread::sleep_for(lt::milliseconds(500));
+	print_session_log(*ses);
+}
+
 // TODO: test sending invalid requests (out of bound piece index, offsets and
 // sizes)
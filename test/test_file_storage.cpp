@@ -1053,5 +1053,69 @@ TORRENT_TEST(file_index_for_root)
 	TEST_EQUAL(fs.file_index_for_root(sha256_hash("55555555555555555555555555555555")), file_index_t{-1});
 }
 
+TORRENT_TEST(interleaved_directories)
+{
+	// files are not ordered by directory, but every directory is still only
+	// stored once
+	file_storage fs;
+	fs.set_piece_length(0x4000);
+	for (int i = 0; i < 1000; ++i)
+	{
+		fs.add_file(combine_path("test", combine_path("dir" + std::to_string(i % 100)
+			, "file" + std::to_string(i))), 100);
+	}
+
+	TEST_EQUAL(fs.paths().size(), 100);
+	for (file_index_t const i : fs.file_range())
+	{
+		TEST_EQUAL(fs.file_path(i), combine_path("test"
+			, combine_path("dir" + std::to_string(static_cast<int>(i) % 100)
+			, "file" + std::to_string(static_cast<int>(i)))));
+	}
+}
+
+TORRENT_TEST(copy_shares_names)
+{
+	file_storage fs;
+	fs.set_piece_length(0x4000);
+	fs.add_file(combine_path("test", "a"), 100);
+	fs.add_file(combine_path("test", "b"), 100);
+
+	file_storage copy(fs);
+
+	// adding files to either copy must not overwrite the names of the
+	// other one
+	fs.add_file(combine_path("test", "c"), 100);
+	copy.add_file(combine_path("test", "d"), 100);
+	for (int i = 0; i < 100; ++i)
+	{
+		fs.add_file(combine_path("test", "x" + std::to_string(i)), 100);
+		copy.add_file(combine_path("test", "y" + std::to_string(i)), 100);
+	}
+
+	fs = file_storage();
+
+	TEST_EQUAL(copy.file_name(file_index_t{0}), "a");
+	TEST_EQUAL(copy.file_name(file_index_t{1}), "b");
+	TEST_EQUAL(copy.file_name(file_index_t{2}), "d");
+	for (int i = 0; i < 100; ++i)
+		TEST_EQUAL(copy.file_name(file_index_t{3 + i}), "y" + std::to_string(i));
+}
+
+TORRENT_TEST(canonicalize_roots)
+{
+	file_storage fs;
+	fs.set_piece_length(0x4000);
+	fs.add_file(combine_path("test", "b"), 100, {}, 0, {}, "22222222222222222222222222222222");
+	fs.add_file(combine_path("test", "a"), 0x4000, {}, 0, {}, "11111111111111111111111111111111");
+	fs.canonicalize();
+
+	TEST_EQUAL(fs.num_files(), 2);
+	TEST_EQUAL(fs.file_name(file_index_t{0}), "a");
+	TEST_EQUAL(fs.root(file_index_t{0}), sha256_hash("11111111111111111111111111111111"));
+	TEST_EQUAL(fs.file_name(file_index_t{1}), "b");
+	TEST_EQUAL(fs.root(file_index_t{1}), sha256_hash("22222222222222222222222222222222"));
+}
+
 // TODO: test file attributes
 // TODO: test symlinks
@@ -35,10 +35,14 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "libtorrent/hasher.hpp"
 #include "libtorrent/hex.hpp"
+#include "libtorrent/aux_/sha_multi.hpp"
 
 #include "test.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <vector>
+#include <string>
 
 using namespace lt;
 
@@ -144,3 +148,107 @@ TORRENT_TEST(hasher256)
 	}
 }
 
+
+namespace {
+
+// buffers of all the interesting sizes around the SHA block boundaries, and
+// some of equal size, to fill the lanes of a batch
+std::vector<std::string> multi_buffers()
+{
+	std::vector<std::string> ret;
+	int const sizes[] = {0, 1, 55, 56, 63, 64, 65, 119, 120, 127, 128, 129, 1000};
+	for (int const s : sizes) ret.emplace_back(std::size_t(s), '\0');
+	for (int i = 0; i < 11; ++i) ret.emplace_back(std::size_t(16384), '\0');
+	for (int i = 0; i < 3; ++i) ret.emplace_back(std::size_t(64), '\0');
+
+	std::uint32_t seed = 0x1337;
+	for (auto& b : ret)
+		for (auto& c : b)
+		{
+			seed = seed * 1103515245 + 12345;
+			c = char(seed >> 16);
+		}
+	return ret;
+}
+
+template <typename Hasher>
+auto hash_one(span<char const> const buf) -> decltype(Hasher().final())
+{
+	Hasher h;
+	if (!buf.empty()) h.update(buf);
+	return h.final();
+}
+
+aux::sha_multi_impl const multi_impls[] = {
+	aux::sha_multi_impl::automatic
+	, aux::sha_multi_impl::portable
+	, aux::sha_multi_impl::sha_ni
+	, aux::sha_multi_impl::avx2
+};
+
+}
+
+TORRENT_TEST(sha1_multi)
+{
+	auto const data = multi_buffers();
+	std::vector<span<char const>> bufs;
+	for (auto const& b : data) bufs.emplace_back(b);
+
+	for (auto const impl : multi_impls)
+	{
+		std::vector<sha1_hash> out(bufs.size());
+		aux::sha1_multi(bufs, out, impl);
+		for (std::size_t i = 0; i < bufs.size(); ++i)
+			TEST_EQUAL(out[i], hash_one<hasher>(bufs[i]));
+	}
+}
+
+TORRENT_TEST(sha256_multi)
+{
+	auto const data = multi_buffers();
+	std::vector<span<char const>> bufs;
+	for (auto const& b : data) bufs.emplace_back(b);
+
+	for (auto const impl : multi_impls)
+	{
+		std::vector<sha256_hash> out(bufs.size());
+		aux::sha256_multi(bufs, out, impl);
+		for (std::size_t i = 0; i < bufs.size(); ++i)
+			TEST_EQUAL(out[i], hash_one<hasher256>(bufs[i]));
+	}
+}
+
+TORRENT_TEST(sha1_multi_context)
+{
+	auto const data = multi_buffers();
+	int const num_streams = int(data.size());
+
+	for (auto const impl : multi_impls)
+	{
+		// feed the streams in chunks of different sizes, so they fall in and
+		// out of step with each other
+		std::size_t const chunks[] = {64, 1, 16384, 0, 63, 130, 64, 200};
+		aux::sha1_multi_context ctx(num_streams, impl);
+		std::vector<std::size_t> pos(data.size(), 0);
+		for (int round = 0;; ++round)
+		{
+			std::vector<span<char const>> bufs;
+			bool done = true;
+			for (std::size_t i = 0; i < data.size(); ++i)
+			{
+				std::size_t const len = std::min(chunks[(i + std::size_t(round)) % 8]
+					, data[i].size() - pos[i]);
+				bufs.emplace_back(data[i].data() + pos[i], std::ptrdiff_t(len));
+				pos[i] += len;
+				done &= pos[i] == data[i].size();
+			}
+			ctx.update(bufs);
+			if (done) break;
+		}
+
+		std::vector<sha1_hash> out(data.size());
+		ctx.final(out);
+		for (std::size_t i = 0; i < data.size(); ++i)
+			TEST_EQUAL(out[i], hash_one<hasher>(data[i]));
+	}
+}
@@ -33,6 +33,8 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "libtorrent/ip_filter.hpp"
 #include "setup_transfer.hpp" // for addr()
+#include <algorithm>
+#include <random>
 #include <utility>
 
 #include "test.hpp"
@@ -258,3 +260,91 @@ TORRENT_TEST(port_filter)
 	TEST_CHECK(pf.access(65535) == 0);
 }
 
+
+TORRENT_TEST(port_filter_overlapping)
+{
+	// compare against a flat array of all ports. The last rule covering a
+	// port takes precedence, including rules added after a lookup
+	std::mt19937 rng(0x1337);
+	for (int round = 0; round < 50; ++round)
+	{
+		port_filter pf;
+		std::vector<std::uint32_t> expected(65536, 0);
+		for (int i = 0; i < 40; ++i)
+		{
+			auto first = std::uint16_t(rng());
+			auto last = std::uint16_t(rng() % 8 == 0 ? first + rng() % 4 : rng());
+			if (first > last) std::swap(first, last);
+			if (rng() % 10 == 0) first = 0;
+			if (rng() % 10 == 0) last = 65535;
+			std::uint32_t const flags = rng() % 3;
+			pf.add_rule(first, last, flags);
+			std::fill(expected.begin() + first, expected.begin() + last + 1, flags);
+
+			if (i % 10 != 9) continue;
+			int mismatches = 0;
+			for (int p = 0; p < 65536; ++p)
+				if (pf.access(std::uint16_t(p)) != expected[std::size_t(p)]) ++mismatches;
+			TEST_EQUAL(mismatches, 0);
+		}
+	}
+}
+
+TORRENT_TEST(add_rules)
+{
+	std::vector<ip_range<address_v4>> const rules4 =
+	{
+		{addr4("1.0.0.0"), addr4("2.0.0.0"), ip_filter::blocked}
+		, {addr4("3.0.0.0"), addr4("4.0.0.0"), ip_filter::blocked}
+		, {addr4("1.5.0.0"), addr4("3.5.0.0"), 0}
+		, {addr4("0.0.0.0"), addr4("0.0.0.0"), ip_filter::blocked}
+	};
+	std::vector<ip_range<address_v6>> const rules6 =
+	{
+		{addr6("1::"), addr6("3::"), ip_filter::blocked}
+		, {addr6("2::"), addr6("ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff"), ip_filter::blocked}
+	};
+
+	ip_filter bulk;
+	bulk.add_rules(rules4);
+	bulk.add_rules(rules6);
+
+	ip_filter single;
+	for (auto const& r : rules4) single.add_rule(r.first, r.last, r.flags);
+	for (auto const& r : rules6) single.add_rule(r.first, r.last, r.flags);
+
+	TEST_CHECK(bulk.export_filter() == single.export_filter());
+
+	auto const range4 = std::get<0>(bulk.export_filter());
+	test_rules_invariant(range4, bulk);
+	std::vector<ip_range<address_v4>> const expected4 =
+	{
+		{addr4("0.0.0.0"), addr4("0.0.0.0"), ip_filter::blocked}
+		, {addr4("0.0.0.1"), addr4("0.255.255.255"), 0}
+		, {addr4("1.0.0.0"), addr4("1.4.255.255"), ip_filter::blocked}
+		, {addr4("1.5.0.0"), addr4("3.5.0.0"), 0}
+		, {addr4("3.5.0.1"), addr4("4.0.0.0"), ip_filter::blocked}
+		, {addr4("4.0.0.1"), addr4("255.255.255.255"), 0}
+	};
+	TEST_CHECK(range4 == expected4);
+
+	auto const range6 = std::get<1>(bulk.export_filter());
+	test_rules_invariant(range6, bulk);
+	TEST_EQUAL(range6.size(), 2);
+	TEST_EQUAL(bulk.access(addr("ffff::1")), ip_filter::blocked);
+	TEST_EQUAL(bulk.access(addr("0:ffff::")), 0);
+}
+
+TORRENT_TEST(copy_pending_rules)
+{
+	ip_filter f;
+	f.add_rule(addr("1.0.0.0"), addr("2.0.0.0"), ip_filter::blocked);
+
+	// the copy is made before the rule has been applied
+	ip_filter const copy = f;
+	ip_filter const moved = std::move(f);
+	TEST_EQUAL(copy.access(addr("1.2.3.4")), ip_filter::blocked);
+	TEST_EQUAL(moved.access(addr("1.2.3.4")), ip_filter::blocked);
+	TEST_EQUAL(copy.access(addr("2.0.0.1")), 0);
+	TEST_CHECK(copy.export_filter() == moved.export_filter());
+}
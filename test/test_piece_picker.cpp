@@ -2487,6 +2487,72 @@ TORRENT_TEST(piece_extent_affinity_no_duplicates)
 	TEST_CHECK(picked == full_piece(9_piece, blocks));
 }
 
+TORRENT_TEST(download_queue_lookup)
+{
+	// many partial pieces, added and removed in random order and moving
+	// between the download queues. Every lookup must find the right
+	// downloading_piece
+	int const num_pieces = 500;
+	auto p = std::make_shared<piece_picker>(4, 4, num_pieces);
+	for (auto i = 0_piece; i < piece_index_t(num_pieces); ++i)
+		p->inc_refcount(i, &tmp0);
+
+	std::vector<piece_index_t> pieces;
+	for (auto i = 0_piece; i < piece_index_t(num_pieces); ++i)
+		pieces.push_back(i);
+	aux::random_shuffle(pieces);
+
+	// partially request every piece
+	for (piece_index_t const i : pieces)
+		p->mark_as_downloading({i, 1}, &tmp1);
+
+	// request the remaining blocks in every third piece (moving it to the
+	// full queue) and finish every fifth piece (moving it to the finished
+	// queue)
+	for (piece_index_t const i : pieces)
+	{
+		if (static_cast<int>(i) % 3 == 0)
+		{
+			p->mark_as_downloading({i, 0}, &tmp1);
+			p->mark_as_downloading({i, 2}, &tmp1);
+			p->mark_as_downloading({i, 3}, &tmp1);
+		}
+		else if (static_cast<int>(i) % 5 == 0)
+		{
+			for (int b = 0; b < 4; ++b)
+			{
+				p->mark_as_writing({i, b}, &tmp1);
+				p->mark_as_finished({i, b}, &tmp1);
+			}
+		}
+	}
+
+	// and cancel the requests of every seventh piece, which removes them
+	for (piece_index_t const i : pieces)
+	{
+		if (static_cast<int>(i) % 7 != 0 || static_cast<int>(i) % 3 == 0
+			|| static_cast<int>(i) % 5 == 0) continue;
+		p->abort_download({i, 1}, &tmp1);
+	}
+
+	int num_downloading = 0;
+	for (auto i = 0_piece; i < piece_index_t(num_pieces); ++i)
+	{
+		int const idx = static_cast<int>(i);
+		bool const removed = idx % 7 == 0 && idx % 3 != 0 && idx % 5 != 0;
+		TEST_EQUAL(p->is_downloading(i), !removed);
+		if (removed) continue;
+		++num_downloading;
+		TEST_CHECK(p->is_requested({i, 1}) || p->is_finished({i, 1}));
+		TEST_EQUAL(p->is_piece_finished(i), idx % 5 == 0 && idx % 3 != 0);
+		TEST_EQUAL(p->is_requested({i, 0}), idx % 3 == 0);
+		TEST_CHECK(p->get_downloader({i, 1}) == &tmp1);
+	}
+
+	auto const queue = p->get_download_queue();
+	TEST_EQUAL(int(queue.size()), num_downloading);
+}
+
 TORRENT_TEST(piece_block_exported)
 {
 	// piece_block is part of the public API via picker_log_alert::blocks
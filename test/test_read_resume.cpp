@@ -36,6 +36,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "test_utils.hpp"
 
 #include <vector>
+#include <algorithm>
 
 #include "libtorrent/entry.hpp"
 #include "libtorrent/torrent_info.hpp"
@@ -45,6 +46,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/add_torrent_params.hpp"
 #include "libtorrent/read_resume_data.hpp"
 #include "libtorrent/write_resume_data.hpp"
+#include "libtorrent/bdecode.hpp"
+#include "libtorrent/aux_/resume_journal.hpp"
 
 using namespace lt;
 
@@ -387,3 +390,253 @@ TORRENT_TEST(round_trip_verified_leaf_hashes)
 		{true, true, false, false}, {false, true, false, true}};
 	test_roundtrip(atp);
 }
+
+namespace {
+
+tcp::endpoint ep(char const* ip, int const port)
+{
+	return tcp::endpoint(make_address(ip), std::uint16_t(port));
+}
+
+add_torrent_params journal_base()
+{
+	add_torrent_params atp;
+	atp.info_hashes.v1 = sha1_hash{"abababababababababab"};
+	atp.have_pieces.resize(10000, false);
+	atp.have_pieces.set_bit(12_piece);
+	atp.file_priorities.resize(100, default_priority);
+	atp.peers.push_back(ep("1.2.3.4", 6881));
+	atp.peers.push_back(ep("1.2.3.5", 6881));
+	atp.peers.push_back(ep("1::2", 6881));
+	atp.total_uploaded = 1000;
+	return atp;
+}
+
+// returns the journal record for going from ``prev`` to ``cur``, the way a
+// torrent saves it. Fields not marked as changed in ``j`` are left out, and
+// the pieces we got are the ones in j.have
+std::vector<char> journal_record(add_torrent_params const& prev
+	, add_torrent_params cur, aux::resume_journal j)
+{
+	std::vector<piece_index_t> have = std::move(j.have);
+	bool const pieces = j.pieces;
+	bool const file_prio = j.file_priorities;
+	bool const piece_prio = j.piece_priorities;
+	j.saved(prev, prev.have_pieces.count());
+	j.have = std::move(have);
+	j.pieces = pieces;
+	j.file_priorities = file_prio;
+	j.piece_priorities = piece_prio;
+
+	if (!j.pieces)
+	{
+		cur.have_pieces.clear();
+		cur.verified_pieces.clear();
+	}
+	if (!j.file_priorities) cur.file_priorities.clear();
+	if (!j.piece_priorities) cur.piece_priorities.clear();
+	return aux::write_resume_journal(cur, j);
+}
+
+template <typename... Bufs>
+std::vector<char> journal(Bufs const&... bufs)
+{
+	std::vector<char> ret;
+	for (auto const* b : {&bufs...})
+		ret.insert(ret.end(), b->begin(), b->end());
+	return ret;
+}
+
+// the resume data, with the peers in a well defined order
+std::vector<char> canonical(add_torrent_params atp)
+{
+	std::sort(atp.peers.begin(), atp.peers.end());
+	std::sort(atp.banned_peers.begin(), atp.banned_peers.end());
+	return write_resume_data_buf(atp);
+}
+
+}
+
+TORRENT_TEST(journal_no_change)
+{
+	add_torrent_params const atp = journal_base();
+	auto const full = write_resume_data_buf(atp);
+	auto const record = journal_record(atp, atp, {});
+
+	// only the small fields are saved
+	error_code ec;
+	bdecode_node const rd = bdecode(record, ec);
+	TEST_CHECK(!ec);
+	TEST_CHECK(!rd.dict_find("pieces"));
+	TEST_CHECK(!rd.dict_find("have"));
+	TEST_CHECK(!rd.dict_find("file_priority"));
+	TEST_CHECK(!rd.dict_find("added_peers"));
+	TEST_CHECK(!rd.dict_find("removed_peers"));
+	TEST_CHECK(record.size() * 10 < full.size());
+
+	add_torrent_params const loaded = read_resume_data_journal(journal(full, record), ec);
+	TEST_CHECK(!ec);
+	TEST_CHECK(canonical(loaded) == canonical(atp));
+}
+
+TORRENT_TEST(journal_round_trip)
+{
+	add_torrent_params const prev = journal_base();
+	add_torrent_params cur = prev;
+	cur.have_pieces.set_bit(13_piece);
+	cur.have_pieces.set_bit(9000_piece);
+	cur.file_priorities[7] = dont_download;
+	cur.peers.erase(cur.peers.begin());
+	cur.peers.push_back(ep("1.2.3.6", 6881));
+	cur.peers.push_back(ep("1::3", 6881));
+	cur.banned_peers.push_back(ep("1.2.3.7", 6881));
+	cur.total_uploaded = 2000;
+	cur.flags |= torrent_flags::sequential_download;
+	cur.name = "foobar";
+
+	aux::resume_journal j;
+	j.have = {13_piece, 9000_piece};
+	j.file_priorities = true;
+
+	auto const full = write_resume_data_buf(prev);
+	auto const record = journal_record(prev, cur, j);
+
+	// only the changes are stored, not the have-bitfield
+	TEST_CHECK(record.size() * 5 < full.size());
+
+	error_code ec;
+	add_torrent_params const loaded = read_resume_data_journal(journal(full, record), ec);
+	TEST_CHECK(!ec);
+	TEST_CHECK(canonical(loaded) == canonical(cur));
+}
+
+TORRENT_TEST(journal_lost_pieces)
+{
+	add_torrent_params const prev = journal_base();
+	add_torrent_params cur = prev;
+	cur.have_pieces.clear_bit(12_piece);
+	cur.have_pieces.set_bit(13_piece);
+	cur.verified_pieces.resize(10000, false);
+	cur.piece_priorities.resize(10000, default_priority);
+	cur.piece_priorities[5] = top_priority;
+
+	// pieces we lost can't be saved as a list, the whole bitfield is saved
+	aux::resume_journal j;
+	j.pieces = true;
+	j.piece_priorities = true;
+
+	add_torrent_params const loaded = read_resume_data_journal(journal(
+		write_resume_data_buf(prev), journal_record(prev, cur, j)));
+	TEST_CHECK(canonical(loaded) == canonical(cur));
+
+	// piece priorities that were reset are saved as empty
+	add_torrent_params next = cur;
+	next.piece_priorities.clear();
+	add_torrent_params const loaded2 = read_resume_data_journal(journal(
+		write_resume_data_buf(prev), journal_record(prev, cur, j)
+		, journal_record(cur, next, j)));
+	TEST_CHECK(canonical(loaded2) == canonical(next));
+}
+
+TORRENT_TEST(journal_multiple_records)
+{
+	std::vector<char> j = write_resume_data_buf(journal_base());
+	add_torrent_params prev = journal_base();
+	for (int i = 0; i < 20; ++i)
+	{
+		add_torrent_params cur = prev;
+		cur.have_pieces.set_bit(piece_index_t(i * 100));
+		cur.total_downloaded += 16 * 1024;
+		if (i == 10) cur.name = "renamed";
+		if (i == 15) cur.peers.push_back(ep("1.2.3.8", 6881));
+		aux::resume_journal rj;
+		rj.have = {piece_index_t(i * 100)};
+		auto const record = journal_record(prev, cur, rj);
+		j.insert(j.end(), record.begin(), record.end());
+		prev = cur;
+	}
+
+	add_torrent_params const loaded = read_resume_data_journal(j);
+	TEST_CHECK(canonical(loaded) == canonical(prev));
+}
+
+TORRENT_TEST(journal_compaction)
+{
+	add_torrent_params const base = journal_base();
+	add_torrent_params cur = base;
+	cur.have_pieces.set_bit(1_piece);
+	add_torrent_params compacted = cur;
+	compacted.have_pieces.set_bit(2_piece);
+
+	aux::resume_journal j;
+	j.have = {1_piece};
+
+	// a full record appended to the journal replaces what came before it
+	add_torrent_params const loaded = read_resume_data_journal(journal(
+		write_resume_data_buf(base)
+		, journal_record(base, cur, j)
+		, write_resume_data_buf(compacted)));
+	TEST_CHECK(canonical(loaded) == canonical(compacted));
+}
+
+TORRENT_TEST(journal_truncated_record)
+{
+	add_torrent_params const prev = journal_base();
+	add_torrent_params cur = prev;
+	cur.have_pieces.set_bit(1_piece);
+	aux::resume_journal j;
+	j.have = {1_piece};
+	auto const record = journal_record(prev, cur, j);
+	auto const full = write_resume_data_buf(prev);
+	auto const expected = canonical(prev);
+
+	// a partially written record is ignored, wherever the append stopped
+	for (std::size_t len = 0; len < record.size(); ++len)
+	{
+		std::vector<char> const torn(record.begin(), record.begin() + std::ptrdiff_t(len));
+		error_code ec;
+		add_torrent_params const loaded = read_resume_data_journal(journal(full, torn), ec);
+		TEST_CHECK(!ec);
+		TEST_CHECK(canonical(loaded) == expected);
+	}
+
+	// so is a tail of zeros, left by a crash before the data was written
+	std::vector<char> const zeros(100, '\0');
+	error_code ec;
+	add_torrent_params const loaded = read_resume_data_journal(journal(full, zeros), ec);
+	TEST_CHECK(!ec);
+	TEST_CHECK(canonical(loaded) == expected);
+}
+
+TORRENT_TEST(journal_mismatching_torrent)
+{
+	add_torrent_params const prev = journal_base();
+	add_torrent_params other = prev;
+	other.info_hashes.v1 = sha1_hash{"cdcdcdcdcdcdcdcdcdcd"};
+
+	error_code ec;
+	read_resume_data_journal(journal(write_resume_data_buf(prev)
+		, journal_record(other, other, {})), ec);
+	TEST_EQUAL(ec, error_code(errors::mismatching_info_hash));
+}
+
+TORRENT_TEST(journal_invalid_piece)
+{
+	add_torrent_params const prev = journal_base();
+	aux::resume_journal j;
+	j.have = {10000_piece};
+
+	error_code ec;
+	read_resume_data_journal(journal(write_resume_data_buf(prev)
+		, journal_record(prev, prev, j)), ec);
+	TEST_EQUAL(ec, error_code(errors::invalid_piece_index));
+}
+
+TORRENT_TEST(journal_missing_full_record)
+{
+	add_torrent_params const prev = journal_base();
+
+	error_code ec;
+	read_resume_data_journal(journal_record(prev, prev, {}), ec);
+	TEST_EQUAL(ec, error_code(errors::invalid_file_tag));
+}
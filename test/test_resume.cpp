@@ -42,6 +42,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/alert_types.hpp"
 #include "libtorrent/entry.hpp"
 #include "libtorrent/bencode.hpp"
+#include "libtorrent/bdecode.hpp"
 #include "libtorrent/read_resume_data.hpp"
 #include "libtorrent/write_resume_data.hpp"
 #include "libtorrent/aux_/path.hpp"
@@ -1807,6 +1808,94 @@ TORRENT_TEST(resume_data_have_pieces)
 }
 #endif
 
+TORRENT_TEST(journal_records)
+{
+	file_storage fs;
+	fs.add_file("tmp1", 16 * 1024 * 1024);
+	lt::create_torrent t(fs, 16 * 1024);
+
+	std::vector<char> piece_data(std::size_t(fs.piece_length()), 0);
+	aux::random_bytes(piece_data);
+
+	sha1_hash const ph = lt::hasher(piece_data).final();
+	for (auto const i : fs.piece_range())
+		t.set_hash(i, ph);
+
+	std::vector<char> buf;
+	bencode(std::back_inserter(buf), t.generate());
+	auto ti = std::make_shared<torrent_info>(buf, from_span);
+
+	lt::session ses(settings());
+	lt::add_torrent_params atp;
+	atp.ti = ti;
+	atp.flags &= ~torrent_flags::paused;
+	atp.save_path = ".";
+	auto h = ses.add_torrent(atp);
+	wait_for_downloading(ses, "");
+
+	auto save = [&](resume_data_flags_t const flags)
+	{
+		h.save_resume_data(flags);
+		auto const* a = alert_cast<save_resume_data_alert>(
+			wait_for_alert(ses, save_resume_data_alert::alert_type));
+		TEST_CHECK(a != nullptr);
+		if (a == nullptr) return std::make_pair(add_torrent_params(), std::vector<char>());
+		return std::make_pair(a->params, a->journal_record);
+	};
+
+	// there is no full record to append a journal record to yet
+	auto const first = save(torrent_handle::journal);
+	TEST_CHECK(first.second.empty());
+	std::vector<char> journal = write_resume_data_buf(first.first);
+	std::size_t const full_size = journal.size();
+
+	h.add_piece(3_piece, piece_data.data());
+	h.add_piece(40_piece, piece_data.data());
+	for (int i = 0; i < 50 && h.status().num_pieces < 2; ++i)
+		std::this_thread::sleep_for(lt::milliseconds(100));
+	TEST_EQUAL(h.status().num_pieces, 2);
+
+	auto const second = save(torrent_handle::journal);
+	std::vector<char> const& record = second.second;
+	TEST_CHECK(!record.empty());
+	TEST_CHECK(record.size() * 2 < full_size);
+	journal.insert(journal.end(), record.begin(), record.end());
+
+	// the pieces we got are saved as a list, not as the have-bitfield
+	error_code ec;
+	bdecode_node const rd = bdecode(record, ec);
+	TEST_CHECK(!ec);
+	TEST_CHECK(!rd.dict_find("pieces"));
+	TEST_CHECK(!rd.dict_find("piece_priority"));
+	bdecode_node const have = rd.dict_find_list("have");
+	TEST_EQUAL(have.list_size(), 2);
+
+	h.piece_priority(10_piece, dont_download);
+	h.piece_priority(11_piece, top_priority);
+
+	auto const third = save(torrent_handle::journal);
+	bdecode_node const rd2 = bdecode(third.second, ec);
+	TEST_CHECK(!ec);
+	TEST_CHECK(!rd2.dict_find("have"));
+	TEST_CHECK(rd2.dict_find_string("piece_priority"));
+	journal.insert(journal.end(), third.second.begin(), third.second.end());
+
+	// nothing but the small fields changed since the last record
+	auto const fourth = save(torrent_handle::journal);
+	TEST_CHECK(!fourth.second.empty());
+	bdecode_node const rd3 = bdecode(fourth.second, ec);
+	TEST_CHECK(!ec);
+	TEST_CHECK(!rd3.dict_find("have"));
+	TEST_CHECK(!rd3.dict_find("piece_priority"));
+	journal.insert(journal.end(), fourth.second.begin(), fourth.second.end());
+
+	entry const expected = write_resume_data(save({}).first);
+	entry const loaded = write_resume_data(read_resume_data_journal(journal));
+	TEST_CHECK(loaded["pieces"] == expected["pieces"]);
+	TEST_CHECK(loaded["piece_priority"] == expected["piece_priority"]);
+	TEST_EQUAL(loaded["total_downloaded"].integer(), expected["total_downloaded"].integer());
+}
+
 // See https://github.com/arvidn/libtorrent/issues/5174
 TORRENT_TEST(removed)
 {
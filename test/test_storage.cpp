@@ -42,8 +42,10 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "libtorrent/mmap_storage.hpp"
 #include "libtorrent/aux_/posix_storage.hpp"
+#include "libtorrent/aux_/posix_file_pool.hpp"
 #include "libtorrent/aux_/file_view_pool.hpp"
 #include "libtorrent/hasher.hpp"
+#include "libtorrent/bitfield.hpp"
 #include "libtorrent/session.hpp"
 #include "libtorrent/session_params.hpp"
 #include "libtorrent/alert_types.hpp"
@@ -52,12 +54,17 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/read_resume_data.hpp"
 #include "libtorrent/write_resume_data.hpp"
 #include "libtorrent/aux_/disk_io_job.hpp"
+#include "libtorrent/aux_/write_hasher.hpp"
+#include "libtorrent/aux_/disk_device.hpp"
+#include "libtorrent/aux_/disk_job_queue.hpp"
+#include "libtorrent/aux_/extent_cache.hpp"
 #include "libtorrent/aux_/path.hpp"
 #include "libtorrent/aux_/storage_utils.hpp"
 #include "libtorrent/aux_/session_settings.hpp"
 #include "libtorrent/random.hpp"
 #include "libtorrent/mmap_disk_io.hpp"
 #include "libtorrent/posix_disk_io.hpp"
+#include "libtorrent/io_uring_disk_io.hpp"
 
 #include <memory>
 #include <functional> // for bind
@@ -194,11 +201,21 @@ std::shared_ptr<mmap_storage> make_storage(storage_params const& p
 	, aux::file_view_pool& fp) = delete;
 #endif
 
+// posix_storage keeps its open files in a pool keyed by storage index. Give
+// each storage its own pool, since the tests don't assign storage indices
+struct posix_storage_with_pool
+{
+	explicit posix_storage_with_pool(storage_params const& p) : storage(p, pool) {}
+	aux::posix_file_pool pool;
+	posix_storage storage;
+};
+
 template <>
 std::shared_ptr<posix_storage> make_storage(storage_params const& p
 	, aux::file_view_pool&)
 {
-	return std::make_shared<posix_storage>(p);
+	auto s = std::make_shared<posix_storage_with_pool>(p);
+	return std::shared_ptr<posix_storage>(s, &s->storage);
 }
 
 template <typename StorageType>
@@ -286,7 +303,7 @@ int readv(std::shared_ptr<posix_storage> s
 	return s->readv(sett, bufs, piece, offset, ec);
 }
 
-void release_files(std::shared_ptr<posix_storage>, storage_error&) {}
+void release_files(std::shared_ptr<posix_storage> s, storage_error&) { s->release_files(); }
 
 std::vector<char> new_piece(std::size_t const size)
 {
@@ -508,7 +525,8 @@ void test_rename(std::string const& test_path)
 }
 
 void test_check_files(std::string const& test_path
-	, lt::storage_mode_t storage_mode)
+	, lt::storage_mode_t storage_mode
+	, lt::disk_io_constructor_type constructor = default_disk_io_constructor)
 {
 	std::shared_ptr<torrent_info> info;
 
@@ -548,7 +566,7 @@ void test_check_files(std::string const& test_path
 
 	aux::session_settings sett;
 	sett.set_int(settings_pack::aio_threads, 1);
-	std::unique_ptr<disk_interface> io = default_disk_io_constructor(ios, sett, cnt);
+	std::unique_ptr<disk_interface> io = constructor(ios, sett, cnt);
 
 	aux::vector<download_priority_t, file_index_t> priorities(
 		std::size_t(info->num_files()), download_priority_t{});
@@ -654,6 +672,22 @@ TORRENT_TEST(check_files_allocate)
 	test_check_files(current_working_directory(), storage_mode_allocate);
 }
 
+// io_uring_disk_io_constructor() falls back to posix_disk_io when the system
+// doesn't support io_uring. Don't pretend to test it in that case
+bool have_io_uring()
+{
+	if (lt::io_uring_available()) return true;
+	std::cout << "io_uring is not available, skipping test\n";
+	return false;
+}
+
+TORRENT_TEST(check_files_io_uring)
+{
+	if (!have_io_uring()) return;
+	test_check_files(current_working_directory(), storage_mode_sparse
+		, lt::io_uring_disk_io_constructor);
+}
+
 #if TORRENT_HAVE_MMAP
 TORRENT_TEST(rename_mmap_disk_io)
 {
@@ -1398,6 +1432,48 @@ TORRENT_TEST(readwritev_zero_size_files)
 	TEST_CHECK(check_pattern(buf, 0));
 }
 
+TORRENT_TEST(posix_file_pool_lru)
+{
+	std::string const test_path = complete("posix_file_pool");
+	delete_dirs(test_path);
+
+	file_storage fs = make_fs();
+	aux::vector<download_priority_t, file_index_t> priorities;
+	sha1_hash info_hash;
+	storage_params p{fs, nullptr, test_path, storage_mode_sparse
+		, priorities, info_hash};
+
+	// the pool may only keep two of the four files open
+	aux::posix_file_pool pool(2);
+	posix_storage st(p, pool);
+	aux::session_settings sett;
+	storage_error ec;
+
+	std::vector<char> buf(std::size_t(fs.total_size()));
+	aux::random_bytes(buf);
+	iovec_t const write_buf = buf;
+	TEST_EQUAL(st.writev(sett, write_buf, 0_piece, 0, ec), fs.total_size());
+	TEST_CHECK(!ec);
+	TEST_EQUAL(int(st.get_status().size()), 2);
+
+	// the files are open in read-write mode, and can be read back from
+	// without being re-opened
+	std::vector<char> read_buf(buf.size());
+	iovec_t const read_iov = read_buf;
+	TEST_EQUAL(st.readv(sett, read_iov, 0_piece, 0, ec), fs.total_size());
+	TEST_CHECK(!ec);
+	TEST_CHECK(buf == read_buf);
+	TEST_EQUAL(int(st.get_status().size()), 2);
+
+	pool.resize(1);
+	TEST_EQUAL(int(st.get_status().size()), 1);
+
+	st.release_files();
+	TEST_EQUAL(int(st.get_status().size()), 0);
+
+	delete_dirs(test_path);
+}
+
 template <typename StorageType>
 void test_move_storage_to_self()
 {
@@ -1567,25 +1643,28 @@ void sync(lt::io_context& ioc, int& outstanding)
 	}
 }
 
-template <typename Fun>
-void test_unaligned_read(lt::disk_io_constructor_type constructor, Fun fun)
+lt::settings_pack disk_test_settings()
 {
-	lt::io_context ioc;
-	lt::counters cnt;
 	lt::settings_pack pack;
 	pack.set_int(lt::settings_pack::aio_threads, 1);
 	pack.set_int(lt::settings_pack::file_pool_size, 2);
+	return pack;
+}
+
+// sets up a disk I/O back-end with a checked torrent of the files in ``fs``,
+// and calls ``fun`` to issue jobs against it
+template <typename Fun>
+void test_unaligned_read(lt::disk_io_constructor_type constructor
+	, lt::settings_pack const& pack, lt::file_storage const& fs
+	, lt::counters& cnt, Fun fun)
+{
+	lt::io_context ioc;
 
 	std::unique_ptr<lt::disk_interface> disk_io
 		= constructor(ioc, pack, cnt);
 
-	lt::file_storage fs;
-	fs.add_file("test", lt::default_block_size * 2);
-	fs.set_num_pieces(1);
-	fs.set_piece_length(lt::default_block_size * 2);
-
 	std::string const save_path = complete("save_path");
-	delete_dirs(combine_path(save_path, "test"));
+	delete_dirs(combine_path(save_path, fs.name()));
 
 	lt::aux::vector<lt::download_priority_t, lt::file_index_t> prios;
 	lt::storage_params params(fs, nullptr
@@ -1610,6 +1689,18 @@ void test_unaligned_read(lt::disk_io_constructor_type constructor, Fun fun)
 	disk_io->abort(true);
 }
 
+template <typename Fun>
+void test_unaligned_read(lt::disk_io_constructor_type constructor, Fun fun)
+{
+	lt::file_storage fs;
+	fs.add_file("test", lt::default_block_size * 2);
+	fs.set_num_pieces(1);
+	fs.set_piece_length(lt::default_block_size * 2);
+
+	lt::counters cnt;
+	test_unaligned_read(constructor, disk_test_settings(), fs, cnt, std::move(fun));
+}
+
 struct write_handler
 {
 	write_handler(int& outstanding) : m_out(&outstanding) {}
@@ -1742,6 +1833,82 @@ void none_from_store_buffer(lt::disk_interface* disk_io, lt::storage_holder cons
 	sync(ioc, outstanding);
 }
 
+void hash_written_piece(lt::disk_interface* disk_io, lt::storage_holder const& t, lt::io_context& ioc, int& outstanding)
+{
+	std::vector<char> write_buffer(lt::default_block_size * 2);
+	aux::random_bytes(write_buffer);
+	lt::sha1_hash const expected = lt::hasher(write_buffer).final();
+
+	lt::peer_request const req0{0_piece, 0, lt::default_block_size};
+	lt::peer_request const req1{0_piece, lt::default_block_size, lt::default_block_size};
+
+	auto hash_handler = [&](lt::piece_index_t, lt::sha1_hash const& h, lt::storage_error const& ec)
+	{
+		--outstanding;
+		if (ec) std::cout << "async_hash failed " << ec.ec.message() << '\n';
+		TEST_CHECK(!ec);
+		TEST_EQUAL(h, expected);
+	};
+
+	// the second block is still in the store buffer when hashing
+	++outstanding;
+	disk_io->async_write(t, req0, write_buffer.data(), {}, write_handler(outstanding));
+	disk_io->submit_jobs();
+	sync(ioc, outstanding);
+
+	++outstanding;
+	disk_io->async_write(t, req1, write_buffer.data() + lt::default_block_size, {}, write_handler(outstanding));
+	++outstanding;
+	disk_io->async_hash(t, 0_piece, {}, lt::disk_interface::v1_hash, hash_handler);
+	disk_io->submit_jobs();
+	sync(ioc, outstanding);
+
+	// now both blocks are read back from disk
+	++outstanding;
+	disk_io->async_hash(t, 0_piece, {}, lt::disk_interface::v1_hash, hash_handler);
+	disk_io->submit_jobs();
+	sync(ioc, outstanding);
+}
+
+void write_receive_buffer(lt::disk_interface* disk_io, lt::storage_holder const& t, lt::io_context& ioc, int& outstanding)
+{
+	std::vector<char> write_buffer(lt::default_block_size * 2);
+	aux::random_bytes(write_buffer);
+
+	lt::peer_request const req0{0_piece, 0, lt::default_block_size};
+	lt::peer_request const req1{0_piece, lt::default_block_size, lt::default_block_size};
+
+	for (lt::peer_request const& r : {req0, req1})
+	{
+		bool exceeded = false;
+		lt::disk_buffer_holder buf = disk_io->allocate_receive_buffer(exceeded, {}, "receive buffer");
+
+		// disk subsystems are not required to support receiving into their
+		// buffers
+		if (!buf) return;
+		TEST_CHECK(buf.size() >= r.length);
+		std::memcpy(buf.data(), write_buffer.data() + r.start, std::size_t(r.length));
+
+		++outstanding;
+		disk_io->async_write_buffer(t, r, std::move(buf), {}, write_handler(outstanding));
+	}
+
+	lt::peer_request const req2{0_piece, lt::default_block_size / 2, lt::default_block_size};
+	std::vector<char> const expected_buffer(write_buffer.begin() + req2.start
+		, write_buffer.begin() + req2.start + req2.length);
+
+	// first from the store buffer, then from disk
+	++outstanding;
+	disk_io->async_read(t, req2, read_handler(outstanding, expected_buffer));
+	disk_io->submit_jobs();
+	sync(ioc, outstanding);
+
+	++outstanding;
+	disk_io->async_read(t, req2, read_handler(outstanding, expected_buffer));
+	disk_io->submit_jobs();
+	sync(ioc, outstanding);
+}
+
 }
 
 #if TORRENT_HAVE_MMAP
@@ -1761,3 +1928,727 @@ TORRENT_TEST(posix_unaligned_read_both_store_buffer)
 	test_unaligned_read(lt::posix_disk_io_constructor, second_side_from_store_buffer);
 	test_unaligned_read(lt::posix_disk_io_constructor, none_from_store_buffer);
 }
+
+TORRENT_TEST(io_uring_unaligned_read_both_store_buffer)
+{
+	if (!have_io_uring()) return;
+	test_unaligned_read(lt::io_uring_disk_io_constructor, both_sides_from_store_buffer);
+	test_unaligned_read(lt::io_uring_disk_io_constructor, first_side_from_store_buffer);
+	test_unaligned_read(lt::io_uring_disk_io_constructor, second_side_from_store_buffer);
+	test_unaligned_read(lt::io_uring_disk_io_constructor, none_from_store_buffer);
+}
+
+TORRENT_TEST(hash_written_piece)
+{
+#if TORRENT_HAVE_MMAP
+	test_unaligned_read(lt::mmap_disk_io_constructor, hash_written_piece);
+#endif
+	test_unaligned_read(lt::posix_disk_io_constructor, hash_written_piece);
+	if (have_io_uring())
+		test_unaligned_read(lt::io_uring_disk_io_constructor, hash_written_piece);
+}
+
+TORRENT_TEST(write_receive_buffer)
+{
+#if TORRENT_HAVE_MMAP
+	test_unaligned_read(lt::mmap_disk_io_constructor, write_receive_buffer);
+#endif
+	test_unaligned_read(lt::posix_disk_io_constructor, write_receive_buffer);
+	if (have_io_uring())
+		test_unaligned_read(lt::io_uring_disk_io_constructor, write_receive_buffer);
+}
+
+// changes to file_pool_size take effect on the open file table of the
+// io_uring back-end
+TORRENT_TEST(io_uring_file_pool_size)
+{
+	if (!have_io_uring()) return;
+
+	int const num_files = 3;
+	lt::file_storage fs;
+	for (int i = 0; i < num_files; ++i)
+		fs.add_file(combine_path("pool", std::to_string(i)), lt::default_block_size);
+	fs.set_piece_length(lt::default_block_size);
+	fs.set_num_pieces(num_files);
+
+	lt::settings_pack pack = disk_test_settings();
+	pack.set_int(lt::settings_pack::file_pool_size, 1);
+	lt::counters cnt;
+	test_unaligned_read(lt::io_uring_disk_io_constructor, pack, fs, cnt
+		, [&](lt::disk_interface* disk_io, lt::storage_holder const& t
+			, lt::io_context& ioc, int& outstanding)
+	{
+		std::vector<char> write_buffer(std::size_t(lt::default_block_size));
+		aux::random_bytes(write_buffer);
+		auto write_files = [&]
+		{
+			for (int i = 0; i < num_files; ++i)
+			{
+				++outstanding;
+				disk_io->async_write(t, {lt::piece_index_t(i), 0, lt::default_block_size}
+					, write_buffer.data(), {}, write_handler(outstanding));
+			}
+			disk_io->submit_jobs();
+			sync(ioc, outstanding);
+		};
+
+		write_files();
+		TEST_EQUAL(int(disk_io->get_status(t).size()), 1);
+
+		pack.set_int(lt::settings_pack::file_pool_size, 4);
+		disk_io->settings_updated();
+		write_files();
+		TEST_EQUAL(int(disk_io->get_status(t).size()), num_files);
+
+		pack.set_int(lt::settings_pack::file_pool_size, 2);
+		disk_io->settings_updated();
+		write_files();
+		TEST_EQUAL(int(disk_io->get_status(t).size()), 2);
+	});
+}
+
+#if TORRENT_HAVE_MMAP
+namespace {
+
+// writes the 4 blocks of a piece out of order, and hashes it. With
+// hash_on_write enabled, none of them should have to be read back from disk
+void test_hash_on_write(bool const enabled)
+{
+	lt::settings_pack pack = disk_test_settings();
+	pack.set_bool(lt::settings_pack::hash_on_write, enabled);
+
+	int const blocks = 4;
+	char const root[32] = {};
+	lt::file_storage fs;
+	fs.set_piece_length(lt::default_block_size * blocks);
+	fs.add_file("test", lt::default_block_size * blocks, {}, 0, {}, root);
+	fs.set_num_pieces(1);
+
+	lt::counters cnt;
+	test_unaligned_read(lt::mmap_disk_io_constructor, pack, fs, cnt
+		, [&](lt::disk_interface* disk_io, lt::storage_holder const& t
+			, lt::io_context& ioc, int& outstanding)
+	{
+		std::vector<char> write_buffer(std::size_t(lt::default_block_size * blocks));
+		aux::random_bytes(write_buffer);
+
+		auto write_block = [&](int const block)
+		{
+			++outstanding;
+			disk_io->async_write(t, {0_piece, block * lt::default_block_size, lt::default_block_size}
+				, write_buffer.data() + block * lt::default_block_size, {}, write_handler(outstanding));
+			disk_io->submit_jobs();
+			sync(ioc, outstanding);
+		};
+
+		auto hash_piece = [&]
+		{
+			std::array<lt::sha256_hash, blocks> block_hashes;
+			lt::sha1_hash piece_hash;
+			++outstanding;
+			disk_io->async_hash(t, 0_piece, block_hashes, lt::disk_interface::v1_hash
+				, [&](lt::piece_index_t, lt::sha1_hash const& h, lt::storage_error const& ec)
+				{
+					--outstanding;
+					if (ec) std::cout << "async_hash failed " << ec.ec.message() << '\n';
+					TEST_CHECK(!ec);
+					piece_hash = h;
+				});
+			disk_io->submit_jobs();
+			sync(ioc, outstanding);
+
+			TEST_EQUAL(piece_hash, lt::hasher(write_buffer).final());
+			for (int i = 0; i < blocks; ++i)
+			{
+				TEST_EQUAL(block_hashes[std::size_t(i)], lt::hasher256(write_buffer.data()
+					+ i * lt::default_block_size, lt::default_block_size).final());
+			}
+		};
+
+		for (int const block : {1, 0, 3, 2})
+			write_block(block);
+
+		std::int64_t const read_back = cnt[lt::counters::num_read_back];
+		hash_piece();
+		TEST_EQUAL(cnt[lt::counters::num_read_back] - read_back, enabled ? 0 : blocks);
+
+		// a block that's written again, after the piece was hashed, must not be
+		// hashed based on its old content
+		write_buffer[0] = char(write_buffer[0] + 1);
+		write_block(0);
+		hash_piece();
+	});
+}
+
+}
+
+TORRENT_TEST(hash_on_write)
+{
+	test_hash_on_write(true);
+	test_hash_on_write(false);
+}
+
+namespace {
+struct null_allocator final : lt::buffer_allocator_interface
+{
+	void free_disk_buffer(char*) override {}
+};
+}
+
+// when the write hasher is full, the pieces that were written to least
+// recently are evicted, but not the ones that have been hashed while writes
+// to them were still outstanding
+TORRENT_TEST(write_hasher_eviction)
+{
+	null_allocator alloc;
+	std::vector<char> block(std::size_t(lt::default_block_size));
+	aux::random_bytes(block);
+	aux::write_hasher wh;
+	lt::storage_index_t const st(0);
+
+	auto write = [&](lt::piece_index_t const p, int const b)
+	{
+		lt::disk_buffer_holder h(alloc, block.data(), lt::default_block_size);
+		wh.block_written({st, p, b * lt::default_block_size}, h
+			, lt::default_block_size, 0, 0);
+	};
+
+	// piece 1 has been hashed, with one write still outstanding
+	lt::piece_index_t const tombstone(1);
+	aux::write_hasher::piece_state state;
+	write(tombstone, 0);
+	TEST_CHECK(wh.take(st, tombstone, state));
+	wh.hashed(st, tombstone, 1);
+
+	// piece 0 keeps being written to while many other pieces are started,
+	// many more than fit
+	int const num_pieces = aux::write_hasher::max_pieces * 2;
+	int blocks0 = 0;
+	for (int i = 2; i < num_pieces; ++i)
+	{
+		write(lt::piece_index_t(i), 0);
+		write(lt::piece_index_t(i), 1);
+		if (i % 16 == 0) write(0_piece, blocks0++);
+	}
+
+	// the outstanding write completes, and must not start a new piece
+	// state
+	write(tombstone, 0);
+
+	aux::write_hasher::piece_state s0;
+	TEST_CHECK(wh.take(st, 0_piece, s0));
+	TEST_EQUAL(s0.v1_blocks, blocks0);
+	wh.hashed(st, 0_piece, 0);
+
+	// the most recently started pieces are all still there
+	for (int i = num_pieces - aux::write_hasher::max_pieces / 4; i < num_pieces; ++i)
+	{
+		aux::write_hasher::piece_state s;
+		TEST_CHECK(wh.take(st, lt::piece_index_t(i), s));
+		TEST_EQUAL(s.v1_blocks, 2);
+		wh.hashed(st, lt::piece_index_t(i), 0);
+	}
+
+	aux::write_hasher::piece_state s1;
+	wh.take(st, tombstone, s1);
+	TEST_EQUAL(s1.v1_blocks, 0);
+	TEST_CHECK(s1.staged.empty());
+	wh.hashed(st, tombstone, 0);
+	wh.clear();
+}
+
+namespace {
+
+std::shared_ptr<mmap_storage> elevator_storage(file_storage const& fs
+	, aux::file_view_pool& fp, storage_index_t const idx)
+{
+	aux::vector<download_priority_t, file_index_t> priorities;
+	storage_params p{fs, nullptr, "", storage_mode_sparse, priorities, sha1_hash()};
+	auto s = make_storage<mmap_storage>(p, fp);
+	s->set_storage_index(idx);
+	return s;
+}
+
+}
+
+// a queue in elevator mode issues jobs in ascending order of the position
+// they access, starting at the last one issued, and wraps around to the
+// lowest position at the end
+TORRENT_TEST(disk_job_queue_elevator)
+{
+	int const piece_len = lt::default_block_size * 4;
+	char const root[32] = {};
+	lt::file_storage fs;
+	fs.set_piece_length(piece_len);
+	fs.add_file("test", piece_len * 16, {}, 0, {}, root);
+	fs.set_num_pieces(16);
+
+	aux::file_view_pool fp;
+	auto st0 = elevator_storage(fs, fp, storage_index_t{0});
+	auto st1 = elevator_storage(fs, fp, storage_index_t{1});
+
+	// storage, piece, offset
+	std::tuple<std::shared_ptr<mmap_storage>, int, int> const positions[] = {
+		{st0, 5, 0},
+		{st1, 0, 0},
+		{st0, 2, lt::default_block_size},
+		{st0, 9, 0},
+		{st0, 2, 0},
+		{st1, 3, 0},
+		{st0, 12, 0},
+	};
+	std::vector<aux::disk_io_job> jobs(std::size(positions));
+	for (std::size_t i = 0; i < jobs.size(); ++i)
+	{
+		jobs[i].action = aux::job_action_t::read;
+		jobs[i].storage = std::get<0>(positions[i]);
+		jobs[i].piece = piece_index_t(std::get<1>(positions[i]));
+		jobs[i].d.io.offset = std::get<2>(positions[i]);
+	}
+
+	aux::disk_job_queue q;
+	q.set_elevator(true);
+	for (std::size_t i = 0; i < 4; ++i) q.push_back(&jobs[i]);
+	TEST_EQUAL(q.size(), 4);
+
+	// the head starts at the lowest position
+	TEST_CHECK(q.pop_front() == &jobs[2]);
+	TEST_CHECK(q.pop_front() == &jobs[0]);
+
+	// jobs queued behind the head wait for the next sweep, jobs ahead of
+	// it are picked up by this one
+	q.push_back(&jobs[4]);
+	q.push_back(&jobs[6]);
+	q.push_back(&jobs[5]);
+	TEST_CHECK(q.pop_front() == &jobs[3]);
+	TEST_CHECK(q.pop_front() == &jobs[6]);
+	TEST_CHECK(q.pop_front() == &jobs[1]);
+	TEST_CHECK(q.pop_front() == &jobs[5]);
+
+	// wrap around to the lowest position
+	TEST_CHECK(q.pop_front() == &jobs[4]);
+	TEST_CHECK(q.empty());
+
+	// jobs at the same position are issued in the order they were queued
+	aux::disk_io_job same[3];
+	for (auto& j : same)
+	{
+		j.action = aux::job_action_t::read;
+		j.storage = st0;
+		j.piece = piece_index_t(7);
+		q.push_back(&j);
+	}
+	for (auto& j : same)
+		TEST_CHECK(q.pop_front() == &j);
+	TEST_CHECK(q.empty());
+}
+
+// without elevator mode, jobs are issued in the order they were queued, and
+// no more than max_in_flight jobs are started at a time
+TORRENT_TEST(disk_job_queue_in_flight)
+{
+	aux::disk_io_job jobs[3];
+	aux::disk_job_queue q;
+	q.set_max_in_flight(2);
+	TEST_CHECK(!q.ready());
+
+	for (int i = 2; i >= 0; --i)
+	{
+		jobs[i].piece = piece_index_t(i);
+		q.push_back(&jobs[i]);
+	}
+	TEST_CHECK(q.ready());
+
+	TEST_CHECK(q.pop_front() == &jobs[2]);
+	q.job_started();
+	TEST_CHECK(q.ready());
+	TEST_CHECK(q.pop_front() == &jobs[1]);
+	q.job_started();
+	TEST_EQUAL(q.num_in_flight(), 2);
+
+	// the limit is reached
+	TEST_CHECK(!q.ready());
+	q.job_finished();
+	TEST_CHECK(q.ready());
+	TEST_CHECK(q.pop_front() == &jobs[0]);
+	q.job_started();
+	TEST_CHECK(!q.ready());
+
+	q.job_finished();
+	q.job_finished();
+	TEST_EQUAL(q.num_in_flight(), 0);
+	TEST_CHECK(!q.ready());
+
+	// 0 means no limit
+	q.set_max_in_flight(0);
+	for (auto& j : jobs)
+	{
+		q.push_back(&j);
+		q.job_started();
+	}
+	TEST_CHECK(q.ready());
+	while (!q.empty())
+	{
+		q.pop_front();
+		q.job_finished();
+	}
+}
+
+// with per-device queues enabled, once the torrent is checked its reads and
+// writes are served by the threads of the device its save path is on
+TORRENT_TEST(device_queues)
+{
+	lt::settings_pack pack = disk_test_settings();
+	pack.set_int(lt::settings_pack::disk_device_threads, 2);
+	pack.set_int(lt::settings_pack::disk_device_max_in_flight, 1);
+
+	int const blocks = 16;
+	char const root[32] = {};
+	lt::file_storage fs;
+	fs.set_piece_length(lt::default_block_size * 4);
+	fs.add_file("test", lt::default_block_size * blocks, {}, 0, {}, root);
+	fs.set_num_pieces(blocks / 4);
+
+	lt::counters cnt;
+	test_unaligned_read(lt::mmap_disk_io_constructor, pack, fs, cnt
+		, [&](lt::disk_interface* disk_io, lt::storage_holder const& t
+			, lt::io_context& ioc, int& outstanding)
+	{
+		std::vector<char> write_buffer(std::size_t(lt::default_block_size * blocks));
+		aux::random_bytes(write_buffer);
+
+		// queue all blocks at once, backwards, for the queue to reorder them if
+		// the device is a spinning disk
+		for (int i = blocks - 1; i >= 0; --i)
+		{
+			++outstanding;
+			disk_io->async_write(t, {lt::piece_index_t(i / 4), (i % 4) * lt::default_block_size
+				, lt::default_block_size}
+				, write_buffer.data() + i * lt::default_block_size, {}, write_handler(outstanding));
+		}
+		disk_io->submit_jobs();
+		sync(ioc, outstanding);
+
+		for (int i = 0; i < blocks; ++i)
+		{
+			++outstanding;
+			disk_io->async_read(t, {lt::piece_index_t(i / 4), (i % 4) * lt::default_block_size
+				, lt::default_block_size}
+				, [&, i](lt::disk_buffer_holder h, lt::storage_error const& ec)
+				{
+					--outstanding;
+					TEST_CHECK(!ec);
+					TEST_EQUAL(h.size(), lt::default_block_size);
+					TEST_CHECK(std::equal(h.data(), h.data() + h.size()
+						, write_buffer.data() + i * lt::default_block_size));
+				});
+		}
+		disk_io->submit_jobs();
+		sync(ioc, outstanding);
+
+		disk_io->update_stats_counters(cnt);
+		TEST_EQUAL(cnt[lt::counters::disk_device_queues], 1);
+		TEST_EQUAL(cnt[lt::counters::disk_device_jobs], 2 * blocks);
+		TEST_EQUAL(cnt[lt::counters::queued_disk_jobs], 0);
+	});
+}
+#endif
+
+TORRENT_TEST(device_for_path)
+{
+	aux::disk_device const cwd = aux::device_for_path(".");
+	TEST_CHECK(cwd.valid);
+
+	// a path that doesn't exist yet is created on the device of its closest
+	// existing parent
+	aux::disk_device const missing = aux::device_for_path(
+		combine_path("device_for_path_missing", "sub"));
+	TEST_CHECK(missing.valid);
+	TEST_EQUAL(missing.id, cwd.id);
+	TEST_EQUAL(missing.rotational, cwd.rotational);
+}
+
+TORRENT_TEST(zero_hash)
+{
+	for (int const len : {1, lt::default_block_size, lt::default_block_size * 3 + 17})
+	{
+		std::vector<char> const zeros(std::size_t(len), '\0');
+		TEST_EQUAL(aux::zero_hash(len), lt::hasher(zeros).final());
+		TEST_EQUAL(aux::zero_hash2(len), lt::hasher256(zeros).final());
+		// the second time, it's returned from the cache
+		TEST_EQUAL(aux::zero_hash(len), lt::hasher(zeros).final());
+	}
+}
+
+namespace {
+
+// writes two pieces of a sparse file, then checks all of them. The pieces
+// that were never written are in holes, and aren't read, if the file system
+// supports sparse files
+void test_sparse_check(lt::disk_io_constructor_type constructor)
+{
+	int const piece_len = lt::default_block_size * 4;
+	int const num_pieces = 16;
+	lt::file_storage fs;
+	fs.set_piece_length(piece_len);
+	fs.add_file(combine_path("sparse", "test"), std::int64_t(piece_len) * num_pieces);
+	fs.set_num_pieces(num_pieces);
+
+	lt::counters cnt;
+	test_unaligned_read(constructor, disk_test_settings(), fs, cnt
+		, [&](lt::disk_interface* disk_io, lt::storage_holder const& t
+			, lt::io_context& ioc, int& outstanding)
+	{
+		// write piece 3 and the last piece, which makes the file full size
+		std::vector<char> write_buffer(static_cast<std::size_t>(piece_len));
+		aux::random_bytes(write_buffer);
+		lt::sha1_hash const expected = lt::hasher(write_buffer).final();
+		for (lt::piece_index_t const p : {3_piece, lt::piece_index_t(num_pieces - 1)})
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				++outstanding;
+				disk_io->async_write(t, {p, i * lt::default_block_size, lt::default_block_size}
+					, write_buffer.data() + i * lt::default_block_size, {}, write_handler(outstanding));
+			}
+		}
+		disk_io->submit_jobs();
+		sync(ioc, outstanding);
+
+		// closing the files flushes them, then check them again, like
+		// force_recheck does
+		++outstanding;
+		disk_io->async_release_files(t, [&] { --outstanding; });
+		lt::add_torrent_params atp;
+		++outstanding;
+		disk_io->async_check_files(t, &atp, lt::aux::vector<std::string, lt::file_index_t>{}
+			, [&](lt::status_t, lt::storage_error const&) { --outstanding; });
+		disk_io->submit_jobs();
+		sync(ioc, outstanding);
+
+		std::int64_t size = 0;
+		aux::data_extents ext;
+		bool const has_holes = aux::query_data_extents(
+			combine_path(complete("save_path"), fs.file_path(0_file)), size, ext)
+			&& !ext.empty() && ext.front().first >= piece_len;
+		if (!has_holes) std::cout << "file system does not report holes\n";
+
+		for (lt::piece_index_t p(0); p < lt::piece_index_t(num_pieces); ++p)
+		{
+			bool const written = p == 3_piece || p == lt::piece_index_t(num_pieces - 1);
+			++outstanding;
+			disk_io->async_hash(t, p, {}, lt::disk_interface::v1_hash | lt::disk_interface::volatile_read
+				, [&, written](lt::piece_index_t, lt::sha1_hash const& h, lt::storage_error const& ec)
+				{
+					--outstanding;
+					TEST_CHECK(!ec);
+					TEST_EQUAL(h, written ? expected : aux::zero_hash(piece_len));
+				});
+		}
+		disk_io->submit_jobs();
+		sync(ioc, outstanding);
+
+		disk_io->update_stats_counters(cnt);
+		if (has_holes)
+			TEST_EQUAL(cnt[lt::counters::num_hole_pieces_skipped], num_pieces - 2);
+
+		// now that the extents of the file are known, the pieces in holes are
+		// answered without waiting for a disk thread. Only the two pieces
+		// holding data are left
+		for (lt::piece_index_t p(0); p < lt::piece_index_t(num_pieces); ++p)
+		{
+			bool const written = p == 3_piece || p == lt::piece_index_t(num_pieces - 1);
+			++outstanding;
+			disk_io->async_hash(t, p, {}, lt::disk_interface::v1_hash | lt::disk_interface::volatile_read
+				, [&, written](lt::piece_index_t, lt::sha1_hash const& h, lt::storage_error const& ec)
+				{
+					--outstanding;
+					TEST_CHECK(!ec);
+					TEST_EQUAL(h, written ? expected : aux::zero_hash(piece_len));
+				});
+		}
+		ioc.poll();
+		ioc.restart();
+		if (has_holes) TEST_CHECK(outstanding <= 2);
+		disk_io->submit_jobs();
+		sync(ioc, outstanding);
+
+		disk_io->update_stats_counters(cnt);
+		if (has_holes)
+			TEST_EQUAL(cnt[lt::counters::num_hole_pieces_skipped], 2 * (num_pieces - 2));
+	});
+}
+}
+
+#if TORRENT_HAVE_MMAP
+TORRENT_TEST(sparse_check_mmap)
+{
+	test_sparse_check(lt::mmap_disk_io_constructor);
+}
+#endif
+
+TORRENT_TEST(sparse_check_posix)
+{
+	test_sparse_check(lt::posix_disk_io_constructor);
+}
+
+namespace {
+
+// writes all pieces of a torrent, corrupting some of them, then hashes every
+// piece twice. First with all hash jobs queued at once, which lets the hash
+// thread hash them together in parallel lanes, then one job at a time, which
+// hashes each piece on its own. Both must pass and fail the same pieces
+void test_batched_check(lt::disk_io_constructor_type constructor, bool const v2)
+{
+	int const piece_len = lt::default_block_size * 4;
+	int const num_pieces = 21;
+	int const last_piece_len = 5000;
+	int const blocks_per_piece = piece_len / lt::default_block_size;
+	char const root[32] = {};
+	lt::file_storage fs;
+	fs.set_piece_length(piece_len);
+	fs.add_file(combine_path("batched", "test")
+		, std::int64_t(piece_len) * (num_pieces - 1) + last_piece_len
+		, {}, 0, {}, v2 ? root : nullptr);
+	fs.set_num_pieces(num_pieces);
+
+	std::vector<char> data(static_cast<std::size_t>(fs.total_size()));
+	aux::random_bytes(data);
+	aux::vector<lt::sha1_hash, lt::piece_index_t> expected;
+	for (lt::piece_index_t p(0); p < fs.end_piece(); ++p)
+	{
+		expected.push_back(lt::hasher(lt::span<char const>(data)
+			.subspan(static_cast<int>(p) * piece_len, fs.piece_size(p))).final());
+	}
+
+	// what's written to disk differs from the expected content in these
+	// pieces
+	for (int const p : {0, 5, 6, 13, num_pieces - 1})
+		data[std::size_t(p * piece_len + 100)] ^= 0x55;
+
+	lt::counters cnt;
+	lt::settings_pack pack = disk_test_settings();
+	pack.set_int(lt::settings_pack::hashing_threads, 1);
+	test_unaligned_read(constructor, pack, fs, cnt
+		, [&](lt::disk_interface* disk_io, lt::storage_holder const& t
+			, lt::io_context& ioc, int& outstanding)
+	{
+		for (lt::piece_index_t p(0); p < fs.end_piece(); ++p)
+		{
+			for (int i = 0; i * lt::default_block_size < fs.piece_size(p); ++i)
+			{
+				int const start = i * lt::default_block_size;
+				int const len = std::min(lt::default_block_size, fs.piece_size(p) - start);
+				++outstanding;
+				disk_io->async_write(t, {p, start, len}
+					, data.data() + static_cast<int>(p) * piece_len + start, {}
+					, write_handler(outstanding));
+			}
+		}
+		disk_io->submit_jobs();
+		sync(ioc, outstanding);
+
+		++outstanding;
+		disk_io->async_release_files(t, [&] { --outstanding; });
+		disk_io->submit_jobs();
+		sync(ioc, outstanding);
+
+		auto check = [&](bool const batch)
+		{
+			lt::typed_bitfield<lt::piece_index_t> passed(num_pieces);
+			aux::vector<std::vector<lt::sha256_hash>, lt::piece_index_t> block_hashes(
+				std::size_t(num_pieces), std::vector<lt::sha256_hash>(std::size_t(v2 ? blocks_per_piece : 0)));
+			for (lt::piece_index_t p(0); p < fs.end_piece(); ++p)
+			{
+				++outstanding;
+				disk_io->async_hash(t, p, block_hashes[p]
+					, lt::disk_interface::v1_hash | lt::disk_interface::volatile_read
+					, [&](lt::piece_index_t const piece, lt::sha1_hash const& h, lt::storage_error const& ec)
+					{
+						--outstanding;
+						TEST_CHECK(!ec);
+						if (h == expected[piece]) passed.set_bit(piece);
+					});
+				if (batch) continue;
+				disk_io->submit_jobs();
+				sync(ioc, outstanding);
+			}
+			disk_io->submit_jobs();
+			sync(ioc, outstanding);
+
+			if (v2)
+			{
+				for (lt::piece_index_t p(0); p < fs.end_piece(); ++p)
+				{
+					for (int i = 0; i * lt::default_block_size < fs.piece_size(p); ++i)
+					{
+						int const start = static_cast<int>(p) * piece_len + i * lt::default_block_size;
+						int const len = std::min(lt::default_block_size
+							, fs.piece_size(p) - i * lt::default_block_size);
+						TEST_EQUAL(block_hashes[p][std::size_t(i)]
+							, lt::hasher256(lt::span<char const>(data).subspan(start, len)).final());
+					}
+				}
+			}
+			return passed;
+		};
+
+		auto const batched = check(true);
+		auto const scalar = check(false);
+		for (lt::piece_index_t p(0); p < fs.end_piece(); ++p)
+		{
+			int const i = static_cast<int>(p);
+			bool const corrupt = i == 0 || i == 5 || i == 6 || i == 13 || i == num_pieces - 1;
+			TEST_EQUAL(batched.get_bit(p), scalar.get_bit(p));
+			TEST_EQUAL(batched.get_bit(p), !corrupt);
+		}
+	});
+}
+}
+
+#if TORRENT_HAVE_MMAP
+TORRENT_TEST(batched_check_mmap)
+{
+	test_batched_check(lt::mmap_disk_io_constructor, false);
+	test_batched_check(lt::mmap_disk_io_constructor, true);
+}
+#endif
+
+TORRENT_TEST(batched_check_posix)
+{
+	test_batched_check(lt::posix_disk_io_constructor, false);
+	test_batched_check(lt::posix_disk_io_constructor, true);
+}
+
+#if TORRENT_HAVE_MMAP
+TORRENT_TEST(mmap_read_view)
+{
+	std::string const save_path = complete("save_path_view");
+	delete_dirs(combine_path(save_path, "temp_storage"));
+
+	aux::session_settings set;
+	file_storage fs;
+	std::vector<char> buf;
+	aux::file_view_pool fp;
+	auto s = setup_torrent<mmap_storage>(fs, fp, buf, save_path, set);
+
+	std::vector<char> piece(0x4000);
+	aux::random_bytes(piece);
+	storage_error se;
+	iovec_t b = piece;
+	TEST_EQUAL(s->writev(set, b, 1_piece, 0, aux::open_mode::write, se), 0x4000);
+
+	disk_buffer_holder view = s->read_view(set, 1_piece, 0x100, 0x1000, aux::open_mode::read_only);
+	TEST_CHECK(view);
+	TEST_EQUAL(view.size(), 0x1000);
+	TEST_CHECK(std::equal(piece.begin() + 0x100, piece.begin() + 0x1100, view.data()));
+
+	// the view keeps the mapping alive after the files are closed
+	s->release_files(se);
+	TEST_CHECK(!se);
+	TEST_CHECK(std::equal(piece.begin() + 0x100, piece.begin() + 0x1100, view.data()));
+
+	// a range spanning two files has to be copied
+	TEST_CHECK(!s->read_view(set, 1_piece, 0x2000, 0x4000, aux::open_mode::read_only));
+}
+#endif
@@ -34,6 +34,10 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/aux_/store_buffer.hpp"
 #include "libtorrent/disk_interface.hpp" // for default_block_size
 
+#include <thread>
+#include <vector>
+#include <atomic>
+
 using lt::aux::torrent_location;
 using lt::aux::store_buffer;
 
@@ -184,3 +188,65 @@ TORRENT_TEST(store_buffer_get2)
 	check2_miss(sb, loc[7], loc[4]);
 }
 
+
+TORRENT_TEST(store_buffer_threads)
+{
+	store_buffer sb;
+	std::vector<char> bufs(4 * 100);
+
+	// every thread inserts, looks up and erases its own blocks, spread over
+	// all shards
+	std::vector<std::thread> threads;
+	std::atomic<int> errors{0};
+	for (int t = 0; t < 4; ++t)
+	{
+		threads.emplace_back([&, t] {
+			lt::storage_index_t const st(t);
+			for (int round = 0; round < 100; ++round)
+			{
+				for (int i = 0; i < 100; ++i)
+					sb.insert({st, lt::piece_index_t(i), 0}, &bufs[std::size_t(t * 100 + i)]);
+				for (int i = 0; i < 100; ++i)
+				{
+					char const* expected = &bufs[std::size_t(t * 100 + i)];
+					bool const found = sb.get({st, lt::piece_index_t(i), 0}
+						, [&](char const* b) { if (b != expected) ++errors; });
+					if (!found) ++errors;
+				}
+				for (int i = 0; i < 100; ++i)
+					sb.erase({st, lt::piece_index_t(i), 0});
+			}
+		});
+	}
+	for (auto& t : threads) t.join();
+
+	TEST_EQUAL(errors, 0);
+	check_miss(sb, {st0, p0, 0});
+}
+
+TORRENT_TEST(store_buffer_contention)
+{
+	store_buffer sb;
+	sb.insert({st0, p0, 0}, &buf1);
+	TEST_EQUAL(sb.lock_contention(), 0);
+
+	// the first thread holds the lock of the piece's shard (while calling the
+	// callback of get()) until the second thread has found it taken, trying
+	// to insert a block of the same piece
+	std::atomic<bool> holding{false};
+	std::thread t1([&] {
+		sb.get({st0, p0, 0}, [&](char const*) {
+			holding = true;
+			while (sb.lock_contention() == 0) std::this_thread::yield();
+		});
+	});
+	std::thread t2([&] {
+		while (!holding) std::this_thread::yield();
+		sb.insert({st0, p0, lt::default_block_size}, &buf2);
+	});
+	t1.join();
+	t2.join();
+
+	TEST_EQUAL(sb.lock_contention(), 1);
+	check(sb, {st0, p0, lt::default_block_size}, &buf2);
+}
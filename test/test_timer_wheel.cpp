@@ -0,0 +1,230 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "test.hpp"
+#include "libtorrent/aux_/timer_wheel.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+struct item : aux::timer_wheel_entry
+{
+	int id = 0;
+	std::int64_t fired = -1;
+};
+
+// advances the wheel one tick at a time up to ``to``, recording the tick each
+// item fired at
+std::vector<item*> advance(aux::timer_wheel& w, std::int64_t const to)
+{
+	std::vector<item*> ret;
+	while (w.now() < to)
+	{
+		std::int64_t const now = w.now() + 1;
+		w.advance(now, [&](aux::timer_wheel_entry& e)
+		{
+			auto& i = static_cast<item&>(e);
+			i.fired = now;
+			ret.push_back(&i);
+		});
+	}
+	return ret;
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(timer_wheel_order)
+{
+	aux::timer_wheel w;
+	item a, b, c;
+	a.id = 0;
+	b.id = 1;
+	c.id = 2;
+	w.schedule(c, 3);
+	w.schedule(a, 1);
+	w.schedule(b, 2);
+	TEST_EQUAL(w.size(), 3);
+	TEST_CHECK(a.scheduled());
+
+	auto const fired = advance(w, 5);
+	TEST_EQUAL(fired.size(), 3);
+	TEST_CHECK(fired[0] == &a);
+	TEST_CHECK(fired[1] == &b);
+	TEST_CHECK(fired[2] == &c);
+	TEST_EQUAL(a.fired, 1);
+	TEST_EQUAL(b.fired, 2);
+	TEST_EQUAL(c.fired, 3);
+	TEST_CHECK(!a.scheduled());
+	TEST_CHECK(w.empty());
+}
+
+TORRENT_TEST(timer_wheel_cancel)
+{
+	aux::timer_wheel w;
+	item a, b;
+	w.schedule(a, 10);
+	w.schedule(b, 10);
+	w.cancel(a);
+	TEST_CHECK(!a.scheduled());
+	TEST_EQUAL(w.size(), 1);
+
+	// cancelling an entry that isn't scheduled is a no-op
+	w.cancel(a);
+	TEST_EQUAL(w.size(), 1);
+
+	{
+		// an entry that's destructed removes itself
+		item c;
+		w.schedule(c, 5);
+		TEST_EQUAL(w.size(), 2);
+	}
+	TEST_EQUAL(w.size(), 1);
+
+	auto const fired = advance(w, 20);
+	TEST_EQUAL(fired.size(), 1);
+	TEST_CHECK(fired[0] == &b);
+	TEST_EQUAL(a.fired, -1);
+}
+
+TORRENT_TEST(timer_wheel_reschedule)
+{
+	aux::timer_wheel w;
+	item a;
+	w.schedule(a, 100);
+	// moving an entry doesn't add another one
+	w.schedule(a, 4);
+	TEST_EQUAL(w.size(), 1);
+	TEST_EQUAL(a.due(), 4);
+
+	// rescheduling from within the callback, like a periodic timer
+	int count = 0;
+	std::int64_t last = 0;
+	while (w.now() < 40)
+	{
+		w.advance(w.now() + 1, [&](aux::timer_wheel_entry& e)
+		{
+			TEST_CHECK(&e == &a);
+			TEST_CHECK(!e.scheduled());
+			++count;
+			last = w.now();
+			w.schedule(e, w.now() + 4);
+		});
+	}
+	TEST_EQUAL(count, 10);
+	TEST_EQUAL(last, 40);
+	TEST_EQUAL(w.size(), 1);
+}
+
+TORRENT_TEST(timer_wheel_past_due)
+{
+	aux::timer_wheel w(1000);
+	item a;
+	// an entry that's already due fires at the next tick
+	w.schedule(a, 10);
+	TEST_EQUAL(a.due(), 1001);
+	auto const fired = advance(w, 1001);
+	TEST_EQUAL(fired.size(), 1);
+	TEST_EQUAL(a.fired, 1001);
+}
+
+TORRENT_TEST(timer_wheel_levels)
+{
+	// entries on every level, including ones beyond what the wheel covers,
+	// fire at exactly the tick they're due
+	aux::timer_wheel w(17);
+	std::vector<std::int64_t> const delays = {1, 63, 64, 65, 100, 4095, 4096
+		, 4097, 262143, 262144, 300000, 16777215, 16777216, 20000000};
+	std::vector<std::unique_ptr<item>> items;
+	for (auto const d : delays)
+	{
+		items.emplace_back(new item);
+		w.schedule(*items.back(), w.now() + d);
+	}
+
+	int num_fired = 0;
+	w.advance(17 + 20000000, [&](aux::timer_wheel_entry& e)
+	{
+		auto& i = static_cast<item&>(e);
+		i.fired = w.now();
+		++num_fired;
+	});
+	TEST_EQUAL(num_fired, int(delays.size()));
+	for (std::size_t i = 0; i < delays.size(); ++i)
+		TEST_EQUAL(items[i]->fired, 17 + delays[i]);
+}
+
+TORRENT_TEST(timer_wheel_idle_jump)
+{
+	// when the wheel is empty, advancing it is free
+	aux::timer_wheel w;
+	w.advance(1000000, [](aux::timer_wheel_entry&) { TEST_CHECK(false); });
+	TEST_EQUAL(w.now(), 1000000);
+
+	item a;
+	w.schedule(a, 1000070);
+	auto const fired = advance(w, 1000100);
+	TEST_EQUAL(fired.size(), 1);
+	TEST_EQUAL(a.fired, 1000070);
+}
+
+TORRENT_TEST(timer_wheel_random)
+{
+	std::mt19937 rng(0x1337);
+	std::uniform_int_distribution<std::int64_t> delay(1, 5000);
+
+	aux::timer_wheel w;
+	std::vector<item> items(2000);
+	for (auto& i : items) w.schedule(i, delay(rng));
+
+	int num_fired = 0;
+	bool in_order = true;
+	w.advance(20000, [&](aux::timer_wheel_entry& e)
+	{
+		auto& i = static_cast<item&>(e);
+		in_order = in_order && i.due() == w.now();
+		++num_fired;
+		// cancel or move some other entries while the wheel is advancing
+		auto& other = items[std::size_t(num_fired * 7) % items.size()];
+		if (num_fired % 3 == 0) w.cancel(other);
+		else if (num_fired % 3 == 1 && other.scheduled())
+			w.schedule(other, w.now() + delay(rng));
+	});
+	TEST_CHECK(in_order);
+	TEST_CHECK(w.empty());
+	TEST_CHECK(num_fired <= int(items.size()));
+}
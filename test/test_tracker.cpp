@@ -49,6 +49,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/tracker_manager.hpp"
 #include "libtorrent/http_tracker_connection.hpp" // for parse_tracker_response
 #include "libtorrent/torrent_info.hpp"
+#include "libtorrent/create_torrent.hpp"
 #include "libtorrent/announce_entry.hpp"
 #include "libtorrent/torrent.hpp"
 #include "libtorrent/aux_/path.hpp"
@@ -438,6 +439,92 @@ TORRENT_TEST(udp_tracker_v6)
 	}
 }
 
+TORRENT_TEST(udp_tracker_shared_connection)
+{
+	int const udp_port = start_udp_tracker(address_v4::any());
+
+	settings_pack pack = settings();
+	// make some of the announces wait for their turn
+	pack.set_int(settings_pack::max_udp_announces_per_second, 10);
+	pack.set_str(settings_pack::listen_interfaces, "127.0.0.1:0");
+	auto s = std::make_unique<lt::session>(pack);
+
+	char tracker_url[200];
+	std::snprintf(tracker_url, sizeof(tracker_url), "udp://127.0.0.1:%d/announce", udp_port);
+
+	int const num_torrents = 20;
+	error_code ec;
+	create_directory("tmp1_tracker", ec);
+	std::vector<torrent_handle> handles;
+	std::vector<sha1_hash> info_hashes;
+	for (int i = 0; i < num_torrents; ++i)
+	{
+		std::string const name = "temporary" + std::to_string(i);
+		ofstream file(combine_path("tmp1_tracker", name).c_str());
+		std::shared_ptr<torrent_info> t = ::create_torrent(&file, name.c_str()
+			, 16 * 1024, 13, false, lt::create_torrent::v1_only);
+		file.close();
+		t->add_tracker(tracker_url, 0);
+
+		add_torrent_params addp;
+		addp.flags &= ~torrent_flags::paused;
+		addp.flags &= ~torrent_flags::auto_managed;
+		addp.flags |= torrent_flags::seed_mode;
+		addp.ti = t;
+		addp.save_path = "tmp1_tracker";
+		info_hashes.push_back(t->info_hashes().v1);
+		handles.push_back(s->add_torrent(addp));
+	}
+
+	for (int i = 0; i < 50; ++i)
+	{
+		print_alerts(*s, "s");
+		if (num_udp_announces() == num_torrents) break;
+		std::this_thread::sleep_for(lt::milliseconds(100));
+	}
+
+	TEST_EQUAL(num_udp_announces(), num_torrents);
+
+	// all torrents share the same connection ID. It may still be cached from
+	// the tests above
+	int const connects = num_udp_connects();
+	TEST_CHECK(connects <= 1);
+
+	for (auto const& h : handles) h.scrape_tracker();
+
+	auto const scraped = [&]
+	{
+		for (int i = 0; i < num_torrents; ++i)
+		{
+			auto const trackers = handles[std::size_t(i)].trackers();
+			if (trackers.empty() || trackers[0].endpoints.empty()) return false;
+			auto const& ih = trackers[0].endpoints[0].info_hashes[protocol_version::V1];
+			sha1_hash const& expect = info_hashes[std::size_t(i)];
+			if (ih.scrape_complete != std::uint8_t(expect[0])
+				|| ih.scrape_incomplete != std::uint8_t(expect[1]))
+				return false;
+		}
+		return true;
+	};
+
+	for (int i = 0; i < 50; ++i)
+	{
+		print_alerts(*s, "s");
+		if (num_udp_scraped_hashes() == num_torrents && scraped()) break;
+		std::this_thread::sleep_for(lt::milliseconds(100));
+	}
+
+	// every torrent got the counts for its own info-hash, while the scrapes
+	// were sent in fewer requests than there are torrents
+	TEST_CHECK(scraped());
+	TEST_EQUAL(num_udp_scraped_hashes(), num_torrents);
+	TEST_CHECK(num_udp_scrapes() < num_torrents);
+	TEST_EQUAL(num_udp_connects(), connects);
+
+	s.reset();
+	stop_udp_tracker();
+}
+
 TORRENT_TEST(http_peers)
 {
 	int const http_port = start_web_server();
@@ -0,0 +1,171 @@
+/*
+
+Copyright (c) 2021, The libtorrent authors
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "test.hpp"
+#include "libtorrent/udp_socket.hpp"
+#include "libtorrent/io_context.hpp"
+#include "libtorrent/aux_/array.hpp"
+#include "libtorrent/time.hpp"
+
+#include <thread>
+#include <vector>
+#include <string>
+
+using namespace lt;
+
+namespace {
+
+struct socket_pair
+{
+	socket_pair()
+		: sender(ios, aux::listen_socket_handle())
+		, receiver(ios, aux::listen_socket_handle())
+	{
+		error_code ec;
+		for (udp_socket* s : {&sender, &receiver})
+		{
+			s->open(udp::v4(), ec);
+			TEST_CHECK(!ec);
+			s->bind(udp::endpoint(make_address_v4("127.0.0.1"), 0), ec);
+			TEST_CHECK(!ec);
+		}
+		target = receiver.local_endpoint();
+	}
+
+	~socket_pair()
+	{
+		sender.close();
+		receiver.close();
+	}
+
+	// read until we have received num packets, or give up after a while
+	std::vector<std::string> receive(int const num)
+	{
+		std::vector<std::string> ret;
+		for (int i = 0; i < 100 && int(ret.size()) < num; ++i)
+		{
+			aux::array<udp_socket::packet, udp_socket::read_batch_size> p;
+			error_code ec;
+			int const n = receiver.read(p, ec);
+			for (int k = 0; k < n; ++k)
+			{
+				TEST_CHECK(!p[k].error);
+				TEST_CHECK(p[k].from.port() == sender.local_endpoint().port());
+				ret.emplace_back(p[k].data.begin(), p[k].data.end());
+			}
+			if (n == 0) std::this_thread::sleep_for(lt::milliseconds(10));
+		}
+		return ret;
+	}
+
+	io_context ios;
+	udp_socket sender;
+	udp_socket receiver;
+	udp::endpoint target;
+};
+
+std::string make_packet(int const i, int const size)
+{
+	std::string ret(std::size_t(size), char('a' + i % 26));
+	ret[0] = char(i);
+	return ret;
+}
+
+}
+
+TORRENT_TEST(send_receive)
+{
+	socket_pair s;
+	error_code ec;
+	std::string const p = make_packet(1, 100);
+	s.sender.send(s.target, p, ec);
+	TEST_CHECK(!ec);
+
+	auto const received = s.receive(1);
+	TEST_EQUAL(received.size(), 1);
+	if (received.size() == 1) TEST_CHECK(received[0] == p);
+}
+
+TORRENT_TEST(batch_send_receive)
+{
+	socket_pair s;
+
+	// a mix of runs of packets of the same size (which may be sent with
+	// segmentation offload) and packets of different sizes, with and without
+	// the DF flag set. They must all arrive, in order
+	std::vector<std::string> sent;
+	s.sender.begin_batch();
+	for (int i = 0; i < 100; ++i)
+	{
+		int const size = i < 40 ? 1000 : i < 60 ? 100 + i : i == 99 ? 1500 : 500;
+		sent.push_back(make_packet(i, size));
+		error_code ec;
+		s.sender.send(s.target, sent.back(), ec
+			, i % 30 < 20 ? udp_socket::dont_fragment : udp_send_flags_t{});
+		TEST_CHECK(!ec);
+	}
+	error_code ec;
+	s.sender.flush_batch(ec);
+	TEST_CHECK(!ec);
+
+	auto const received = s.receive(int(sent.size()));
+	TEST_EQUAL(received.size(), sent.size());
+	for (std::size_t i = 0; i < std::min(sent.size(), received.size()); ++i)
+		TEST_CHECK(received[i] == sent[i]);
+}
+
+TORRENT_TEST(read_batch)
+{
+	socket_pair s;
+
+	int const num = udp_socket::read_batch_size + 5;
+	for (int i = 0; i < num; ++i)
+	{
+		error_code ec;
+		s.sender.send(s.target, make_packet(i, 200), ec);
+		TEST_CHECK(!ec);
+	}
+	std::this_thread::sleep_for(lt::milliseconds(100));
+
+	// all packets should be returned by the first two calls
+	aux::array<udp_socket::packet, udp_socket::read_batch_size> p;
+	error_code ec;
+	int const first = s.receiver.read(p, ec);
+	TEST_CHECK(first > 0);
+	TEST_CHECK(first <= udp_socket::read_batch_size);
+	if (first > 0)
+		TEST_CHECK(std::string(p[0].data.begin(), p[0].data.end()) == make_packet(0, 200));
+
+	auto const rest = s.receive(num - first);
+	TEST_EQUAL(int(rest.size()), num - first);
+	if (!rest.empty()) TEST_CHECK(rest.back() == make_packet(num - 1, 200));
+}
@@ -39,6 +39,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/time.hpp"
 #include "libtorrent/aux_/path.hpp"
 #include "libtorrent/aux_/utp_stream.hpp"
+#include "libtorrent/aux_/utp_socket_table.hpp"
 #include <tuple>
 #include <functional>
 
@@ -166,3 +167,57 @@ TORRENT_TEST(compare_less_wrap)
 	TEST_CHECK(compare_less_wrap(0xfff0, 0x000f, 0xffff)); // wrap
 	TEST_CHECK(!compare_less_wrap(0xfff0, 0xff00, 0xffff));
 }
+
+TORRENT_TEST(utp_socket_table)
+{
+	using lt::aux::utp_socket_impl;
+	lt::aux::utp_socket_table t;
+
+	// the table never dereferences the sockets, any distinct pointers will do
+	std::vector<char> storage(4000);
+	auto sock = [&](int const i) { return reinterpret_cast<utp_socket_impl*>(&storage[std::size_t(i)]); };
+	auto endpoint = [](int const i) {
+		if (i & 1) return udp::endpoint(make_address_v6("2001:db8::" + std::to_string(i / 16)), std::uint16_t(6881 + i % 4));
+		return udp::endpoint(make_address_v4("10.0.0." + std::to_string(i / 16)), std::uint16_t(6881 + i % 4));
+	};
+	// sockets with the same connection ID and sockets with the same endpoint
+	auto conn_id = [](int const i) { return std::uint16_t(i % 5); };
+
+	TEST_CHECK(t.find(endpoint(0), conn_id(0)) == nullptr);
+	TEST_CHECK(!t.erase(endpoint(0), conn_id(0), sock(0)));
+
+	std::vector<int> keys;
+	for (int i = 0; i < 4000; ++i)
+	{
+		TEST_CHECK(t.insert(endpoint(i), conn_id(i), sock(i)));
+		keys.push_back(i);
+	}
+	TEST_EQUAL(t.size(), int(keys.size()));
+
+	// inserting a duplicate key keeps the existing socket
+	TEST_CHECK(!t.insert(endpoint(keys[0]), conn_id(keys[0]), sock(3999)));
+	TEST_CHECK(t.find(endpoint(keys[0]), conn_id(keys[0])) == sock(keys[0]));
+
+	for (int const i : keys)
+		TEST_CHECK(t.find(endpoint(i), conn_id(i)) == sock(i));
+
+	// the IPv4 address 10.0.0.1 must not be confused with an IPv6 address
+	// with the same leading bytes
+	TEST_CHECK(t.find(udp::endpoint(make_address_v6("a00:1::"), 6881), 0) == nullptr);
+
+	// erasing only removes the entry if it maps to the specified socket
+	TEST_CHECK(!t.erase(endpoint(keys[1]), conn_id(keys[1]), sock(keys[2])));
+	TEST_CHECK(t.find(endpoint(keys[1]), conn_id(keys[1])) == sock(keys[1]));
+
+	// erase every other socket, and make sure the remaining ones can still be
+	// found, even if they were displaced by the erased ones
+	for (std::size_t k = 0; k < keys.size(); k += 2)
+		TEST_CHECK(t.erase(endpoint(keys[k]), conn_id(keys[k]), sock(keys[k])));
+	TEST_EQUAL(t.size(), int(keys.size() / 2));
+
+	for (std::size_t k = 0; k < keys.size(); ++k)
+	{
+		utp_socket_impl* const expected = (k % 2) ? sock(keys[k]) : nullptr;
+		TEST_CHECK(t.find(endpoint(keys[k]), conn_id(keys[k])) == expected);
+	}
+}
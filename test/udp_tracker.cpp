@@ -49,6 +49,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <thread>
 #include <atomic>
 #include <memory>
+#include <vector>
 
 using namespace lt;
 using namespace std::placeholders;
@@ -58,6 +59,9 @@ struct udp_tracker
 
 	lt::io_context m_ios;
 	std::atomic<int> m_udp_announces{0};
+	std::atomic<int> m_udp_connects{0};
+	std::atomic<int> m_udp_scrapes{0};
+	std::atomic<int> m_udp_scraped_hashes{0};
 	udp::socket m_socket{m_ios};
 	int m_port = 0;
 	bool m_abort = false;
@@ -103,6 +107,7 @@ struct udp_tracker
 						, int(bytes_transferred));
 					return;
 				}
+				++m_udp_connects;
 				std::printf("%s: UDP connect from %s\n", time_now_string().c_str()
 					, print_endpoint(*from).c_str());
 				ptr = buffer;
@@ -161,10 +166,41 @@ struct udp_tracker
 				else std::printf("%s: UDP sent response to: %s\n"
 					, time_now_string().c_str(), print_endpoint(*from).c_str());
 				break;
-			case 2:
-				// ignore scrapes
-				std::printf("%s: UDP scrape (ignored)\n", time_now_string().c_str());
+			case 2: // scrape
+			{
+				if (bytes_transferred < 36 || (bytes_transferred - 16) % 20 != 0)
+				{
+					std::printf("invalid scrape message: %d Bytes\n"
+						, int(bytes_transferred));
+					return;
+				}
+
+				int const num_hashes = int(bytes_transferred - 16) / 20;
+				++m_udp_scrapes;
+				m_udp_scraped_hashes += num_hashes;
+				std::printf("%s: UDP scrape [%d] info-hashes: %d\n"
+					, time_now_string().c_str(), int(m_udp_scrapes), num_hashes);
+
+				// respond with the first two bytes of each info-hash as its
+				// complete and incomplete counts, for the client to tell them
+				// apart
+				std::vector<char> hashes(buffer + 16, buffer + bytes_transferred);
+				ptr = buffer;
+				aux::write_uint32(2, ptr); // action = scrape
+				aux::write_uint32(transaction_id, ptr); // transaction_id
+				for (int i = 0; i < num_hashes; ++i)
+				{
+					char const* ih = hashes.data() + i * 20;
+					aux::write_uint32(std::uint8_t(ih[0]), ptr); // complete
+					aux::write_uint32(num_hashes, ptr); // downloaded
+					aux::write_uint32(std::uint8_t(ih[1]), ptr); // incomplete
+				}
+				m_socket.send_to(boost::asio::buffer(buffer
+					, static_cast<std::size_t>(ptr - buffer)), *from, 0, e);
+				if (e) std::printf("%s: UDP send_to failed. ERROR: %s\n"
+					, time_now_string().c_str(), e.message().c_str());
 				break;
+			}
 			default:
 				std::printf("%s: UDP unknown message: %d\n", time_now_string().c_str()
 					, action);
@@ -225,6 +261,9 @@ struct udp_tracker
 	int port() const { return m_port; }
 
 	int num_hits() const { return m_udp_announces; }
+	int num_connects() const { return m_udp_connects; }
+	int num_scrapes() const { return m_udp_scrapes; }
+	int num_scraped_hashes() const { return m_udp_scraped_hashes; }
 
 	void thread_fun()
 	{
@@ -259,6 +298,24 @@ int num_udp_announces()
 	return 0;
 }
 
+int num_udp_connects()
+{
+	if (g_udp_tracker) return g_udp_tracker->num_connects();
+	return 0;
+}
+
+int num_udp_scrapes()
+{
+	if (g_udp_tracker) return g_udp_tracker->num_scrapes();
+	return 0;
+}
+
+int num_udp_scraped_hashes()
+{
+	if (g_udp_tracker) return g_udp_tracker->num_scraped_hashes();
+	return 0;
+}
+
 void stop_udp_tracker()
 {
 	g_udp_tracker.reset();
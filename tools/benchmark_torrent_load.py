@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+# vim: tabstop=8 expandtab shiftwidth=4 softtabstop=4
+
+# generates torrents with a large number of files and measures how long it
+# takes to load them, and the peak memory usage, using dump_torrent
+
+import os
+import random
+import subprocess
+import sys
+
+toolset = ''
+if len(sys.argv) > 1:
+    toolset = sys.argv[1]
+
+num_files = 1000000
+if len(sys.argv) > 2:
+    num_files = int(sys.argv[2])
+
+ret = os.system('cd ../examples && b2 release %s stage_dump_torrent' % toolset)
+if ret != 0:
+    print('ERROR: build failed: %d' % ret)
+    sys.exit(1)
+
+
+def bencode(out, v):
+    if isinstance(v, int):
+        out.append(b'i%de' % v)
+    elif isinstance(v, bytes):
+        out.append(b'%d:' % len(v))
+        out.append(v)
+    elif isinstance(v, str):
+        bencode(out, v.encode('utf-8'))
+    elif isinstance(v, list):
+        out.append(b'l')
+        for e in v:
+            bencode(out, e)
+        out.append(b'e')
+    elif isinstance(v, dict):
+        out.append(b'd')
+        for k in sorted(v.keys()):
+            bencode(out, k)
+            bencode(out, v[k])
+        out.append(b'e')
+
+
+def file_paths(interleaved):
+    # 100 files per directory, two levels deep. In the interleaved layout
+    # consecutive files are in different directories
+    num_dirs = max(num_files // 100, 1)
+    for i in range(num_files):
+        d = i % num_dirs if interleaved else i // 100
+        yield ['dir-%d' % (d // 100), 'sub-%d' % d, 'file-%d.dat' % i]
+
+
+def write_torrent(filename, info, extra={}):
+    out = []
+    t = {'info': info}
+    t.update(extra)
+    bencode(out, t)
+    with open(filename, 'wb') as f:
+        f.write(b''.join(out))
+
+
+def gen_v1(filename, interleaved):
+    piece_size = 4 * 1024 * 1024
+    files = []
+    total_size = 0
+    for p in file_paths(interleaved):
+        size = random.randint(1, 2000)
+        files.append({'length': size, 'path': p})
+        total_size += size
+    num_pieces = (total_size + piece_size - 1) // piece_size
+    write_torrent(filename, {
+        'name': 'benchmark',
+        'piece length': piece_size,
+        'pieces': os.urandom(20 * num_pieces),
+        'files': files})
+
+
+def gen_v2(filename):
+    # all files fit in a single piece, so there are no piece layers
+    tree = {}
+    for p in file_paths(False):
+        node = tree
+        for e in p[:-1]:
+            node = node.setdefault(e, {})
+        node[p[-1]] = {'': {'length': random.randint(1, 16384),
+                            'pieces root': os.urandom(32)}}
+    write_torrent(filename, {
+        'name': 'benchmark',
+        'piece length': 16384,
+        'meta version': 2,
+        'file tree': {'benchmark': tree}}, {'piece layers': {}})
+
+
+def run_test(filename):
+    out = subprocess.check_output(['../examples/dump_torrent', filename,
+                                   '--timing', '--no-files']).decode('utf-8')
+    result = {}
+    for line in out.split('\n'):
+        if line.startswith('load time:') or line.startswith('peak memory:'):
+            k, v = line.split(':', 1)
+            result[k] = v.strip()
+    print('%-32s load time: %10s peak memory: %12s' %
+          (filename, result['load time'], result['peak memory']))
+
+
+torrents = [
+    ('load_benchmark_v1.torrent', lambda f: gen_v1(f, False)),
+    ('load_benchmark_v1_interleaved.torrent', lambda f: gen_v1(f, True)),
+    ('load_benchmark_v2.torrent', gen_v2),
+]
+
+for name, gen in torrents:
+    if not os.path.exists(name):
+        print('generating %s (%d files)' % (name, num_files))
+        gen(name)
+    run_test(name)